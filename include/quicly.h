@@ -33,6 +33,7 @@ extern "C" {
 #include <sys/socket.h>
 #include <sys/types.h>
 #include "picotls.h"
+#include "quicly/allocator.h"
 #include "quicly/constants.h"
 #include "quicly/frame.h"
 #include "quicly/local_cid.h"
@@ -45,6 +46,7 @@ extern "C" {
 #include "quicly/maxsender.h"
 #include "quicly/cid.h"
 #include "quicly/remote_cid.h"
+#include "quicly/timerwheel.h"
 
 /* invariants! */
 #define QUICLY_LONG_HEADER_BIT 0x80
@@ -138,8 +140,9 @@ QUICLY_CALLBACK_TYPE(void, receive_datagram_frame, quicly_conn_t *conn, ptls_iov
 QUICLY_CALLBACK_TYPE(void, closed_by_remote, quicly_conn_t *conn, int err, uint64_t frame_type, const char *reason,
                      size_t reason_len);
 /**
- * Returns current time in milliseconds. The returned value MUST monotonically increase (i.e., it is the responsibility of the
- * callback implementation to guarantee that the returned value never goes back to the past).
+ * Returns current time, in the resolution specified by `quicly_context_t::clock_resolution` (i.e., milliseconds by default). The
+ * returned value MUST monotonically increase (i.e., it is the responsibility of the callback implementation to guarantee that the
+ * returned value never goes back to the past).
  */
 QUICLY_CALLBACK_TYPE0(int64_t, now);
 /**
@@ -162,6 +165,41 @@ QUICLY_CALLBACK_TYPE(void, init_cc, quicly_cc_t *cc, uint32_t initcwnd, int64_t
  */
 QUICLY_CALLBACK_TYPE(void, update_open_count, ssize_t delta);
 
+#ifndef QUICLY_MAX_PAYLOAD_GATHERS
+/**
+ * maximum number of regions of a packet payload that can be supplied by reference (see `quicly_payload_gather_t`)
+ */
+#define QUICLY_MAX_PAYLOAD_GATHERS 16
+#endif
+
+/**
+ * A region of the packet payload, the plaintext of which has not been copied into the datagram buffer. The plaintext is found at
+ * `src`, and the region is `src.len` bytes starting at `dst_off` (offset within the datagram).
+ */
+typedef struct st_quicly_payload_gather_t {
+    size_t dst_off;
+    ptls_iovec_t src;
+} quicly_payload_gather_t;
+
+#ifndef QUICLY_MAX_DEFERRED_ENCRYPTIONS
+/**
+ * maximum number of packets being passed to `quicly_crypto_engine_t::encrypt_packets` at once
+ */
+#define QUICLY_MAX_DEFERRED_ENCRYPTIONS 32
+#endif
+
+/**
+ * A packet whose encryption has been deferred (see `quicly_crypto_engine_t::encrypt_packets`). The fields correspond to the
+ * arguments of `quicly_crypto_engine_t::encrypt_packet`.
+ */
+typedef struct st_quicly_deferred_packet_t {
+    ptls_iovec_t datagram;
+    size_t first_byte_at;
+    size_t payload_from;
+    uint64_t packet_number;
+    int coalesced;
+} quicly_deferred_packet_t;
+
 /**
  * crypto offload API
  */
@@ -191,6 +229,26 @@ typedef struct st_quicly_crypto_engine_t {
     void (*encrypt_packet)(struct st_quicly_crypto_engine_t *engine, quicly_conn_t *conn, ptls_cipher_context_t *header_protect_ctx,
                            ptls_aead_context_t *packet_protect_ctx, ptls_iovec_t datagram, size_t first_byte_at,
                            size_t payload_from, uint64_t packet_number, int coalesced);
+    /**
+     * Optional callback that is used in place of `encrypt_packet` when some regions of the payload have not been copied into the
+     * datagram buffer (see `quicly_stream_callbacks_t::on_send_emit_vec`). The engine must read the plaintext of those regions from
+     * `gathers` (sorted by `dst_off`) and the rest from the datagram buffer, writing the ciphertext to the datagram buffer, so that
+     * each byte of the payload is touched only once. The memory referred to by `gathers` MUST NOT be accessed after the callback
+     * returns. When the callback is NULL, quicly copies the regions into the datagram buffer then calls `encrypt_packet`.
+     */
+    void (*encrypt_packet_gather)(struct st_quicly_crypto_engine_t *engine, quicly_conn_t *conn,
+                                  ptls_cipher_context_t *header_protect_ctx, ptls_aead_context_t *packet_protect_ctx,
+                                  ptls_iovec_t datagram, size_t first_byte_at, size_t payload_from, uint64_t packet_number,
+                                  int coalesced, const quicly_payload_gather_t *gathers, size_t num_gathers);
+    /**
+     * Optional callback for encrypting 1-RTT packets in batches. When the callback is non-NULL, quicly defers the encryption of
+     * the 1-RTT packets being built by `quicly_send`, and passes up to QUICLY_MAX_DEFERRED_ENCRYPTIONS of them at once, all being
+     * protected by the same keys. All the deferred packets are passed before `quicly_send` returns. Packets that are protected by
+     * other keys, or that are encrypted using `encrypt_packet_gather`, are encrypted immediately.
+     */
+    void (*encrypt_packets)(struct st_quicly_crypto_engine_t *engine, quicly_conn_t *conn,
+                            ptls_cipher_context_t *header_protect_ctx, ptls_aead_context_t *packet_protect_ctx,
+                            const quicly_deferred_packet_t *packets, size_t num_packets);
 } quicly_crypto_engine_t;
 
 /**
@@ -336,7 +394,7 @@ struct st_quicly_context_t {
      */
     quicly_closed_by_remote_t *closed_by_remote;
     /**
-     * returns current time in milliseconds
+     * returns current time, in the resolution specified by `clock_resolution`
      */
     quicly_now_t *now;
     /**
@@ -359,6 +417,48 @@ struct st_quicly_context_t {
      * optional refcount callback
      */
     quicly_update_open_count_t *update_open_count;
+    /**
+     * allocator of the blocks used by the sentmap (see `quicly_sent_block_allocator_t`), or NULL to use `allocator`
+     */
+    quicly_sent_block_allocator_t *sent_block_allocator;
+    /**
+     * allocator used for allocating memory (or NULL to use malloc)
+     */
+    quicly_allocator_t *allocator;
+    /**
+     * Resolution of the clock returned by `now`, as the number of ticks per millisecond; either QUICLY_CLOCK_RESOLUTION_MSEC or
+     * QUICLY_CLOCK_RESOLUTION_USEC. All the time values exchanged with the application (e.g., the value returned by
+     * `quicly_get_first_timeout`, `quicly_stats_t::rtt`) use this resolution, while the configuration parameters (e.g.,
+     * `quicly_loss_conf_t`, `quicly_transport_parameters_t::max_idle_timeout`) remain in milliseconds.
+     */
+    uint32_t clock_resolution;
+    /**
+     * if packets should be paced (see `quicly_pacer_t`)
+     */
+    unsigned use_pacing : 1;
+    /**
+     * If set, per-connection objects (e.g., streams, ranges, datagram payloads) are allocated from an arena (`quicly_arena_t`)
+     * owned by each connection, which is released at once when the connection is freed.
+     */
+    unsigned use_connection_arena : 1;
+    /**
+     * If set, the size of the datagrams is raised using Datagram Packetization Layer PMTU Discovery (RFC 8899; see
+     * `quicly_pmtud_t`), up to `min(local.tp.max_udp_payload_size, remote.tp.max_udp_payload_size)`. The buffer being supplied to
+     * `quicly_send` should be large enough to hold a datagram of `transport_params.max_udp_payload_size` bytes; otherwise, probes
+     * are not sent.
+     */
+    unsigned use_pmtud : 1;
+    /**
+     * If set, packets are sent with the ECT(0) codepoint and the ECN counts are reported to the peer (RFC 9000 Section 13.4). The
+     * application is responsible for setting the ECN bits of the outgoing datagrams to the value returned by
+     * `quicly_send_get_ecn_bits`, and for passing the ECN bits of the incoming datagrams via `quicly_decoded_packet_t::ecn`.
+     */
+    unsigned use_ecn : 1;
+    /**
+     * If set, Reno, CUBIC, and Pico use HyStart++ (RFC 9406; see `quicly_hystart_t`) to exit slow start before losses are
+     * induced.
+     */
+    unsigned use_hystart : 1;
 };
 
 /**
@@ -463,6 +563,27 @@ struct st_quicly_conn_streamgroup_state_t {
             retire_connection_id, path_challenge, path_response, transport_close, application_close, handshake_done, datagram,     \
             ack_frequency;                                                                                                         \
     } num_frames_sent, num_frames_received;                                                                                        \
+    /**                                                                                                                            \
+     * ECN counters.                                                                                                               \
+     */                                                                                                                            \
+    struct {                                                                                                                       \
+        /**                                                                                                                        \
+         * Number of packets received with ECT(0), ECT(1), CE codepoints, indexed by QUICLY_ECN_COUNT_*.                           \
+         */                                                                                                                        \
+        uint64_t received[QUICLY_NUM_ECN_CODEPOINTS];                                                                              \
+        /**                                                                                                                        \
+         * The ECN counts reported by the peer, summed up across all packet number spaces.                                         \
+         */                                                                                                                        \
+        uint64_t acked[QUICLY_NUM_ECN_CODEPOINTS];                                                                                 \
+        /**                                                                                                                        \
+         * Number of ACK frames that reported an increase of the CE count.                                                         \
+         */                                                                                                                        \
+        uint64_t congestion_events;                                                                                                \
+        /**                                                                                                                        \
+         * Number of times ECN was disabled, due to either validation failure or the marked packets being dropped.                 \
+         */                                                                                                                        \
+        uint64_t validation_failed;                                                                                                \
+    } num_ecn;                                                                                                                     \
     /**                                                                                                                            \
      * Total number of PTOs observed during the connection.                                                                        \
      */                                                                                                                            \
@@ -500,6 +621,42 @@ struct st_quicly_default_scheduler_state_t {
     quicly_linklist_t blocked;
 };
 
+/**
+ * Number of urgency levels defined by Extensible Priorities (RFC 9218), and the default urgency.
+ */
+#define QUICLY_PRIORITY_NUM_URGENCIES 8
+#define QUICLY_PRIORITY_DEFAULT_URGENCY 3
+
+/**
+ * The state of the priority stream scheduler (`quicly_priority_stream_scheduler`). For each urgency level, there are two lists of
+ * streams that can emit STREAM frames: `non_incremental` being sorted by stream ID, and `incremental` being used for round-robin.
+ * Streams blocked by the connection-level flow control are retained in `blocked`, regardless of their priorities.
+ */
+struct st_quicly_priority_scheduler_state_t {
+    struct {
+        quicly_linklist_t non_incremental;
+        quicly_linklist_t incremental;
+    } active[QUICLY_PRIORITY_NUM_URGENCIES];
+    quicly_linklist_t blocked;
+};
+
+#ifndef QUICLY_DRR_DEFAULT_QUANTUM
+/**
+ * The default value of `quicly_stream_t::drr_quantum`.
+ */
+#define QUICLY_DRR_DEFAULT_QUANTUM 16384
+#endif
+
+/**
+ * The state of the deficit round-robin stream scheduler (`quicly_drr_stream_scheduler`). `active` is the round-robin list of
+ * streams that can emit STREAM frames, the stream at the head being the one given the turn. Streams blocked by the
+ * connection-level flow control are retained in `blocked`.
+ */
+struct st_quicly_drr_scheduler_state_t {
+    quicly_linklist_t active;
+    quicly_linklist_t blocked;
+};
+
 typedef void (*quicly_trace_cb)(void *ctx, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 
 struct _st_quicly_conn_public_t {
@@ -552,6 +709,8 @@ struct _st_quicly_conn_public_t {
      */
     quicly_cid_t original_dcid;
     struct st_quicly_default_scheduler_state_t _default_scheduler;
+    struct st_quicly_priority_scheduler_state_t _priority_scheduler;
+    struct st_quicly_drr_scheduler_state_t _drr_scheduler;
     struct {
         QUICLY_STATS_PREBUILT_FIELDS;
     } stats;
@@ -561,6 +720,10 @@ struct _st_quicly_conn_public_t {
      * trace callback (cb != NULL when used)
      */
     quicly_tracer_t tracer;
+    /**
+     * allocator used for the objects owned by the connection; either the per-connection arena or `quicly_context_t::allocator`
+     */
+    quicly_allocator_t *allocator;
 };
 
 typedef enum {
@@ -618,6 +781,16 @@ typedef struct st_quicly_stream_callbacks_t {
      * called when a RESET_STREAM frame is received
      */
     void (*on_receive_reset)(quicly_stream_t *stream, int err);
+    /**
+     * Optional callback that can be used in place of `on_send_emit`. Instead of copying the payload, the application returns
+     * references to the payload in `vecs`, which the crypto engine reads directly when encrypting the packet. `num_vecs` is an
+     * in/out argument that specifies the capacity of `vecs` / the number of vectors being returned, and the sum of the lengths of
+     * the vectors MUST be equal to `*len`. Other arguments are the same as those of `on_send_emit`. The memory being referred to
+     * MUST remain valid and unmodified until `quicly_send` returns. When the callback returns zero vectors (without closing the
+     * connection or resetting the stream), `on_send_emit` is called instead.
+     */
+    void (*on_send_emit_vec)(quicly_stream_t *stream, size_t off, ptls_iovec_t *vecs, size_t *num_vecs, size_t *len,
+                             int *wrote_all);
 } quicly_stream_callbacks_t;
 
 struct st_quicly_stream_t {
@@ -649,6 +822,19 @@ struct st_quicly_stream_t {
      *
      */
     unsigned streams_blocked : 1;
+    /**
+     * Priority of the stream as defined in RFC 9218, being used by `quicly_priority_stream_scheduler`. The values are initialized
+     * to the defaults (i.e., urgency of 3, non-incremental); use `quicly_stream_set_priority` to change them.
+     */
+    struct {
+        uint8_t urgency;
+        uint8_t incremental : 1;
+    } priority;
+    /**
+     * Number of bytes that the stream is permitted to send in each round of `quicly_drr_stream_scheduler`. Streams being active
+     * at the same time are given bandwidth proportional to this value. Initialized to QUICLY_DRR_DEFAULT_QUANTUM; MUST be non-zero.
+     */
+    uint32_t drr_quantum;
     /**
      *
      */
@@ -687,8 +873,12 @@ struct st_quicly_stream_t {
          */
         struct {
             quicly_linklist_t control; /* links to conn_t::control (or to conn_t::streams_blocked if the blocked flag is set) */
-            quicly_linklist_t default_scheduler;
+            quicly_linklist_t default_scheduler; /* used by the built-in stream schedulers */
         } pending_link;
+        /**
+         * bytes that can be sent in the current turn of the DRR scheduler; becomes negative when a STREAM frame overshoots
+         */
+        int64_t drr_deficit;
     } _send_aux;
     /**
      *
@@ -708,6 +898,12 @@ struct st_quicly_stream_t {
     } _recv_aux;
 };
 
+/**
+ * Value of `quicly_decoded_packet_t::decrypted.pn` indicating that `quicly_decrypt_packets` failed to decrypt the packet. As the
+ * header protection has been removed, such packets cannot be decrypted again; `quicly_receive` discards them.
+ */
+#define QUICLY_DECRYPTED_PN_FAILED (UINT64_MAX - 1)
+
 typedef struct st_quicly_decoded_packet_t {
     /**
      * octets of the entire packet
@@ -761,7 +957,13 @@ typedef struct st_quicly_decoded_packet_t {
      */
     size_t datagram_size;
     /**
-     * when decrypted.pn is not UINT64_MAX, indicates that the packet has been decrypted prior to being passed to `quicly_receive`.
+     * ECN bits of the IP packet that carried the datagram (QUICLY_ECN_*). `quicly_decode_packet` sets the value to
+     * QUICLY_ECN_NOT_ECT; applications that read the ECN bits of the incoming datagrams should overwrite the value.
+     */
+    uint8_t ecn;
+    /**
+     * when decrypted.pn is not UINT64_MAX, indicates that the packet has been decrypted prior to being passed to `quicly_receive`,
+     * or that the decryption has failed if the value is QUICLY_DECRYPTED_PN_FAILED
      */
     struct {
         uint64_t pn;
@@ -821,6 +1023,16 @@ static int quicly_is_supported_version(uint32_t version);
  */
 size_t quicly_decode_packet(quicly_context_t *ctx, quicly_decoded_packet_t *packet, const uint8_t *datagram, size_t datagram_size,
                             size_t *off);
+/**
+ * Decrypts the destination CID of the first QUIC packet found in the UDP datagram, without decoding the rest of the packet. This is
+ * a lightweight alternative to `quicly_decode_packet` for stages that only need to determine where each datagram should be steered
+ * to (i.e., `node_id` and `thread_id`). As is the case with `quicly_decode_packet`, the DCID of Initial and 0-RTT packets might
+ * have been chosen by the client; `plaintext` is set to `quicly_cid_plaintext_invalid` if the CID cannot be decrypted.
+ * @return length of the DCID, or SIZE_MAX if the datagram is malformed or if the DCID of a packet other than Initial or 0-RTT
+ *         cannot be decrypted
+ */
+size_t quicly_peek_cid(quicly_cid_encryptor_t *cid_encryptor, quicly_cid_plaintext_t *plaintext, const uint8_t *datagram,
+                       size_t datagram_size);
 /**
  *
  */
@@ -829,6 +1041,10 @@ uint64_t quicly_determine_packet_number(uint32_t truncated, size_t num_bits, uin
  *
  */
 static quicly_context_t *quicly_get_context(quicly_conn_t *conn);
+/**
+ * Returns the allocator to be used for allocating objects that are owned by the connection (e.g., stream-level buffers).
+ */
+static quicly_allocator_t *quicly_get_allocator(quicly_conn_t *conn);
 /**
  *
  */
@@ -889,6 +1105,10 @@ int quicly_get_stats(quicly_conn_t *conn, quicly_stats_t *stats);
  *
  */
 int quicly_get_delivery_rate(quicly_conn_t *conn, quicly_rate_t *delivery_rate);
+/**
+ * Returns the pacing rate in bytes per millisecond, or zero if pacing is not in use (see `quicly_context_t::use_pacing`).
+ */
+uint32_t quicly_get_pacing_rate(quicly_conn_t *conn);
 /**
  *
  */
@@ -916,9 +1136,27 @@ void quicly_free(quicly_conn_t *conn);
  */
 int quicly_close(quicly_conn_t *conn, int err, const char *reason_phrase);
 /**
- *
+ * Returns the time at which `quicly_send` should be called next, in the resolution of the clock (see
+ * `quicly_context_t::clock_resolution`).
  */
 int64_t quicly_get_first_timeout(quicly_conn_t *conn);
+/**
+ * Registers the connection to a timer wheel, or unregisters it if `wheel` is NULL. While being registered, the connection keeps its
+ * entry in the wheel in sync with the value of `quicly_get_first_timeout`, so that event loops can find the connections that
+ * need to be serviced by calling `quicly_pop_expired_conn`, instead of checking the timeout of every connection.
+ */
+void quicly_set_timerwheel(quicly_conn_t *conn, quicly_timerwheel_t *wheel);
+/**
+ * Returns one of the connections registered to the wheel that have reached the first timeout at `now`, or NULL if there is none.
+ * The returned connection stays out of the wheel until its timeout is updated, which happens when `quicly_send` is called.
+ */
+quicly_conn_t *quicly_pop_expired_conn(quicly_timerwheel_t *wheel, int64_t now);
+/**
+ * Converts a duration expressed in the resolution of the clock to milliseconds, rounding up. Applications that run a
+ * millisecond-based event loop can use this function for calculating the timeout (e.g., `quicly_get_first_timeout(conn) - now`)
+ * regardless of the clock resolution being selected.
+ */
+static int64_t quicly_clock_to_msec(quicly_context_t *ctx, int64_t duration);
 /**
  *
  */
@@ -984,6 +1222,10 @@ size_t quicly_send_retry(quicly_context_t *ctx, ptls_aead_context_t *token_encry
  */
 int quicly_send(quicly_conn_t *conn, quicly_address_t *dest, quicly_address_t *src, struct iovec *datagrams, size_t *num_datagrams,
                 void *buf, size_t bufsize);
+/**
+ * Returns the ECN bits (QUICLY_ECN_*) to be set to the datagrams being built by the preceding call to `quicly_send`.
+ */
+uint8_t quicly_send_get_ecn_bits(quicly_conn_t *conn);
 /**
  *
  */
@@ -1001,11 +1243,37 @@ int quicly_send_resumption_token(quicly_conn_t *conn);
  *
  */
 int quicly_receive(quicly_conn_t *conn, struct sockaddr *dest_addr, struct sockaddr *src_addr, quicly_decoded_packet_t *packet);
+/**
+ * Processes a batch of packets that belong to the same connection and have been received from the same address (e.g., the packets
+ * being coalesced by UDP GRO). Compared to calling `quicly_receive` for each packet, the per-call overhead (e.g., obtaining the
+ * current time, updating the timers) is paid once per batch. As ACKs are sent by `quicly_send`, applications can send one ACK for
+ * the entire batch by calling `quicly_send` after this function returns. Packets that are ignored are skipped silently.
+ * @return 0 if successful, otherwise an error code (e.g., PTLS_ERROR_NO_MEMORY) that prevented the rest of the batch from being
+ *         processed
+ */
+int quicly_receive_batch(quicly_conn_t *conn, struct sockaddr *dest_addr, struct sockaddr *src_addr,
+                         quicly_decoded_packet_t *packets, size_t num_packets);
+/**
+ * Decrypts a batch of 1-RTT packets that belong to the given connection, prior to passing them to `quicly_receive` or
+ * `quicly_receive_batch`. Header protection is removed from the packets first, then the payloads are decrypted back-to-back. The
+ * packets being decrypted are marked as such using `quicly_decoded_packet_t::decrypted`. Long header packets, packets that have
+ * already been processed, packets too short to carry a packet number, and packets that arrive before the 1-RTT keys become
+ * available are left as they are. Packets that fail to decrypt have `decrypted.pn` set to QUICLY_DECRYPTED_PN_FAILED; they are
+ * counted as such and discarded by `quicly_receive`.
+ * @return 0 if successful, otherwise an error code (e.g., PTLS_ERROR_NO_MEMORY) that prevented the rest of the batch from being
+ *         processed
+ */
+int quicly_decrypt_packets(quicly_conn_t *conn, quicly_decoded_packet_t *packets, size_t num_packets);
 /**
  * consults if the incoming packet identified by (dest_addr, src_addr, decoded) belongs to the given connection
  */
 int quicly_is_destination(quicly_conn_t *conn, struct sockaddr *dest_addr, struct sockaddr *src_addr,
                           quicly_decoded_packet_t *decoded);
+/**
+ * Returns the CID chosen by the client that is used as the destination CID of Initial and 0-RTT packets; i.e., the original
+ * destination CID, or the source CID of the Retry packet if Retry was used. Applicable only to server-side connections.
+ */
+const quicly_cid_t *quicly_get_client_dcid(quicly_conn_t *conn);
 /**
  *
  */
@@ -1091,6 +1359,11 @@ static int quicly_stop_requested(quicly_stream_t *stream);
  *
  */
 int quicly_stream_sync_sendbuf(quicly_stream_t *stream, int activate);
+/**
+ * Changes the priority of the stream (RFC 9218). `urgency` must be below QUICLY_PRIORITY_NUM_URGENCIES, lower values being more
+ * urgent. The stream is relinked by the stream scheduler through `quicly_stream_scheduler_t::update_state`.
+ */
+void quicly_stream_set_priority(quicly_stream_t *stream, uint8_t urgency, int incremental);
 /**
  *
  */
@@ -1220,6 +1493,11 @@ inline int quicly_is_supported_version(uint32_t version)
     }
 }
 
+inline int64_t quicly_clock_to_msec(quicly_context_t *ctx, int64_t duration)
+{
+    return (duration + ctx->clock_resolution - 1) / ctx->clock_resolution;
+}
+
 inline quicly_state_t quicly_get_state(quicly_conn_t *conn)
 {
     struct _st_quicly_conn_public_t *c = (struct _st_quicly_conn_public_t *)conn;
@@ -1238,6 +1516,12 @@ inline quicly_context_t *quicly_get_context(quicly_conn_t *conn)
     return c->ctx;
 }
 
+inline quicly_allocator_t *quicly_get_allocator(quicly_conn_t *conn)
+{
+    struct _st_quicly_conn_public_t *c = (struct _st_quicly_conn_public_t *)conn;
+    return c->allocator;
+}
+
 inline const quicly_cid_plaintext_t *quicly_get_master_id(quicly_conn_t *conn)
 {
     struct _st_quicly_conn_public_t *c = (struct _st_quicly_conn_public_t *)conn;
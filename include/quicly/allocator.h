@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef quicly_allocator_h
+#define quicly_allocator_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Memory allocator. Unlike malloc and friends, the size of the memory block is passed to `realloc` and `free` so that allocators
+ * can be implemented without retaining the size of each block. All the functions of quicly accept NULL as the allocator, in which
+ * case malloc, realloc, and free are used.
+ */
+typedef struct st_quicly_allocator_t {
+    /**
+     * allocates a memory block of `size` bytes, or returns NULL if failed
+     */
+    void *(*alloc)(struct st_quicly_allocator_t *self, size_t size);
+    /**
+     * resizes a memory block, returning NULL (while retaining the original block) if failed
+     */
+    void *(*realloc)(struct st_quicly_allocator_t *self, void *p, size_t old_size, size_t new_size);
+    /**
+     * releases a memory block
+     */
+    void (*free)(struct st_quicly_allocator_t *self, void *p, size_t size);
+} quicly_allocator_t;
+
+#ifndef QUICLY_ARENA_CHUNK_SIZE
+/**
+ * size of the chunks that an arena obtains from the parent allocator
+ */
+#define QUICLY_ARENA_CHUNK_SIZE 8192
+#endif
+
+#ifndef QUICLY_ARENA_MAX_OBJECT_SIZE
+/**
+ * Objects larger than this size are allocated directly from the parent allocator. Must be a multiple of
+ * `QUICLY_ARENA_ALIGNMENT`.
+ */
+#define QUICLY_ARENA_MAX_OBJECT_SIZE 1024
+#endif
+
+#define QUICLY_ARENA_ALIGNMENT 16
+
+/**
+ * An arena allocator that carves objects out of large chunks, and releases all the chunks at once when being disposed. Objects
+ * being freed are retained in per-size freelists for reuse, so that the memory footprint stays bounded even when objects are
+ * allocated and freed repeatedly. The arena is not thread-safe.
+ */
+typedef struct st_quicly_arena_t {
+    quicly_allocator_t super;
+    /**
+     * allocator from which the chunks and the large objects are obtained
+     */
+    quicly_allocator_t *parent;
+    /**
+     * list of chunks being allocated
+     */
+    struct st_quicly_arena_chunk_t *chunks;
+    /**
+     * unused region of the newest chunk
+     */
+    uint8_t *pos, *end;
+    /**
+     * freelists of the objects being released, indexed by `size / QUICLY_ARENA_ALIGNMENT - 1`
+     */
+    void *freelists[QUICLY_ARENA_MAX_OBJECT_SIZE / QUICLY_ARENA_ALIGNMENT];
+} quicly_arena_t;
+
+/**
+ * Allocates memory using the allocator.
+ */
+static void *quicly_allocator_malloc(quicly_allocator_t *allocator, size_t size);
+/**
+ * Resizes memory using the allocator.
+ */
+static void *quicly_allocator_realloc(quicly_allocator_t *allocator, void *p, size_t old_size, size_t new_size);
+/**
+ * Releases memory using the allocator. `p` may be NULL.
+ */
+static void quicly_allocator_free(quicly_allocator_t *allocator, void *p, size_t size);
+/**
+ * Initializes an arena.
+ * @param parent  allocator from which the chunks are obtained (or NULL to use malloc)
+ */
+void quicly_arena_init(quicly_arena_t *arena, quicly_allocator_t *parent);
+/**
+ * Releases all the chunks being owned by the arena. Objects larger than `QUICLY_ARENA_MAX_OBJECT_SIZE` are not released; they
+ * should be freed individually.
+ */
+void quicly_arena_dispose(quicly_arena_t *arena);
+
+/* inline definitions */
+
+inline void *quicly_allocator_malloc(quicly_allocator_t *allocator, size_t size)
+{
+    if (allocator == NULL)
+        return malloc(size);
+    return allocator->alloc(allocator, size);
+}
+
+inline void *quicly_allocator_realloc(quicly_allocator_t *allocator, void *p, size_t old_size, size_t new_size)
+{
+    if (allocator == NULL)
+        return realloc(p, new_size);
+    return allocator->realloc(allocator, p, old_size, new_size);
+}
+
+inline void quicly_allocator_free(quicly_allocator_t *allocator, void *p, size_t size)
+{
+    if (p == NULL)
+        return;
+    if (allocator == NULL) {
+        free(p);
+    } else {
+        allocator->free(allocator, p, size);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -34,11 +34,20 @@ extern "C" {
 #include <stdint.h>
 #include <string.h>
 #include "quicly/constants.h"
+#include "quicly/hystart.h"
 #include "quicly/loss.h"
 
 #define QUICLY_MIN_CWND 2
 #define QUICLY_RENO_BETA 0.7
 
+/**
+ * Modes of BBR (see `quicly_cc_t::state.bbr.mode`).
+ */
+#define QUICLY_CC_BBR_MODE_STARTUP 0
+#define QUICLY_CC_BBR_MODE_DRAIN 1
+#define QUICLY_CC_BBR_MODE_PROBE_BW 2
+#define QUICLY_CC_BBR_MODE_PROBE_RTT 3
+
 /**
  * Holds pointers to concrete congestion control implementation functions.
  */
@@ -64,7 +73,7 @@ typedef struct st_quicly_cc_t {
     /**
      * State information specific to the congestion controller implementation.
      */
-    union {
+    union st_quicly_cc_state_t {
         /**
          * State information for Reno congestion control.
          */
@@ -112,6 +121,77 @@ typedef struct st_quicly_cc_t {
              */
             int64_t last_sent_time;
         } cubic;
+        /**
+         * State information for BBR congestion control.
+         */
+        struct {
+            /**
+             * Current mode; one of QUICLY_CC_BBR_MODE_*.
+             */
+            uint8_t mode;
+            /**
+             * Index within the gain cycle of PROBE_BW.
+             */
+            uint8_t cycle_index;
+            /**
+             * Number of consecutive rounds in STARTUP during which the bandwidth did not grow significantly.
+             */
+            uint8_t full_bw_count;
+            /**
+             * If the bottleneck bandwidth has been reached once (i.e., STARTUP has been exited).
+             */
+            uint8_t filled_pipe : 1;
+            /**
+             * If in loss recovery.
+             */
+            uint8_t in_recovery : 1;
+            /**
+             * If a round trip has been completed since the target inflight of PROBE_RTT has been reached.
+             */
+            uint8_t probe_rtt_round_done : 1;
+            /**
+             * Windowed max filter of the bandwidth samples (in bytes per millisecond), holding the best three samples observed
+             * during the last QUICLY_CC_BBR_BW_FILTER_ROUNDS rounds.
+             */
+            struct st_quicly_cc_bbr_bw_sample_t {
+                uint32_t round;
+                uint32_t bw;
+            } max_bw[3];
+            /**
+             * Bandwidth observed when the full_bw_count was last reset.
+             */
+            uint32_t full_bw;
+            /**
+             * Number of round trips since the beginning of the connection.
+             */
+            uint32_t round_count;
+            /**
+             * Windowed minimum RTT, and the time when it was last updated.
+             */
+            uint32_t min_rtt;
+            int64_t min_rtt_at;
+            /**
+             * Round trip is complete when a packet with this PN or above gets acknowledged.
+             */
+            uint64_t round_end_pn;
+            /**
+             * Time at which the current phase of the PROBE_BW gain cycle started.
+             */
+            int64_t cycle_start_at;
+            /**
+             * Time at which PROBE_RTT can be exited, or zero if the target inflight has not yet been reached.
+             */
+            int64_t probe_rtt_done_at;
+            /**
+             * CWND saved when entering loss recovery or PROBE_RTT.
+             */
+            uint32_t prior_cwnd;
+            /**
+             * Minimum CWND in bytes, as calculated from the max_udp_payload_size given to the latest `cc_on_acked` or
+             * `cc_on_lost` callback.
+             */
+            uint32_t min_pipe_cwnd;
+        } bbr;
     } state;
     /**
      * Initial congestion window.
@@ -133,6 +213,37 @@ typedef struct st_quicly_cc_t {
      * Total number of number of loss episodes (congestion window reductions).
      */
     uint32_t num_loss_episodes;
+    /**
+     * Total number of loss episodes being undone, as they were found to be spurious.
+     */
+    uint32_t num_loss_episodes_undone;
+    /**
+     * State prior to the CWND reduction of the latest loss episode (see `quicly_cc_save_undo_state`). When all the packets deemed
+     * lost during the episode are acknowledged later, the reduction is undone by calling `quicly_cc_type_t::cc_on_spurious_loss`.
+     */
+    struct {
+        uint32_t cwnd;
+        uint32_t ssthresh;
+        uint32_t cwnd_exiting_slow_start;
+        /**
+         * value of `recovery_end` prior to the episode; the packets deemed lost during the episode have PNs at or above this value
+         */
+        uint64_t recovery_end;
+        union st_quicly_cc_state_t state;
+        /**
+         * number of packets deemed lost during the episode that are yet to be acknowledged, or zero if the episode cannot be undone
+         */
+        uint32_t num_lost;
+    } undo;
+    /**
+     * Pacing rate in bytes per millisecond, if the congestion controller calculates one by itself. Otherwise zero, in which case
+     * the pacer derives the rate from CWND and RTT.
+     */
+    uint32_t pacing_rate;
+    /**
+     * State of HyStart++, used by Reno, CUBIC, and Pico during slow start. Disabled unless initialized by the caller.
+     */
+    quicly_hystart_t hystart;
 } quicly_cc_t;
 
 struct st_quicly_cc_type_t {
@@ -145,10 +256,10 @@ struct st_quicly_cc_type_t {
      */
     struct st_quicly_init_cc_t *cc_init;
     /**
-     * Called when a packet is newly acknowledged.
+     * Called when a packet is newly acknowledged. |rs| is the delivery rate sample generated for the ACK frame.
      */
     void (*cc_on_acked)(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes, uint64_t largest_acked, uint32_t inflight,
-                        uint64_t next_pn, int64_t now, uint32_t max_udp_payload_size);
+                        uint64_t next_pn, int64_t now, uint32_t max_udp_payload_size, const quicly_delivery_rate_sample_t *rs);
     /**
      * Called when a packet is detected as lost. |next_pn| is the next unsent packet number,
      * used for setting the recovery window.
@@ -167,16 +278,27 @@ struct st_quicly_cc_type_t {
      * Switches the underlying algorithm of `cc` to that of `cc_switch`, returning a boolean if the operation was successful.
      */
     int (*cc_switch)(quicly_cc_t *cc);
+    /**
+     * Called when the peer reports an increase of the ECN-CE counter (RFC 9002 Section 7.1). |pn| is the largest packet number
+     * being acknowledged by the ACK frame carrying the report.
+     */
+    void (*cc_on_ecn_congestion)(quicly_cc_t *cc, const quicly_loss_t *loss, uint64_t pn, uint64_t next_pn, int64_t now,
+                                 uint32_t max_udp_payload_size);
+    /**
+     * Called when all the packets deemed lost during the latest loss episode have been acknowledged; i.e., the losses were caused
+     * by reordering rather than by congestion. The CWND reduction is undone by restoring the state saved in `quicly_cc_t::undo`.
+     */
+    void (*cc_on_spurious_loss)(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now);
 };
 
 /**
  * The type objects for each CC. These can be used for testing the type of each `quicly_cc_t`.
  */
-extern quicly_cc_type_t quicly_cc_type_reno, quicly_cc_type_cubic, quicly_cc_type_pico;
+extern quicly_cc_type_t quicly_cc_type_reno, quicly_cc_type_cubic, quicly_cc_type_pico, quicly_cc_type_bbr;
 /**
  * The factory methods for each CC.
  */
-extern struct st_quicly_init_cc_t quicly_cc_reno_init, quicly_cc_cubic_init, quicly_cc_pico_init;
+extern struct st_quicly_init_cc_t quicly_cc_reno_init, quicly_cc_cubic_init, quicly_cc_pico_init, quicly_cc_bbr_init;
 
 /**
  * A null-terminated list of all CC types.
@@ -187,9 +309,23 @@ extern quicly_cc_type_t *quicly_cc_all_types[];
  * Calculates the initial congestion window size given the maximum UDP payload size.
  */
 uint32_t quicly_cc_calc_initial_cwnd(uint32_t max_packets, uint16_t max_udp_payload_size);
+/**
+ * Saves the state of the CC to `cc->undo`. Called by `cc_on_lost` upon entering a new loss episode, before reducing CWND and before
+ * updating `recovery_end`.
+ */
+void quicly_cc_save_undo_state(quicly_cc_t *cc);
+/**
+ * Runs HyStart++ during slow start, adjusting `*bytes` to the amount by which CWND can grow. Returns a boolean indicating if slow
+ * start has been exited, in which case `ssthresh` is set to the current CWND. Does nothing if `cc->hystart` is disabled.
+ */
+int quicly_cc_hystart_on_acked(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t *bytes, uint64_t largest_acked,
+                               uint64_t next_pn, uint32_t max_udp_payload_size);
 
 void quicly_cc_reno_on_lost(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes, uint64_t lost_pn, uint64_t next_pn,
                             int64_t now, uint32_t max_udp_payload_size);
+void quicly_cc_reno_on_ecn_congestion(quicly_cc_t *cc, const quicly_loss_t *loss, uint64_t pn, uint64_t next_pn, int64_t now,
+                                       uint32_t max_udp_payload_size);
+void quicly_cc_reno_on_spurious_loss(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now);
 void quicly_cc_reno_on_persistent_congestion(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now);
 void quicly_cc_reno_on_sent(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes, int64_t now);
 
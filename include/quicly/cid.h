@@ -93,6 +93,15 @@ typedef struct st_quicly_cid_encryptor_t {
      * generates a stateless reset token (returns if generated)
      */
     int (*generate_stateless_reset_token)(struct st_quicly_cid_encryptor_t *self, void *token, const void *cid);
+    /**
+     * Optional callback that decrypts the CIDs of multiple short header packets at once. Semantics are equivalent to calling
+     * `decrypt_cid` with `len` set to zero for each CID.
+     * @param plaintexts  array of `num_cids` elements to which the decoded CIDs will be written
+     * @param encrypted   array of `num_cids` pointers, each pointing to the encrypted CID (i.e., the second byte of the packet)
+     * @return            length of the CIDs if successful, or SIZE_MAX if failed
+     */
+    size_t (*decrypt_cid_batch)(struct st_quicly_cid_encryptor_t *self, quicly_cid_plaintext_t *plaintexts,
+                                const void *const *encrypted, size_t num_cids);
 } quicly_cid_encryptor_t;
 
 static void quicly_set_cid(quicly_cid_t *dest, ptls_iovec_t src);
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef quicly_conn_map_h
+#define quicly_conn_map_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "quicly.h"
+
+/**
+ * A table for finding the connection to which an incoming packet should be delivered. The table is keyed by the tuple of
+ * `master_id` and `thread_id` of the connection (see `quicly_cid_plaintext_t`) when CIDs are issued using a CID encryptor, and by
+ * the peer address when zero-length CIDs are used. For server-side connections, the table also retains the CID chosen by the
+ * client along with the client address, as that CID is used by Initial and 0-RTT packets.
+ *
+ * As all the CIDs being issued for a connection share `master_id` and `thread_id`, applications do not need to update the table
+ * when CIDs are being issued or retired. Lookups are O(1) and the connections being found are verified using
+ * `quicly_is_destination`. Note that stateless reset packets are not detected by the table.
+ */
+typedef struct st_quicly_conn_map_t quicly_conn_map_t;
+
+/**
+ * Creates a new table.
+ */
+quicly_conn_map_t *quicly_conn_map_new(void);
+/**
+ * Destroys the table. Connections being registered are not freed.
+ */
+void quicly_conn_map_free(quicly_conn_map_t *map);
+/**
+ * Returns the number of connections being registered.
+ */
+size_t quicly_conn_map_get_size(quicly_conn_map_t *map);
+/**
+ * Registers a connection. The connection MUST be unregistered before being freed.
+ * @return 0 if successful, otherwise an error code
+ */
+int quicly_conn_map_add(quicly_conn_map_t *map, quicly_conn_t *conn);
+/**
+ * Unregisters a connection.
+ */
+void quicly_conn_map_remove(quicly_conn_map_t *map, quicly_conn_t *conn);
+/**
+ * Returns the connection to which the decoded packet should be delivered, or NULL if none was found.
+ */
+quicly_conn_t *quicly_conn_map_lookup(quicly_conn_map_t *map, struct sockaddr *dest_addr, struct sockaddr *src_addr,
+                                      quicly_decoded_packet_t *decoded);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -47,10 +47,28 @@ extern "C" {
 #define QUICLY_MIN_ACTIVE_CONNECTION_ID_LIMIT 2
 #define QUICLY_DEFAULT_MAX_UDP_PAYLOAD_SIZE 65527
 #define QUICLY_MIN_CLIENT_INITIAL_SIZE 1200
-#define QUICLY_DEFAULT_MIN_PTO 1      /* milliseconds */
+#define QUICLY_DEFAULT_MIN_PTO 1000   /* microseconds */
 #define QUICLY_DEFAULT_INITIAL_RTT 66 /* initial retransmission timeout is *3, i.e. 200ms */
 #define QUICLY_LOSS_DEFAULT_PACKET_THRESHOLD 3
 
+/**
+ * Upper bounds of the reordering thresholds being adjusted upon detecting spurious losses (see
+ * `quicly_loss_t::reordering_threshold`). The time threshold is in 1/1024 of an RTT.
+ */
+#define QUICLY_LOSS_MAX_PACKET_THRESHOLD 256
+#define QUICLY_LOSS_MAX_TIME_REORDERING_PERCENTILE 1024
+/**
+ * Number of loss episodes without spurious losses after which the reordering thresholds are restored to their defaults.
+ */
+#define QUICLY_LOSS_REORDERING_DECAY_EPISODES 16
+
+/**
+ * Resolutions of the clock that can be selected by `quicly_context_t::clock_resolution`. The values represent the number of clock
+ * ticks per millisecond.
+ */
+#define QUICLY_CLOCK_RESOLUTION_MSEC 1
+#define QUICLY_CLOCK_RESOLUTION_USEC 1000
+
 #define QUICLY_DEFAULT_PACKET_TOLERANCE 2
 #define QUICLY_MAX_PACKET_TOLERANCE 10
 #define QUICLY_FIRST_ACK_FREQUENCY_LOSS_EPISODE 4
@@ -66,6 +84,17 @@ extern "C" {
 #define QUICLY_EPOCH_1RTT 3
 #define QUICLY_NUM_EPOCHS 4
 
+/* ECN codepoints as carried in the IP header (RFC 3168) */
+#define QUICLY_ECN_NOT_ECT 0
+#define QUICLY_ECN_ECT1 1
+#define QUICLY_ECN_ECT0 2
+#define QUICLY_ECN_CE 3
+/* indexes of the counters carried by ACK_ECN frames (RFC 9000 Section 19.3.2) */
+#define QUICLY_ECN_COUNT_ECT0 0
+#define QUICLY_ECN_COUNT_ECT1 1
+#define QUICLY_ECN_COUNT_CE 2
+#define QUICLY_NUM_ECN_CODEPOINTS 3
+
 /* coexists with picotls error codes, assuming that int is at least 32-bits */
 #define QUICLY_ERROR_IS_QUIC(e) (((e) & ~0x1ffff) == 0x20000)
 #define QUICLY_ERROR_IS_QUIC_TRANSPORT(e) (((e) & ~0xffff) == 0x20000)
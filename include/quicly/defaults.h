@@ -48,14 +48,49 @@ void quicly_free_default_cid_encryptor(quicly_cid_encryptor_t *self);
  *
  */
 extern quicly_stream_scheduler_t quicly_default_stream_scheduler;
+/**
+ * Stream scheduler that implements the prioritization scheme of Extensible Priorities (RFC 9218), using
+ * `quicly_stream_t::priority`. The most urgent level having something to send is served first. Within the level, non-incremental
+ * streams are served one at a time in the order of stream IDs, then incremental streams are served in round-robin. Selection of
+ * the stream is done in constant time regardless of the number of streams. Activation of a non-incremental stream requires a
+ * sorted insertion, which is constant time when the stream has the largest or the smallest ID among those sharing the urgency,
+ * but is linear to the number of such streams in the worst case (see t/scheduler-bench.c).
+ */
+extern quicly_stream_scheduler_t quicly_priority_stream_scheduler;
+/**
+ * Stream scheduler that implements weighted deficit round robin. Streams are served in turn, each being permitted to send
+ * `quicly_stream_t::drr_quantum` bytes per round, so that the bandwidth is shared in proportion to the quanta regardless of how
+ * much data each stream emits at once.
+ */
+extern quicly_stream_scheduler_t quicly_drr_stream_scheduler;
 /**
  *
  */
 extern quicly_now_t quicly_default_now;
+/**
+ * Clock with microsecond resolution. Contexts using this callback MUST set `quicly_context_t::clock_resolution` to
+ * QUICLY_CLOCK_RESOLUTION_USEC.
+ */
+extern quicly_now_t quicly_default_now_usec;
 /**
  *
  */
 extern quicly_crypto_engine_t quicly_default_crypto_engine;
+/**
+ * Variant of `quicly_default_crypto_engine` that defers the encryption of 1-RTT packets until the end of `quicly_send`, then
+ * encrypts them in batches (see `quicly_crypto_engine_t::encrypt_packets`).
+ */
+extern quicly_crypto_engine_t quicly_default_batch_crypto_engine;
+/**
+ * Sentmap block allocator that retains the blocks being released in a per-thread pool. Blocks can be released by a thread
+ * different from the one that allocated them. The blocks are allocated using malloc, and those being cached are released when the
+ * thread exits. Applications opt in by setting `quicly_context_t::sent_block_allocator`.
+ */
+extern quicly_sent_block_allocator_t quicly_default_sent_block_allocator;
+/**
+ * Allocator that uses malloc, realloc, and free.
+ */
+extern quicly_allocator_t quicly_default_allocator;
 
 #define quicly_default_cc quicly_cc_type_reno
 #define quicly_default_init_cc quicly_cc_reno_init
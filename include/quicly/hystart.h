@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef quicly_hystart_h
+#define quicly_hystart_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Lower and upper bounds of the RTT increase (in milliseconds) that triggers the exit from slow start (MIN_RTT_THRESH and
+ * MAX_RTT_THRESH of RFC 9406).
+ */
+#define QUICLY_HYSTART_MIN_RTT_THRESH 4
+#define QUICLY_HYSTART_MAX_RTT_THRESH 16
+/**
+ * The RTT increase threshold is the minimum RTT of the previous round divided by this value, clamped by the bounds above.
+ */
+#define QUICLY_HYSTART_MIN_RTT_DIVISOR 8
+/**
+ * Minimum number of RTT samples within a round required for checking the RTT increase.
+ */
+#define QUICLY_HYSTART_N_RTT_SAMPLE 8
+/**
+ * During Conservative Slow Start (CSS), CWND grows at 1/CSS_GROWTH_DIVISOR of the rate of standard slow start.
+ */
+#define QUICLY_HYSTART_CSS_GROWTH_DIVISOR 4
+/**
+ * Number of rounds spent in CSS before entering congestion avoidance.
+ */
+#define QUICLY_HYSTART_CSS_ROUNDS 5
+/**
+ * Maximum number of full-sized packets by which CWND can grow upon receiving one ACK (L of RFC 9406).
+ */
+#define QUICLY_HYSTART_L 8
+
+/**
+ * Phases of HyStart++ (see `quicly_hystart_t::phase`).
+ */
+#define QUICLY_HYSTART_DISABLED 0
+#define QUICLY_HYSTART_SLOW_START 1
+#define QUICLY_HYSTART_CSS 2
+#define QUICLY_HYSTART_DONE 3
+
+/**
+ * State of HyStart++ (RFC 9406), the slow start algorithm shared by Reno, CUBIC, and Pico. The RTT samples are tracked for each
+ * round (i.e., the period until all the packets sent during the previous round get acknowledged). When the minimum RTT of the
+ * current round exceeds that of the previous round by a threshold, standard slow start is replaced by CSS, which exits to
+ * congestion avoidance after QUICLY_HYSTART_CSS_ROUNDS rounds, unless the RTT goes back below the baseline.
+ * The state is zero-cleared (i.e., `QUICLY_HYSTART_DISABLED`) unless `quicly_hystart_init` is called.
+ */
+typedef struct st_quicly_hystart_t {
+    /**
+     * one of QUICLY_HYSTART_*
+     */
+    uint8_t phase;
+    /**
+     * number of rounds that have been completed in CSS
+     */
+    uint8_t css_rounds;
+    /**
+     * number of RTT samples obtained in the current round
+     */
+    uint32_t rtt_sample_count;
+    /**
+     * minimum RTT of the current round and of the previous round, or UINT32_MAX if none
+     */
+    uint32_t current_round_min_rtt;
+    uint32_t last_round_min_rtt;
+    /**
+     * minimum RTT of the round during which CSS was entered
+     */
+    uint32_t css_baseline_min_rtt;
+    /**
+     * current round ends when a packet with this packet number or above gets acknowledged
+     */
+    uint64_t window_end;
+} quicly_hystart_t;
+
+/**
+ * Initializes the state, starting in standard slow start.
+ */
+void quicly_hystart_init(quicly_hystart_t *hystart);
+/**
+ * Updates the state upon receiving an ACK during slow start, returning the number of bytes by which CWND can be increased. When the
+ * phase becomes `QUICLY_HYSTART_DONE`, the caller should exit slow start.
+ * @param bytes         number of bytes newly acknowledged
+ * @param latest_rtt    the latest RTT sample, in the resolution of the clock
+ */
+uint32_t quicly_hystart_on_acked(quicly_hystart_t *hystart, uint32_t bytes, uint64_t largest_acked, uint64_t next_pn,
+                                 uint32_t latest_rtt, uint32_t clock_resolution, uint32_t max_udp_payload_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef quicly_lb_h
+#define quicly_lb_h
+
+#include "quicly/cid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Config rotation codepoint reserved for CIDs that cannot be routed by the load balancer.
+ */
+#define QUICLY_LB_CONFIG_ID_UNROUTABLE 7
+#define QUICLY_LB_MAX_SERVER_ID_LEN 15
+#define QUICLY_LB_MIN_NONCE_LEN 4
+/**
+ * Minimum length of the nonce when using `quicly_new_lb_cid_encryptor`, that stores master_id, thread_id, and path_id in the
+ * nonce.
+ */
+#define QUICLY_LB_CID_ENCRYPTOR_MIN_NONCE_LEN 8
+
+/**
+ * Configuration shared between the servers and the load balancer, as defined in the QUIC-LB draft
+ * (draft-ietf-quic-load-balancers). The layout of the CID is: first octet || server ID || nonce, where the first octet carries the
+ * config rotation bits in the 3 most significant bits.
+ */
+typedef struct st_quicly_lb_config_t {
+    /**
+     * config rotation bits (0 to 6)
+     */
+    uint8_t config_id;
+    /**
+     * length of the server ID (1 to QUICLY_LB_MAX_SERVER_ID_LEN)
+     */
+    uint8_t server_id_len;
+    /**
+     * length of the nonce; minimum is QUICLY_LB_MIN_NONCE_LEN, and the sum of `server_id_len` and `nonce_len` MUST NOT exceed 19
+     * (or 16 if the CID is encrypted)
+     */
+    uint8_t nonce_len;
+    /**
+     * if set, the 5 least significant bits of the first octet encode the length of the CID minus one
+     */
+    unsigned self_encode_length : 1;
+} quicly_lb_config_t;
+
+/**
+ * Encoder / decoder of QUIC-LB CIDs. The object does not depend on other parts of quicly, so that load balancers can use it for
+ * extracting the server ID.
+ *
+ * Depending on the configuration, one of the three modes is used: plaintext (no cipher), single-pass encryption (the server ID and
+ * the nonce add up to 16 bytes), or four-pass encryption (shorter than 16 bytes).
+ */
+typedef struct st_quicly_lb_codec_t {
+    quicly_lb_config_t config;
+    /**
+     * AES-128-ECB contexts; both are NULL in plaintext mode, `ecb_decrypt` is used only in single-pass mode
+     */
+    ptls_cipher_context_t *ecb_encrypt, *ecb_decrypt;
+} quicly_lb_codec_t;
+
+/**
+ * Initializes the codec.
+ * @param cipher  AES-128-ECB (e.g., `ptls_openssl_aes128ecb`), or NULL to use the plaintext mode
+ * @param key     16-byte key shared with the load balancer; ignored if `cipher` is NULL
+ * @return 0 if successful, or PTLS_ERROR_NO_MEMORY
+ */
+int quicly_lb_codec_init(quicly_lb_codec_t *codec, const quicly_lb_config_t *config, ptls_cipher_algorithm_t *cipher,
+                         const void *key);
+/**
+ *
+ */
+void quicly_lb_codec_dispose(quicly_lb_codec_t *codec);
+/**
+ * returns the length of the CIDs being handled by the codec
+ */
+static size_t quicly_lb_get_cid_len(const quicly_lb_codec_t *codec);
+/**
+ * Returns the config rotation bits of given CID, so that the load balancer can select the codec to be used. The caller MUST
+ * ensure that the CID is at least 1 byte long.
+ */
+static uint8_t quicly_lb_get_config_id(const uint8_t *cid);
+/**
+ * Builds a CID.
+ * @param cid        buffer to which `quicly_lb_get_cid_len` bytes are written
+ * @param server_id  the server ID, being `server_id_len` bytes long
+ * @param nonce      the nonce, being `nonce_len` bytes long
+ */
+void quicly_lb_encrypt(quicly_lb_codec_t *codec, uint8_t *cid, const uint8_t *server_id, const uint8_t *nonce);
+/**
+ * Decodes a CID.
+ * @param server_id  buffer to which the server ID is written
+ * @param nonce      buffer to which the nonce is written, or NULL if only the server ID is needed. In four-pass mode, omitting the
+ *                   nonce might save one AES operation.
+ * @param cid        the CID
+ * @param len        length of the CID when known (i.e., long header packet), or 0 if it is a short header packet
+ * @return length of the CID if successful, or SIZE_MAX if the CID does not belong to the configuration
+ */
+size_t quicly_lb_decrypt(quicly_lb_codec_t *codec, uint8_t *server_id, uint8_t *nonce, const uint8_t *cid, size_t len);
+
+/**
+ * Instantiates a CID encryptor that emits QUIC-LB CIDs. The server ID carries `quicly_cid_plaintext_t::node_id` in network byte
+ * order, and the first 8 bytes of the nonce carry `master_id`, `thread_id`, and `path_id`. Stateless reset tokens are generated
+ * using a key derived from `reset_key`, that is not shared with the load balancer.
+ * @param config  `server_id_len` MUST be large enough to carry the node_id being used, and `nonce_len` MUST be no less than
+ *                QUICLY_LB_CID_ENCRYPTOR_MIN_NONCE_LEN
+ * @param cipher  AES-128-ECB; the plaintext mode is not supported, as the nonce would expose master_id, thread_id, and path_id,
+ *                making the CIDs of a connection linkable to each other (RFC 9000 Section 9.5)
+ * @param key     see `quicly_lb_codec_init`
+ */
+quicly_cid_encryptor_t *quicly_new_lb_cid_encryptor(const quicly_lb_config_t *config, ptls_cipher_algorithm_t *cipher,
+                                                    const void *key, ptls_cipher_algorithm_t *reset_token_cipher,
+                                                    ptls_hash_algorithm_t *hash, ptls_iovec_t reset_key);
+/**
+ *
+ */
+void quicly_free_lb_cid_encryptor(quicly_cid_encryptor_t *self);
+
+/* inline functions */
+
+inline size_t quicly_lb_get_cid_len(const quicly_lb_codec_t *codec)
+{
+    return 1 + codec->config.server_id_len + codec->config.nonce_len;
+}
+
+inline uint8_t quicly_lb_get_config_id(const uint8_t *cid)
+{
+    return cid[0] >> 5;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -38,11 +38,12 @@ typedef struct quicly_loss_conf_t {
      */
     unsigned time_reordering_percentile;
     /**
-     * Minimum time in the future a PTO alarm may be set for. Typically set to alarm granularity.
+     * Minimum time in the future a PTO alarm may be set for, in microseconds. Typically set to alarm granularity. Values below one
+     * millisecond are effective only when the clock resolution is finer than a millisecond (see `quicly_loss_get_min_pto`).
      */
-    uint32_t min_pto;
+    uint32_t min_pto_usec;
     /**
-     * The default RTT used before an RTT sample is taken.
+     * The default RTT used before an RTT sample is taken, in milliseconds.
      */
     uint32_t default_initial_rtt;
     /**
@@ -56,7 +57,7 @@ typedef struct quicly_loss_conf_t {
 #define QUICLY_LOSS_SPEC_CONF                                                                                                      \
     {                                                                                                                              \
         QUICLY_LOSS_DEFAULT_TIME_REORDERING_PERCENTILE, /* time_reordering_percentile */                                           \
-            QUICLY_DEFAULT_MIN_PTO,                     /* min_pto */                                                              \
+            QUICLY_DEFAULT_MIN_PTO,                     /* min_pto_usec */                                                         \
             QUICLY_DEFAULT_INITIAL_RTT,                 /* initial_rtt */                                                          \
             0                                           /* number of speculative PTOs */                                           \
     }
@@ -64,13 +65,13 @@ typedef struct quicly_loss_conf_t {
 #define QUICLY_LOSS_PERFORMANT_CONF                                                                                                \
     {                                                                                                                              \
         QUICLY_LOSS_DEFAULT_TIME_REORDERING_PERCENTILE, /* time_reordering_percentile */                                           \
-            QUICLY_DEFAULT_MIN_PTO,                     /* min_pto */                                                              \
+            QUICLY_DEFAULT_MIN_PTO,                     /* min_pto_usec */                                                         \
             QUICLY_DEFAULT_INITIAL_RTT,                 /* initial_rtt */                                                          \
             2                                           /* number of speculative PTOs */                                           \
     }
 
 /**
- * Holds RTT variables. We use this structure differently from the specification:
+ * Holds RTT variables, in the resolution of the clock. We use this structure differently from the specification:
  * * if the first sample has been obtained should be checked by doing: `latest != 0`
  * * smoothed and variance are avaiable even before the first RTT sample is obtained
  */
@@ -110,6 +111,10 @@ typedef struct quicly_loss_t {
      * pointer to transport parameter containing the remote peer's ack exponent
      */
     const uint8_t *ack_delay_exponent;
+    /**
+     * number of clock ticks per millisecond (see `quicly_context_t::clock_resolution`)
+     */
+    uint32_t clock_resolution;
     /**
      * The number of consecutive PTOs (PTOs that have fired without receiving an ack).
      */
@@ -130,10 +135,38 @@ typedef struct quicly_loss_t {
      * The time at which the next packet will be considered lost based on exceeding the reordering window in time.
      */
     int64_t loss_time;
+    /**
+     * Packets with PNs below this value are known to be either acked or deemed lost. Loss detection skips them when only the
+     * 1-RTT packet number space is active.
+     */
+    uint64_t first_inflight_pn_hint;
     /**
      * The time at when lostdetect_on_alarm should be called.
      */
     int64_t alarm_at;
+    /**
+     * Reordering thresholds being used for detecting losses. The thresholds are raised when packets deemed lost are acknowledged
+     * later, and are restored to their defaults after QUICLY_LOSS_REORDERING_DECAY_EPISODES loss episodes pass without spurious
+     * losses, in the spirit of the adaptive reordering window of RACK (RFC 8985 Section 6.2).
+     */
+    struct {
+        /**
+         * packet threshold
+         */
+        uint32_t packets;
+        /**
+         * time threshold, in 1/1024 of an RTT
+         */
+        uint32_t time_percentile;
+        /**
+         * number of loss episodes to pass before the thresholds are restored, or zero if they are at their defaults
+         */
+        uint8_t decay_countdown;
+        /**
+         * if the time threshold has already been raised during the current loss episode
+         */
+        uint8_t time_raised_in_episode : 1;
+    } reordering_threshold;
     /**
      * rtt
      */
@@ -144,10 +177,19 @@ typedef struct quicly_loss_t {
     quicly_sentmap_t sentmap;
 } quicly_loss_t;
 
-typedef void (*quicly_loss_on_detect_cb)(quicly_loss_t *loss, const quicly_sent_packet_t *lost_packet, int is_time_threshold);
+/**
+ * Called when a packet is deemed lost. The callback may set `lost_packet->cc_lost` to indicate that the loss has been reported to
+ * the congestion controller.
+ */
+typedef void (*quicly_loss_on_detect_cb)(quicly_loss_t *loss, quicly_sent_packet_t *lost_packet, int is_time_threshold);
 
+/**
+ * Initializes the loss recovery state. `initial_rtt` is given in milliseconds, while the values being retained are converted to the
+ * resolution of the clock. `allocator` and `block_allocator` are passed to `quicly_sentmap_init`.
+ */
 static void quicly_loss_init(quicly_loss_t *r, const quicly_loss_conf_t *conf, uint32_t initial_rtt, const uint16_t *max_ack_delay,
-                             const uint8_t *ack_delay_exponent);
+                             const uint8_t *ack_delay_exponent, uint32_t clock_resolution, quicly_allocator_t *allocator,
+                             quicly_sent_block_allocator_t *block_allocator);
 static void quicly_loss_dispose(quicly_loss_t *r);
 static void quicly_loss_update_alarm(quicly_loss_t *r, int64_t now, int64_t last_retransmittable_sent_at, int has_outstanding,
                                      int can_send_stream_data, int handshake_is_in_progress, uint64_t total_bytes_sent,
@@ -165,6 +207,17 @@ static void quicly_loss_on_ack_received(quicly_loss_t *r, uint64_t largest_newly
  */
 static int quicly_loss_on_alarm(quicly_loss_t *r, int64_t now, uint32_t max_ack_delay, int is_1rtt_only,
                                 size_t *min_packets_to_send, int *restrict_sending, quicly_loss_on_detect_cb on_loss_detected);
+/**
+ * Notifies that a packet deemed lost has been acknowledged, raising the reordering thresholds. The packet threshold is raised to
+ * tolerate the observed degree of reordering, while the time threshold is raised by
+ * `quicly_loss_conf_t::time_reordering_percentile` at most once per loss episode.
+ * @param reordering  distance between the packet number of the packet and the largest packet number being acknowledged
+ */
+static void quicly_loss_on_spurious_loss(quicly_loss_t *r, uint64_t reordering);
+/**
+ * Notifies that a new loss episode has started.
+ */
+static void quicly_loss_on_loss_episode(quicly_loss_t *r);
 /**
  *
  */
@@ -178,8 +231,17 @@ int quicly_loss_init_sentmap_iter(quicly_loss_t *loss, quicly_sentmap_iter_t *it
 /**
  * Returns the timeout for sentmap entries. This timeout is also used as the duration of CLOSING / DRAINING state, and therefore be
  * longer than 3PTO. At the moment, the value is 4PTO.
+ * @param max_ack_delay  max_ack_delay in milliseconds; the returned value is in the resolution of the clock
  */
 static int64_t quicly_loss_get_sentmap_expiration_time(quicly_loss_t *loss, uint32_t max_ack_delay);
+/**
+ * Returns the PTO in the resolution of the clock, taking the max_ack_delay (in milliseconds) into account.
+ */
+static uint32_t quicly_loss_get_pto(quicly_loss_t *loss, uint32_t max_ack_delay);
+/**
+ * Returns `quicly_loss_conf_t::min_pto_usec` converted to the resolution of the clock, rounded up to at least one tick.
+ */
+static uint32_t quicly_loss_get_min_pto(quicly_loss_t *loss);
 
 /* inline definitions */
 
@@ -196,7 +258,7 @@ inline void quicly_rtt_update(quicly_rtt_t *rtt, uint32_t latest_rtt, uint32_t a
     int is_first_sample = rtt->latest == 0;
 
     assert(latest_rtt != UINT32_MAX);
-    rtt->latest = latest_rtt != 0 ? latest_rtt : 1; /* Force minimum RTT sample to 1ms */
+    rtt->latest = latest_rtt != 0 ? latest_rtt : 1; /* Force minimum RTT sample to 1 clock tick */
 
     /* update min_rtt */
     if (rtt->latest < rtt->minimum)
@@ -224,19 +286,24 @@ inline uint32_t quicly_rtt_get_pto(quicly_rtt_t *rtt, uint32_t max_ack_delay, ui
 }
 
 inline void quicly_loss_init(quicly_loss_t *r, const quicly_loss_conf_t *conf, uint32_t initial_rtt, const uint16_t *max_ack_delay,
-                             const uint8_t *ack_delay_exponent)
+                             const uint8_t *ack_delay_exponent, uint32_t clock_resolution, quicly_allocator_t *allocator,
+                             quicly_sent_block_allocator_t *block_allocator)
 {
     *r = (quicly_loss_t){.conf = conf,
                          .max_ack_delay = max_ack_delay,
                          .ack_delay_exponent = ack_delay_exponent,
+                         .clock_resolution = clock_resolution,
                          .pto_count = 0,
                          .time_of_last_packet_sent = 0,
                          .largest_acked_packet_plus1 = {0},
                          .total_bytes_sent = 0,
                          .loss_time = INT64_MAX,
-                         .alarm_at = INT64_MAX};
-    quicly_rtt_init(&r->rtt, conf, initial_rtt);
-    quicly_sentmap_init(&r->sentmap);
+                         .first_inflight_pn_hint = 0,
+                         .alarm_at = INT64_MAX,
+                         .reordering_threshold = {.packets = QUICLY_LOSS_DEFAULT_PACKET_THRESHOLD,
+                                                  .time_percentile = conf->time_reordering_percentile}};
+    quicly_rtt_init(&r->rtt, conf, initial_rtt * clock_resolution);
+    quicly_sentmap_init(&r->sentmap, allocator, block_allocator);
 }
 
 inline void quicly_loss_dispose(quicly_loss_t *r)
@@ -274,6 +341,7 @@ inline void quicly_loss_update_alarm(quicly_loss_t *r, int64_t now, int64_t last
     }
 
     /* PTO alarm */
+    uint32_t min_pto = quicly_loss_get_min_pto(r);
     int64_t alarm_duration;
     assert(r->pto_count < 63);
     /* Probes are sent with a modified backoff to minimize latency of recovery. For instance, with num_speculative_ptos set to
@@ -299,14 +367,14 @@ inline void quicly_loss_update_alarm(quicly_loss_t *r, int64_t now, int64_t last
     if (r->pto_count < 0) {
         /* Speculative probes sent under an RTT do not need to account for ack delay, since there is no expectation
          * of an ack being received before the probe is sent. */
-        alarm_duration = quicly_rtt_get_pto(&r->rtt, 0, r->conf->min_pto);
+        alarm_duration = quicly_rtt_get_pto(&r->rtt, 0, min_pto);
         alarm_duration >>= -r->pto_count;
-        if (alarm_duration < r->conf->min_pto)
-            alarm_duration = r->conf->min_pto;
+        if (alarm_duration < min_pto)
+            alarm_duration = min_pto;
     } else {
         /* Ordinary PTO. The bitshift below is fine; it would take more than a millenium to overflow either alarm_duration or
          * pto_count, even when the timer granularity is nanosecond */
-        alarm_duration = quicly_rtt_get_pto(&r->rtt, handshake_is_in_progress ? 0 : *r->max_ack_delay, r->conf->min_pto);
+        alarm_duration = quicly_loss_get_pto(r, handshake_is_in_progress ? 0 : *r->max_ack_delay);
         alarm_duration <<= r->pto_count;
     }
     SET_ALARM(last_retransmittable_sent_at + alarm_duration);
@@ -330,13 +398,13 @@ inline void quicly_loss_on_ack_received(quicly_loss_t *r, uint64_t largest_newly
     if (!ack_eliciting)
         return;
 
-    /* Decode ack delay */
+    /* Decode ack delay, converting to the resolution of the clock (with rounding) */
     uint64_t ack_delay_microsecs = ack_delay_encoded << *r->ack_delay_exponent;
-    uint32_t ack_delay_millisecs = (uint32_t)((ack_delay_microsecs * 2 + 1000) / 2000);
+    uint64_t ack_delay_ticks = (ack_delay_microsecs * r->clock_resolution * 2 + 1000) / 2000;
     /* use min(ack_delay, max_ack_delay) as the ack delay */
-    if (ack_delay_millisecs > *r->max_ack_delay)
-        ack_delay_millisecs = *r->max_ack_delay;
-    quicly_rtt_update(&r->rtt, (uint32_t)(now - sent_at), ack_delay_millisecs);
+    if (ack_delay_ticks > (uint64_t)*r->max_ack_delay * r->clock_resolution)
+        ack_delay_ticks = (uint64_t)*r->max_ack_delay * r->clock_resolution;
+    quicly_rtt_update(&r->rtt, (uint32_t)(now - sent_at), (uint32_t)ack_delay_ticks);
 }
 
 inline int quicly_loss_on_alarm(quicly_loss_t *r, int64_t now, uint32_t max_ack_delay, int is_1rtt_only,
@@ -358,9 +426,43 @@ inline int quicly_loss_on_alarm(quicly_loss_t *r, int64_t now, uint32_t max_ack_
     return 0;
 }
 
+inline void quicly_loss_on_spurious_loss(quicly_loss_t *r, uint64_t reordering)
+{
+    if (reordering >= r->reordering_threshold.packets)
+        r->reordering_threshold.packets =
+            reordering < QUICLY_LOSS_MAX_PACKET_THRESHOLD ? (uint32_t)reordering + 1 : QUICLY_LOSS_MAX_PACKET_THRESHOLD;
+    if (!r->reordering_threshold.time_raised_in_episode) {
+        r->reordering_threshold.time_percentile += r->conf->time_reordering_percentile;
+        if (r->reordering_threshold.time_percentile > QUICLY_LOSS_MAX_TIME_REORDERING_PERCENTILE)
+            r->reordering_threshold.time_percentile = QUICLY_LOSS_MAX_TIME_REORDERING_PERCENTILE;
+        r->reordering_threshold.time_raised_in_episode = 1;
+    }
+    r->reordering_threshold.decay_countdown = QUICLY_LOSS_REORDERING_DECAY_EPISODES;
+}
+
+inline void quicly_loss_on_loss_episode(quicly_loss_t *r)
+{
+    r->reordering_threshold.time_raised_in_episode = 0;
+    if (r->reordering_threshold.decay_countdown != 0 && --r->reordering_threshold.decay_countdown == 0) {
+        r->reordering_threshold.packets = QUICLY_LOSS_DEFAULT_PACKET_THRESHOLD;
+        r->reordering_threshold.time_percentile = r->conf->time_reordering_percentile;
+    }
+}
+
+inline uint32_t quicly_loss_get_pto(quicly_loss_t *loss, uint32_t max_ack_delay)
+{
+    return quicly_rtt_get_pto(&loss->rtt, max_ack_delay * loss->clock_resolution, quicly_loss_get_min_pto(loss));
+}
+
+inline uint32_t quicly_loss_get_min_pto(quicly_loss_t *loss)
+{
+    uint32_t min_pto = (uint32_t)(((uint64_t)loss->conf->min_pto_usec * loss->clock_resolution + 999) / 1000);
+    return min_pto != 0 ? min_pto : 1;
+}
+
 inline int64_t quicly_loss_get_sentmap_expiration_time(quicly_loss_t *loss, uint32_t max_ack_delay)
 {
-    return quicly_rtt_get_pto(&loss->rtt, max_ack_delay, loss->conf->min_pto) * 4;
+    return (int64_t)quicly_loss_get_pto(loss, max_ack_delay) * 4;
 }
 
 #ifdef __cplusplus
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef quicly_pacer_h
+#define quicly_pacer_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "quicly/cc.h"
+#include "quicly/loss.h"
+
+#ifndef QUICLY_PACER_BURST_PACKETS
+/**
+ * Number of full-sized packets that can be sent back-to-back when the pacer is idle.
+ */
+#define QUICLY_PACER_BURST_PACKETS 10
+#endif
+
+/**
+ * Multipliers (in 1/1024) applied to `cwnd / srtt` when calculating the pacing rate. Slow start uses a larger multiplier so that
+ * the pacer does not become the bottleneck while CWND is being doubled every RTT.
+ */
+#define QUICLY_PACER_SLOW_START_MULTIPLIER 2048
+#define QUICLY_PACER_CONGESTION_AVOIDANCE_MULTIPLIER 1280
+
+/**
+ * A token-bucket pacer. The pacer permits sending `QUICLY_PACER_BURST_PACKETS` packets at once, then releases tokens at the pacing
+ * rate. Time is expressed in the resolution of the clock, while the rate is expressed in bytes per millisecond.
+ */
+typedef struct st_quicly_pacer_t {
+    /**
+     * the time from which the number of bytes that can be sent is calculated
+     */
+    int64_t at;
+    /**
+     * number of bytes sent since `at`
+     */
+    uint64_t bytes_sent;
+} quicly_pacer_t;
+
+/**
+ * Initializes (or resets) the pacer, allowing a full burst to be sent immediately.
+ */
+static void quicly_pacer_reset(quicly_pacer_t *pacer);
+/**
+ * Returns the pacing rate (in bytes per millisecond) being derived from the state of the congestion controller. If the congestion
+ * controller provides a pacing rate (i.e., `quicly_cc_t::pacing_rate`), that value is used. Otherwise, the rate is calculated from
+ * CWND and smoothed RTT.
+ */
+uint32_t quicly_pacer_calc_send_rate(const quicly_cc_t *cc, const quicly_loss_t *loss);
+/**
+ * Returns the number of bytes that can be sent at `now`.
+ */
+uint64_t quicly_pacer_get_window(quicly_pacer_t *pacer, int64_t now, uint32_t bytes_per_msec, uint16_t mtu,
+                                 uint32_t clock_resolution);
+/**
+ * Returns the earliest time at which a full-sized packet can be sent. The returned value might be less than `now`.
+ */
+int64_t quicly_pacer_can_send_at(quicly_pacer_t *pacer, uint32_t bytes_per_msec, uint16_t mtu, uint32_t clock_resolution);
+/**
+ * Notifies the pacer that given number of bytes has been sent.
+ */
+static void quicly_pacer_consume_window(quicly_pacer_t *pacer, size_t bytes);
+
+/* inline definitions */
+
+inline void quicly_pacer_reset(quicly_pacer_t *pacer)
+{
+    pacer->at = INT64_MIN;
+    pacer->bytes_sent = 0;
+}
+
+inline void quicly_pacer_consume_window(quicly_pacer_t *pacer, size_t bytes)
+{
+    assert(pacer->at != INT64_MIN);
+    pacer->bytes_sent += bytes;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
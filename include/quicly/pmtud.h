@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef quicly_pmtud_h
+#define quicly_pmtud_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef QUICLY_PMTUD_MAX_PROBES
+/**
+ * Number of times a probe of a particular size is sent before concluding that the path does not support that size (MAX_PROBES of
+ * RFC 8899).
+ */
+#define QUICLY_PMTUD_MAX_PROBES 3
+#endif
+
+#ifndef QUICLY_PMTUD_SEARCH_GRANULARITY
+/**
+ * The search stops when the difference between the largest size confirmed and the smallest size known to fail becomes smaller
+ * than this value.
+ */
+#define QUICLY_PMTUD_SEARCH_GRANULARITY 16
+#endif
+
+#ifndef QUICLY_PMTUD_BLACK_HOLE_THRESHOLD
+/**
+ * Number of full-sized packets being lost without any full-sized packet sent after them getting acknowledged, before concluding
+ * that the path can no longer carry packets of the size that has been discovered.
+ */
+#define QUICLY_PMTUD_BLACK_HOLE_THRESHOLD 3
+#endif
+
+#ifndef QUICLY_PMTUD_RAISE_INTERVAL
+/**
+ * Interval (in milliseconds) after which the search is restarted, so that an increase of the PMTU can be detected (PMTU_RAISE_TIMER
+ * of RFC 8899).
+ */
+#define QUICLY_PMTUD_RAISE_INTERVAL 600000
+#endif
+
+/**
+ * State of Datagram Packetization Layer PMTU Discovery (RFC 8899). The search starts from the maximum size permitted, then
+ * continues as a binary search between the largest size confirmed and the smallest size known to fail. Only one probe is inflight
+ * at a time.
+ */
+typedef struct st_quicly_pmtud_t {
+    /**
+     * size that is known to work without probing; PMTU falls back to this value when a black hole is detected
+     */
+    uint16_t base_size;
+    /**
+     * largest size to be probed
+     */
+    uint16_t max_size;
+    /**
+     * the largest size being confirmed (i.e., current PMTU)
+     */
+    uint16_t search_low;
+    /**
+     * the largest size not known to fail; the search is complete when this value becomes equal to `search_low`
+     */
+    uint16_t search_high;
+    /**
+     * size of the probe being inflight, or zero if none
+     */
+    uint16_t probe_inflight;
+    /**
+     * number of probes of the current candidate size that have been lost
+     */
+    uint8_t num_probes_lost;
+    /**
+     * number of full-sized packets lost (see `QUICLY_PMTUD_BLACK_HOLE_THRESHOLD`)
+     */
+    uint8_t num_full_sized_lost;
+    /**
+     * full-sized packets with packet numbers below this value are not counted when being lost, as a full-sized packet sent
+     * afterwards has been acknowledged
+     */
+    uint64_t full_sized_acked_until;
+    /**
+     * when the search is to be restarted, after being complete
+     */
+    int64_t next_search_at;
+    /**
+     * `QUICLY_PMTUD_RAISE_INTERVAL` in the resolution of the clock
+     */
+    int64_t raise_interval;
+} quicly_pmtud_t;
+
+/**
+ * Initializes the state. PMTUD is disabled if `max_size` is not greater than `base_size`.
+ */
+void quicly_pmtud_init(quicly_pmtud_t *pmtud, uint16_t base_size, uint16_t max_size, uint32_t clock_resolution);
+/**
+ * Returns the size of the probe to be sent at `now`, or zero if a probe should not be sent.
+ */
+uint16_t quicly_pmtud_get_probe_size(quicly_pmtud_t *pmtud, int64_t now);
+/**
+ * Notifies that a probe of given size has been sent.
+ */
+static void quicly_pmtud_on_probe_sent(quicly_pmtud_t *pmtud, uint16_t size);
+/**
+ * Notifies that a probe has been acknowledged. Returns the new PMTU if it has been raised, otherwise zero.
+ */
+uint16_t quicly_pmtud_on_probe_acked(quicly_pmtud_t *pmtud, uint16_t size, int64_t now);
+/**
+ * Notifies that a probe has been deemed lost.
+ */
+void quicly_pmtud_on_probe_lost(quicly_pmtud_t *pmtud, uint16_t size, int64_t now);
+/**
+ * Notifies that PTO has fired while a probe was inflight. The probe is re-armed without being counted as lost.
+ */
+static void quicly_pmtud_on_probe_pto(quicly_pmtud_t *pmtud, uint16_t size);
+/**
+ * Notifies that a packet as large as the current PMTU has been acknowledged.
+ */
+static void quicly_pmtud_on_full_sized_acked(quicly_pmtud_t *pmtud, uint64_t pn);
+/**
+ * Notifies that a packet as large as the current PMTU has been deemed lost. Returns if a black hole has been detected, in which
+ * case PMTU is reset to `base_size`.
+ */
+int quicly_pmtud_on_full_sized_lost(quicly_pmtud_t *pmtud, uint64_t pn);
+
+/* inline definitions */
+
+inline void quicly_pmtud_on_probe_sent(quicly_pmtud_t *pmtud, uint16_t size)
+{
+    pmtud->probe_inflight = size;
+}
+
+inline void quicly_pmtud_on_probe_pto(quicly_pmtud_t *pmtud, uint16_t size)
+{
+    if (pmtud->probe_inflight == size)
+        pmtud->probe_inflight = 0;
+}
+
+inline void quicly_pmtud_on_full_sized_acked(quicly_pmtud_t *pmtud, uint64_t pn)
+{
+    if (pmtud->full_sized_acked_until <= pn) {
+        pmtud->full_sized_acked_until = pn + 1;
+        pmtud->num_full_sized_lost = 0;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -29,6 +29,7 @@ extern "C" {
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "quicly/allocator.h"
 
 typedef struct st_quicly_range_t {
     uint64_t start;
@@ -39,16 +40,18 @@ typedef struct st_quicly_ranges_t {
     quicly_range_t *ranges;
     size_t num_ranges, capacity;
     quicly_range_t _initial;
+    quicly_allocator_t *allocator;
 } quicly_ranges_t;
 
 /**
  * initializes the structure
+ * @param allocator  allocator to be used (or NULL to use malloc)
  */
-static void quicly_ranges_init(quicly_ranges_t *ranges);
+static void quicly_ranges_init(quicly_ranges_t *ranges, quicly_allocator_t *allocator);
 /**
  * initializes the structure, registering given range
  */
-int quicly_ranges_init_with_range(quicly_ranges_t *ranges, uint64_t start, uint64_t end);
+int quicly_ranges_init_with_range(quicly_ranges_t *ranges, quicly_allocator_t *allocator, uint64_t start, uint64_t end);
 /**
  * clears the structure
  */
@@ -68,17 +71,18 @@ void quicly_ranges_drop_by_range_indices(quicly_ranges_t *ranges, size_t begin_i
 
 /* inline functions */
 
-inline void quicly_ranges_init(quicly_ranges_t *ranges)
+inline void quicly_ranges_init(quicly_ranges_t *ranges, quicly_allocator_t *allocator)
 {
     ranges->ranges = &ranges->_initial;
     ranges->num_ranges = 0;
     ranges->capacity = 1;
+    ranges->allocator = allocator;
 }
 
 inline void quicly_ranges_clear(quicly_ranges_t *ranges)
 {
     if (ranges->ranges != &ranges->_initial) {
-        free(ranges->ranges);
+        quicly_allocator_free(ranges->allocator, ranges->ranges, ranges->capacity * sizeof(*ranges->ranges));
         ranges->ranges = &ranges->_initial;
     }
     ranges->num_ranges = 0;
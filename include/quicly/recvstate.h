@@ -46,8 +46,8 @@ typedef struct st_quicly_recvstate_t {
     uint64_t eos;
 } quicly_recvstate_t;
 
-void quicly_recvstate_init(quicly_recvstate_t *state);
-void quicly_recvstate_init_closed(quicly_recvstate_t *state);
+void quicly_recvstate_init(quicly_recvstate_t *state, quicly_allocator_t *allocator);
+void quicly_recvstate_init_closed(quicly_recvstate_t *state, quicly_allocator_t *allocator);
 void quicly_recvstate_dispose(quicly_recvstate_t *state);
 static int quicly_recvstate_transfer_complete(quicly_recvstate_t *state);
 static size_t quicly_recvstate_bytes_available(quicly_recvstate_t *state);
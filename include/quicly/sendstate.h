@@ -54,8 +54,8 @@ typedef struct st_quicly_sendstate_sent_t {
     uint64_t end;
 } quicly_sendstate_sent_t;
 
-void quicly_sendstate_init(quicly_sendstate_t *state);
-void quicly_sendstate_init_closed(quicly_sendstate_t *state);
+void quicly_sendstate_init(quicly_sendstate_t *state, quicly_allocator_t *allocator);
+void quicly_sendstate_init_closed(quicly_sendstate_t *state, quicly_allocator_t *allocator);
 void quicly_sendstate_dispose(quicly_sendstate_t *state);
 static int quicly_sendstate_transfer_complete(quicly_sendstate_t *state);
 static int quicly_sendstate_is_open(quicly_sendstate_t *state);
@@ -28,6 +28,7 @@ extern "C" {
 
 #include <assert.h>
 #include <stdint.h>
+#include "quicly/allocator.h"
 #include "quicly/constants.h"
 #include "quicly/maxsender.h"
 #include "quicly/sendstate.h"
@@ -56,12 +57,46 @@ typedef struct st_quicly_sent_packet_t {
      * if the frames being contained are considered inflight (becomes zero when deemed lost or when PTO fires)
      */
     uint8_t frames_in_flight : 1;
+    /**
+     * if the sender was application-limited when the packet was sent
+     */
+    uint8_t is_app_limited : 1;
+    /**
+     * if the packet has been deemed lost and the loss has been reported to the congestion controller (i.e., is subject to undo
+     * when the packet is acknowledged late)
+     */
+    uint8_t cc_lost : 1;
     /**
      * number of bytes in-flight for the packet, from the context of CC (becomes zero when deemed lost, but not when PTO fires)
      */
     uint16_t cc_bytes_in_flight;
+    /**
+     * lower 32 bits of `quicly_sentmap_t::delivered` at the moment the packet was sent
+     */
+    uint32_t delivered;
 } quicly_sent_packet_t;
 
+/**
+ * A delivery rate sample, generated for each ACK frame (see draft-cheng-iccrg-delivery-rate-estimation). The sample is taken from
+ * the newest packet being acknowledged, as the number of bytes acknowledged between when that packet was sent and when it was
+ * acknowledged.
+ */
+typedef struct st_quicly_delivery_rate_sample_t {
+    /**
+     * number of bytes delivered during `interval`
+     */
+    uint64_t delivered;
+    /**
+     * duration of the sample, in the resolution of the clock; zero if the sample is not available
+     */
+    int64_t interval;
+    /**
+     * if the sender was application-limited when the packet was sent; if set, the sample might underestimate the capacity of the
+     * path
+     */
+    int is_app_limited;
+} quicly_delivery_rate_sample_t;
+
 typedef enum en_quicly_sentmap_event_t {
     /**
      * a packet has been acked
@@ -160,6 +195,9 @@ struct st_quicly_sent_t {
         struct {
             uint64_t sequence;
         } retire_connection_id;
+        struct {
+            uint16_t size;
+        } pmtu_probe;
     } data;
 };
 
@@ -168,6 +206,10 @@ struct st_quicly_sent_block_t {
      * next block if exists (or NULL)
      */
     struct st_quicly_sent_block_t *next;
+    /**
+     * previous block if exists (or NULL)
+     */
+    struct st_quicly_sent_block_t *prev;
     /**
      * number of entries in the block
      */
@@ -176,12 +218,70 @@ struct st_quicly_sent_block_t {
      * insertion index within `entries`
      */
     size_t next_insert_at;
+    /**
+     * sequence number of the block, used for locating the block within `quicly_sentmap_t::index`
+     */
+    uint64_t seq;
     /**
      * slots
      */
     quicly_sent_t entries[16];
 };
 
+/**
+ * An entry of the block index.
+ */
+struct st_quicly_sent_block_index_entry_t {
+    /**
+     * Packet number of the packet that was the latest when the block was allocated. Headers of the packets with smaller PNs reside
+     * in the preceding blocks, and those with greater PNs reside in this block or in the succeeding blocks.
+     */
+    uint64_t pn;
+    /**
+     * the block, or NULL if the block has been freed
+     */
+    struct st_quicly_sent_block_t *block;
+};
+
+/**
+ * Allocator of sentmap blocks. When `quicly_sentmap_t::block_allocator` is NULL, the blocks are allocated using
+ * `quicly_sentmap_t::allocator`.
+ */
+typedef struct st_quicly_sent_block_allocator_t {
+    /**
+     * returns a block, or NULL if failed to allocate memory
+     */
+    struct st_quicly_sent_block_t *(*alloc)(struct st_quicly_sent_block_allocator_t *self);
+    /**
+     * releases a block
+     */
+    void (*free)(struct st_quicly_sent_block_allocator_t *self, struct st_quicly_sent_block_t *block);
+} quicly_sent_block_allocator_t;
+
+/**
+ * A freelist of sentmap blocks that retains up to `capacity` blocks being released for reuse. The pool is not thread-safe; it is
+ * the responsibility of the application to use one pool per thread.
+ */
+typedef struct st_quicly_sent_block_pool_t {
+    quicly_sent_block_allocator_t super;
+    /**
+     * list of blocks being cached, linked by `quicly_sent_block_t::next`
+     */
+    struct st_quicly_sent_block_t *head;
+    /**
+     * number of blocks being cached
+     */
+    size_t count;
+    /**
+     * maximum number of blocks to be cached
+     */
+    size_t capacity;
+    /**
+     * allocator from which the blocks are obtained (or NULL to use malloc)
+     */
+    quicly_allocator_t *allocator;
+} quicly_sent_block_pool_t;
+
 /**
  * quicly_sentmap_t is a structure that holds a list of sent objects being tracked.  The list is a list of packet header and
  * frame-level objects of that packet.  Packet header is identified by quicly_sent_t::acked being quicly_sent__type_header.
@@ -197,7 +297,8 @@ struct st_quicly_sent_block_t {
  * 3. call quicly_sentmap_update to update the states of the packet that the iterator points to (as well as the state of the frames
  *    that were part of the packet) and move the iterator to the next packet header.  The function is also used for discarding
  * entries from the sent map.
- * 4. call quicly_sentmap_skip to move the iterator to the next packet header
+ * 4. call quicly_sentmap_skip to move the iterator to the next packet header, or quicly_sentmap_seek to move the iterator to a
+ *    packet with a given packet number without visiting the ones in between
  *
  * Note that quicly_sentmap_update and quicly_sentmap_skip move the iterator to the next packet header.
  */
@@ -206,6 +307,16 @@ struct st_quicly_sentmap_t {
      * the linked list includes entries that are deemed lost, but not expired yet
      */
     struct st_quicly_sent_block_t *head, *tail;
+    /**
+     * Index of the blocks, sorted by packet number. Valid entries reside in `entries[start..end)`, where the entry of the block
+     * with sequence number `seq` is located at `entries[start + seq - start_seq]`. Entries of the blocks being freed are retained
+     * with `block` set to NULL until they reach the front.
+     */
+    struct {
+        struct st_quicly_sent_block_index_entry_t *entries;
+        size_t start, end, capacity;
+        uint64_t start_seq;
+    } index;
     /**
      * number of packets contained
      */
@@ -214,6 +325,22 @@ struct st_quicly_sentmap_t {
      * bytes in-flight
      */
     size_t bytes_in_flight;
+    /**
+     * total number of bytes in-flight that have been acknowledged
+     */
+    uint64_t delivered;
+    /**
+     * if non-zero, packets are marked as being application-limited until `delivered` exceeds this value
+     */
+    uint64_t app_limited_until;
+    /**
+     * allocator being used for allocating the blocks (or NULL to use `allocator`)
+     */
+    quicly_sent_block_allocator_t *block_allocator;
+    /**
+     * allocator being used for allocating the index (or NULL to use malloc)
+     */
+    quicly_allocator_t *allocator;
     /**
      * is non-NULL between prepare and commit, pointing to the packet header that is being written to
      */
@@ -230,8 +357,11 @@ extern const quicly_sent_t quicly_sentmap__end_iter;
 
 /**
  * initializes the sentmap
+ * @param allocator  allocator to be used, or NULL to use malloc
+ * @param block_allocator  allocator to be used for allocating the blocks, or NULL to use `allocator`
  */
-static void quicly_sentmap_init(quicly_sentmap_t *map);
+static void quicly_sentmap_init(quicly_sentmap_t *map, quicly_allocator_t *allocator,
+                                quicly_sent_block_allocator_t *block_allocator);
 /**
  *
  */
@@ -249,6 +379,17 @@ int quicly_sentmap_prepare(quicly_sentmap_t *map, uint64_t packet_number, int64_
  * commits a write
  */
 static void quicly_sentmap_commit(quicly_sentmap_t *map, uint16_t bytes_in_flight);
+/**
+ * Notifies the sentmap that the sender has become application-limited. Packets being sent are marked as application-limited until
+ * all the bytes currently in-flight are acknowledged.
+ */
+static void quicly_sentmap_mark_app_limited(quicly_sentmap_t *map);
+/**
+ * Generates a delivery rate sample, given a copy of the newest packet acknowledged by an ACK frame. The function MUST be called
+ * after all the packets being acknowledged by the frame are marked as acked.
+ */
+void quicly_sentmap_get_rate_sample(quicly_sentmap_t *map, const quicly_sent_packet_t *newest_acked, int64_t now,
+                                    quicly_delivery_rate_sample_t *rs);
 /**
  * Allocates a slot to contain a callback for a frame.  The function MUST be called after _prepare but before _commit.
  */
@@ -266,19 +407,38 @@ static const quicly_sent_packet_t *quicly_sentmap_get(quicly_sentmap_iter_t *ite
  * advances the iterator to the next packet
  */
 void quicly_sentmap_skip(quicly_sentmap_iter_t *iter);
+/**
+ * Advances the iterator to the first packet with a packet number greater than or equal to `pn`. The cost is logarithmic to the
+ * number of packets being skipped. The function does nothing if the iterator already points to such a packet.
+ */
+void quicly_sentmap_seek(quicly_sentmap_t *map, quicly_sentmap_iter_t *iter, uint64_t pn);
 /**
  * updates the state of the packet being pointed to by the iterator, _and advances to the next packet_
  */
 int quicly_sentmap_update(quicly_sentmap_t *map, quicly_sentmap_iter_t *iter, quicly_sentmap_event_t event);
 
+/**
+ * Initializes a block pool.
+ * @param capacity   maximum number of blocks to be retained for reuse
+ * @param allocator  allocator from which the blocks are obtained (or NULL to use malloc)
+ */
+void quicly_sent_block_pool_init(quicly_sent_block_pool_t *pool, size_t capacity, quicly_allocator_t *allocator);
+/**
+ * Releases the blocks being cached by the pool.
+ */
+void quicly_sent_block_pool_dispose(quicly_sent_block_pool_t *pool);
+
 struct st_quicly_sent_block_t *quicly_sentmap__new_block(quicly_sentmap_t *map);
 int quicly_sentmap__type_packet(quicly_sentmap_t *map, const quicly_sent_packet_t *packet, int acked, quicly_sent_t *sent);
 
 /* inline definitions */
 
-inline void quicly_sentmap_init(quicly_sentmap_t *map)
+inline void quicly_sentmap_init(quicly_sentmap_t *map, quicly_allocator_t *allocator,
+                                quicly_sent_block_allocator_t *block_allocator)
 {
     *map = (quicly_sentmap_t){NULL};
+    map->allocator = allocator;
+    map->block_allocator = block_allocator;
 }
 
 inline int quicly_sentmap_is_open(quicly_sentmap_t *map)
@@ -301,6 +461,12 @@ inline void quicly_sentmap_commit(quicly_sentmap_t *map, uint16_t bytes_in_fligh
     ++map->num_packets;
 }
 
+inline void quicly_sentmap_mark_app_limited(quicly_sentmap_t *map)
+{
+    if ((map->app_limited_until = map->delivered + map->bytes_in_flight) == 0)
+        map->app_limited_until = 1;
+}
+
 inline quicly_sent_t *quicly_sentmap_allocate(quicly_sentmap_t *map, quicly_sent_acked_cb acked)
 {
     struct st_quicly_sent_block_t *block;
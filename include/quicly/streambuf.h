@@ -57,8 +57,40 @@ struct st_quicly_sendbuf_vec_t {
     const quicly_streambuf_sendvec_callbacks_t *cb;
     size_t len;
     void *cbdata;
+    /**
+     * offset of the data within the object referred to by `cbdata`, for use by the callbacks (e.g., the slice of a
+     * `quicly_sendbuf_shared_t`)
+     */
+    size_t off;
 };
 
+#ifndef QUICLY_SENDBUF_SLAB_SIZE
+/**
+ * Size of the memory blocks used for storing the copies of small writes. Consecutive writes that fit into the remaining space of
+ * the last block are coalesced into one vector.
+ */
+#define QUICLY_SENDBUF_SLAB_SIZE 1024
+#endif
+
+/**
+ * A reference-counted buffer that can be sent without being copied into the send buffer, and that can be shared among multiple
+ * send buffers (e.g., when sending the same object to many clients). References held by the send buffers are released once the
+ * data is acknowledged (i.e. by `quicly_sendbuf_shift`) or when the send buffer is disposed. The reference counter is not atomic;
+ * a shared buffer must not be used by multiple threads concurrently.
+ */
+typedef struct st_quicly_sendbuf_shared_t {
+    size_t _refcnt;
+    /**
+     * called when the reference counter drops to zero
+     */
+    void (*dispose)(struct st_quicly_sendbuf_shared_t *self);
+    /**
+     * the data
+     */
+    uint8_t *bytes;
+    size_t len;
+} quicly_sendbuf_shared_t;
+
 /**
  * A simple stream-level send buffer that can be used to store data to be sent.
  */
@@ -69,12 +101,17 @@ typedef struct st_quicly_sendbuf_t {
     } vecs;
     size_t off_in_first_vec;
     uint64_t bytes_written;
+    /**
+     * allocator used for allocating the vectors and the copies of the data being written
+     */
+    quicly_allocator_t *allocator;
 } quicly_sendbuf_t;
 
 /**
  * Inilializes the send buffer.
+ * @param allocator  allocator to be used (or NULL to use malloc)
  */
-static void quicly_sendbuf_init(quicly_sendbuf_t *sb);
+static void quicly_sendbuf_init(quicly_sendbuf_t *sb, quicly_allocator_t *allocator);
 /**
  * Disposes of the send buffer.
  */
@@ -88,6 +125,13 @@ void quicly_sendbuf_shift(quicly_stream_t *stream, quicly_sendbuf_t *sb, size_t
  * The concrete function for `quicly_stream_callbacks_t::on_send_emit`.
  */
 void quicly_sendbuf_emit(quicly_stream_t *stream, quicly_sendbuf_t *sb, size_t off, void *dst, size_t *len, int *wrote_all);
+/**
+ * The concrete function for `quicly_stream_callbacks_t::on_send_emit_vec`. References to the data are returned for the vectors
+ * being written by `quicly_sendbuf_write` and `quicly_sendbuf_write_shared`. Emission stops at the first vector that needs to be
+ * flattened; zero vectors are returned if that is the first one.
+ */
+void quicly_sendbuf_emit_vec(quicly_stream_t *stream, quicly_sendbuf_t *sb, size_t off, ptls_iovec_t *vecs, size_t *num_vecs,
+                             size_t *len, int *wrote_all);
 /**
  * Appends some bytes to the send buffer.  The data being appended is copied.
  */
@@ -96,6 +140,39 @@ int quicly_sendbuf_write(quicly_stream_t *stream, quicly_sendbuf_t *sb, const vo
  * Appends a vector to the send buffer.  Members of the `quicly_sendbuf_vec_t` are copied.
  */
 int quicly_sendbuf_write_vec(quicly_stream_t *stream, quicly_sendbuf_t *sb, quicly_sendbuf_vec_t *vec);
+/**
+ * Appends `len` bytes starting from `off` of the shared buffer to the send buffer, without copying the data. The send buffer
+ * retains a reference to the shared buffer until the data is acknowledged.
+ */
+int quicly_sendbuf_write_shared(quicly_stream_t *stream, quicly_sendbuf_t *sb, quicly_sendbuf_shared_t *shared, size_t off,
+                                size_t len);
+
+/**
+ * Initializes a shared buffer that refers to application-owned memory, setting the reference counter to one. `dispose` is called
+ * when the last reference is released.
+ */
+static void quicly_sendbuf_shared_init(quicly_sendbuf_shared_t *shared, void *bytes, size_t len,
+                                       void (*dispose)(quicly_sendbuf_shared_t *));
+/**
+ * Allocates a shared buffer with `len` bytes of storage following the header, setting the reference counter to one. The caller is
+ * expected to fill the storage (pointed to by `bytes`) before writing the buffer.
+ * @param allocator  allocator to be used (or NULL to use malloc)
+ */
+quicly_sendbuf_shared_t *quicly_sendbuf_shared_new(quicly_allocator_t *allocator, size_t len);
+/**
+ * Increments the reference counter.
+ */
+static void quicly_sendbuf_shared_addref(quicly_sendbuf_shared_t *shared);
+/**
+ * Decrements the reference counter, disposing of the shared buffer when it drops to zero.
+ */
+static void quicly_sendbuf_shared_release(quicly_sendbuf_shared_t *shared);
+/**
+ * Initializes a vector that refers to `len` bytes starting from `off` of the shared buffer, taking a reference. The reference is
+ * released by the `discard_vec` callback of the vector. This can be used for passing the shared buffer to
+ * `quicly_sendbuf_write_vec` directly.
+ */
+void quicly_sendbuf_shared_init_vec(quicly_sendbuf_vec_t *vec, quicly_sendbuf_shared_t *shared, size_t off, size_t len);
 
 /**
  * Pops the specified amount of bytes at the beginning of the simple stream-level receive buffer (which in fact is `ptls_buffer_t`).
@@ -112,6 +189,74 @@ ptls_iovec_t quicly_recvbuf_get(quicly_stream_t *stream, ptls_buffer_t *rb);
  */
 int quicly_recvbuf_receive(quicly_stream_t *stream, ptls_buffer_t *rb, size_t off, const void *src, size_t len);
 
+#ifndef QUICLY_RECVBUF_CHUNK_SIZE
+/**
+ * size of the chunks used by `quicly_chunked_recvbuf_t`
+ */
+#define QUICLY_RECVBUF_CHUNK_SIZE 16384
+#endif
+
+/**
+ * A receive buffer built from fixed-sized chunks, that can be used in place of `ptls_buffer_t` (i.e. `quicly_recvbuf_*`). Unlike
+ * `ptls_buffer_t`, the received data is never moved; shifting releases the chunks that have been consumed, and the data is
+ * returned as a list of iovecs. The chunks are obtained from the allocator, which can pool them.
+ */
+typedef struct st_quicly_chunked_recvbuf_t {
+    /**
+     * ring of chunks; `entries[(first + i) % capacity]` holds the i-th chunk, or NULL if nothing has been written to the range
+     */
+    struct {
+        uint8_t **entries;
+        size_t first, size, capacity;
+    } chunks;
+    /**
+     * offset of the first byte within the first chunk
+     */
+    size_t off_in_first_chunk;
+    /**
+     * number of bytes being buffered, up to the end of the data written at the largest offset (i.e. `ptls_buffer_t::off`)
+     */
+    size_t off;
+    quicly_allocator_t *allocator;
+} quicly_chunked_recvbuf_t;
+
+/**
+ * Initializes the receive buffer.
+ * @param allocator  allocator to be used (or NULL to use malloc)
+ */
+static void quicly_chunked_recvbuf_init(quicly_chunked_recvbuf_t *rb, quicly_allocator_t *allocator);
+/**
+ * Disposes of the receive buffer.
+ */
+void quicly_chunked_recvbuf_dispose(quicly_chunked_recvbuf_t *rb);
+/**
+ * Stores `len` bytes at `off` (relative to the first byte that has not been shifted). Returns 0 if successful.
+ */
+int quicly_chunked_recvbuf_write(quicly_chunked_recvbuf_t *rb, size_t off, const void *src, size_t len);
+/**
+ * Fills `vecs` with references to the first `len` bytes of the buffer. `num_vecs` is an in/out argument that specifies the capacity
+ * of `vecs` / the number of vectors being returned. Returns the number of bytes being referred to, which is less than `len` only
+ * when `vecs` is too small.
+ */
+size_t quicly_chunked_recvbuf_peek(quicly_chunked_recvbuf_t *rb, size_t len, ptls_iovec_t *vecs, size_t *num_vecs);
+/**
+ * Discards the first `delta` bytes, releasing the chunks that are no longer used.
+ */
+void quicly_chunked_recvbuf_consume(quicly_chunked_recvbuf_t *rb, size_t delta);
+/**
+ * The stream-level counterpart of `quicly_recvbuf_shift`.
+ */
+void quicly_chunked_recvbuf_shift(quicly_stream_t *stream, quicly_chunked_recvbuf_t *rb, size_t delta);
+/**
+ * The stream-level counterpart of `quicly_recvbuf_get`, returning the data available as a list of iovecs. See
+ * `quicly_chunked_recvbuf_peek` for the arguments and the return value.
+ */
+size_t quicly_chunked_recvbuf_get(quicly_stream_t *stream, quicly_chunked_recvbuf_t *rb, ptls_iovec_t *vecs, size_t *num_vecs);
+/**
+ * The concrete function for `quicly_stream_callbacks_t::on_receive`; the counterpart of `quicly_recvbuf_receive`.
+ */
+int quicly_chunked_recvbuf_receive(quicly_stream_t *stream, quicly_chunked_recvbuf_t *rb, size_t off, const void *src, size_t len);
+
 /**
  * The simple stream buffer.  The API assumes that stream->data points to quicly_streambuf_t.  Applications can extend the structure
  * by passing arbitrary size to `quicly_streambuf_create`.
@@ -119,14 +264,21 @@ int quicly_recvbuf_receive(quicly_stream_t *stream, ptls_buffer_t *rb, size_t of
 typedef struct st_quicly_streambuf_t {
     quicly_sendbuf_t egress;
     ptls_buffer_t ingress;
+    /**
+     * size of the structure, as specified by `quicly_streambuf_create`
+     */
+    size_t _size;
 } quicly_streambuf_t;
 
 int quicly_streambuf_create(quicly_stream_t *stream, size_t sz);
 void quicly_streambuf_destroy(quicly_stream_t *stream, int err);
 static void quicly_streambuf_egress_shift(quicly_stream_t *stream, size_t delta);
 void quicly_streambuf_egress_emit(quicly_stream_t *stream, size_t off, void *dst, size_t *len, int *wrote_all);
+void quicly_streambuf_egress_emit_vec(quicly_stream_t *stream, size_t off, ptls_iovec_t *vecs, size_t *num_vecs, size_t *len,
+                                      int *wrote_all);
 static int quicly_streambuf_egress_write(quicly_stream_t *stream, const void *src, size_t len);
 static int quicly_streambuf_egress_write_vec(quicly_stream_t *stream, quicly_sendbuf_vec_t *vec);
+static int quicly_streambuf_egress_write_shared(quicly_stream_t *stream, quicly_sendbuf_shared_t *shared, size_t off, size_t len);
 int quicly_streambuf_egress_shutdown(quicly_stream_t *stream);
 static void quicly_streambuf_ingress_shift(quicly_stream_t *stream, size_t delta);
 static ptls_iovec_t quicly_streambuf_ingress_get(quicly_stream_t *stream);
@@ -139,9 +291,38 @@ int quicly_streambuf_ingress_receive(quicly_stream_t *stream, size_t off, const
 
 /* inline definitions */
 
-inline void quicly_sendbuf_init(quicly_sendbuf_t *sb)
+inline void quicly_sendbuf_init(quicly_sendbuf_t *sb, quicly_allocator_t *allocator)
 {
     memset(sb, 0, sizeof(*sb));
+    sb->allocator = allocator;
+}
+
+inline void quicly_chunked_recvbuf_init(quicly_chunked_recvbuf_t *rb, quicly_allocator_t *allocator)
+{
+    memset(rb, 0, sizeof(*rb));
+    rb->allocator = allocator;
+}
+
+inline void quicly_sendbuf_shared_init(quicly_sendbuf_shared_t *shared, void *bytes, size_t len,
+                                       void (*dispose)(quicly_sendbuf_shared_t *))
+{
+    shared->_refcnt = 1;
+    shared->dispose = dispose;
+    shared->bytes = bytes;
+    shared->len = len;
+}
+
+inline void quicly_sendbuf_shared_addref(quicly_sendbuf_shared_t *shared)
+{
+    assert(shared->_refcnt != 0);
+    ++shared->_refcnt;
+}
+
+inline void quicly_sendbuf_shared_release(quicly_sendbuf_shared_t *shared)
+{
+    assert(shared->_refcnt != 0);
+    if (--shared->_refcnt == 0)
+        shared->dispose(shared);
 }
 
 inline void quicly_streambuf_egress_shift(quicly_stream_t *stream, size_t delta)
@@ -162,6 +343,12 @@ inline int quicly_streambuf_egress_write_vec(quicly_stream_t *stream, quicly_sen
     return quicly_sendbuf_write_vec(stream, &sbuf->egress, vec);
 }
 
+inline int quicly_streambuf_egress_write_shared(quicly_stream_t *stream, quicly_sendbuf_shared_t *shared, size_t off, size_t len)
+{
+    quicly_streambuf_t *sbuf = (quicly_streambuf_t *)stream->data;
+    return quicly_sendbuf_write_shared(stream, &sbuf->egress, shared, off, len);
+}
+
 inline void quicly_streambuf_ingress_shift(quicly_stream_t *stream, size_t delta)
 {
     quicly_streambuf_t *sbuf = (quicly_streambuf_t *)stream->data;
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef quicly_timerwheel_h
+#define quicly_timerwheel_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "quicly/linklist.h"
+
+#ifndef QUICLY_TIMERWHEEL_BITS_PER_LEVEL
+/**
+ * log2 of the number of slots in each level of the timer wheel
+ */
+#define QUICLY_TIMERWHEEL_BITS_PER_LEVEL 6
+#endif
+
+#ifndef QUICLY_TIMERWHEEL_NUM_LEVELS
+/**
+ * number of levels of the timer wheel; timers further in the future than the span of the wheel are clamped to the span
+ */
+#define QUICLY_TIMERWHEEL_NUM_LEVELS 6
+#endif
+
+#define QUICLY_TIMERWHEEL_SLOTS_PER_LEVEL (1 << QUICLY_TIMERWHEEL_BITS_PER_LEVEL)
+
+/**
+ * A timer that can be linked to `quicly_timerwheel_t`.
+ */
+typedef struct st_quicly_timer_t {
+    /**
+     * link in the slot of the wheel (or in the list of expired timers)
+     */
+    quicly_linklist_t _link;
+    /**
+     * time at which the timer expires
+     */
+    int64_t at;
+} quicly_timer_t;
+
+/**
+ * A hierarchical timer wheel. Linking, unlinking, and finding the timers that have expired are O(1) (amortized), regardless of the
+ * number of timers being linked. Time is expressed in the same unit as `quicly_context_t::now`, with level `n` of the wheel
+ * covering `QUICLY_TIMERWHEEL_SLOTS_PER_LEVEL ^ (n + 1)` units of time. Timers linked to higher levels move to lower levels as the
+ * time advances.
+ */
+typedef struct st_quicly_timerwheel_t {
+    /**
+     * time up to which the timers have been expired
+     */
+    int64_t last_run;
+    /**
+     * timers that have expired but are yet to be popped
+     */
+    quicly_linklist_t expired;
+    /**
+     * the slots
+     */
+    quicly_linklist_t slots[QUICLY_TIMERWHEEL_NUM_LEVELS][QUICLY_TIMERWHEEL_SLOTS_PER_LEVEL];
+} quicly_timerwheel_t;
+
+/**
+ * Initializes a timer.
+ */
+static void quicly_timer_init(quicly_timer_t *timer);
+/**
+ * Returns if the timer is linked to a wheel.
+ */
+static int quicly_timer_is_linked(quicly_timer_t *timer);
+/**
+ * Initializes the timer wheel.
+ */
+void quicly_timerwheel_init(quicly_timerwheel_t *wheel, int64_t now);
+/**
+ * Disposes the timer wheel. All the timers MUST be unlinked before calling this function.
+ */
+void quicly_timerwheel_dispose(quicly_timerwheel_t *wheel);
+/**
+ * Links the timer to the wheel so that it expires at `at`. If the timer is already linked, it is relinked. Timers that have
+ * already expired are returned by the next call to `quicly_timerwheel_pop`.
+ */
+void quicly_timerwheel_link(quicly_timerwheel_t *wheel, quicly_timer_t *timer, int64_t at);
+/**
+ * Unlinks the timer.
+ */
+static void quicly_timerwheel_unlink(quicly_timer_t *timer);
+/**
+ * Returns the time at which the wheel should be checked for expired timers, or INT64_MAX if no timer is linked. The returned value
+ * might be earlier than the time at which the earliest timer expires.
+ */
+int64_t quicly_timerwheel_get_wake_at(quicly_timerwheel_t *wheel);
+/**
+ * Unlinks and returns one of the timers that have expired at `now`, or returns NULL if there is none.
+ */
+quicly_timer_t *quicly_timerwheel_pop(quicly_timerwheel_t *wheel, int64_t now);
+
+/* inline definitions */
+
+inline void quicly_timer_init(quicly_timer_t *timer)
+{
+    quicly_linklist_init(&timer->_link);
+    timer->at = INT64_MAX;
+}
+
+inline int quicly_timer_is_linked(quicly_timer_t *timer)
+{
+    return quicly_linklist_is_linked(&timer->_link);
+}
+
+inline void quicly_timerwheel_unlink(quicly_timer_t *timer)
+{
+    if (quicly_linklist_is_linked(&timer->_link))
+        quicly_linklist_unlink(&timer->_link);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <assert.h>
+#include <string.h>
+#include "picotls.h"
+#include "quicly/allocator.h"
+
+struct st_quicly_arena_chunk_t {
+    struct st_quicly_arena_chunk_t *next;
+};
+
+#define CHUNK_HEADER_SIZE                                                                                                          \
+    ((sizeof(struct st_quicly_arena_chunk_t) + QUICLY_ARENA_ALIGNMENT - 1) / QUICLY_ARENA_ALIGNMENT * QUICLY_ARENA_ALIGNMENT)
+
+static size_t get_slot(size_t size)
+{
+    return size == 0 ? 0 : (size - 1) / QUICLY_ARENA_ALIGNMENT;
+}
+
+static void *arena_alloc(quicly_allocator_t *_self, size_t size)
+{
+    quicly_arena_t *self = (void *)_self;
+
+    if (size > QUICLY_ARENA_MAX_OBJECT_SIZE)
+        return quicly_allocator_malloc(self->parent, size);
+
+    size_t slot = get_slot(size);
+    void *p;
+
+    /* reuse the object being freed, if any */
+    if ((p = self->freelists[slot]) != NULL) {
+        memcpy(&self->freelists[slot], p, sizeof(void *));
+        return p;
+    }
+
+    /* carve out from the current chunk, allocating a new one if necessary */
+    size = (slot + 1) * QUICLY_ARENA_ALIGNMENT;
+    if ((size_t)(self->end - self->pos) < size) {
+        struct st_quicly_arena_chunk_t *chunk;
+        if ((chunk = quicly_allocator_malloc(self->parent, QUICLY_ARENA_CHUNK_SIZE)) == NULL)
+            return NULL;
+        chunk->next = self->chunks;
+        self->chunks = chunk;
+        self->pos = (uint8_t *)chunk + CHUNK_HEADER_SIZE;
+        self->end = (uint8_t *)chunk + QUICLY_ARENA_CHUNK_SIZE;
+    }
+    p = self->pos;
+    self->pos += size;
+
+    return p;
+}
+
+static void arena_free(quicly_allocator_t *_self, void *p, size_t size)
+{
+    quicly_arena_t *self = (void *)_self;
+
+    if (size > QUICLY_ARENA_MAX_OBJECT_SIZE) {
+        quicly_allocator_free(self->parent, p, size);
+        return;
+    }
+
+    size_t slot = get_slot(size);
+    memcpy(p, &self->freelists[slot], sizeof(void *));
+    self->freelists[slot] = p;
+}
+
+static void *arena_realloc(quicly_allocator_t *_self, void *p, size_t old_size, size_t new_size)
+{
+    quicly_arena_t *self = (void *)_self;
+
+    if (p == NULL)
+        return arena_alloc(&self->super, new_size);
+    if (old_size > QUICLY_ARENA_MAX_OBJECT_SIZE && new_size > QUICLY_ARENA_MAX_OBJECT_SIZE)
+        return quicly_allocator_realloc(self->parent, p, old_size, new_size);
+    if (old_size <= QUICLY_ARENA_MAX_OBJECT_SIZE && new_size <= QUICLY_ARENA_MAX_OBJECT_SIZE &&
+        get_slot(old_size) == get_slot(new_size))
+        return p;
+
+    void *newp;
+    if ((newp = arena_alloc(&self->super, new_size)) == NULL)
+        return NULL;
+    memcpy(newp, p, old_size < new_size ? old_size : new_size);
+    arena_free(&self->super, p, old_size);
+
+    return newp;
+}
+
+void quicly_arena_init(quicly_arena_t *arena, quicly_allocator_t *parent)
+{
+    PTLS_BUILD_ASSERT(QUICLY_ARENA_MAX_OBJECT_SIZE % QUICLY_ARENA_ALIGNMENT == 0);
+    PTLS_BUILD_ASSERT(QUICLY_ARENA_MAX_OBJECT_SIZE + CHUNK_HEADER_SIZE <= QUICLY_ARENA_CHUNK_SIZE);
+
+    *arena = (quicly_arena_t){{arena_alloc, arena_realloc, arena_free}, parent};
+}
+
+void quicly_arena_dispose(quicly_arena_t *arena)
+{
+    struct st_quicly_arena_chunk_t *chunk;
+
+    while ((chunk = arena->chunks) != NULL) {
+        arena->chunks = chunk->next;
+        quicly_allocator_free(arena->parent, chunk, QUICLY_ARENA_CHUNK_SIZE);
+    }
+    arena->pos = NULL;
+    arena->end = NULL;
+    memset(arena->freelists, 0, sizeof(arena->freelists));
+}
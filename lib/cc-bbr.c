@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+/* BBR congestion control, following the design of BBR v1 (draft-cardwell-iccrg-bbr-congestion-control-00). Bandwidth is estimated
+ * from the delivery rate samples being generated for each ACK frame. */
+#include "quicly/cc.h"
+#include "quicly.h"
+
+/**
+ * Gains are represented in 1/1024.
+ */
+#define BBR_UNIT 1024
+/**
+ * 2/ln(2); the minimum gain that allows the sending rate to double every round trip.
+ */
+#define BBR_HIGH_GAIN 2955
+/**
+ * Inverse of BBR_HIGH_GAIN, used for draining the queue being built during STARTUP.
+ */
+#define BBR_DRAIN_GAIN 355
+#define BBR_CWND_GAIN 2048
+/**
+ * Window length of the max bandwidth filter, in round trips.
+ */
+#define QUICLY_CC_BBR_BW_FILTER_ROUNDS 10
+/**
+ * Window length of the min RTT filter, in milliseconds.
+ */
+#define BBR_MIN_RTT_EXPIRY 10000
+/**
+ * Duration of PROBE_RTT, in milliseconds.
+ */
+#define BBR_PROBE_RTT_DURATION 200
+/**
+ * Minimum CWND in packets, also used as the target inflight during PROBE_RTT.
+ */
+#define BBR_MIN_PIPE_CWND 4
+/**
+ * STARTUP is exited when the bandwidth does not grow by 25% for 3 round trips.
+ */
+#define BBR_FULL_BW_THRESH 1280
+#define BBR_FULL_BW_COUNT 3
+
+static const uint16_t pacing_gain_cycle[] = {BBR_UNIT * 5 / 4, BBR_UNIT * 3 / 4, BBR_UNIT, BBR_UNIT,
+                                             BBR_UNIT,         BBR_UNIT,         BBR_UNIT, BBR_UNIT};
+#define BBR_CYCLE_LEN (sizeof(pacing_gain_cycle) / sizeof(pacing_gain_cycle[0]))
+
+static uint32_t get_max_bw(quicly_cc_t *cc)
+{
+    return cc->state.bbr.max_bw[0].bw;
+}
+
+/**
+ * Windowed max filter (Kathleen Nichols' algorithm), retaining the best, 2nd best, and 3rd best samples within the window.
+ */
+static void update_max_bw(quicly_cc_t *cc, uint32_t bw)
+{
+    struct st_quicly_cc_bbr_bw_sample_t *s = cc->state.bbr.max_bw,
+                                        sample = {.round = cc->state.bbr.round_count, .bw = bw};
+
+    /* forget earlier samples if the new sample is the largest, or if nothing is left in the window */
+    if (sample.bw >= s[0].bw || sample.round - s[2].round > QUICLY_CC_BBR_BW_FILTER_ROUNDS) {
+        s[0] = s[1] = s[2] = sample;
+        return;
+    }
+    if (sample.bw >= s[1].bw) {
+        s[2] = s[1] = sample;
+    } else if (sample.bw >= s[2].bw) {
+        s[2] = sample;
+    }
+
+    /* expire the best sample(s) being too old, and also make sure that the 2nd and 3rd best samples are taken from the later
+     * portions of the window */
+    uint32_t delta = sample.round - s[0].round;
+    if (delta > QUICLY_CC_BBR_BW_FILTER_ROUNDS) {
+        s[0] = s[1];
+        s[1] = s[2];
+        s[2] = sample;
+        if (sample.round - s[0].round > QUICLY_CC_BBR_BW_FILTER_ROUNDS) {
+            s[0] = s[1];
+            s[1] = s[2];
+            s[2] = sample;
+        }
+    } else if (s[1].round == s[0].round && delta > QUICLY_CC_BBR_BW_FILTER_ROUNDS / 4) {
+        s[2] = s[1] = sample;
+    } else if (s[2].round == s[1].round && delta > QUICLY_CC_BBR_BW_FILTER_ROUNDS / 2) {
+        s[2] = sample;
+    }
+}
+
+/**
+ * Returns the BDP multiplied by `gain`, or zero if it cannot be calculated yet.
+ */
+static uint64_t calc_bdp(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t gain)
+{
+    if (cc->state.bbr.min_rtt == UINT32_MAX)
+        return 0;
+    return (uint64_t)get_max_bw(cc) * cc->state.bbr.min_rtt / loss->clock_resolution * gain / BBR_UNIT;
+}
+
+static uint32_t get_pacing_gain(quicly_cc_t *cc)
+{
+    switch (cc->state.bbr.mode) {
+    case QUICLY_CC_BBR_MODE_STARTUP:
+        return BBR_HIGH_GAIN;
+    case QUICLY_CC_BBR_MODE_DRAIN:
+        return BBR_DRAIN_GAIN;
+    case QUICLY_CC_BBR_MODE_PROBE_BW:
+        return pacing_gain_cycle[cc->state.bbr.cycle_index];
+    default:
+        return BBR_UNIT;
+    }
+}
+
+static uint32_t get_cwnd_gain(quicly_cc_t *cc)
+{
+    return cc->state.bbr.mode == QUICLY_CC_BBR_MODE_PROBE_BW ? BBR_CWND_GAIN : BBR_HIGH_GAIN;
+}
+
+/**
+ * Saves CWND so that it can be restored after loss recovery or PROBE_RTT.
+ */
+static void save_cwnd(quicly_cc_t *cc)
+{
+    if (!cc->state.bbr.in_recovery && cc->state.bbr.mode != QUICLY_CC_BBR_MODE_PROBE_RTT) {
+        cc->state.bbr.prior_cwnd = cc->cwnd;
+    } else if (cc->state.bbr.prior_cwnd < cc->cwnd) {
+        cc->state.bbr.prior_cwnd = cc->cwnd;
+    }
+}
+
+static void restore_cwnd(quicly_cc_t *cc)
+{
+    if (cc->cwnd < cc->state.bbr.prior_cwnd)
+        cc->cwnd = cc->state.bbr.prior_cwnd;
+}
+
+static void advance_cycle_phase(quicly_cc_t *cc, int64_t now)
+{
+    cc->state.bbr.cycle_index = (cc->state.bbr.cycle_index + 1) % BBR_CYCLE_LEN;
+    cc->state.bbr.cycle_start_at = now;
+}
+
+static void enter_probe_bw(quicly_cc_t *cc, int64_t now)
+{
+    cc->state.bbr.mode = QUICLY_CC_BBR_MODE_PROBE_BW;
+    /* Start from a pseudo-random phase other than the draining phase (index 1), so that flows sharing the bottleneck do not
+     * synchronize. */
+    cc->state.bbr.cycle_index = BBR_CYCLE_LEN - 1 - cc->state.bbr.round_count % (BBR_CYCLE_LEN - 1);
+    advance_cycle_phase(cc, now);
+}
+
+static int is_next_cycle_phase(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes_in_flight, int64_t now)
+{
+    uint32_t gain = pacing_gain_cycle[cc->state.bbr.cycle_index];
+    int is_full_length = now - cc->state.bbr.cycle_start_at > cc->state.bbr.min_rtt;
+
+    if (gain == BBR_UNIT)
+        return is_full_length;
+    /* when probing, keep the gain until inflight reaches the target, or a loss is observed */
+    if (gain > BBR_UNIT)
+        return is_full_length && (cc->state.bbr.in_recovery || bytes_in_flight >= calc_bdp(cc, loss, gain));
+    /* when draining, exit early if inflight is already small enough */
+    return is_full_length || bytes_in_flight <= calc_bdp(cc, loss, BBR_UNIT);
+}
+
+static void check_full_pipe(quicly_cc_t *cc)
+{
+    if (cc->state.bbr.filled_pipe)
+        return;
+
+    uint32_t max_bw = get_max_bw(cc);
+    if ((uint64_t)max_bw * BBR_UNIT >= (uint64_t)cc->state.bbr.full_bw * BBR_FULL_BW_THRESH) {
+        cc->state.bbr.full_bw = max_bw;
+        cc->state.bbr.full_bw_count = 0;
+        return;
+    }
+    if (++cc->state.bbr.full_bw_count >= BBR_FULL_BW_COUNT) {
+        cc->state.bbr.filled_pipe = 1;
+        cc->cwnd_exiting_slow_start = cc->cwnd;
+    }
+}
+
+static void update_min_rtt(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes_in_flight, uint64_t next_pn, int round_start,
+                           int64_t now, uint32_t min_pipe_cwnd)
+{
+    int expired = cc->state.bbr.min_rtt != UINT32_MAX &&
+                  now - cc->state.bbr.min_rtt_at > (int64_t)BBR_MIN_RTT_EXPIRY * loss->clock_resolution;
+
+    if (loss->rtt.latest != 0 && (loss->rtt.latest <= cc->state.bbr.min_rtt || expired)) {
+        cc->state.bbr.min_rtt = loss->rtt.latest;
+        cc->state.bbr.min_rtt_at = now;
+    }
+
+    /* enter PROBE_RTT if min_rtt has not been refreshed for a while */
+    if (expired && cc->state.bbr.mode != QUICLY_CC_BBR_MODE_PROBE_RTT) {
+        save_cwnd(cc);
+        cc->state.bbr.mode = QUICLY_CC_BBR_MODE_PROBE_RTT;
+        cc->state.bbr.probe_rtt_done_at = 0;
+    }
+
+    if (cc->state.bbr.mode != QUICLY_CC_BBR_MODE_PROBE_RTT)
+        return;
+
+    /* Stay in PROBE_RTT for BBR_PROBE_RTT_DURATION and one round trip after inflight drops to the target. */
+    if (cc->state.bbr.probe_rtt_done_at == 0) {
+        if (bytes_in_flight <= min_pipe_cwnd) {
+            cc->state.bbr.probe_rtt_done_at = now + (int64_t)BBR_PROBE_RTT_DURATION * loss->clock_resolution;
+            cc->state.bbr.probe_rtt_round_done = 0;
+            cc->state.bbr.round_end_pn = next_pn;
+        }
+    } else {
+        if (round_start)
+            cc->state.bbr.probe_rtt_round_done = 1;
+        if (cc->state.bbr.probe_rtt_round_done && now >= cc->state.bbr.probe_rtt_done_at) {
+            cc->state.bbr.min_rtt_at = now;
+            restore_cwnd(cc);
+            if (cc->state.bbr.filled_pipe) {
+                enter_probe_bw(cc, now);
+            } else {
+                cc->state.bbr.mode = QUICLY_CC_BBR_MODE_STARTUP;
+            }
+        }
+    }
+}
+
+static void set_cwnd(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes, uint32_t bytes_in_flight, uint32_t min_pipe_cwnd)
+{
+    uint64_t target = calc_bdp(cc, loss, get_cwnd_gain(cc));
+    if (target != 0)
+        target += 3 * (min_pipe_cwnd / BBR_MIN_PIPE_CWND); /* leave room for delayed and aggregated ACKs */
+
+    if (cc->state.bbr.in_recovery) {
+        /* packet conservation; send as many bytes as being acknowledged */
+        if (cc->cwnd < bytes_in_flight + bytes)
+            cc->cwnd = bytes_in_flight + bytes;
+    } else if (cc->state.bbr.filled_pipe && target != 0) {
+        cc->cwnd = cc->cwnd + bytes < target ? cc->cwnd + bytes : (uint32_t)target;
+    } else if (target == 0 || cc->cwnd < target || loss->sentmap.delivered < cc->cwnd_initial) {
+        cc->cwnd += bytes;
+    }
+
+    if (cc->cwnd < min_pipe_cwnd)
+        cc->cwnd = min_pipe_cwnd;
+    if (cc->state.bbr.mode == QUICLY_CC_BBR_MODE_PROBE_RTT && cc->cwnd > min_pipe_cwnd)
+        cc->cwnd = min_pipe_cwnd;
+
+    if (cc->cwnd_maximum < cc->cwnd)
+        cc->cwnd_maximum = cc->cwnd;
+}
+
+static void set_pacing_rate(quicly_cc_t *cc)
+{
+    uint32_t max_bw = get_max_bw(cc);
+    if (max_bw == 0)
+        return;
+
+    uint64_t rate = (uint64_t)max_bw * get_pacing_gain(cc) / BBR_UNIT;
+    if (rate == 0)
+        rate = 1;
+    if (rate > UINT32_MAX)
+        rate = UINT32_MAX;
+    /* until the pipe is filled, do not reduce the pacing rate, as the bandwidth might have been underestimated */
+    if (cc->state.bbr.filled_pipe || cc->pacing_rate < rate)
+        cc->pacing_rate = (uint32_t)rate;
+}
+
+static void bbr_on_acked(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes, uint64_t largest_acked, uint32_t inflight,
+                         uint64_t next_pn, int64_t now, uint32_t max_udp_payload_size, const quicly_delivery_rate_sample_t *rs)
+{
+    uint32_t bytes_in_flight = inflight - bytes, min_pipe_cwnd = BBR_MIN_PIPE_CWND * max_udp_payload_size;
+    int round_start = 0;
+
+    cc->state.bbr.min_pipe_cwnd = min_pipe_cwnd;
+
+    assert(inflight >= bytes);
+
+    /* start a new round when the packets sent at the beginning of the current round get acknowledged */
+    if (largest_acked >= cc->state.bbr.round_end_pn) {
+        cc->state.bbr.round_end_pn = next_pn;
+        ++cc->state.bbr.round_count;
+        round_start = 1;
+    }
+
+    /* update the max bandwidth filter; application-limited samples are used only when they increase the estimate */
+    if (rs->interval > 0) {
+        uint64_t bw = rs->delivered * loss->clock_resolution / rs->interval;
+        if (bw > UINT32_MAX)
+            bw = UINT32_MAX;
+        if (!rs->is_app_limited || bw >= get_max_bw(cc))
+            update_max_bw(cc, (uint32_t)bw);
+    }
+
+    /* exit recovery */
+    if (cc->state.bbr.in_recovery && largest_acked >= cc->recovery_end) {
+        cc->state.bbr.in_recovery = 0;
+        restore_cwnd(cc);
+    }
+
+    /* update the state machine */
+    if (round_start && !rs->is_app_limited)
+        check_full_pipe(cc);
+    if (cc->state.bbr.mode == QUICLY_CC_BBR_MODE_STARTUP && cc->state.bbr.filled_pipe) {
+        cc->state.bbr.mode = QUICLY_CC_BBR_MODE_DRAIN;
+        cc->ssthresh = cc->cwnd;
+    }
+    if (cc->state.bbr.mode == QUICLY_CC_BBR_MODE_DRAIN && bytes_in_flight <= calc_bdp(cc, loss, BBR_UNIT))
+        enter_probe_bw(cc, now);
+    if (cc->state.bbr.mode == QUICLY_CC_BBR_MODE_PROBE_BW && is_next_cycle_phase(cc, loss, bytes_in_flight, now))
+        advance_cycle_phase(cc, now);
+    update_min_rtt(cc, loss, bytes_in_flight, next_pn, round_start, now, min_pipe_cwnd);
+
+    set_pacing_rate(cc);
+    set_cwnd(cc, loss, bytes, bytes_in_flight, min_pipe_cwnd);
+}
+
+static void bbr_on_lost(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes, uint64_t lost_pn, uint64_t next_pn, int64_t now,
+                        uint32_t max_udp_payload_size)
+{
+    cc->state.bbr.min_pipe_cwnd = BBR_MIN_PIPE_CWND * max_udp_payload_size;
+
+    /* Nothing to do if loss is in recovery window. */
+    if (lost_pn < cc->recovery_end)
+        return;
+    quicly_cc_save_undo_state(cc);
+    cc->recovery_end = next_pn;
+
+    ++cc->num_loss_episodes;
+
+    /* Enter recovery, reducing CWND to the number of bytes in flight (the lost packet is still accounted as inflight at this
+     * point). Unlike loss-based controllers, the model is not changed; CWND is restored once recovery is complete. */
+    save_cwnd(cc);
+    cc->state.bbr.in_recovery = 1;
+    uint32_t bytes_in_flight = loss->sentmap.bytes_in_flight > bytes ? (uint32_t)(loss->sentmap.bytes_in_flight - bytes) : 0;
+    cc->cwnd = bytes_in_flight;
+    if (cc->cwnd < cc->state.bbr.min_pipe_cwnd)
+        cc->cwnd = cc->state.bbr.min_pipe_cwnd;
+
+    if (cc->cwnd_minimum > cc->cwnd)
+        cc->cwnd_minimum = cc->cwnd;
+}
+
+static void bbr_on_ecn_congestion(quicly_cc_t *cc, const quicly_loss_t *loss, uint64_t pn, uint64_t next_pn, int64_t now,
+                                  uint32_t max_udp_payload_size)
+{
+    /* BBR v1 does not react to ECN; the model is driven by the delivery rate and RTT */
+}
+
+static void bbr_on_spurious_loss(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now)
+{
+    /* The model is not affected by losses; the only thing to undo is the CWND reduction of the recovery. */
+    if (cc->state.bbr.in_recovery) {
+        cc->state.bbr.in_recovery = 0;
+        restore_cwnd(cc);
+    }
+    cc->recovery_end = cc->undo.recovery_end;
+    cc->undo.num_lost = 0;
+    ++cc->num_loss_episodes_undone;
+}
+
+static void bbr_on_persistent_congestion(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now)
+{
+    /* Collapse CWND to the minimum. Recovery is left without restoring the CWND being saved, and the reduction cannot be undone;
+     * CWND grows again as the model (i.e., bandwidth and RTT estimates) permits. */
+    cc->state.bbr.in_recovery = 0;
+    cc->state.bbr.prior_cwnd = 0;
+    cc->undo.num_lost = 0;
+    cc->cwnd = cc->state.bbr.min_pipe_cwnd;
+    if (cc->cwnd_minimum > cc->cwnd)
+        cc->cwnd_minimum = cc->cwnd;
+}
+
+static void bbr_on_sent(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes, int64_t now)
+{
+    /* Unused */
+}
+
+static void bbr_init_bbr_state(quicly_cc_t *cc)
+{
+    memset(&cc->state.bbr, 0, sizeof(cc->state.bbr));
+    cc->state.bbr.mode = QUICLY_CC_BBR_MODE_STARTUP;
+    cc->state.bbr.min_rtt = UINT32_MAX;
+    /* until the callbacks tell the actual value, assume the smallest max_udp_payload_size being permitted */
+    cc->state.bbr.min_pipe_cwnd = BBR_MIN_PIPE_CWND * QUICLY_MIN_CLIENT_INITIAL_SIZE;
+}
+
+static void bbr_reset(quicly_cc_t *cc, uint32_t initcwnd)
+{
+    memset(cc, 0, sizeof(quicly_cc_t));
+    cc->type = &quicly_cc_type_bbr;
+    cc->cwnd = cc->cwnd_initial = cc->cwnd_maximum = initcwnd;
+    cc->ssthresh = cc->cwnd_minimum = UINT32_MAX;
+    bbr_init_bbr_state(cc);
+}
+
+static int bbr_on_switch(quicly_cc_t *cc)
+{
+    if (cc->type == &quicly_cc_type_bbr)
+        return 1;
+
+    if (cc->type == &quicly_cc_type_reno || cc->type == &quicly_cc_type_cubic || cc->type == &quicly_cc_type_pico) {
+        /* CWND is retained, and the model is built from scratch, starting from STARTUP */
+        cc->type = &quicly_cc_type_bbr;
+        cc->ssthresh = UINT32_MAX;
+        cc->pacing_rate = 0;
+        bbr_init_bbr_state(cc);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void bbr_init(quicly_init_cc_t *self, quicly_cc_t *cc, uint32_t initcwnd, int64_t now)
+{
+    bbr_reset(cc, initcwnd);
+}
+
+quicly_cc_type_t quicly_cc_type_bbr = {"bbr",
+                                       &quicly_cc_bbr_init,
+                                       bbr_on_acked,
+                                       bbr_on_lost,
+                                       bbr_on_persistent_congestion,
+                                       bbr_on_sent,
+                                       bbr_on_switch,
+                                       bbr_on_ecn_congestion,
+                                       bbr_on_spurious_loss};
+quicly_init_cc_t quicly_cc_bbr_init = {bbr_init};
@@ -31,10 +31,10 @@ typedef double cubic_float_t;
 #define QUICLY_CUBIC_BETA ((cubic_float_t)0.7)
 
 /* Calculates the time elapsed since the last congestion event (parameter t) */
-static cubic_float_t calc_cubic_t(const quicly_cc_t *cc, int64_t now)
+static cubic_float_t calc_cubic_t(const quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now)
 {
     cubic_float_t clock_delta = now - cc->state.cubic.avoidance_start;
-    return clock_delta / 1000; /* ms -> s */
+    return clock_delta / (1000 * loss->clock_resolution); /* clock ticks -> s */
 }
 
 /* RFC 8312, Equation 1; using bytes as unit instead of MSS */
@@ -61,7 +61,7 @@ static uint32_t calc_w_est(const quicly_cc_t *cc, cubic_float_t t_sec, cubic_flo
 
 /* TODO: Avoid increase if sender was application limited. */
 static void cubic_on_acked(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes, uint64_t largest_acked, uint32_t inflight,
-                           uint64_t next_pn, int64_t now, uint32_t max_udp_payload_size)
+                           uint64_t next_pn, int64_t now, uint32_t max_udp_payload_size, const quicly_delivery_rate_sample_t *rs)
 {
     assert(inflight >= bytes);
     /* Do not increase congestion window while in recovery. */
@@ -70,6 +70,13 @@ static void cubic_on_acked(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t
 
     /* Slow start. */
     if (cc->cwnd < cc->ssthresh) {
+        if (quicly_cc_hystart_on_acked(cc, loss, &bytes, largest_acked, next_pn, max_udp_payload_size)) {
+            /* RFC 9406, Section 4.2; start congestion avoidance from the convex region, using current CWND as W_max */
+            cc->state.cubic.avoidance_start = now;
+            cc->state.cubic.w_max = cc->cwnd;
+            cc->state.cubic.k = 0;
+            return;
+        }
         cc->cwnd += bytes;
         if (cc->cwnd_maximum < cc->cwnd)
             cc->cwnd_maximum = cc->cwnd;
@@ -77,8 +84,8 @@ static void cubic_on_acked(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t
     }
 
     /* Congestion avoidance. */
-    cubic_float_t t_sec = calc_cubic_t(cc, now);
-    cubic_float_t rtt_sec = loss->rtt.smoothed / (cubic_float_t)1000; /* ms -> s */
+    cubic_float_t t_sec = calc_cubic_t(cc, loss, now);
+    cubic_float_t rtt_sec = loss->rtt.smoothed / ((cubic_float_t)1000 * loss->clock_resolution); /* clock ticks -> s */
 
     uint32_t w_cubic = calc_w_cubic(cc, t_sec, max_udp_payload_size);
     uint32_t w_est = calc_w_est(cc, t_sec, rtt_sec, max_udp_payload_size);
@@ -108,6 +115,7 @@ static void cubic_on_lost(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t b
     /* Nothing to do if loss is in recovery window. */
     if (lost_pn < cc->recovery_end)
         return;
+    quicly_cc_save_undo_state(cc);
     cc->recovery_end = next_pn;
 
     ++cc->num_loss_episodes;
@@ -137,6 +145,22 @@ static void cubic_on_lost(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t b
         cc->cwnd_minimum = cc->cwnd;
 }
 
+static void cubic_on_ecn_congestion(quicly_cc_t *cc, const quicly_loss_t *loss, uint64_t pn, uint64_t next_pn, int64_t now,
+                                    uint32_t max_udp_payload_size)
+{
+    cubic_on_lost(cc, loss, 0, pn, next_pn, now, max_udp_payload_size);
+}
+
+static void cubic_on_spurious_loss(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now)
+{
+    /* restore the curve, but not `last_sent_time`, which is used for detecting idle periods */
+    cc->state.cubic.k = cc->undo.state.cubic.k;
+    cc->state.cubic.w_max = cc->undo.state.cubic.w_max;
+    cc->state.cubic.w_last_max = cc->undo.state.cubic.w_last_max;
+    cc->state.cubic.avoidance_start = cc->undo.state.cubic.avoidance_start;
+    quicly_cc_reno_on_spurious_loss(cc, loss, now);
+}
+
 static void cubic_on_persistent_congestion(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now)
 {
     /* TODO */
@@ -178,6 +202,9 @@ static int cubic_on_switch(quicly_cc_t *cc)
             cubic_reset(cc, cc->cwnd_initial);
         }
         return 1;
+    } else if (cc->type == &quicly_cc_type_bbr) {
+        cubic_reset(cc, cc->cwnd_initial);
+        return 1;
     }
 
     return 0;
@@ -188,6 +215,13 @@ static void cubic_init(quicly_init_cc_t *self, quicly_cc_t *cc, uint32_t initcwn
     cubic_reset(cc, initcwnd);
 }
 
-quicly_cc_type_t quicly_cc_type_cubic = {
-    "cubic", &quicly_cc_cubic_init, cubic_on_acked, cubic_on_lost, cubic_on_persistent_congestion, cubic_on_sent, cubic_on_switch};
+quicly_cc_type_t quicly_cc_type_cubic = {"cubic",
+                                         &quicly_cc_cubic_init,
+                                         cubic_on_acked,
+                                         cubic_on_lost,
+                                         cubic_on_persistent_congestion,
+                                         cubic_on_sent,
+                                         cubic_on_switch,
+                                         cubic_on_ecn_congestion,
+                                         cubic_on_spurious_loss};
 quicly_init_cc_t quicly_cc_cubic_init = {cubic_init};
@@ -26,7 +26,7 @@
 /**
  * Calculates the increase ratio to be used in congestion avoidance phase.
  */
-static uint32_t calc_bytes_per_mtu_increase(uint32_t cwnd, uint32_t rtt, uint32_t mtu)
+static uint32_t calc_bytes_per_mtu_increase(uint32_t cwnd, uint32_t rtt, uint32_t clock_resolution, uint32_t mtu)
 {
     /* Reno: CWND size after reduction */
     uint32_t reno = cwnd * QUICLY_RENO_BETA;
@@ -54,14 +54,14 @@ static uint32_t calc_bytes_per_mtu_increase(uint32_t cwnd, uint32_t rtt, uint32_
      *
      *   bytes_per_mtu_increase = ((1 + 0.85^(1/3) * 2) / 2) * K * MTU / (0.3 * RTT_at_Wmax)
      */
-    uint32_t cubic = 1.447 / 0.3 * 1000 * cbrt(0.3 / 0.4 * cwnd / mtu) / rtt * mtu;
+    uint32_t cubic = 1.447 / 0.3 * 1000 * clock_resolution * cbrt(0.3 / 0.4 * cwnd / mtu) / rtt * mtu;
 
     return reno < cubic ? reno : cubic;
 }
 
 /* TODO: Avoid increase if sender was application limited. */
 static void pico_on_acked(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes, uint64_t largest_acked, uint32_t inflight,
-                          uint64_t next_pn, int64_t now, uint32_t max_udp_payload_size)
+                          uint64_t next_pn, int64_t now, uint32_t max_udp_payload_size, const quicly_delivery_rate_sample_t *rs)
 {
     assert(inflight >= bytes);
 
@@ -69,6 +69,13 @@ static void pico_on_acked(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t b
     if (largest_acked < cc->recovery_end)
         return;
 
+    if (cc->cwnd < cc->ssthresh &&
+        quicly_cc_hystart_on_acked(cc, loss, &bytes, largest_acked, next_pn, max_udp_payload_size)) {
+        cc->state.pico.bytes_per_mtu_increase = calc_bytes_per_mtu_increase(cc->cwnd, loss->rtt.smoothed, loss->clock_resolution,
+                                                                            max_udp_payload_size);
+        return;
+    }
+
     cc->state.pico.stash += bytes;
 
     /* Calculate the amount of bytes required to be acked for incrementing CWND by one MTU. */
@@ -98,6 +105,7 @@ static void pico_on_lost(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t by
     /* Nothing to do if loss is in recovery window. */
     if (lost_pn < cc->recovery_end)
         return;
+    quicly_cc_save_undo_state(cc);
     cc->recovery_end = next_pn;
 
     ++cc->num_loss_episodes;
@@ -105,7 +113,8 @@ static void pico_on_lost(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t by
         cc->cwnd_exiting_slow_start = cc->cwnd;
 
     /* Calculate increase rate. */
-    cc->state.pico.bytes_per_mtu_increase = calc_bytes_per_mtu_increase(cc->cwnd, loss->rtt.smoothed, max_udp_payload_size);
+    cc->state.pico.bytes_per_mtu_increase = calc_bytes_per_mtu_increase(cc->cwnd, loss->rtt.smoothed, loss->clock_resolution,
+                                                                        max_udp_payload_size);
 
     /* Reduce congestion window. */
     cc->cwnd *= QUICLY_RENO_BETA;
@@ -117,6 +126,18 @@ static void pico_on_lost(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t by
         cc->cwnd_minimum = cc->cwnd;
 }
 
+static void pico_on_ecn_congestion(quicly_cc_t *cc, const quicly_loss_t *loss, uint64_t pn, uint64_t next_pn, int64_t now,
+                                   uint32_t max_udp_payload_size)
+{
+    pico_on_lost(cc, loss, 0, pn, next_pn, now, max_udp_payload_size);
+}
+
+static void pico_on_spurious_loss(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now)
+{
+    cc->state.pico.bytes_per_mtu_increase = cc->undo.state.pico.bytes_per_mtu_increase;
+    quicly_cc_reno_on_spurious_loss(cc, loss, now);
+}
+
 static void pico_on_persistent_congestion(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now)
 {
     /* TODO */
@@ -163,6 +184,9 @@ static int pico_on_switch(quicly_cc_t *cc)
             pico_reset(cc, cc->cwnd_initial);
         }
         return 1;
+    } else if (cc->type == &quicly_cc_type_bbr) {
+        pico_reset(cc, cc->cwnd_initial);
+        return 1;
     }
 
     return 0;
@@ -173,6 +197,13 @@ static void pico_init(quicly_init_cc_t *self, quicly_cc_t *cc, uint32_t initcwnd
     pico_reset(cc, initcwnd);
 }
 
-quicly_cc_type_t quicly_cc_type_pico = {
-    "pico", &quicly_cc_pico_init, pico_on_acked, pico_on_lost, pico_on_persistent_congestion, pico_on_sent, pico_on_switch};
+quicly_cc_type_t quicly_cc_type_pico = {"pico",
+                                        &quicly_cc_pico_init,
+                                        pico_on_acked,
+                                        pico_on_lost,
+                                        pico_on_persistent_congestion,
+                                        pico_on_sent,
+                                        pico_on_switch,
+                                        pico_on_ecn_congestion,
+                                        pico_on_spurious_loss};
 quicly_init_cc_t quicly_cc_pico_init = {pico_init};
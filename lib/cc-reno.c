@@ -24,7 +24,7 @@
 
 /* TODO: Avoid increase if sender was application limited. */
 static void reno_on_acked(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t bytes, uint64_t largest_acked, uint32_t inflight,
-                          uint64_t next_pn, int64_t now, uint32_t max_udp_payload_size)
+                          uint64_t next_pn, int64_t now, uint32_t max_udp_payload_size, const quicly_delivery_rate_sample_t *rs)
 {
     assert(inflight >= bytes);
     /* Do not increase congestion window while in recovery. */
@@ -33,6 +33,8 @@ static void reno_on_acked(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t b
 
     /* Slow start. */
     if (cc->cwnd < cc->ssthresh) {
+        if (quicly_cc_hystart_on_acked(cc, loss, &bytes, largest_acked, next_pn, max_udp_payload_size))
+            return;
         cc->cwnd += bytes;
         if (cc->cwnd_maximum < cc->cwnd)
             cc->cwnd_maximum = cc->cwnd;
@@ -56,6 +58,7 @@ void quicly_cc_reno_on_lost(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t
     /* Nothing to do if loss is in recovery window. */
     if (lost_pn < cc->recovery_end)
         return;
+    quicly_cc_save_undo_state(cc);
     cc->recovery_end = next_pn;
 
     ++cc->num_loss_episodes;
@@ -72,6 +75,30 @@ void quicly_cc_reno_on_lost(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t
         cc->cwnd_minimum = cc->cwnd;
 }
 
+void quicly_cc_reno_on_ecn_congestion(quicly_cc_t *cc, const quicly_loss_t *loss, uint64_t pn, uint64_t next_pn, int64_t now,
+                                       uint32_t max_udp_payload_size)
+{
+    /* CE marks are handled the same way as a loss (RFC 9002 Section 7.1), except that nothing is removed from the network */
+    quicly_cc_reno_on_lost(cc, loss, 0, pn, next_pn, now, max_udp_payload_size);
+}
+
+void quicly_cc_reno_on_spurious_loss(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now)
+{
+    /* Restore the state prior to the reduction; if the values have grown since then, they are retained. Restoring the original
+     * `cwnd_exiting_slow_start` means that slow start resumes if the reduction was the one that ended slow start. */
+    if (cc->cwnd < cc->undo.cwnd)
+        cc->cwnd = cc->undo.cwnd;
+    if (cc->ssthresh < cc->undo.ssthresh)
+        cc->ssthresh = cc->undo.ssthresh;
+    cc->cwnd_exiting_slow_start = cc->undo.cwnd_exiting_slow_start;
+    cc->recovery_end = cc->undo.recovery_end;
+    cc->undo.num_lost = 0;
+    ++cc->num_loss_episodes_undone;
+
+    if (cc->cwnd_maximum < cc->cwnd)
+        cc->cwnd_maximum = cc->cwnd;
+}
+
 void quicly_cc_reno_on_persistent_congestion(quicly_cc_t *cc, const quicly_loss_t *loss, int64_t now)
 {
     /* TODO */
@@ -106,6 +133,9 @@ static int reno_on_switch(quicly_cc_t *cc)
             reno_reset(cc, cc->cwnd_initial);
         }
         return 1;
+    } else if (cc->type == &quicly_cc_type_bbr) {
+        reno_reset(cc, cc->cwnd_initial);
+        return 1;
     }
 
     return 0;
@@ -122,10 +152,23 @@ quicly_cc_type_t quicly_cc_type_reno = {"reno",
                                         quicly_cc_reno_on_lost,
                                         quicly_cc_reno_on_persistent_congestion,
                                         quicly_cc_reno_on_sent,
-                                        reno_on_switch};
+                                        reno_on_switch,
+                                        quicly_cc_reno_on_ecn_congestion,
+                                        quicly_cc_reno_on_spurious_loss};
 quicly_init_cc_t quicly_cc_reno_init = {reno_init};
 
-quicly_cc_type_t *quicly_cc_all_types[] = {&quicly_cc_type_reno, &quicly_cc_type_cubic, &quicly_cc_type_pico, NULL};
+quicly_cc_type_t *quicly_cc_all_types[] = {&quicly_cc_type_reno, &quicly_cc_type_cubic, &quicly_cc_type_pico, &quicly_cc_type_bbr,
+                                           NULL};
+
+void quicly_cc_save_undo_state(quicly_cc_t *cc)
+{
+    cc->undo.cwnd = cc->cwnd;
+    cc->undo.ssthresh = cc->ssthresh;
+    cc->undo.cwnd_exiting_slow_start = cc->cwnd_exiting_slow_start;
+    cc->undo.recovery_end = cc->recovery_end;
+    cc->undo.state = cc->state;
+    cc->undo.num_lost = 0;
+}
 
 uint32_t quicly_cc_calc_initial_cwnd(uint32_t max_packets, uint16_t max_udp_payload_size)
 {
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <assert.h>
+#include <netinet/in.h>
+#include <string.h>
+#include "khash.h"
+#include "quicly/conn_map.h"
+
+/**
+ * Key of the connections being identified by the peer address and optionally a CID chosen by the peer. The fields are serialized
+ * into a byte array so that the keys can be hashed and compared without worrying about padding: CID length (1 byte), CID (20
+ * bytes), address family (1 byte), port (2 bytes), address (16 bytes).
+ */
+struct st_quicly_conn_map_addr_key_t {
+    uint8_t bytes[1 + QUICLY_MAX_CID_LEN_V1 + 1 + 2 + 16];
+};
+
+static khint_t addr_key_hash(struct st_quicly_conn_map_addr_key_t key)
+{
+    /* FNV-1a */
+    khint_t hash = 2166136261u;
+    for (size_t i = 0; i != sizeof(key.bytes); ++i)
+        hash = (hash ^ key.bytes[i]) * 16777619u;
+    return hash;
+}
+
+static int addr_key_equal(struct st_quicly_conn_map_addr_key_t x, struct st_quicly_conn_map_addr_key_t y)
+{
+    return memcmp(x.bytes, y.bytes, sizeof(x.bytes)) == 0;
+}
+
+/**
+ * builds the key; returns 0 if the address is not an IP address
+ */
+static int build_addr_key(struct st_quicly_conn_map_addr_key_t *key, ptls_iovec_t cid, struct sockaddr *addr)
+{
+    uint8_t *p = key->bytes;
+
+    memset(key, 0, sizeof(*key));
+    assert(cid.len <= QUICLY_MAX_CID_LEN_V1);
+    *p++ = (uint8_t)cid.len;
+    if (cid.len != 0)
+        memcpy(p, cid.base, cid.len);
+    p += QUICLY_MAX_CID_LEN_V1;
+
+    switch (addr->sa_family) {
+    case AF_INET: {
+        struct sockaddr_in *sin = (void *)addr;
+        *p++ = 4;
+        memcpy(p, &sin->sin_port, 2);
+        p += 2;
+        memcpy(p, &sin->sin_addr, 4);
+    } break;
+    case AF_INET6: {
+        struct sockaddr_in6 *sin6 = (void *)addr;
+        *p++ = 6;
+        memcpy(p, &sin6->sin6_port, 2);
+        p += 2;
+        memcpy(p, &sin6->sin6_addr, 16);
+    } break;
+    default:
+        return 0;
+    }
+
+    return 1;
+}
+
+static uint64_t build_id_key(const quicly_cid_plaintext_t *plaintext)
+{
+    return (uint64_t)plaintext->thread_id << 32 | plaintext->master_id;
+}
+
+KHASH_INIT(quicly_conn_map_by_id, uint64_t, quicly_conn_t *, 1, kh_int64_hash_func, kh_int64_hash_equal)
+KHASH_INIT(quicly_conn_map_by_addr, struct st_quicly_conn_map_addr_key_t, quicly_conn_t *, 1, addr_key_hash, addr_key_equal)
+
+struct st_quicly_conn_map_t {
+    /**
+     * connections keyed by master_id and thread_id
+     */
+    khash_t(quicly_conn_map_by_id) * by_id;
+    /**
+     * connections keyed by the peer address, and the CID chosen by the client (if any)
+     */
+    khash_t(quicly_conn_map_by_addr) * by_addr;
+    /**
+     * number of connections being registered
+     */
+    size_t size;
+};
+
+quicly_conn_map_t *quicly_conn_map_new(void)
+{
+    quicly_conn_map_t *map;
+
+    if ((map = malloc(sizeof(*map))) == NULL)
+        return NULL;
+    map->by_id = kh_init(quicly_conn_map_by_id);
+    map->by_addr = kh_init(quicly_conn_map_by_addr);
+    map->size = 0;
+    if (map->by_id == NULL || map->by_addr == NULL) {
+        quicly_conn_map_free(map);
+        return NULL;
+    }
+
+    return map;
+}
+
+void quicly_conn_map_free(quicly_conn_map_t *map)
+{
+    kh_destroy(quicly_conn_map_by_id, map->by_id);
+    kh_destroy(quicly_conn_map_by_addr, map->by_addr);
+    free(map);
+}
+
+size_t quicly_conn_map_get_size(quicly_conn_map_t *map)
+{
+    return map->size;
+}
+
+static int uses_cid_encryptor(quicly_conn_t *conn)
+{
+    return quicly_get_context(conn)->cid_encryptor != NULL;
+}
+
+static int put_by_addr(quicly_conn_map_t *map, ptls_iovec_t cid, struct sockaddr *addr, quicly_conn_t *conn)
+{
+    struct st_quicly_conn_map_addr_key_t key;
+    khiter_t iter;
+    int ret;
+
+    if (!build_addr_key(&key, cid, addr))
+        return 0;
+    iter = kh_put(quicly_conn_map_by_addr, map->by_addr, key, &ret);
+    if (ret == -1)
+        return PTLS_ERROR_NO_MEMORY;
+    kh_val(map->by_addr, iter) = conn;
+    return 0;
+}
+
+static int del_by_addr(quicly_conn_map_t *map, ptls_iovec_t cid, struct sockaddr *addr, quicly_conn_t *conn)
+{
+    struct st_quicly_conn_map_addr_key_t key;
+    khiter_t iter;
+
+    if (!build_addr_key(&key, cid, addr))
+        return 0;
+    if ((iter = kh_get(quicly_conn_map_by_addr, map->by_addr, key)) == kh_end(map->by_addr) || kh_val(map->by_addr, iter) != conn)
+        return 0;
+    kh_del(quicly_conn_map_by_addr, map->by_addr, iter);
+    return 1;
+}
+
+int quicly_conn_map_add(quicly_conn_map_t *map, quicly_conn_t *conn)
+{
+    int ret;
+
+    if (uses_cid_encryptor(conn)) {
+        khiter_t iter = kh_put(quicly_conn_map_by_id, map->by_id, build_id_key(quicly_get_master_id(conn)), &ret);
+        if (ret == -1)
+            return PTLS_ERROR_NO_MEMORY;
+        kh_val(map->by_id, iter) = conn;
+    } else {
+        if ((ret = put_by_addr(map, ptls_iovec_init(NULL, 0), quicly_get_peername(conn), conn)) != 0)
+            return ret;
+    }
+    ++map->size;
+
+    if (!quicly_is_client(conn)) {
+        const quicly_cid_t *cid = quicly_get_client_dcid(conn);
+        if ((ret = put_by_addr(map, ptls_iovec_init(cid->cid, cid->len), quicly_get_peername(conn), conn)) != 0) {
+            quicly_conn_map_remove(map, conn);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+void quicly_conn_map_remove(quicly_conn_map_t *map, quicly_conn_t *conn)
+{
+    int found = 0;
+
+    if (uses_cid_encryptor(conn)) {
+        khiter_t iter;
+        if ((iter = kh_get(quicly_conn_map_by_id, map->by_id, build_id_key(quicly_get_master_id(conn)))) != kh_end(map->by_id) &&
+            kh_val(map->by_id, iter) == conn) {
+            kh_del(quicly_conn_map_by_id, map->by_id, iter);
+            found = 1;
+        }
+    } else {
+        found = del_by_addr(map, ptls_iovec_init(NULL, 0), quicly_get_peername(conn), conn);
+    }
+
+    if (!quicly_is_client(conn)) {
+        const quicly_cid_t *cid = quicly_get_client_dcid(conn);
+        del_by_addr(map, ptls_iovec_init(cid->cid, cid->len), quicly_get_peername(conn), conn);
+    }
+
+    if (found)
+        --map->size;
+}
+
+static quicly_conn_t *get_by_addr(quicly_conn_map_t *map, ptls_iovec_t cid, struct sockaddr *addr)
+{
+    struct st_quicly_conn_map_addr_key_t key;
+    khiter_t iter;
+
+    if (!build_addr_key(&key, cid, addr))
+        return NULL;
+    if ((iter = kh_get(quicly_conn_map_by_addr, map->by_addr, key)) == kh_end(map->by_addr))
+        return NULL;
+    return kh_val(map->by_addr, iter);
+}
+
+quicly_conn_t *quicly_conn_map_lookup(quicly_conn_map_t *map, struct sockaddr *dest_addr, struct sockaddr *src_addr,
+                                      quicly_decoded_packet_t *decoded)
+{
+    quicly_conn_t *conn;
+    khiter_t iter;
+
+    /* Initial and 0-RTT packets might carry the CID chosen by the client */
+    if (QUICLY_PACKET_IS_LONG_HEADER(decoded->octets.base[0]) && decoded->cid.dest.might_be_client_generated &&
+        decoded->cid.dest.encrypted.len <= QUICLY_MAX_CID_LEN_V1 &&
+        (conn = get_by_addr(map, decoded->cid.dest.encrypted, src_addr)) != NULL &&
+        quicly_is_destination(conn, dest_addr, src_addr, decoded))
+        return conn;
+
+    /* CIDs issued by us */
+    if (kh_size(map->by_id) != 0 &&
+        (iter = kh_get(quicly_conn_map_by_id, map->by_id, build_id_key(&decoded->cid.dest.plaintext))) != kh_end(map->by_id) &&
+        quicly_is_destination(conn = kh_val(map->by_id, iter), dest_addr, src_addr, decoded))
+        return conn;
+
+    /* zero-length CIDs */
+    if (kh_size(map->by_addr) != 0 && (conn = get_by_addr(map, ptls_iovec_init(NULL, 0), src_addr)) != NULL &&
+        quicly_is_destination(conn, dest_addr, src_addr, decoded))
+        return conn;
+
+    return NULL;
+}
@@ -19,6 +19,7 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
+#include <pthread.h>
 #include <sys/time.h>
 #include "quicly/defaults.h"
 
@@ -28,6 +29,7 @@
 #define DEFAULT_MAX_CRYPTO_BYTES 65536
 #define DEFAULT_INITCWND_PACKETS 10
 #define DEFAULT_PRE_VALIDATION_AMPLIFICATION_LIMIT 3
+#define DEFAULT_SENT_BLOCK_POOL_CAPACITY 1024
 
 /* profile that employs IETF specified values */
 const quicly_context_t quicly_spec_context = {NULL,                                                 /* tls */
@@ -55,7 +57,11 @@ const quicly_context_t quicly_spec_context = {NULL,
                                               NULL,
                                               NULL,
                                               &quicly_default_crypto_engine,
-                                              &quicly_default_init_cc};
+                                              &quicly_default_init_cc,
+                                              NULL,
+                                              NULL,
+                                              &quicly_default_allocator,
+                                              QUICLY_CLOCK_RESOLUTION_MSEC};
 
 /* profile with a focus on reducing latency for the HTTP use case */
 const quicly_context_t quicly_performant_context = {NULL,                                                 /* tls */
@@ -83,7 +89,11 @@ const quicly_context_t quicly_performant_context = {NULL,
                                                     NULL,
                                                     NULL,
                                                     &quicly_default_crypto_engine,
-                                                    &quicly_default_init_cc};
+                                                    &quicly_default_init_cc,
+                                                    NULL,
+                                                    NULL,
+                                                    &quicly_default_allocator,
+                                                    QUICLY_CLOCK_RESOLUTION_MSEC};
 
 /**
  * The context of the default CID encryptor.  All the contexts being used here are ECB ciphers and therefore stateless - they can be
@@ -143,12 +153,26 @@ static void default_encrypt_cid(quicly_cid_encryptor_t *_self, quicly_cid_t *enc
         generate_reset_token(self, reset_token, encrypted->cid);
 }
 
+static void decode_cid_plaintext(quicly_cid_plaintext_t *plaintext, const uint8_t *ptbuf, size_t len)
+{
+    const uint8_t *p = ptbuf;
+
+    if (len == 16) {
+        plaintext->node_id = quicly_decode64(&p);
+    } else {
+        plaintext->node_id = 0;
+    }
+    plaintext->master_id = quicly_decode32(&p);
+    plaintext->thread_id = quicly_decode24(&p);
+    plaintext->path_id = *p++;
+    assert(p - ptbuf == len);
+}
+
 static size_t default_decrypt_cid(quicly_cid_encryptor_t *_self, quicly_cid_plaintext_t *plaintext, const void *encrypted,
                                   size_t len)
 {
     struct st_quicly_default_encrypt_cid_t *self = (void *)_self;
     uint8_t ptbuf[16];
-    const uint8_t *p;
 
     if (len != 0) {
         /* long header packet; decrypt only if given Connection ID matches the expected size */
@@ -162,17 +186,28 @@ static size_t default_decrypt_cid(quicly_cid_encryptor_t *_self, quicly_cid_plai
     /* decrypt */
     ptls_cipher_encrypt(self->cid_decrypt_ctx, ptbuf, encrypted, len);
 
-    /* decode */
-    p = ptbuf;
-    if (len == 16) {
-        plaintext->node_id = quicly_decode64(&p);
-    } else {
-        plaintext->node_id = 0;
+    decode_cid_plaintext(plaintext, ptbuf, len);
+    return len;
+}
+
+static size_t default_decrypt_cid_batch(quicly_cid_encryptor_t *_self, quicly_cid_plaintext_t *plaintexts,
+                                        const void *const *encrypted, size_t num_cids)
+{
+    struct st_quicly_default_encrypt_cid_t *self = (void *)_self;
+    size_t len = self->cid_decrypt_ctx->algo->block_size;
+    uint8_t buf[16 * 16];
+
+    /* Decrypt the CIDs by chunks, each chunk being transformed by one call to the ECB cipher so that the backend can process
+     * multiple blocks in parallel. */
+    for (size_t i = 0; i < num_cids;) {
+        size_t chunk_size = num_cids - i < sizeof(buf) / len ? num_cids - i : sizeof(buf) / len;
+        for (size_t j = 0; j != chunk_size; ++j)
+            memcpy(buf + j * len, encrypted[i + j], len);
+        ptls_cipher_encrypt(self->cid_decrypt_ctx, buf, buf, chunk_size * len);
+        for (size_t j = 0; j != chunk_size; ++j)
+            decode_cid_plaintext(plaintexts + i + j, buf + j * len, len);
+        i += chunk_size;
     }
-    plaintext->master_id = quicly_decode32(&p);
-    plaintext->thread_id = quicly_decode24(&p);
-    plaintext->path_id = *p++;
-    assert(p - ptbuf == len);
 
     return len;
 }
@@ -201,7 +236,8 @@ quicly_cid_encryptor_t *quicly_new_default_cid_encryptor(ptls_cipher_algorithm_t
 
     if ((self = malloc(sizeof(*self))) == NULL)
         goto Fail;
-    *self = (struct st_quicly_default_encrypt_cid_t){{default_encrypt_cid, default_decrypt_cid, default_generate_reset_token}};
+    *self = (struct st_quicly_default_encrypt_cid_t){
+        {default_encrypt_cid, default_decrypt_cid, default_generate_reset_token, default_decrypt_cid_batch}};
 
     if (ptls_hkdf_expand_label(hash, keybuf, cid_cipher->key_size, key, "cid", ptls_iovec_init(NULL, 0), "") != 0)
         goto Fail;
@@ -346,14 +382,247 @@ static int default_stream_scheduler_update_state(quicly_stream_scheduler_t *self
 quicly_stream_scheduler_t quicly_default_stream_scheduler = {default_stream_scheduler_can_send, default_stream_scheduler_do_send,
                                                              default_stream_scheduler_update_state};
 
+static quicly_stream_t *get_pending_stream(quicly_linklist_t *link)
+{
+    return (void *)((char *)link - offsetof(quicly_stream_t, _send_aux.pending_link.default_scheduler));
+}
+
+static void priority_link_stream(struct st_quicly_priority_scheduler_state_t *sched, quicly_stream_t *stream, int conn_is_blocked)
+{
+    quicly_linklist_t *link = &stream->_send_aux.pending_link.default_scheduler;
+
+    if (quicly_linklist_is_linked(link))
+        return;
+
+    if (conn_is_blocked && !quicly_stream_can_send(stream, 0)) {
+        quicly_linklist_insert(sched->blocked.prev, link);
+    } else if (stream->priority.incremental) {
+        quicly_linklist_insert(sched->active[stream->priority.urgency].incremental.prev, link);
+    } else {
+        /* Keep the list sorted by stream ID, scanning from both ends. The cost is linear to the distance from the closer end; i.e.,
+         * it is O(1) for the common cases of a new stream being activated or of the oldest stream being reactivated, but becomes
+         * O(n) in the number of non-incremental streams sharing the urgency when a stream is inserted in the middle. */
+        quicly_linklist_t *anchor = &sched->active[stream->priority.urgency].non_incremental, *prev = anchor->prev,
+                          *next = anchor->next;
+        while (prev != anchor && get_pending_stream(prev)->stream_id > stream->stream_id) {
+            if (get_pending_stream(next)->stream_id > stream->stream_id) {
+                prev = next->prev;
+                break;
+            }
+            prev = prev->prev;
+            next = next->next;
+        }
+        quicly_linklist_insert(prev, link);
+    }
+}
+
+static void priority_unblock_streams(struct st_quicly_priority_scheduler_state_t *sched)
+{
+    while (quicly_linklist_is_linked(&sched->blocked)) {
+        quicly_stream_t *stream = get_pending_stream(sched->blocked.next);
+        quicly_linklist_unlink(&stream->_send_aux.pending_link.default_scheduler);
+        priority_link_stream(sched, stream, 0);
+    }
+}
+
+/**
+ * Returns the link of the stream that should be served next, or NULL if there is none. Among the streams that share the most urgent
+ * level, non-incremental streams are served one by one in the order of stream IDs before the incremental streams are served in
+ * round-robin.
+ */
+static quicly_linklist_t *priority_get_next(struct st_quicly_priority_scheduler_state_t *sched)
+{
+    for (size_t i = 0; i < QUICLY_PRIORITY_NUM_URGENCIES; ++i) {
+        if (quicly_linklist_is_linked(&sched->active[i].non_incremental))
+            return sched->active[i].non_incremental.next;
+        if (quicly_linklist_is_linked(&sched->active[i].incremental))
+            return sched->active[i].incremental.next;
+    }
+    return NULL;
+}
+
+static int priority_stream_scheduler_can_send(quicly_stream_scheduler_t *self, quicly_conn_t *conn, int conn_is_saturated)
+{
+    struct st_quicly_priority_scheduler_state_t *sched = &((struct _st_quicly_conn_public_t *)conn)->_priority_scheduler;
+
+    /* like the default scheduler, streams are moved to `blocked` only by `do_send` */
+    if (!conn_is_saturated)
+        priority_unblock_streams(sched);
+
+    return priority_get_next(sched) != NULL;
+}
+
+static int priority_stream_scheduler_do_send(quicly_stream_scheduler_t *self, quicly_conn_t *conn, quicly_send_context_t *s)
+{
+    struct st_quicly_priority_scheduler_state_t *sched = &((struct _st_quicly_conn_public_t *)conn)->_priority_scheduler;
+    int conn_is_blocked = quicly_is_blocked(conn), ret = 0;
+    quicly_linklist_t *link;
+
+    if (!conn_is_blocked)
+        priority_unblock_streams(sched);
+
+    while (quicly_can_send_data((quicly_conn_t *)conn, s) && (link = priority_get_next(sched)) != NULL) {
+        quicly_stream_t *stream = get_pending_stream(link);
+        /* move the stream to the blocked list if necessary */
+        if (conn_is_blocked && !quicly_stream_can_send(stream, 0)) {
+            quicly_linklist_unlink(link);
+            quicly_linklist_insert(sched->blocked.prev, link);
+            continue;
+        }
+        /* send, while the stream is kept linked so that a non-incremental stream retains its position */
+        if ((ret = quicly_send_stream(stream, s)) != 0) {
+            /* FIXME see the comment in `default_stream_scheduler_do_send` */
+            if (ret == QUICLY_ERROR_SENDBUF_FULL)
+                assert(quicly_stream_can_send(stream, 1));
+            break;
+        }
+        /* reschedule; incremental streams are moved to the tail */
+        conn_is_blocked = quicly_is_blocked(conn);
+        if (!quicly_stream_can_send(stream, 1)) {
+            quicly_linklist_unlink(link);
+        } else if (stream->priority.incremental) {
+            quicly_linklist_unlink(link);
+            priority_link_stream(sched, stream, conn_is_blocked);
+        }
+    }
+
+    return ret;
+}
+
+static int priority_stream_scheduler_update_state(quicly_stream_scheduler_t *self, quicly_stream_t *stream)
+{
+    struct st_quicly_priority_scheduler_state_t *sched = &((struct _st_quicly_conn_public_t *)stream->conn)->_priority_scheduler;
+
+    if (quicly_stream_can_send(stream, 1)) {
+        priority_link_stream(sched, stream, quicly_is_blocked(stream->conn));
+    } else if (quicly_linklist_is_linked(&stream->_send_aux.pending_link.default_scheduler)) {
+        quicly_linklist_unlink(&stream->_send_aux.pending_link.default_scheduler);
+    }
+
+    return 0;
+}
+
+quicly_stream_scheduler_t quicly_priority_stream_scheduler = {priority_stream_scheduler_can_send, priority_stream_scheduler_do_send,
+                                                              priority_stream_scheduler_update_state};
+
+static void drr_link_stream(struct st_quicly_drr_scheduler_state_t *sched, quicly_stream_t *stream, int conn_is_blocked)
+{
+    quicly_linklist_t *link = &stream->_send_aux.pending_link.default_scheduler;
+
+    if (quicly_linklist_is_linked(link))
+        return;
+
+    if (conn_is_blocked && !quicly_stream_can_send(stream, 0)) {
+        quicly_linklist_insert(sched->blocked.prev, link);
+    } else {
+        quicly_linklist_insert(sched->active.prev, link);
+    }
+}
+
+static void drr_unlink_idle_stream(quicly_stream_t *stream)
+{
+    quicly_linklist_unlink(&stream->_send_aux.pending_link.default_scheduler);
+    /* as is the case with DRR, streams do not carry the deficit (or the surplus) across idle periods */
+    stream->_send_aux.drr_deficit = 0;
+}
+
+static void drr_unblock_streams(struct st_quicly_drr_scheduler_state_t *sched)
+{
+    while (quicly_linklist_is_linked(&sched->blocked)) {
+        quicly_stream_t *stream = get_pending_stream(sched->blocked.next);
+        quicly_linklist_unlink(&stream->_send_aux.pending_link.default_scheduler);
+        drr_link_stream(sched, stream, 0);
+    }
+}
+
+static int drr_stream_scheduler_can_send(quicly_stream_scheduler_t *self, quicly_conn_t *conn, int conn_is_saturated)
+{
+    struct st_quicly_drr_scheduler_state_t *sched = &((struct _st_quicly_conn_public_t *)conn)->_drr_scheduler;
+
+    if (!conn_is_saturated)
+        drr_unblock_streams(sched);
+
+    return quicly_linklist_is_linked(&sched->active);
+}
+
+/**
+ * Deficit round robin. Each time a stream is given the turn, `drr_quantum` is added to its deficit, and the stream keeps on sending
+ * until the deficit is exhausted. As the size of the STREAM frame is not known until it is built, a stream might overshoot; the
+ * excess is carried as a negative deficit and is paid back in the following rounds.
+ */
+static int drr_stream_scheduler_do_send(quicly_stream_scheduler_t *self, quicly_conn_t *conn, quicly_send_context_t *s)
+{
+    struct st_quicly_drr_scheduler_state_t *sched = &((struct _st_quicly_conn_public_t *)conn)->_drr_scheduler;
+    const uint64_t *bytes_sent = &((struct _st_quicly_conn_public_t *)conn)->stats.num_bytes.stream_data_sent;
+    int conn_is_blocked = quicly_is_blocked(conn), ret = 0;
+
+    if (!conn_is_blocked)
+        drr_unblock_streams(sched);
+
+    while (quicly_can_send_data((quicly_conn_t *)conn, s) && quicly_linklist_is_linked(&sched->active)) {
+        quicly_linklist_t *link = sched->active.next;
+        quicly_stream_t *stream = get_pending_stream(link);
+        /* move the stream to the blocked list if necessary */
+        if (conn_is_blocked && !quicly_stream_can_send(stream, 0)) {
+            quicly_linklist_unlink(link);
+            quicly_linklist_insert(sched->blocked.prev, link);
+            continue;
+        }
+        /* start the turn; if the stream is still paying back what it has overshot, the turn is passed to the next stream */
+        if (stream->_send_aux.drr_deficit <= 0) {
+            assert(stream->drr_quantum != 0);
+            if ((stream->_send_aux.drr_deficit += stream->drr_quantum) <= 0) {
+                quicly_linklist_unlink(link);
+                quicly_linklist_insert(sched->active.prev, link);
+                continue;
+            }
+        }
+        /* send, and charge the bytes being sent */
+        uint64_t bytes_sent_before = *bytes_sent;
+        if ((ret = quicly_send_stream(stream, s)) != 0) {
+            /* FIXME see the comment in `default_stream_scheduler_do_send` */
+            if (ret == QUICLY_ERROR_SENDBUF_FULL)
+                assert(quicly_stream_can_send(stream, 1));
+            break;
+        }
+        stream->_send_aux.drr_deficit -= (int64_t)(*bytes_sent - bytes_sent_before);
+        /* reschedule; the stream is moved to the tail when its turn ends */
+        conn_is_blocked = quicly_is_blocked(conn);
+        if (!quicly_stream_can_send(stream, 1)) {
+            drr_unlink_idle_stream(stream);
+        } else if (stream->_send_aux.drr_deficit <= 0) {
+            quicly_linklist_unlink(link);
+            drr_link_stream(sched, stream, conn_is_blocked);
+        }
+    }
+
+    return ret;
+}
+
+static int drr_stream_scheduler_update_state(quicly_stream_scheduler_t *self, quicly_stream_t *stream)
+{
+    struct st_quicly_drr_scheduler_state_t *sched = &((struct _st_quicly_conn_public_t *)stream->conn)->_drr_scheduler;
+
+    if (quicly_stream_can_send(stream, 1)) {
+        drr_link_stream(sched, stream, quicly_is_blocked(stream->conn));
+    } else if (quicly_linklist_is_linked(&stream->_send_aux.pending_link.default_scheduler)) {
+        drr_unlink_idle_stream(stream);
+    }
+
+    return 0;
+}
+
+quicly_stream_scheduler_t quicly_drr_stream_scheduler = {drr_stream_scheduler_can_send, drr_stream_scheduler_do_send,
+                                                         drr_stream_scheduler_update_state};
+
 quicly_stream_t *quicly_default_alloc_stream(quicly_context_t *ctx)
 {
-    return malloc(sizeof(quicly_stream_t));
+    return quicly_allocator_malloc(ctx->allocator, sizeof(quicly_stream_t));
 }
 
 void quicly_default_free_stream(quicly_stream_t *stream)
 {
-    free(stream);
+    quicly_allocator_free(quicly_get_context(stream->conn)->allocator, stream, sizeof(*stream));
 }
 
 static int64_t default_now(quicly_now_t *self)
@@ -371,6 +640,81 @@ static int64_t default_now(quicly_now_t *self)
 
 quicly_now_t quicly_default_now = {default_now};
 
+static int64_t default_now_usec(quicly_now_t *self)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t tv_now = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+
+    /* make sure that the time does not get rewind */
+    static __thread int64_t now;
+    if (now < tv_now)
+        now = tv_now;
+    return now;
+}
+
+quicly_now_t quicly_default_now_usec = {default_now_usec};
+
+static pthread_key_t default_sent_block_pool_key;
+static pthread_once_t default_sent_block_pool_once = PTHREAD_ONCE_INIT;
+
+static void dispose_default_sent_block_pool(void *_pool)
+{
+    quicly_sent_block_pool_t *pool = _pool;
+
+    quicly_sent_block_pool_dispose(pool);
+    /* blocks being released after this point (e.g., by other TSD destructors) are freed immediately */
+    pool->capacity = 0;
+}
+
+static void init_default_sent_block_pool_key(void)
+{
+    pthread_key_create(&default_sent_block_pool_key, dispose_default_sent_block_pool);
+}
+
+static quicly_sent_block_allocator_t *get_default_sent_block_pool(void)
+{
+    static __thread quicly_sent_block_pool_t pool;
+    if (pool.super.alloc == NULL) {
+        quicly_sent_block_pool_init(&pool, DEFAULT_SENT_BLOCK_POOL_CAPACITY, NULL);
+        /* register the pool so that the cached blocks are released when the thread exits */
+        pthread_once(&default_sent_block_pool_once, init_default_sent_block_pool_key);
+        pthread_setspecific(default_sent_block_pool_key, &pool);
+    }
+    return &pool.super;
+}
+
+static struct st_quicly_sent_block_t *default_sent_block_alloc(quicly_sent_block_allocator_t *self)
+{
+    quicly_sent_block_allocator_t *pool = get_default_sent_block_pool();
+    return pool->alloc(pool);
+}
+
+static void default_sent_block_free(quicly_sent_block_allocator_t *self, struct st_quicly_sent_block_t *block)
+{
+    quicly_sent_block_allocator_t *pool = get_default_sent_block_pool();
+    pool->free(pool, block);
+}
+
+quicly_sent_block_allocator_t quicly_default_sent_block_allocator = {default_sent_block_alloc, default_sent_block_free};
+
+static void *default_alloc(quicly_allocator_t *self, size_t size)
+{
+    return malloc(size);
+}
+
+static void *default_realloc(quicly_allocator_t *self, void *p, size_t old_size, size_t new_size)
+{
+    return realloc(p, new_size);
+}
+
+static void default_free(quicly_allocator_t *self, void *p, size_t size)
+{
+    free(p);
+}
+
+quicly_allocator_t quicly_default_allocator = {default_alloc, default_realloc, default_free};
+
 static int default_setup_cipher(quicly_crypto_engine_t *engine, quicly_conn_t *conn, size_t epoch, int is_enc,
                                 ptls_cipher_context_t **hp_ctx, ptls_aead_context_t **aead_ctx, ptls_aead_algorithm_t *aead,
                                 ptls_hash_algorithm_t *hash, const void *secret)
@@ -415,6 +759,13 @@ Exit:
     return ret;
 }
 
+static void apply_header_protection(ptls_iovec_t datagram, size_t first_byte_at, size_t payload_from, const uint8_t *mask)
+{
+    datagram.base[first_byte_at] ^= mask[0] & (QUICLY_PACKET_IS_LONG_HEADER(datagram.base[first_byte_at]) ? 0xf : 0x1f);
+    for (size_t i = 0; i != QUICLY_SEND_PN_SIZE; ++i)
+        datagram.base[payload_from + i - QUICLY_SEND_PN_SIZE] ^= mask[i + 1];
+}
+
 static void default_finalize_send_packet(quicly_crypto_engine_t *engine, quicly_conn_t *conn,
                                          ptls_cipher_context_t *header_protect_ctx, ptls_aead_context_t *packet_protect_ctx,
                                          ptls_iovec_t datagram, size_t first_byte_at, size_t payload_from, uint64_t packet_number,
@@ -427,9 +778,61 @@ static void default_finalize_send_packet(quicly_crypto_engine_t *engine, quicly_
                         datagram.len - payload_from - packet_protect_ctx->algo->tag_size, packet_number,
                         datagram.base + first_byte_at, payload_from - first_byte_at, &supp);
 
-    datagram.base[first_byte_at] ^= supp.output[0] & (QUICLY_PACKET_IS_LONG_HEADER(datagram.base[first_byte_at]) ? 0xf : 0x1f);
-    for (size_t i = 0; i != QUICLY_SEND_PN_SIZE; ++i)
-        datagram.base[payload_from + i - QUICLY_SEND_PN_SIZE] ^= supp.output[i + 1];
+    apply_header_protection(datagram, first_byte_at, payload_from, supp.output);
+}
+
+static void default_finalize_send_packet_gather(quicly_crypto_engine_t *engine, quicly_conn_t *conn,
+                                                ptls_cipher_context_t *header_protect_ctx, ptls_aead_context_t *packet_protect_ctx,
+                                                ptls_iovec_t datagram, size_t first_byte_at, size_t payload_from,
+                                                uint64_t packet_number, int coalesced, const quicly_payload_gather_t *gathers,
+                                                size_t num_gathers)
+{
+    /* AEADs that do not support incremental encryption (e.g., fusion) encrypt in-place after the payload is copied */
+    if (packet_protect_ctx->do_encrypt_update == NULL) {
+        for (size_t i = 0; i != num_gathers; ++i)
+            memcpy(datagram.base + gathers[i].dst_off, gathers[i].src.base, gathers[i].src.len);
+        default_finalize_send_packet(engine, conn, header_protect_ctx, packet_protect_ctx, datagram, first_byte_at, payload_from,
+                                     packet_number, coalesced);
+        return;
+    }
+
+    /* Encrypt the payload, reading the regions specified by `gathers` from the source and the rest from the datagram buffer. As
+     * the output never goes ahead of the input, the ciphertext can be written to the datagram buffer as we go. */
+    size_t payload_end = datagram.len - packet_protect_ctx->algo->tag_size, in_off = payload_from;
+    uint8_t *out = datagram.base + payload_from;
+    ptls_aead_encrypt_init(packet_protect_ctx, packet_number, datagram.base + first_byte_at, payload_from - first_byte_at);
+    for (size_t i = 0; i != num_gathers; ++i) {
+        assert(in_off <= gathers[i].dst_off);
+        out += ptls_aead_encrypt_update(packet_protect_ctx, out, datagram.base + in_off, gathers[i].dst_off - in_off);
+        out += ptls_aead_encrypt_update(packet_protect_ctx, out, gathers[i].src.base, gathers[i].src.len);
+        in_off = gathers[i].dst_off + gathers[i].src.len;
+    }
+    assert(in_off <= payload_end);
+    out += ptls_aead_encrypt_update(packet_protect_ctx, out, datagram.base + in_off, payload_end - in_off);
+    out += ptls_aead_encrypt_final(packet_protect_ctx, out);
+    assert(out == datagram.base + datagram.len);
+
+    /* apply header protection, using the ciphertext as the sample */
+    uint8_t mask[16] = {0};
+    ptls_cipher_init(header_protect_ctx, datagram.base + payload_from - QUICLY_SEND_PN_SIZE + QUICLY_MAX_PN_SIZE);
+    ptls_cipher_encrypt(header_protect_ctx, mask, mask, sizeof(mask));
+    apply_header_protection(datagram, first_byte_at, payload_from, mask);
+}
+
+static void default_finalize_send_packets(quicly_crypto_engine_t *engine, quicly_conn_t *conn,
+                                          ptls_cipher_context_t *header_protect_ctx, ptls_aead_context_t *packet_protect_ctx,
+                                          const quicly_deferred_packet_t *packets, size_t num_packets)
+{
+    /* Packets are encrypted back-to-back, keeping the keys hot in cache. Header protection is applied as part of each AEAD
+     * operation, so that backends capable of doing so (e.g., fusion) can calculate the mask within the AES pipeline. */
+    for (size_t i = 0; i != num_packets; ++i)
+        default_finalize_send_packet(engine, conn, header_protect_ctx, packet_protect_ctx, packets[i].datagram,
+                                     packets[i].first_byte_at, packets[i].payload_from, packets[i].packet_number,
+                                     packets[i].coalesced);
 }
 
-quicly_crypto_engine_t quicly_default_crypto_engine = {default_setup_cipher, default_finalize_send_packet};
+quicly_crypto_engine_t quicly_default_crypto_engine = {default_setup_cipher, default_finalize_send_packet,
+                                                        default_finalize_send_packet_gather};
+
+quicly_crypto_engine_t quicly_default_batch_crypto_engine = {default_setup_cipher, default_finalize_send_packet,
+                                                              default_finalize_send_packet_gather, default_finalize_send_packets};
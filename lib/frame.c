@@ -31,7 +31,7 @@ uint8_t *quicly_encode_path_challenge_frame(uint8_t *dst, int is_response, const
     return dst;
 }
 
-uint8_t *quicly_encode_ack_frame(uint8_t *dst, uint8_t *dst_end, quicly_ranges_t *ranges, uint64_t ack_delay)
+uint8_t *quicly_encode_ack_frame(uint8_t *dst, uint8_t *dst_end, quicly_ranges_t *ranges, uint64_t *ecn_counts, uint64_t ack_delay)
 {
 #define WRITE_BLOCK(start, end)                                                                                                    \
     do {                                                                                                                           \
@@ -47,7 +47,7 @@ uint8_t *quicly_encode_ack_frame(uint8_t *dst, uint8_t *dst_end, quicly_ranges_t
     assert(ranges->num_ranges != 0);
 
     /* number of bytes being emitted without space check are 1 + 8 + 8 + 1 bytes (as defined in QUICLY_ACK_FRAME_CAPACITY) */
-    *dst++ = QUICLY_FRAME_TYPE_ACK;
+    *dst++ = ecn_counts == NULL ? QUICLY_FRAME_TYPE_ACK : QUICLY_FRAME_TYPE_ACK_ECN;
     dst = quicly_encodev(dst, ranges->ranges[range_index].end - 1); /* largest acknowledged */
     dst = quicly_encodev(dst, ack_delay);                           /* ack delay */
     PTLS_BUILD_ASSERT(QUICLY_MAX_ACK_BLOCKS - 1 <= 63);
@@ -60,6 +60,13 @@ uint8_t *quicly_encode_ack_frame(uint8_t *dst, uint8_t *dst_end, quicly_ranges_t
         WRITE_BLOCK(ranges->ranges[range_index].end, ranges->ranges[range_index + 1].start);
     }
 
+    if (ecn_counts != NULL) {
+        if (dst_end - dst < QUICLY_NUM_ECN_CODEPOINTS * 8)
+            return NULL;
+        for (size_t i = 0; i < QUICLY_NUM_ECN_CODEPOINTS; ++i)
+            dst = quicly_encodev(dst, ecn_counts[i]);
+    }
+
     return dst;
 
 #undef WRITE_BLOCK
@@ -100,10 +107,12 @@ int quicly_decode_ack_frame(const uint8_t **src, const uint8_t *end, quicly_ack_
     }
 
     if (is_ack_ecn) {
-        /* just skip ECT(0), ECT(1), ECT-CE counters for the time being */
-        for (i = 0; i != 3; ++i)
-            if (quicly_decodev(src, end) == UINT64_MAX)
+        for (i = 0; i != QUICLY_NUM_ECN_CODEPOINTS; ++i)
+            if ((frame->ecn_counts[i] = quicly_decodev(src, end)) == UINT64_MAX)
                 goto Error;
+    } else {
+        for (i = 0; i != QUICLY_NUM_ECN_CODEPOINTS; ++i)
+            frame->ecn_counts[i] = 0;
     }
     return 0;
 Error:
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "quicly/cc.h"
+#include "quicly/hystart.h"
+
+static void start_round(quicly_hystart_t *hystart, uint64_t next_pn)
+{
+    hystart->last_round_min_rtt = hystart->current_round_min_rtt;
+    hystart->current_round_min_rtt = UINT32_MAX;
+    hystart->rtt_sample_count = 0;
+    hystart->window_end = next_pn;
+}
+
+void quicly_hystart_init(quicly_hystart_t *hystart)
+{
+    *hystart = (quicly_hystart_t){
+        .phase = QUICLY_HYSTART_SLOW_START,
+        .current_round_min_rtt = UINT32_MAX,
+        .last_round_min_rtt = UINT32_MAX,
+        .css_baseline_min_rtt = UINT32_MAX,
+    };
+}
+
+uint32_t quicly_hystart_on_acked(quicly_hystart_t *hystart, uint32_t bytes, uint64_t largest_acked, uint64_t next_pn,
+                                 uint32_t latest_rtt, uint32_t clock_resolution, uint32_t max_udp_payload_size)
+{
+    assert(hystart->phase == QUICLY_HYSTART_SLOW_START || hystart->phase == QUICLY_HYSTART_CSS);
+
+    /* start a new round when all the packets sent in the current round are acknowledged */
+    if (largest_acked >= hystart->window_end) {
+        if (hystart->phase == QUICLY_HYSTART_CSS && ++hystart->css_rounds >= QUICLY_HYSTART_CSS_ROUNDS) {
+            hystart->phase = QUICLY_HYSTART_DONE;
+            return 0;
+        }
+        start_round(hystart, next_pn);
+    }
+
+    /* update the minimum RTT of the round */
+    if (latest_rtt < hystart->current_round_min_rtt)
+        hystart->current_round_min_rtt = latest_rtt;
+    ++hystart->rtt_sample_count;
+
+    /* check if the phase has to be changed */
+    if (hystart->rtt_sample_count >= QUICLY_HYSTART_N_RTT_SAMPLE) {
+        switch (hystart->phase) {
+        case QUICLY_HYSTART_SLOW_START:
+            if (hystart->last_round_min_rtt != UINT32_MAX) {
+                uint32_t thresh = hystart->last_round_min_rtt / QUICLY_HYSTART_MIN_RTT_DIVISOR;
+                if (thresh < QUICLY_HYSTART_MIN_RTT_THRESH * clock_resolution) {
+                    thresh = QUICLY_HYSTART_MIN_RTT_THRESH * clock_resolution;
+                } else if (thresh > QUICLY_HYSTART_MAX_RTT_THRESH * clock_resolution) {
+                    thresh = QUICLY_HYSTART_MAX_RTT_THRESH * clock_resolution;
+                }
+                if (hystart->current_round_min_rtt >= hystart->last_round_min_rtt + thresh) {
+                    hystart->phase = QUICLY_HYSTART_CSS;
+                    hystart->css_rounds = 0;
+                    hystart->css_baseline_min_rtt = hystart->current_round_min_rtt;
+                }
+            }
+            break;
+        case QUICLY_HYSTART_CSS:
+            /* the increase of RTT was spurious; resume standard slow start */
+            if (hystart->current_round_min_rtt < hystart->css_baseline_min_rtt) {
+                hystart->phase = QUICLY_HYSTART_SLOW_START;
+                hystart->css_baseline_min_rtt = UINT32_MAX;
+            }
+            break;
+        }
+    }
+
+    /* calculate the increase */
+    if (bytes > QUICLY_HYSTART_L * max_udp_payload_size)
+        bytes = QUICLY_HYSTART_L * max_udp_payload_size;
+    if (hystart->phase == QUICLY_HYSTART_CSS)
+        bytes /= QUICLY_HYSTART_CSS_GROWTH_DIVISOR;
+    return bytes;
+}
+
+int quicly_cc_hystart_on_acked(quicly_cc_t *cc, const quicly_loss_t *loss, uint32_t *bytes, uint64_t largest_acked,
+                               uint64_t next_pn, uint32_t max_udp_payload_size)
+{
+    if (cc->hystart.phase == QUICLY_HYSTART_DISABLED)
+        return 0;
+
+    /* HyStart++ can be done (e.g., when the CC is switched), while CWND is still below ssthresh */
+    if (cc->hystart.phase != QUICLY_HYSTART_DONE) {
+        *bytes = quicly_hystart_on_acked(&cc->hystart, *bytes, largest_acked, next_pn, loss->rtt.latest, loss->clock_resolution,
+                                         max_udp_payload_size);
+        if (cc->hystart.phase != QUICLY_HYSTART_DONE)
+            return 0;
+    }
+
+    /* exit slow start, entering congestion avoidance without reducing CWND */
+    cc->ssthresh = cc->cwnd;
+    if (cc->cwnd_exiting_slow_start == 0)
+        cc->cwnd_exiting_slow_start = cc->cwnd;
+    return 1;
+}
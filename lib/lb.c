@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include "quicly/frame.h"
+#include "quicly/lb.h"
+
+static void four_pass_split(const quicly_lb_codec_t *codec, uint8_t *left, uint8_t *right, const uint8_t *src)
+{
+    size_t plaintext_len = codec->config.server_id_len + codec->config.nonce_len, half_len = (plaintext_len + 1) / 2;
+
+    memcpy(left, src, half_len);
+    memcpy(right, src + plaintext_len - half_len, half_len);
+    if (plaintext_len % 2 != 0) {
+        left[half_len - 1] &= 0xf0;
+        right[0] &= 0x0f;
+    }
+}
+
+static void four_pass_merge(const quicly_lb_codec_t *codec, uint8_t *dst, const uint8_t *left, const uint8_t *right)
+{
+    size_t plaintext_len = codec->config.server_id_len + codec->config.nonce_len, half_len = (plaintext_len + 1) / 2;
+
+    memcpy(dst, left, half_len);
+    if (plaintext_len % 2 != 0) {
+        dst[half_len - 1] |= right[0];
+        memcpy(dst + half_len, right + 1, half_len - 1);
+    } else {
+        memcpy(dst + half_len, right, half_len);
+    }
+}
+
+/**
+ * Runs one pass of the four-pass encryption; i.e., `dst ^= truncate(AES_ECB(key, expand(src, pass)))`, where `to_left` designates
+ * if `dst` is the left half. Expansion places the half at the beginning of the block, followed by zeros, the plaintext length, and
+ * the pass index. Truncation takes the first `half_len` bytes of the block, clearing the nibble that does not belong to `dst` when
+ * the length is odd.
+ */
+static void four_pass_round(const quicly_lb_codec_t *codec, uint8_t *dst, const uint8_t *src, uint8_t pass, int to_left)
+{
+    size_t plaintext_len = codec->config.server_id_len + codec->config.nonce_len, half_len = (plaintext_len + 1) / 2;
+    uint8_t block[16] = {0};
+
+    /* expand */
+    memcpy(block, src, half_len);
+    block[14] = (uint8_t)plaintext_len;
+    block[15] = pass;
+
+    ptls_cipher_encrypt(codec->ecb_encrypt, block, block, sizeof(block));
+
+    /* truncate and apply */
+    if (plaintext_len % 2 != 0) {
+        if (to_left) {
+            block[half_len - 1] &= 0xf0;
+        } else {
+            block[0] &= 0x0f;
+        }
+    }
+    for (size_t i = 0; i < half_len; ++i)
+        dst[i] ^= block[i];
+}
+
+int quicly_lb_codec_init(quicly_lb_codec_t *codec, const quicly_lb_config_t *config, ptls_cipher_algorithm_t *cipher,
+                         const void *key)
+{
+    size_t plaintext_len = config->server_id_len + config->nonce_len;
+
+    assert(config->config_id < QUICLY_LB_CONFIG_ID_UNROUTABLE);
+    assert(1 <= config->server_id_len && config->server_id_len <= QUICLY_LB_MAX_SERVER_ID_LEN);
+    assert(config->nonce_len >= QUICLY_LB_MIN_NONCE_LEN);
+    assert(1 + plaintext_len <= QUICLY_MAX_CID_LEN_V1);
+
+    *codec = (quicly_lb_codec_t){.config = *config};
+
+    if (cipher != NULL) {
+        assert(cipher->block_size == 16 && cipher->key_size == 16);
+        assert(plaintext_len <= 16);
+        if ((codec->ecb_encrypt = ptls_cipher_new(cipher, 1, key)) == NULL)
+            goto Fail;
+        if (plaintext_len == 16 && (codec->ecb_decrypt = ptls_cipher_new(cipher, 0, key)) == NULL)
+            goto Fail;
+    }
+
+    return 0;
+Fail:
+    quicly_lb_codec_dispose(codec);
+    return PTLS_ERROR_NO_MEMORY;
+}
+
+void quicly_lb_codec_dispose(quicly_lb_codec_t *codec)
+{
+    if (codec->ecb_encrypt != NULL)
+        ptls_cipher_free(codec->ecb_encrypt);
+    if (codec->ecb_decrypt != NULL)
+        ptls_cipher_free(codec->ecb_decrypt);
+    codec->ecb_encrypt = NULL;
+    codec->ecb_decrypt = NULL;
+}
+
+void quicly_lb_encrypt(quicly_lb_codec_t *codec, uint8_t *cid, const uint8_t *server_id, const uint8_t *nonce)
+{
+    size_t plaintext_len = codec->config.server_id_len + codec->config.nonce_len;
+    uint8_t plaintext[QUICLY_MAX_CID_LEN_V1];
+
+    /* first octet; low bits are either the length or zero, as they are not used for conveying entropy */
+    cid[0] = codec->config.config_id << 5;
+    if (codec->config.self_encode_length)
+        cid[0] |= (uint8_t)plaintext_len; /* CID length minus one */
+
+    memcpy(plaintext, server_id, codec->config.server_id_len);
+    memcpy(plaintext + codec->config.server_id_len, nonce, codec->config.nonce_len);
+
+    if (codec->ecb_encrypt == NULL) {
+        /* plaintext mode */
+        memcpy(cid + 1, plaintext, plaintext_len);
+    } else if (plaintext_len == 16) {
+        /* single-pass mode */
+        ptls_cipher_encrypt(codec->ecb_encrypt, cid + 1, plaintext, plaintext_len);
+    } else {
+        /* four-pass mode */
+        uint8_t left[8], right[8];
+        four_pass_split(codec, left, right, plaintext);
+        four_pass_round(codec, right, left, 1, 0);
+        four_pass_round(codec, left, right, 2, 1);
+        four_pass_round(codec, right, left, 3, 0);
+        four_pass_round(codec, left, right, 4, 1);
+        four_pass_merge(codec, cid + 1, left, right);
+    }
+}
+
+size_t quicly_lb_decrypt(quicly_lb_codec_t *codec, uint8_t *server_id, uint8_t *nonce, const uint8_t *cid, size_t len)
+{
+    size_t plaintext_len = codec->config.server_id_len + codec->config.nonce_len;
+    uint8_t plaintext[QUICLY_MAX_CID_LEN_V1];
+
+    /* check length and the first octet */
+    if (len != 0 && len != 1 + plaintext_len)
+        return SIZE_MAX;
+    if (quicly_lb_get_config_id(cid) != codec->config.config_id)
+        return SIZE_MAX;
+    if (codec->config.self_encode_length && (cid[0] & 0x1f) != plaintext_len)
+        return SIZE_MAX;
+
+    if (codec->ecb_encrypt == NULL) {
+        /* plaintext mode */
+        memcpy(plaintext, cid + 1, plaintext_len);
+    } else if (plaintext_len == 16) {
+        /* single-pass mode */
+        ptls_cipher_encrypt(codec->ecb_decrypt, plaintext, cid + 1, plaintext_len);
+    } else {
+        /* four-pass mode; the last pass recovers the right half, which can be skipped if the server ID is entirely in the left half
+         * and the nonce is not needed */
+        uint8_t left[8], right[8];
+        four_pass_split(codec, left, right, cid + 1);
+        four_pass_round(codec, left, right, 4, 1);
+        four_pass_round(codec, right, left, 3, 0);
+        four_pass_round(codec, left, right, 2, 1);
+        if (nonce == NULL && codec->config.server_id_len <= plaintext_len / 2) {
+            memcpy(server_id, left, codec->config.server_id_len);
+            return 1 + plaintext_len;
+        }
+        four_pass_round(codec, right, left, 1, 0);
+        four_pass_merge(codec, plaintext, left, right);
+    }
+
+    memcpy(server_id, plaintext, codec->config.server_id_len);
+    if (nonce != NULL)
+        memcpy(nonce, plaintext + codec->config.server_id_len, codec->config.nonce_len);
+    return 1 + plaintext_len;
+}
+
+struct st_quicly_lb_encrypt_cid_t {
+    quicly_cid_encryptor_t super;
+    quicly_lb_codec_t codec;
+    ptls_cipher_context_t *reset_token_ctx;
+};
+
+static void lb_generate_reset_token(struct st_quicly_lb_encrypt_cid_t *self, void *token, const quicly_cid_plaintext_t *plaintext)
+{
+    uint8_t buf[QUICLY_STATELESS_RESET_TOKEN_LEN], *p = buf;
+
+    assert(self->reset_token_ctx->algo->block_size == QUICLY_STATELESS_RESET_TOKEN_LEN);
+
+    /* the CID might be longer than the token, therefore the token is calculated from the plaintext that is unique to each CID */
+    p = quicly_encode64(p, plaintext->node_id);
+    p = quicly_encode32(p, plaintext->master_id);
+    p = quicly_encode32(p, ((uint32_t)plaintext->thread_id << 8) | plaintext->path_id);
+    assert(p - buf == sizeof(buf));
+
+    ptls_cipher_encrypt(self->reset_token_ctx, token, buf, sizeof(buf));
+}
+
+static void lb_encrypt_cid(quicly_cid_encryptor_t *_self, quicly_cid_t *encrypted, void *reset_token,
+                           const quicly_cid_plaintext_t *plaintext)
+{
+    struct st_quicly_lb_encrypt_cid_t *self = (void *)_self;
+    uint8_t server_id[QUICLY_LB_MAX_SERVER_ID_LEN] = {0}, nonce[QUICLY_MAX_CID_LEN_V1] = {0}, *p;
+
+    /* encode node_id to server ID in network byte order */
+    for (size_t i = 0; i < self->codec.config.server_id_len && i < 8; ++i)
+        server_id[self->codec.config.server_id_len - 1 - i] = (uint8_t)(plaintext->node_id >> (i * 8));
+    assert(self->codec.config.server_id_len >= 8 || plaintext->node_id >> (self->codec.config.server_id_len * 8) == 0);
+
+    /* encode the rest to nonce; remaining bytes of the nonce are left zero */
+    p = nonce;
+    p = quicly_encode32(p, plaintext->master_id);
+    p = quicly_encode32(p, ((uint32_t)plaintext->thread_id << 8) | plaintext->path_id);
+
+    /* generate CID */
+    quicly_lb_encrypt(&self->codec, encrypted->cid, server_id, nonce);
+    encrypted->len = (uint8_t)quicly_lb_get_cid_len(&self->codec);
+
+    /* generate stateless reset token if requested */
+    if (reset_token != NULL)
+        lb_generate_reset_token(self, reset_token, plaintext);
+}
+
+static size_t lb_decrypt_cid(quicly_cid_encryptor_t *_self, quicly_cid_plaintext_t *plaintext, const void *encrypted, size_t len)
+{
+    struct st_quicly_lb_encrypt_cid_t *self = (void *)_self;
+    uint8_t server_id[QUICLY_LB_MAX_SERVER_ID_LEN], nonce[QUICLY_MAX_CID_LEN_V1];
+    const uint8_t *p;
+
+    if ((len = quicly_lb_decrypt(&self->codec, server_id, nonce, encrypted, len)) == SIZE_MAX)
+        return SIZE_MAX;
+
+    plaintext->node_id = 0;
+    for (size_t i = 0; i < self->codec.config.server_id_len; ++i)
+        plaintext->node_id = (plaintext->node_id << 8) | server_id[i];
+    p = nonce;
+    plaintext->master_id = quicly_decode32(&p);
+    plaintext->thread_id = quicly_decode24(&p);
+    plaintext->path_id = *p++;
+
+    return len;
+}
+
+static int lb_generate_stateless_reset_token(quicly_cid_encryptor_t *_self, void *token, const void *cid)
+{
+    struct st_quicly_lb_encrypt_cid_t *self = (void *)_self;
+    quicly_cid_plaintext_t plaintext;
+
+    if (lb_decrypt_cid(&self->super, &plaintext, cid, 0) == SIZE_MAX)
+        return 0;
+    lb_generate_reset_token(self, token, &plaintext);
+    return 1;
+}
+
+quicly_cid_encryptor_t *quicly_new_lb_cid_encryptor(const quicly_lb_config_t *config, ptls_cipher_algorithm_t *cipher,
+                                                    const void *key, ptls_cipher_algorithm_t *reset_token_cipher,
+                                                    ptls_hash_algorithm_t *hash, ptls_iovec_t reset_key)
+{
+    struct st_quicly_lb_encrypt_cid_t *self;
+    uint8_t digestbuf[PTLS_MAX_DIGEST_SIZE], keybuf[PTLS_MAX_SECRET_SIZE];
+
+    assert(cipher != NULL);
+    assert(config->nonce_len >= QUICLY_LB_CID_ENCRYPTOR_MIN_NONCE_LEN);
+    assert(reset_token_cipher->block_size == 16);
+
+    if (reset_key.len > hash->block_size) {
+        ptls_calc_hash(hash, digestbuf, reset_key.base, reset_key.len);
+        reset_key = ptls_iovec_init(digestbuf, hash->digest_size);
+    }
+
+    if ((self = malloc(sizeof(*self))) == NULL)
+        goto Fail;
+    *self = (struct st_quicly_lb_encrypt_cid_t){{lb_encrypt_cid, lb_decrypt_cid, lb_generate_stateless_reset_token}};
+
+    if (quicly_lb_codec_init(&self->codec, config, cipher, key) != 0)
+        goto Fail;
+    if (ptls_hkdf_expand_label(hash, keybuf, reset_token_cipher->key_size, reset_key, "reset", ptls_iovec_init(NULL, 0), "") != 0)
+        goto Fail;
+    if ((self->reset_token_ctx = ptls_cipher_new(reset_token_cipher, 1, keybuf)) == NULL)
+        goto Fail;
+
+    ptls_clear_memory(digestbuf, sizeof(digestbuf));
+    ptls_clear_memory(keybuf, sizeof(keybuf));
+    return &self->super;
+
+Fail:
+    if (self != NULL) {
+        quicly_lb_codec_dispose(&self->codec);
+        if (self->reset_token_ctx != NULL)
+            ptls_cipher_free(self->reset_token_ctx);
+        free(self);
+    }
+    ptls_clear_memory(digestbuf, sizeof(digestbuf));
+    ptls_clear_memory(keybuf, sizeof(keybuf));
+    return NULL;
+}
+
+void quicly_free_lb_cid_encryptor(quicly_cid_encryptor_t *_self)
+{
+    struct st_quicly_lb_encrypt_cid_t *self = (void *)_self;
+
+    quicly_lb_codec_dispose(&self->codec);
+    ptls_cipher_free(self->reset_token_ctx);
+    free(self);
+}
@@ -48,7 +48,10 @@ int quicly_loss_detect_loss(quicly_loss_t *loss, int64_t now, uint32_t max_ack_d
     /* This function ensures that the value returned in loss_time is when the next application timer should be set for loss
      * detection. if no timer is required, loss_time is set to INT64_MAX. */
 
-    const uint32_t delay_until_lost = ((loss->rtt.latest > loss->rtt.smoothed ? loss->rtt.latest : loss->rtt.smoothed) * 9 + 7) / 8;
+    const uint32_t rtt = loss->rtt.latest > loss->rtt.smoothed ? loss->rtt.latest : loss->rtt.smoothed;
+    const uint32_t delay_until_lost =
+        (uint32_t)(((uint64_t)rtt * (1024 + loss->reordering_threshold.time_percentile) + 1023) / 1024);
+    const uint32_t packet_threshold = loss->reordering_threshold.packets;
     quicly_sentmap_iter_t iter;
     const quicly_sent_packet_t *sent;
     int ret;
@@ -57,6 +60,8 @@ int quicly_loss_detect_loss(quicly_loss_t *loss, int64_t now, uint32_t max_ack_d
 
     if ((ret = quicly_loss_init_sentmap_iter(loss, &iter, now, max_ack_delay, 0)) != 0)
         return ret;
+    if (is_1rtt_only)
+        quicly_sentmap_seek(&loss->sentmap, &iter, loss->first_inflight_pn_hint);
 
     /* Mark packets as lost if they are smaller than the largest_acked and outside either time-threshold or packet-threshold
      * windows. Once marked as lost, cc_bytes_in_flight becomes zero. */
@@ -64,10 +69,10 @@ int quicly_loss_detect_loss(quicly_loss_t *loss, int64_t now, uint32_t max_ack_d
         int64_t largest_acked_signed = loss->largest_acked_packet_plus1[sent->ack_epoch] - 1;
         if ((int64_t)sent->packet_number < largest_acked_signed &&
             (sent->sent_at <= now - delay_until_lost ||                                                      /* time threshold */
-             (int64_t)sent->packet_number <= largest_acked_signed - QUICLY_LOSS_DEFAULT_PACKET_THRESHOLD)) { /* packet threshold */
+             (int64_t)sent->packet_number <= largest_acked_signed - packet_threshold)) { /* packet threshold */
             if (sent->cc_bytes_in_flight != 0) {
-                on_loss_detected(loss, sent,
-                                 (int64_t)sent->packet_number > largest_acked_signed - QUICLY_LOSS_DEFAULT_PACKET_THRESHOLD);
+                on_loss_detected(loss, &iter.p->data.packet,
+                                 (int64_t)sent->packet_number > largest_acked_signed - packet_threshold);
                 if ((ret = quicly_sentmap_update(&loss->sentmap, &iter, QUICLY_SENTMAP_EVENT_LOST)) != 0)
                     return ret;
             } else {
@@ -99,5 +104,9 @@ int quicly_loss_detect_loss(quicly_loss_t *loss, int64_t now, uint32_t max_ack_d
         sent = quicly_sentmap_get(&iter);
     }
 
+    /* all the packets preceding the one being pointed to by the iterator have been either acked or deemed lost */
+    if (is_1rtt_only && sent->packet_number != UINT64_MAX)
+        loss->first_inflight_pn_hint = sent->packet_number;
+
     return 0;
 }
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "quicly/pacer.h"
+
+static uint64_t calc_burst_size(uint16_t mtu)
+{
+    return (uint64_t)QUICLY_PACER_BURST_PACKETS * mtu;
+}
+
+uint32_t quicly_pacer_calc_send_rate(const quicly_cc_t *cc, const quicly_loss_t *loss)
+{
+    if (cc->pacing_rate != 0)
+        return cc->pacing_rate;
+
+    uint32_t multiplier =
+        cc->cwnd < cc->ssthresh ? QUICLY_PACER_SLOW_START_MULTIPLIER : QUICLY_PACER_CONGESTION_AVOIDANCE_MULTIPLIER;
+    uint64_t rate = (uint64_t)cc->cwnd * multiplier * loss->clock_resolution / 1024 / loss->rtt.smoothed;
+
+    if (rate == 0)
+        rate = 1;
+    return rate < UINT32_MAX ? (uint32_t)rate : UINT32_MAX;
+}
+
+uint64_t quicly_pacer_get_window(quicly_pacer_t *pacer, int64_t now, uint32_t bytes_per_msec, uint16_t mtu,
+                                 uint32_t clock_resolution)
+{
+    assert(bytes_per_msec != 0);
+
+    /* When the pacer is idle (i.e., the bytes being sent have been drained at the pacing rate), restart from now, permitting a full
+     * burst. Doing so also bounds the values used in the calculation below. */
+    if (pacer->at == INT64_MIN || pacer->at + (int64_t)(pacer->bytes_sent * clock_resolution / bytes_per_msec) <= now) {
+        pacer->at = now;
+        pacer->bytes_sent = 0;
+        return calc_burst_size(mtu);
+    }
+
+    /* calculate the number of bytes that are yet to be drained, and subtract that from the burst size */
+    uint64_t drained = (uint64_t)(now - pacer->at) * bytes_per_msec / clock_resolution, burst_size = calc_burst_size(mtu);
+    assert(drained < pacer->bytes_sent);
+    uint64_t pending = pacer->bytes_sent - drained;
+    return pending < burst_size ? burst_size - pending : 0;
+}
+
+int64_t quicly_pacer_can_send_at(quicly_pacer_t *pacer, uint32_t bytes_per_msec, uint16_t mtu, uint32_t clock_resolution)
+{
+    assert(bytes_per_msec != 0);
+
+    uint64_t burst_size = calc_burst_size(mtu);
+
+    if (pacer->at == INT64_MIN)
+        return 0;
+    if (pacer->bytes_sent + mtu <= burst_size)
+        return pacer->at;
+
+    /* time required for draining the bytes beyond the burst size, rounded up */
+    uint64_t excess = pacer->bytes_sent + mtu - burst_size;
+    return pacer->at + (int64_t)((excess * clock_resolution + bytes_per_msec - 1) / bytes_per_msec);
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "quicly/pmtud.h"
+
+void quicly_pmtud_init(quicly_pmtud_t *pmtud, uint16_t base_size, uint16_t max_size, uint32_t clock_resolution)
+{
+    *pmtud = (quicly_pmtud_t){
+        .base_size = base_size,
+        .max_size = max_size > base_size ? max_size : base_size,
+        .search_low = base_size,
+        .search_high = max_size > base_size ? max_size : base_size,
+        .next_search_at = INT64_MAX,
+        .raise_interval = (int64_t)QUICLY_PMTUD_RAISE_INTERVAL * clock_resolution,
+    };
+}
+
+uint16_t quicly_pmtud_get_probe_size(quicly_pmtud_t *pmtud, int64_t now)
+{
+    if (pmtud->probe_inflight != 0)
+        return 0;
+
+    if (pmtud->search_high == pmtud->search_low) {
+        /* search is complete; restart when the raise timer fires */
+        if (pmtud->search_low == pmtud->max_size || now < pmtud->next_search_at)
+            return 0;
+        pmtud->search_high = pmtud->max_size;
+        pmtud->num_probes_lost = 0;
+    }
+
+    /* Probe the maximum size first, as the endpoints are likely configured to use what the network supports. Once the probe for the
+     * maximum fails, continue as a binary search. */
+    if (pmtud->search_high == pmtud->max_size)
+        return pmtud->max_size;
+    if (pmtud->search_high - pmtud->search_low < QUICLY_PMTUD_SEARCH_GRANULARITY) {
+        pmtud->search_high = pmtud->search_low;
+        pmtud->next_search_at = now + pmtud->raise_interval;
+        return 0;
+    }
+    return pmtud->search_low + (pmtud->search_high - pmtud->search_low + 1) / 2;
+}
+
+uint16_t quicly_pmtud_on_probe_acked(quicly_pmtud_t *pmtud, uint16_t size, int64_t now)
+{
+    if (pmtud->probe_inflight == size)
+        pmtud->probe_inflight = 0;
+
+    /* the ack might be a late one, acknowledging a probe that has been deemed lost */
+    if (size <= pmtud->search_low)
+        return 0;
+
+    pmtud->search_low = size;
+    if (pmtud->search_high < size)
+        pmtud->search_high = size;
+    pmtud->num_probes_lost = 0;
+    if (pmtud->search_high == pmtud->search_low)
+        pmtud->next_search_at = now + pmtud->raise_interval;
+
+    return size;
+}
+
+void quicly_pmtud_on_probe_lost(quicly_pmtud_t *pmtud, uint16_t size, int64_t now)
+{
+    if (pmtud->probe_inflight == size)
+        pmtud->probe_inflight = 0;
+
+    if (!(pmtud->search_low < size && size <= pmtud->search_high))
+        return;
+    if (++pmtud->num_probes_lost < QUICLY_PMTUD_MAX_PROBES)
+        return;
+
+    /* the path does not support the size */
+    pmtud->search_high = size - 1;
+    pmtud->num_probes_lost = 0;
+    if (pmtud->search_high == pmtud->search_low)
+        pmtud->next_search_at = now + pmtud->raise_interval;
+}
+
+int quicly_pmtud_on_full_sized_lost(quicly_pmtud_t *pmtud, uint64_t pn)
+{
+    if (pmtud->search_low <= pmtud->base_size || pn < pmtud->full_sized_acked_until)
+        return 0;
+    if (++pmtud->num_full_sized_lost < QUICLY_PMTUD_BLACK_HOLE_THRESHOLD)
+        return 0;
+
+    /* Black hole detected. Fall back to the base size, and search again below the size that stopped working. */
+    pmtud->search_high = pmtud->search_low - 1;
+    pmtud->search_low = pmtud->base_size;
+    pmtud->probe_inflight = 0;
+    pmtud->num_probes_lost = 0;
+    pmtud->num_full_sized_lost = 0;
+
+    return 1;
+}
@@ -35,6 +35,8 @@
 #include "quicly/frame.h"
 #include "quicly/streambuf.h"
 #include "quicly/cc.h"
+#include "quicly/pacer.h"
+#include "quicly/pmtud.h"
 #if QUICLY_USE_EMBEDDED_PROBES
 #include "embedded-probes.h"
 #elif QUICLY_USE_DTRACE
@@ -73,6 +75,11 @@
  * smaller than QUICLY_MAX_RANGES.
  */
 #define QUICLY_NUM_ACK_BLOCKS_TO_INDUCE_ACKACK 8
+/**
+ * ECN is disabled when this many consecutive PTOs fire before any of the ECT-marked packets are acknowledged, as the marked packets
+ * might be dropped by the network (RFC 9000 Section 13.4.2.1)
+ */
+#define QUICLY_ECN_PROBING_MAX_PTOS 3
 
 KHASH_MAP_INIT_INT64(quicly_stream_t, quicly_stream_t *)
 
@@ -140,6 +147,10 @@ struct st_quicly_pn_space_t {
      * boolean indicating if reorder should NOT trigger an immediate ack
      */
     uint8_t ignore_order;
+    /**
+     * ECT(0), ECT(1), CE counts of the packets received, reported using ACK_ECN frames
+     */
+    uint64_t ecn_counts[QUICLY_NUM_ECN_CODEPOINTS];
 };
 
 struct st_quicly_handshake_space_t {
@@ -151,6 +162,14 @@ struct st_quicly_handshake_space_t {
     uint16_t largest_ingress_udp_payload_size;
 };
 
+/**
+ * AEAD context and the secret of the next key phase, being derived ahead of time (see `prepare_next_1rtt_keys`)
+ */
+struct st_quicly_next_1rtt_key_t {
+    ptls_aead_context_t *aead;
+    uint8_t secret[PTLS_MAX_DIGEST_SIZE];
+};
+
 struct st_quicly_application_space_t {
     struct st_quicly_pn_space_t super;
     struct {
@@ -163,11 +182,18 @@ struct st_quicly_application_space_t {
             struct {
                 uint64_t prepared;
                 uint64_t decrypted;
+                /**
+                 * PN of the packet that confirmed the current phase. Packets carrying the other key phase bit are decrypted using
+                 * the key of the previous phase if their PNs are below this value, or using the key of the next phase otherwise.
+                 */
+                uint64_t decrypted_at_pn;
             } key_phase;
+            struct st_quicly_next_1rtt_key_t next;
         } ingress;
         struct {
             struct st_quicly_cipher_context_t key;
             uint8_t secret[PTLS_MAX_DIGEST_SIZE];
+            struct st_quicly_next_1rtt_key_t next;
             uint64_t key_phase;
             struct {
                 /**
@@ -353,6 +379,33 @@ struct st_quicly_conn_t {
          * delivery rate estimator
          */
         quicly_ratemeter_t ratemeter;
+        /**
+         * pacer (used only when `quicly_context_t::use_pacing` is set)
+         */
+        quicly_pacer_t pacer;
+        /**
+         * state of path MTU discovery (used only when `quicly_context_t::use_pmtud` is set); initialized when the first probe is to
+         * be sent, as the maximum size depends on the transport parameters of the peer
+         */
+        quicly_pmtud_t pmtud;
+        /**
+         * ECN state (RFC 9000 Section 13.4.2)
+         */
+        struct {
+            /**
+             * ECN is off (either because it is not used or because the validation failed), being probed (i.e., packets are marked
+             * but the peer has not yet acknowledged any of them), or validated
+             */
+            enum en_quicly_ecn_state { QUICLY_ECN_OFF, QUICLY_ECN_PROBING, QUICLY_ECN_ON } state;
+            /**
+             * Packets with packet numbers below this value have been sent with ECT(0). UINT64_MAX while ECN is not off.
+             */
+            uint64_t marked_pn_end;
+            /**
+             * largest ECN counts reported by the peer, for each packet number space
+             */
+            uint64_t counts[QUICLY_NUM_EPOCHS][QUICLY_NUM_ECN_CODEPOINTS];
+        } ecn;
     } egress;
     /**
      * crypto data
@@ -400,6 +453,11 @@ struct st_quicly_conn_t {
          *
          */
         uint8_t lock_count;
+        /**
+         * set while frames are being marked for retransmission due to PTO, so that the on_ack callbacks of the frames can tell PTO
+         * apart from the packet being deemed lost
+         */
+        uint8_t on_pto : 1;
         struct {
             /**
              * This cache is used to concatenate acked ranges of streams before processing them, reducing the frequency of function
@@ -415,6 +473,17 @@ struct st_quicly_conn_t {
             } active_acked_cache;
         } on_ack_stream;
     } stash;
+    /**
+     * arena used for allocating per-connection objects, when `quicly_context_t::use_connection_arena` is set
+     */
+    quicly_arena_t arena;
+    /**
+     * timer wheel to which the connection is registered (if any), and the entry
+     */
+    struct {
+        quicly_timerwheel_t *wheel;
+        quicly_timer_t entry;
+    } timer;
 };
 
 #if QUICLY_USE_TRACER
@@ -498,12 +567,31 @@ static void lock_now(quicly_conn_t *conn, int is_reentrant)
     ++conn->stash.lock_count;
 }
 
+/**
+ * Registers the first timeout to the timer wheel. While the lock is held, this is deferred until `unlock_now` is called.
+ */
+static void update_timer(quicly_conn_t *conn)
+{
+    if (conn->timer.wheel == NULL || conn->stash.lock_count != 0)
+        return;
+
+    int64_t at = quicly_get_first_timeout(conn);
+    if (at == INT64_MAX) {
+        quicly_timerwheel_unlink(&conn->timer.entry);
+    } else if (!(quicly_timer_is_linked(&conn->timer.entry) && conn->timer.entry.at == at)) {
+        quicly_timerwheel_link(conn->timer.wheel, &conn->timer.entry, at);
+    }
+}
+
 static void unlock_now(quicly_conn_t *conn)
 {
     assert(conn->stash.now != 0);
 
-    if (--conn->stash.lock_count == 0)
+    if (--conn->stash.lock_count == 0) {
+        /* the timeout is recalculated while `stash.now` is available, as it is used by the pacer */
+        update_timer(conn);
         conn->stash.now = 0;
+    }
 }
 
 static void set_address(quicly_address_t *addr, struct sockaddr *sa)
@@ -579,7 +667,8 @@ static void dispose_cipher(struct st_quicly_cipher_context_t *ctx)
 static void clear_datagram_frame_payloads(quicly_conn_t *conn)
 {
     for (size_t i = 0; i != conn->egress.datagram_frame_payloads.count; ++i) {
-        free(conn->egress.datagram_frame_payloads.payloads[i].base);
+        quicly_allocator_free(conn->super.allocator, conn->egress.datagram_frame_payloads.payloads[i].base,
+                              conn->egress.datagram_frame_payloads.payloads[i].len);
         conn->egress.datagram_frame_payloads.payloads[i] = ptls_iovec_init(NULL, 0);
     }
     conn->egress.datagram_frame_payloads.count = 0;
@@ -623,6 +712,7 @@ size_t quicly_decode_packet(quicly_context_t *ctx, quicly_decoded_packet_t *pack
     if (packet->octets.len < 2)
         goto Error;
     packet->datagram_size = *off == 0 ? datagram_size : 0;
+    packet->ecn = QUICLY_ECN_NOT_ECT;
     packet->token = ptls_iovec_init(NULL, 0);
     packet->decrypted.pn = UINT64_MAX;
 
@@ -734,6 +824,39 @@ Error:
     return SIZE_MAX;
 }
 
+size_t quicly_peek_cid(quicly_cid_encryptor_t *cid_encryptor, quicly_cid_plaintext_t *plaintext, const uint8_t *datagram,
+                       size_t datagram_size)
+{
+    const uint8_t *src = datagram + 1, *src_end = datagram + datagram_size;
+
+    if (datagram_size < 2)
+        return SIZE_MAX;
+
+    if (QUICLY_PACKET_IS_LONG_HEADER(datagram[0])) {
+        /* skip version, then read DCID */
+        if (src_end - src < 5)
+            return SIZE_MAX;
+        src += 4;
+        size_t cidl = *src++;
+        if (cidl == 0 || src_end - src < cidl)
+            return SIZE_MAX;
+        switch (datagram[0] & QUICLY_PACKET_TYPE_BITMASK) {
+        case QUICLY_PACKET_TYPE_INITIAL:
+        case QUICLY_PACKET_TYPE_0RTT:
+            if (cid_encryptor->decrypt_cid(cid_encryptor, plaintext, src, cidl) == SIZE_MAX)
+                *plaintext = quicly_cid_plaintext_invalid;
+            return cidl;
+        default:
+            return cid_encryptor->decrypt_cid(cid_encryptor, plaintext, src, cidl);
+        }
+    } else {
+        /* short header; the length of the CID is determined by the encryptor */
+        if (src_end - src < QUICLY_MAX_CID_LEN_V1)
+            return SIZE_MAX;
+        return cid_encryptor->decrypt_cid(cid_encryptor, plaintext, src, 0);
+    }
+}
+
 uint64_t quicly_determine_packet_number(uint32_t truncated, size_t num_bits, uint64_t expected)
 {
     uint64_t win = (uint64_t)1 << num_bits, candidate = (expected & ~(win - 1)) | truncated;
@@ -884,15 +1007,34 @@ int quicly_stream_sync_sendbuf(quicly_stream_t *stream, int activate)
     }
 
     resched_stream_data(stream);
+    update_timer(stream->conn);
     return 0;
 }
 
+void quicly_stream_set_priority(quicly_stream_t *stream, uint8_t urgency, int incremental)
+{
+    assert(urgency < QUICLY_PRIORITY_NUM_URGENCIES);
+
+    if (stream->priority.urgency == urgency && stream->priority.incremental == !!incremental)
+        return;
+    stream->priority.urgency = urgency;
+    stream->priority.incremental = !!incremental;
+
+    /* unlink the stream so that the scheduler would link it to the position that corresponds to the new priority */
+    if (quicly_linklist_is_linked(&stream->_send_aux.pending_link.default_scheduler)) {
+        quicly_linklist_unlink(&stream->_send_aux.pending_link.default_scheduler);
+        resched_stream_data(stream);
+    }
+}
+
 void quicly_stream_sync_recvbuf(quicly_stream_t *stream, size_t shift_amount)
 {
     stream->recvstate.data_off += shift_amount;
     if (stream->stream_id >= 0) {
-        if (should_send_max_stream_data(stream))
+        if (should_send_max_stream_data(stream)) {
             sched_stream_control(stream);
+            update_timer(stream->conn);
+        }
     }
 }
 
@@ -900,7 +1042,7 @@ static int schedule_path_challenge_frame(quicly_conn_t *conn, int is_response, c
 {
     struct st_quicly_pending_path_challenge_t *pending;
 
-    if ((pending = malloc(sizeof(struct st_quicly_pending_path_challenge_t))) == NULL)
+    if ((pending = quicly_allocator_malloc(conn->super.allocator, sizeof(struct st_quicly_pending_path_challenge_t))) == NULL)
         return PTLS_ERROR_NO_MEMORY;
 
     pending->next = NULL;
@@ -1016,14 +1158,14 @@ static void init_stream_properties(quicly_stream_t *stream, uint32_t initial_max
     int is_client = quicly_is_client(stream->conn);
 
     if (quicly_stream_has_send_side(is_client, stream->stream_id)) {
-        quicly_sendstate_init(&stream->sendstate);
+        quicly_sendstate_init(&stream->sendstate, stream->conn->super.allocator);
     } else {
-        quicly_sendstate_init_closed(&stream->sendstate);
+        quicly_sendstate_init_closed(&stream->sendstate, stream->conn->super.allocator);
     }
     if (quicly_stream_has_receive_side(is_client, stream->stream_id)) {
-        quicly_recvstate_init(&stream->recvstate);
+        quicly_recvstate_init(&stream->recvstate, stream->conn->super.allocator);
     } else {
-        quicly_recvstate_init_closed(&stream->recvstate);
+        quicly_recvstate_init_closed(&stream->recvstate, stream->conn->super.allocator);
     }
     stream->streams_blocked = 0;
 
@@ -1036,6 +1178,10 @@ static void init_stream_properties(quicly_stream_t *stream, uint32_t initial_max
     stream->_send_aux.blocked = QUICLY_SENDER_STATE_NONE;
     quicly_linklist_init(&stream->_send_aux.pending_link.control);
     quicly_linklist_init(&stream->_send_aux.pending_link.default_scheduler);
+    stream->priority.urgency = QUICLY_PRIORITY_DEFAULT_URGENCY;
+    stream->priority.incremental = 0;
+    stream->drr_quantum = QUICLY_DRR_DEFAULT_QUANTUM;
+    stream->_send_aux.drr_deficit = 0;
 
     stream->_recv_aux.window = initial_max_stream_data_local;
 
@@ -1067,7 +1213,7 @@ static quicly_stream_t *open_stream(quicly_conn_t *conn, uint64_t stream_id, uin
 {
     quicly_stream_t *stream;
 
-    if ((stream = malloc(sizeof(*stream))) == NULL)
+    if ((stream = quicly_allocator_malloc(conn->super.allocator, sizeof(*stream))) == NULL)
         return NULL;
     stream->conn = conn;
     stream->stream_id = stream_id;
@@ -1153,7 +1299,7 @@ static void destroy_stream(quicly_stream_t *stream, int err)
             conn->egress.send_ack_at = 0;
     }
 
-    free(stream);
+    quicly_allocator_free(conn->super.allocator, stream, sizeof(*stream));
 }
 
 static void destroy_all_streams(quicly_conn_t *conn, int err, int including_crypto_streams)
@@ -1219,6 +1365,18 @@ int quicly_get_delivery_rate(quicly_conn_t *conn, quicly_rate_t *delivery_rate)
     return 0;
 }
 
+uint8_t quicly_send_get_ecn_bits(quicly_conn_t *conn)
+{
+    return conn->egress.ecn.state == QUICLY_ECN_OFF ? QUICLY_ECN_NOT_ECT : QUICLY_ECN_ECT0;
+}
+
+uint32_t quicly_get_pacing_rate(quicly_conn_t *conn)
+{
+    if (!conn->super.ctx->use_pacing)
+        return 0;
+    return quicly_pacer_calc_send_rate(&conn->egress.cc, &conn->egress.loss);
+}
+
 quicly_stream_id_t quicly_get_ingress_max_streams(quicly_conn_t *conn, int uni)
 {
     quicly_maxsender_t *maxsender = uni ? &conn->ingress.max_streams.uni : &conn->ingress.max_streams.bidi;
@@ -1250,9 +1408,9 @@ static void update_idle_timeout(quicly_conn_t *conn, int is_in_receive)
     if (idle_msec == INT64_MAX)
         return;
 
-    uint32_t three_pto = 3 * quicly_rtt_get_pto(&conn->egress.loss.rtt, conn->super.ctx->transport_params.max_ack_delay,
-                                                conn->egress.loss.conf->min_pto);
-    conn->idle_timeout.at = conn->stash.now + (idle_msec > three_pto ? idle_msec : three_pto);
+    int64_t idle_ticks = idle_msec * conn->super.ctx->clock_resolution;
+    uint32_t three_pto = 3 * quicly_loss_get_pto(&conn->egress.loss, conn->super.ctx->transport_params.max_ack_delay);
+    conn->idle_timeout.at = conn->stash.now + (idle_ticks > three_pto ? idle_ticks : three_pto);
     conn->idle_timeout.should_rearm_on_send = is_in_receive;
 }
 
@@ -1322,29 +1480,30 @@ static void destroy_handshake_flow(quicly_conn_t *conn, size_t epoch)
         destroy_stream(stream, 0);
 }
 
-static struct st_quicly_pn_space_t *alloc_pn_space(size_t sz, uint32_t packet_tolerance)
+static struct st_quicly_pn_space_t *alloc_pn_space(quicly_allocator_t *allocator, size_t sz, uint32_t packet_tolerance)
 {
     struct st_quicly_pn_space_t *space;
 
-    if ((space = malloc(sz)) == NULL)
+    if ((space = quicly_allocator_malloc(allocator, sz)) == NULL)
         return NULL;
 
-    quicly_ranges_init(&space->ack_queue);
+    quicly_ranges_init(&space->ack_queue, allocator);
     space->largest_pn_received_at = INT64_MAX;
     space->next_expected_packet_number = 0;
     space->unacked_count = 0;
     space->packet_tolerance = packet_tolerance;
     space->ignore_order = 0;
+    memset(space->ecn_counts, 0, sizeof(space->ecn_counts));
     if (sz != sizeof(*space))
         memset((uint8_t *)space + sizeof(*space), 0, sz - sizeof(*space));
 
     return space;
 }
 
-static void do_free_pn_space(struct st_quicly_pn_space_t *space)
+static void do_free_pn_space(quicly_allocator_t *allocator, struct st_quicly_pn_space_t *space, size_t sz)
 {
     quicly_ranges_clear(&space->ack_queue);
-    free(space);
+    quicly_allocator_free(allocator, space, sz);
 }
 
 static int record_pn(quicly_ranges_t *ranges, uint64_t pn, int *is_out_of_order)
@@ -1371,7 +1530,26 @@ static int record_pn(quicly_ranges_t *ranges, uint64_t pn, int *is_out_of_order)
     return 0;
 }
 
-static int record_receipt(struct st_quicly_pn_space_t *space, uint64_t pn, int is_ack_only, int64_t now, int64_t *send_ack_at)
+/**
+ * Maps the ECN bits of the IP header to the index of the ECN counts (QUICLY_ECN_COUNT_*).
+ */
+static size_t get_ecn_index_from_bits(uint8_t bits)
+{
+    static const size_t map[] = {SIZE_MAX, QUICLY_ECN_COUNT_ECT1, QUICLY_ECN_COUNT_ECT0, QUICLY_ECN_COUNT_CE};
+    assert(bits != QUICLY_ECN_NOT_ECT && bits < PTLS_ELEMENTSOF(map));
+    return map[bits];
+}
+
+static void disable_ecn(quicly_conn_t *conn)
+{
+    conn->egress.ecn.state = QUICLY_ECN_OFF;
+    conn->egress.ecn.marked_pn_end = conn->egress.packet_number;
+    ++conn->super.stats.num_ecn.validation_failed;
+    QUICLY_PROBE(ECN_VALIDATION, conn, conn->stash.now, conn->egress.ecn.state);
+}
+
+static int record_receipt(struct st_quicly_pn_space_t *space, uint64_t pn, uint8_t ecn, int is_ack_only, int64_t now,
+                          int64_t delayed_ack_timeout, int64_t *send_ack_at)
 {
     int ret, ack_now, is_out_of_order;
 
@@ -1380,6 +1558,13 @@ static int record_receipt(struct st_quicly_pn_space_t *space, uint64_t pn, int i
 
     ack_now = is_out_of_order && !space->ignore_order && !is_ack_only;
 
+    /* count the ECN codepoint; CE marks are reported immediately (RFC 9000 Section 13.2.1) so that the peer can react quickly */
+    if (ecn != QUICLY_ECN_NOT_ECT) {
+        ++space->ecn_counts[get_ecn_index_from_bits(ecn)];
+        if (ecn == QUICLY_ECN_CE && !is_ack_only)
+            ack_now = 1;
+    }
+
     /* update largest_pn_received_at (TODO implement deduplication at an earlier moment?) */
     if (space->ack_queue.ranges[space->ack_queue.num_ranges - 1].end == pn + 1)
         space->largest_pn_received_at = now;
@@ -1394,7 +1579,7 @@ static int record_receipt(struct st_quicly_pn_space_t *space, uint64_t pn, int i
     if (ack_now) {
         *send_ack_at = now;
     } else if (*send_ack_at == INT64_MAX && space->unacked_count != 0) {
-        *send_ack_at = now + QUICLY_DELAYED_ACK_TIMEOUT;
+        *send_ack_at = now + delayed_ack_timeout;
     }
 
     ret = 0;
@@ -1402,14 +1587,14 @@ Exit:
     return ret;
 }
 
-static void free_handshake_space(struct st_quicly_handshake_space_t **space)
+static void free_handshake_space(quicly_conn_t *conn, struct st_quicly_handshake_space_t **space)
 {
     if (*space != NULL) {
         if ((*space)->cipher.ingress.aead != NULL)
             dispose_cipher(&(*space)->cipher.ingress);
         if ((*space)->cipher.egress.aead != NULL)
             dispose_cipher(&(*space)->cipher.egress);
-        do_free_pn_space(&(*space)->super);
+        do_free_pn_space(conn->super.allocator, &(*space)->super, sizeof(**space));
         *space = NULL;
     }
 }
@@ -1427,12 +1612,12 @@ static int setup_cipher(quicly_conn_t *conn, size_t epoch, int is_enc, ptls_ciph
 static int setup_handshake_space_and_flow(quicly_conn_t *conn, size_t epoch)
 {
     struct st_quicly_handshake_space_t **space = epoch == QUICLY_EPOCH_INITIAL ? &conn->initial : &conn->handshake;
-    if ((*space = (void *)alloc_pn_space(sizeof(struct st_quicly_handshake_space_t), 1)) == NULL)
+    if ((*space = (void *)alloc_pn_space(conn->super.allocator, sizeof(struct st_quicly_handshake_space_t), 1)) == NULL)
         return PTLS_ERROR_NO_MEMORY;
     return create_handshake_flow(conn, epoch);
 }
 
-static void free_application_space(struct st_quicly_application_space_t **space)
+static void free_application_space(quicly_conn_t *conn, struct st_quicly_application_space_t **space)
 {
     if (*space != NULL) {
 #define DISPOSE_INGRESS(label, func)                                                                                               \
@@ -1442,11 +1627,16 @@ static void free_application_space(struct st_quicly_application_space_t **space)
         DISPOSE_INGRESS(header_protection.one_rtt, ptls_cipher_free);
         DISPOSE_INGRESS(aead[0], ptls_aead_free);
         DISPOSE_INGRESS(aead[1], ptls_aead_free);
+        DISPOSE_INGRESS(next.aead, ptls_aead_free);
 #undef DISPOSE_INGRESS
+        ptls_clear_memory((*space)->cipher.ingress.next.secret, sizeof((*space)->cipher.ingress.next.secret));
         if ((*space)->cipher.egress.key.aead != NULL)
             dispose_cipher(&(*space)->cipher.egress.key);
         ptls_clear_memory((*space)->cipher.egress.secret, sizeof((*space)->cipher.egress.secret));
-        do_free_pn_space(&(*space)->super);
+        if ((*space)->cipher.egress.next.aead != NULL)
+            ptls_aead_free((*space)->cipher.egress.next.aead);
+        ptls_clear_memory((*space)->cipher.egress.next.secret, sizeof((*space)->cipher.egress.next.secret));
+        do_free_pn_space(conn->super.allocator, &(*space)->super, sizeof(**space));
         *space = NULL;
     }
 }
@@ -1454,7 +1644,8 @@ static void free_application_space(struct st_quicly_application_space_t **space)
 static int setup_application_space(quicly_conn_t *conn)
 {
     if ((conn->application =
-             (void *)alloc_pn_space(sizeof(struct st_quicly_application_space_t), QUICLY_DEFAULT_PACKET_TOLERANCE)) == NULL)
+             (void *)alloc_pn_space(conn->super.allocator, sizeof(struct st_quicly_application_space_t),
+                                    QUICLY_DEFAULT_PACKET_TOLERANCE)) == NULL)
         return PTLS_ERROR_NO_MEMORY;
 
     /* prohibit key-update until receiving an ACK for an 1-RTT packet */
@@ -1473,7 +1664,7 @@ static int discard_handshake_context(quicly_conn_t *conn, size_t epoch)
     if ((ret = discard_sentmap_by_epoch(conn, 1u << epoch)) != 0)
         return ret;
     destroy_handshake_flow(conn, epoch);
-    free_handshake_space(epoch == QUICLY_EPOCH_INITIAL ? &conn->initial : &conn->handshake);
+    free_handshake_space(conn, epoch == QUICLY_EPOCH_INITIAL ? &conn->initial : &conn->handshake);
 
     return 0;
 }
@@ -1491,34 +1682,63 @@ static int apply_remote_transport_params(quicly_conn_t *conn)
     return 0;
 }
 
-static int update_1rtt_key(quicly_conn_t *conn, ptls_cipher_suite_t *cipher, int is_enc, ptls_aead_context_t **aead,
-                           uint8_t *secret)
+/**
+ * Derives the key of the phase that follows the one being identified by `secret`, unless it has already been derived.
+ */
+static int prepare_next_1rtt_key(quicly_conn_t *conn, ptls_cipher_suite_t *cipher, int is_enc, const uint8_t *secret,
+                                 struct st_quicly_next_1rtt_key_t *next)
 {
-    uint8_t new_secret[PTLS_MAX_DIGEST_SIZE];
-    ptls_aead_context_t *new_aead = NULL;
     int ret;
 
-    /* generate next AEAD key */
-    if ((ret = ptls_hkdf_expand_label(cipher->hash, new_secret, cipher->hash->digest_size,
+    if (next->aead != NULL)
+        return 0;
+
+    if ((ret = ptls_hkdf_expand_label(cipher->hash, next->secret, cipher->hash->digest_size,
                                       ptls_iovec_init(secret, cipher->hash->digest_size), "quic ku", ptls_iovec_init(NULL, 0),
-                                      NULL)) != 0)
-        goto Exit;
-    if ((ret = setup_cipher(conn, QUICLY_EPOCH_1RTT, is_enc, NULL, &new_aead, cipher->aead, cipher->hash, new_secret)) != 0)
-        goto Exit;
+                                      NULL)) != 0 ||
+        (ret = setup_cipher(conn, QUICLY_EPOCH_1RTT, is_enc, NULL, &next->aead, cipher->aead, cipher->hash, next->secret)) != 0) {
+        next->aead = NULL;
+        ptls_clear_memory(next->secret, cipher->hash->digest_size);
+    }
+
+    return ret;
+}
+
+/**
+ * Derives the keys of the next phase ahead of time, so that key updates can be handled without running key derivation on the packet
+ * path. Failures are ignored, as the keys are derived when being used, if not available.
+ */
+static void prepare_next_1rtt_keys(quicly_conn_t *conn)
+{
+    struct st_quicly_application_space_t *space = conn->application;
 
-    /* success! update AEAD and secret */
+    if (space == NULL || space->cipher.ingress.header_protection.one_rtt == NULL || conn->super.state >= QUICLY_STATE_CLOSING)
+        return;
+
+    ptls_cipher_suite_t *cipher = ptls_get_cipher(conn->crypto.tls);
+    prepare_next_1rtt_key(conn, cipher, 0, space->cipher.ingress.secret, &space->cipher.ingress.next);
+    if (space->one_rtt_writable)
+        prepare_next_1rtt_key(conn, cipher, 1, space->cipher.egress.secret, &space->cipher.egress.next);
+}
+
+static int update_1rtt_key(quicly_conn_t *conn, ptls_cipher_suite_t *cipher, int is_enc, ptls_aead_context_t **aead,
+                           uint8_t *secret, struct st_quicly_next_1rtt_key_t *next)
+{
+    int ret;
+
+    /* obtain the next AEAD key, which is usually prepared ahead of time */
+    if ((ret = prepare_next_1rtt_key(conn, cipher, is_enc, secret, next)) != 0)
+        return ret;
+
+    /* update AEAD and secret */
     if (*aead != NULL)
         ptls_aead_free(*aead);
-    *aead = new_aead;
-    new_aead = NULL;
-    memcpy(secret, new_secret, cipher->hash->digest_size);
+    *aead = next->aead;
+    next->aead = NULL;
+    memcpy(secret, next->secret, cipher->hash->digest_size);
+    ptls_clear_memory(next->secret, cipher->hash->digest_size);
 
-    ret = 0;
-Exit:
-    if (new_aead != NULL)
-        ptls_aead_free(new_aead);
-    ptls_clear_memory(new_secret, cipher->hash->digest_size);
-    return ret;
+    return 0;
 }
 
 static int update_1rtt_egress_key(quicly_conn_t *conn)
@@ -1528,7 +1748,8 @@ static int update_1rtt_egress_key(quicly_conn_t *conn)
     int ret;
 
     /* generate next AEAD key, and increment key phase if it succeeds */
-    if ((ret = update_1rtt_key(conn, cipher, 1, &space->cipher.egress.key.aead, space->cipher.egress.secret)) != 0)
+    if ((ret = update_1rtt_key(conn, cipher, 1, &space->cipher.egress.key.aead, space->cipher.egress.secret,
+                               &space->cipher.egress.next)) != 0)
         return ret;
     ++space->cipher.egress.key_phase;
 
@@ -1542,7 +1763,7 @@ static int update_1rtt_egress_key(quicly_conn_t *conn)
     return 0;
 }
 
-static int received_key_update(quicly_conn_t *conn, uint64_t newly_decrypted_key_phase)
+static int received_key_update(quicly_conn_t *conn, uint64_t newly_decrypted_key_phase, uint64_t pn)
 {
     struct st_quicly_application_space_t *space = conn->application;
 
@@ -1550,6 +1771,7 @@ static int received_key_update(quicly_conn_t *conn, uint64_t newly_decrypted_key
     assert(newly_decrypted_key_phase <= space->cipher.ingress.key_phase.prepared);
 
     space->cipher.ingress.key_phase.decrypted = newly_decrypted_key_phase;
+    space->cipher.ingress.key_phase.decrypted_at_pn = pn;
 
     QUICLY_PROBE(CRYPTO_RECEIVE_KEY_UPDATE, conn, conn->stash.now, space->cipher.ingress.key_phase.decrypted,
                  QUICLY_PROBE_HEXDUMP(space->cipher.ingress.secret, ptls_get_cipher(conn->crypto.tls)->hash->digest_size));
@@ -1569,6 +1791,7 @@ static inline void update_open_count(quicly_context_t *ctx, ssize_t delta)
 
 void quicly_free(quicly_conn_t *conn)
 {
+    quicly_set_timerwheel(conn, NULL);
     lock_now(conn, 0);
 
     QUICLY_PROBE(FREE, conn, conn->stash.now);
@@ -1590,7 +1813,7 @@ void quicly_free(quicly_conn_t *conn)
     while (conn->egress.path_challenge.head != NULL) {
         struct st_quicly_pending_path_challenge_t *pending = conn->egress.path_challenge.head;
         conn->egress.path_challenge.head = pending->next;
-        free(pending);
+        quicly_allocator_free(conn->super.allocator, pending, sizeof(*pending));
     }
     quicly_loss_dispose(&conn->egress.loss);
 
@@ -1601,18 +1824,27 @@ void quicly_free(quicly_conn_t *conn)
     assert(!quicly_linklist_is_linked(&conn->egress.pending_streams.control));
     assert(!quicly_linklist_is_linked(&conn->super._default_scheduler.active));
     assert(!quicly_linklist_is_linked(&conn->super._default_scheduler.blocked));
+    for (size_t i = 0; i < QUICLY_PRIORITY_NUM_URGENCIES; ++i) {
+        assert(!quicly_linklist_is_linked(&conn->super._priority_scheduler.active[i].non_incremental));
+        assert(!quicly_linklist_is_linked(&conn->super._priority_scheduler.active[i].incremental));
+    }
+    assert(!quicly_linklist_is_linked(&conn->super._priority_scheduler.blocked));
+    assert(!quicly_linklist_is_linked(&conn->super._drr_scheduler.active));
+    assert(!quicly_linklist_is_linked(&conn->super._drr_scheduler.blocked));
 
-    free_handshake_space(&conn->initial);
-    free_handshake_space(&conn->handshake);
-    free_application_space(&conn->application);
+    free_handshake_space(conn, &conn->initial);
+    free_handshake_space(conn, &conn->handshake);
+    free_application_space(conn, &conn->application);
 
     ptls_buffer_dispose(&conn->crypto.transport_params.buf);
     ptls_free(conn->crypto.tls);
 
     unlock_now(conn);
 
-    free(conn->token.base);
-    free(conn);
+    quicly_allocator_free(conn->super.allocator, conn->token.base, conn->token.len);
+    if (conn->super.ctx->use_connection_arena)
+        quicly_arena_dispose(&conn->arena);
+    quicly_allocator_free(conn->super.ctx->allocator, conn, sizeof(*conn));
 }
 
 static int setup_initial_key(struct st_quicly_cipher_context_t *ctx, ptls_cipher_suite_t *cs, const void *master_secret,
@@ -2077,12 +2309,19 @@ static quicly_conn_t *create_connection(quicly_context_t *ctx, uint32_t protocol
     }
 
     /* allocate memory and start creating QUIC context */
-    if ((conn = malloc(sizeof(*conn))) == NULL) {
+    if ((conn = quicly_allocator_malloc(ctx->allocator, sizeof(*conn))) == NULL) {
         ptls_free(tls);
         return NULL;
     }
     memset(conn, 0, sizeof(*conn));
     conn->super.ctx = ctx;
+    if (ctx->use_connection_arena) {
+        quicly_arena_init(&conn->arena, ctx->allocator);
+        conn->super.allocator = &conn->arena.super;
+    } else {
+        conn->super.allocator = ctx->allocator;
+    }
+    quicly_timer_init(&conn->timer.entry);
     lock_now(conn, 0);
     set_address(&conn->super.local.address, local_addr);
     set_address(&conn->super.remote.address, remote_addr);
@@ -2106,13 +2345,21 @@ static quicly_conn_t *create_connection(quicly_context_t *ctx, uint32_t protocol
     conn->super.remote.largest_retire_prior_to = 0;
     quicly_linklist_init(&conn->super._default_scheduler.active);
     quicly_linklist_init(&conn->super._default_scheduler.blocked);
+    for (size_t i = 0; i < QUICLY_PRIORITY_NUM_URGENCIES; ++i) {
+        quicly_linklist_init(&conn->super._priority_scheduler.active[i].non_incremental);
+        quicly_linklist_init(&conn->super._priority_scheduler.active[i].incremental);
+    }
+    quicly_linklist_init(&conn->super._priority_scheduler.blocked);
+    quicly_linklist_init(&conn->super._drr_scheduler.active);
+    quicly_linklist_init(&conn->super._drr_scheduler.blocked);
     conn->streams = kh_init(quicly_stream_t);
     quicly_maxsender_init(&conn->ingress.max_data.sender, conn->super.ctx->transport_params.max_data);
     quicly_maxsender_init(&conn->ingress.max_streams.uni, conn->super.ctx->transport_params.max_streams_uni);
     quicly_maxsender_init(&conn->ingress.max_streams.bidi, conn->super.ctx->transport_params.max_streams_bidi);
     quicly_loss_init(&conn->egress.loss, &conn->super.ctx->loss,
                      conn->super.ctx->loss.default_initial_rtt /* FIXME remember initial_rtt in session ticket */,
-                     &conn->super.remote.transport_params.max_ack_delay, &conn->super.remote.transport_params.ack_delay_exponent);
+                     &conn->super.remote.transport_params.max_ack_delay, &conn->super.remote.transport_params.ack_delay_exponent,
+                     conn->super.ctx->clock_resolution, conn->super.allocator, conn->super.ctx->sent_block_allocator);
     conn->egress.next_pn_to_skip =
         calc_next_pn_to_skip(conn->super.ctx->tls, 0, initcwnd, conn->super.ctx->initial_egress_max_udp_payload_size);
     conn->egress.max_udp_payload_size = conn->super.ctx->initial_egress_max_udp_payload_size;
@@ -2122,11 +2369,21 @@ static quicly_conn_t *create_connection(quicly_context_t *ctx, uint32_t protocol
     conn->egress.ack_frequency.update_at = INT64_MAX;
     conn->egress.send_ack_at = INT64_MAX;
     conn->super.ctx->init_cc->cb(conn->super.ctx->init_cc, &conn->egress.cc, initcwnd, conn->stash.now);
+    if (conn->super.ctx->use_hystart)
+        quicly_hystart_init(&conn->egress.cc.hystart);
     quicly_retire_cid_init(&conn->egress.retire_cid);
     quicly_linklist_init(&conn->egress.pending_streams.blocked.uni);
     quicly_linklist_init(&conn->egress.pending_streams.blocked.bidi);
     quicly_linklist_init(&conn->egress.pending_streams.control);
     quicly_ratemeter_init(&conn->egress.ratemeter);
+    quicly_pacer_reset(&conn->egress.pacer);
+    if (conn->super.ctx->use_ecn) {
+        conn->egress.ecn.state = QUICLY_ECN_PROBING;
+        conn->egress.ecn.marked_pn_end = UINT64_MAX;
+    } else {
+        conn->egress.ecn.state = QUICLY_ECN_OFF;
+        conn->egress.ecn.marked_pn_end = 0;
+    }
     conn->crypto.tls = tls;
     if (handshake_properties != NULL) {
         assert(handshake_properties->additional_extensions == NULL);
@@ -2256,7 +2513,7 @@ int quicly_connect(quicly_conn_t **_conn, quicly_context_t *ctx, const char *ser
     conn->super.remote.address_validation.validated = 1;
     conn->super.remote.address_validation.send_probe = 1;
     if (address_token.len != 0) {
-        if ((conn->token.base = malloc(address_token.len)) == NULL) {
+        if ((conn->token.base = quicly_allocator_malloc(conn->super.allocator, address_token.len)) == NULL) {
             ret = PTLS_ERROR_NO_MEMORY;
             goto Exit;
         }
@@ -2419,57 +2676,46 @@ static int aead_decrypt_1rtt(void *ctx, uint64_t pn, quicly_decoded_packet_t *pa
     size_t aead_index = (packet->octets.base[0] & QUICLY_KEY_PHASE_BIT) != 0;
     int ret;
 
-    /* prepare key, when not available (yet) */
-    if (space->cipher.ingress.aead[aead_index] == NULL) {
-    Retry_1RTT : {
-        /* Replace the AEAD key at the alternative slot (note: decryption key slots are shared by 0-RTT and 1-RTT), at the same time
-         * dropping 0-RTT header protection key. */
+    /* Install the key of the next phase to the slot, if the slot is empty, or if the slot retains the key of the previous phase
+     * and the PN indicates that the packet belongs to the next phase. Note that the decryption key slots are shared by 0-RTT and
+     * 1-RTT; the 0-RTT header protection key is dropped at the same time. */
+    if (space->cipher.ingress.aead[aead_index] == NULL ||
+        (space->cipher.ingress.key_phase.decrypted == space->cipher.ingress.key_phase.prepared &&
+         space->cipher.ingress.key_phase.decrypted % 2 != aead_index && pn > space->cipher.ingress.key_phase.decrypted_at_pn)) {
         if (conn->application->cipher.ingress.header_protection.zero_rtt != NULL) {
             ptls_cipher_free(conn->application->cipher.ingress.header_protection.zero_rtt);
             conn->application->cipher.ingress.header_protection.zero_rtt = NULL;
         }
         ptls_cipher_suite_t *cipher = ptls_get_cipher(conn->crypto.tls);
-        if ((ret = update_1rtt_key(conn, cipher, 0, &space->cipher.ingress.aead[aead_index], space->cipher.ingress.secret)) != 0)
+        if ((ret = update_1rtt_key(conn, cipher, 0, &space->cipher.ingress.aead[aead_index], space->cipher.ingress.secret,
+                                   &space->cipher.ingress.next)) != 0)
             return ret;
         ++space->cipher.ingress.key_phase.prepared;
         QUICLY_PROBE(CRYPTO_RECEIVE_KEY_UPDATE_PREPARE, conn, conn->stash.now, space->cipher.ingress.key_phase.prepared,
                      QUICLY_PROBE_HEXDUMP(space->cipher.ingress.secret, cipher->hash->digest_size));
     }
-    }
 
     /* decrypt */
-    ptls_aead_context_t *aead = space->cipher.ingress.aead[aead_index];
-    if ((*ptlen = aead_decrypt_core(aead, pn, packet, aead_off)) == SIZE_MAX) {
-        /* retry with a new key, if possible */
-        if (space->cipher.ingress.key_phase.decrypted == space->cipher.ingress.key_phase.prepared &&
-            space->cipher.ingress.key_phase.decrypted % 2 != aead_index) {
-            /* reapply AEAD to revert payload to the encrypted form. This assumes that the cipher used in AEAD is CTR. */
-            aead_decrypt_core(aead, pn, packet, aead_off);
-            goto Retry_1RTT;
-        }
-        /* otherwise return failure */
+    if ((*ptlen = aead_decrypt_core(space->cipher.ingress.aead[aead_index], pn, packet, aead_off)) == SIZE_MAX)
         return QUICLY_ERROR_PACKET_IGNORED;
-    }
 
     /* update the confirmed key phase and also the egress key phase, if necessary */
     if (space->cipher.ingress.key_phase.prepared != space->cipher.ingress.key_phase.decrypted &&
         space->cipher.ingress.key_phase.prepared % 2 == aead_index) {
-        if ((ret = received_key_update(conn, space->cipher.ingress.key_phase.prepared)) != 0)
+        if ((ret = received_key_update(conn, space->cipher.ingress.key_phase.prepared, pn)) != 0)
             return ret;
     }
 
     return 0;
 }
 
-static int do_decrypt_packet(ptls_cipher_context_t *header_protection,
-                             int (*aead_cb)(void *, uint64_t, quicly_decoded_packet_t *, size_t, size_t *), void *aead_ctx,
-                             uint64_t *next_expected_pn, quicly_decoded_packet_t *packet, uint64_t *pn, ptls_iovec_t *payload)
+static int remove_header_protection(ptls_cipher_context_t *header_protection, uint64_t next_expected_pn,
+                                    quicly_decoded_packet_t *packet, uint64_t *pn, size_t *aead_off)
 {
     size_t encrypted_len = packet->octets.len - packet->encrypted_off;
     uint8_t hpmask[5] = {0};
     uint32_t pnbits = 0;
-    size_t pnlen, ptlen, i;
-    int ret;
+    size_t pnlen, i;
 
     /* decipher the header protection, as well as obtaining pnbits, pnlen */
     if (encrypted_len < header_protection->algo->iv_size + QUICLY_MAX_PN_SIZE) {
@@ -2485,8 +2731,20 @@ static int do_decrypt_packet(ptls_cipher_context_t *header_protection,
         pnbits = (pnbits << 8) | packet->octets.base[packet->encrypted_off + i];
     }
 
-    size_t aead_off = packet->encrypted_off + pnlen;
-    *pn = quicly_determine_packet_number(pnbits, pnlen * 8, *next_expected_pn);
+    *aead_off = packet->encrypted_off + pnlen;
+    *pn = quicly_determine_packet_number(pnbits, pnlen * 8, next_expected_pn);
+    return 0;
+}
+
+static int do_decrypt_packet(ptls_cipher_context_t *header_protection,
+                             int (*aead_cb)(void *, uint64_t, quicly_decoded_packet_t *, size_t, size_t *), void *aead_ctx,
+                             uint64_t *next_expected_pn, quicly_decoded_packet_t *packet, uint64_t *pn, ptls_iovec_t *payload)
+{
+    size_t aead_off, ptlen;
+    int ret;
+
+    if ((ret = remove_header_protection(header_protection, *next_expected_pn, packet, pn, &aead_off)) != 0)
+        return ret;
 
     /* AEAD decryption */
     if ((ret = (*aead_cb)(aead_ctx, *pn, packet, aead_off, &ptlen)) != 0) {
@@ -2506,7 +2764,10 @@ static int decrypt_packet(ptls_cipher_context_t *header_protection,
     int ret;
 
     /* decrypt ourselves, or use the pre-decrypted input */
-    if (packet->decrypted.pn == UINT64_MAX) {
+    if (packet->decrypted.pn == QUICLY_DECRYPTED_PN_FAILED) {
+        *pn = UINT64_MAX;
+        return QUICLY_ERROR_PACKET_IGNORED;
+    } else if (packet->decrypted.pn == UINT64_MAX) {
         if ((ret = do_decrypt_packet(header_protection, aead_cb, aead_ctx, next_expected_pn, packet, pn, payload)) != 0)
             return ret;
     } else {
@@ -2515,7 +2776,7 @@ static int decrypt_packet(ptls_cipher_context_t *header_protection,
         if (aead_cb == aead_decrypt_1rtt) {
             quicly_conn_t *conn = aead_ctx;
             if (conn->application->cipher.ingress.key_phase.decrypted < packet->decrypted.key_phase) {
-                if ((ret = received_key_update(conn, packet->decrypted.key_phase)) != 0)
+                if ((ret = received_key_update(conn, packet->decrypted.key_phase, packet->decrypted.pn)) != 0)
                     return ret;
             }
         }
@@ -2920,6 +3181,12 @@ static size_t calc_send_window(quicly_conn_t *conn, size_t min_bytes_to_send, ui
     return window;
 }
 
+static int64_t calc_pacer_send_at(quicly_conn_t *conn)
+{
+    return quicly_pacer_can_send_at(&conn->egress.pacer, quicly_pacer_calc_send_rate(&conn->egress.cc, &conn->egress.loss),
+                                    conn->egress.max_udp_payload_size, conn->super.ctx->clock_resolution);
+}
+
 /**
  * Checks if the server is waiting for ClientFinished. When that is the case, the loss timer is disactivated, to avoid repeatedly
  * sending 1-RTT packets while the client spends time verifying the certificate chain at the same time buffering 1-RTT packets.
@@ -2943,18 +3210,22 @@ int64_t quicly_get_first_timeout(quicly_conn_t *conn)
         return 0;
 
     uint64_t amp_window = calc_amplification_limit_allowance(conn);
+    int64_t at = conn->idle_timeout.at;
 
     if (calc_send_window(conn, 0, amp_window, 0) > 0) {
-        if (conn->egress.pending_flows != 0)
-            return 0;
-        if (quicly_linklist_is_linked(&conn->egress.pending_streams.control))
-            return 0;
-        if (scheduler_can_send(conn))
-            return 0;
+        if (conn->egress.pending_flows != 0 || quicly_linklist_is_linked(&conn->egress.pending_streams.control) ||
+            scheduler_can_send(conn)) {
+            /* something can be sent; return the time permitted by the pacer if it is in use, otherwise return immediately */
+            if (!conn->super.ctx->use_pacing)
+                return 0;
+            int64_t send_at = calc_pacer_send_at(conn);
+            if (send_at <= conn->stash.now)
+                return 0;
+            at = send_at < at ? send_at : at;
+        }
     }
 
     /* if something can be sent, return the earliest timeout. Otherwise return the idle timeout. */
-    int64_t at = conn->idle_timeout.at;
     if (amp_window > 0) {
         if (conn->egress.loss.alarm_at < at && !is_point5rtt_with_no_handshake_data_to_send(conn))
             at = conn->egress.loss.alarm_at;
@@ -2965,6 +3236,22 @@ int64_t quicly_get_first_timeout(quicly_conn_t *conn)
     return at;
 }
 
+void quicly_set_timerwheel(quicly_conn_t *conn, quicly_timerwheel_t *wheel)
+{
+    quicly_timerwheel_unlink(&conn->timer.entry);
+    conn->timer.wheel = wheel;
+    update_timer(conn);
+}
+
+quicly_conn_t *quicly_pop_expired_conn(quicly_timerwheel_t *wheel, int64_t now)
+{
+    quicly_timer_t *timer;
+
+    if ((timer = quicly_timerwheel_pop(wheel, now)) == NULL)
+        return NULL;
+    return (quicly_conn_t *)((char *)timer - offsetof(quicly_conn_t, timer.entry));
+}
+
 uint64_t quicly_get_next_expected_packet_number(quicly_conn_t *conn)
 {
     if (!conn->application)
@@ -3049,8 +3336,39 @@ struct st_quicly_send_context_t {
      * first packet number to be used within the lifetime of this send context
      */
     uint64_t first_packet_number;
+    /**
+     * regions of the packet under construction that are to be filled by the crypto engine, reading directly from the memory
+     * provided by `on_send_emit_vec`; `dst_off` is relative to `payload_buf.datagram`
+     */
+    struct {
+        quicly_payload_gather_t entries[QUICLY_MAX_PAYLOAD_GATHERS];
+        size_t count;
+    } gathers;
+    /**
+     * 1-RTT packets that have been built but are yet to be encrypted (see `quicly_crypto_engine_t::encrypt_packets`)
+     */
+    struct {
+        quicly_deferred_packet_t entries[QUICLY_MAX_DEFERRED_ENCRYPTIONS];
+        size_t count;
+    } deferred_packets;
+    /**
+     * size of the datagrams being built; usually `conn->egress.max_udp_payload_size`, but is larger when building a PMTU probe
+     */
+    uint16_t datagram_size;
 };
 
+static void encrypt_deferred_packets(quicly_conn_t *conn, quicly_send_context_t *s)
+{
+    if (s->deferred_packets.count == 0)
+        return;
+
+    conn->super.ctx->crypto_engine->encrypt_packets(conn->super.ctx->crypto_engine, conn,
+                                                    conn->application->cipher.egress.key.header_protection,
+                                                    conn->application->cipher.egress.key.aead, s->deferred_packets.entries,
+                                                    s->deferred_packets.count);
+    s->deferred_packets.count = 0;
+}
+
 static int commit_send_packet(quicly_conn_t *conn, quicly_send_context_t *s, int coalesced)
 {
     size_t datagram_size, packet_bytes_in_flight;
@@ -3064,8 +3382,8 @@ static int commit_send_packet(quicly_conn_t *conn, quicly_send_context_t *s, int
         *s->dst++ = QUICLY_FRAME_TYPE_PADDING;
 
     if (!coalesced && s->target.full_size) {
-        assert(s->num_datagrams == 0 || s->datagrams[s->num_datagrams - 1].iov_len == conn->egress.max_udp_payload_size);
-        const size_t max_size = conn->egress.max_udp_payload_size - QUICLY_AEAD_TAG_SIZE;
+        assert(s->num_datagrams == 0 || s->datagrams[s->num_datagrams - 1].iov_len == s->datagram_size);
+        const size_t max_size = s->datagram_size - QUICLY_AEAD_TAG_SIZE;
         assert(s->dst - s->payload_buf.datagram <= max_size);
         memset(s->dst, QUICLY_FRAME_TYPE_PADDING, s->payload_buf.datagram + max_size - s->dst);
         s->dst = s->payload_buf.datagram + max_size;
@@ -3080,6 +3398,8 @@ static int commit_send_packet(quicly_conn_t *conn, quicly_send_context_t *s, int
     } else {
         if (conn->egress.packet_number >= conn->application->cipher.egress.key_update_pn.next) {
             int ret;
+            /* packets being deferred have to be encrypted using the current key, before it is discarded */
+            encrypt_deferred_packets(conn, s);
             if ((ret = update_1rtt_egress_key(conn)) != 0)
                 return ret;
         }
@@ -3091,13 +3411,38 @@ static int commit_send_packet(quicly_conn_t *conn, quicly_send_context_t *s, int
     /* encrypt the packet */
     s->dst += s->target.cipher->aead->algo->tag_size;
     datagram_size = s->dst - s->payload_buf.datagram;
-    assert(datagram_size <= conn->egress.max_udp_payload_size);
-
-    conn->super.ctx->crypto_engine->encrypt_packet(conn->super.ctx->crypto_engine, conn, s->target.cipher->header_protection,
-                                                   s->target.cipher->aead, ptls_iovec_init(s->payload_buf.datagram, datagram_size),
-                                                   s->target.first_byte_at - s->payload_buf.datagram,
-                                                   s->dst_payload_from - s->payload_buf.datagram, conn->egress.packet_number,
-                                                   coalesced);
+    assert(datagram_size <= s->datagram_size);
+
+    if (s->gathers.count != 0 && conn->super.ctx->crypto_engine->encrypt_packet_gather != NULL) {
+        conn->super.ctx->crypto_engine->encrypt_packet_gather(
+            conn->super.ctx->crypto_engine, conn, s->target.cipher->header_protection, s->target.cipher->aead,
+            ptls_iovec_init(s->payload_buf.datagram, datagram_size), s->target.first_byte_at - s->payload_buf.datagram,
+            s->dst_payload_from - s->payload_buf.datagram, conn->egress.packet_number, coalesced, s->gathers.entries,
+            s->gathers.count);
+    } else {
+        /* the engine cannot read the payload by reference; copy it to the datagram buffer */
+        for (size_t i = 0; i != s->gathers.count; ++i)
+            memcpy(s->payload_buf.datagram + s->gathers.entries[i].dst_off, s->gathers.entries[i].src.base,
+                   s->gathers.entries[i].src.len);
+        if (conn->super.ctx->crypto_engine->encrypt_packets != NULL && !QUICLY_PACKET_IS_LONG_HEADER(*s->target.first_byte_at)) {
+            assert(s->target.cipher == &conn->application->cipher.egress.key);
+            if (s->deferred_packets.count == PTLS_ELEMENTSOF(s->deferred_packets.entries))
+                encrypt_deferred_packets(conn, s);
+            s->deferred_packets.entries[s->deferred_packets.count++] = (quicly_deferred_packet_t){
+                .datagram = ptls_iovec_init(s->payload_buf.datagram, datagram_size),
+                .first_byte_at = s->target.first_byte_at - s->payload_buf.datagram,
+                .payload_from = s->dst_payload_from - s->payload_buf.datagram,
+                .packet_number = conn->egress.packet_number,
+                .coalesced = coalesced,
+            };
+        } else {
+            conn->super.ctx->crypto_engine->encrypt_packet(
+                conn->super.ctx->crypto_engine, conn, s->target.cipher->header_protection, s->target.cipher->aead,
+                ptls_iovec_init(s->payload_buf.datagram, datagram_size), s->target.first_byte_at - s->payload_buf.datagram,
+                s->dst_payload_from - s->payload_buf.datagram, conn->egress.packet_number, coalesced);
+        }
+    }
+    s->gathers.count = 0;
 
     /* update CC, commit sentmap */
     if (s->target.ack_eliciting) {
@@ -3110,6 +3455,8 @@ static int commit_send_packet(quicly_conn_t *conn, quicly_send_context_t *s, int
         quicly_sentmap_commit(&conn->egress.loss.sentmap, (uint16_t)packet_bytes_in_flight);
 
     conn->egress.cc.type->cc_on_sent(&conn->egress.cc, &conn->egress.loss, (uint32_t)packet_bytes_in_flight, conn->stash.now);
+    if (conn->super.ctx->use_pacing && packet_bytes_in_flight != 0)
+        quicly_pacer_consume_window(&conn->egress.pacer, packet_bytes_in_flight);
     QUICLY_PROBE(PACKET_SENT, conn, conn->stash.now, conn->egress.packet_number, s->dst - s->target.first_byte_at,
                  get_epoch(*s->target.first_byte_at), !s->target.ack_eliciting);
 
@@ -3211,12 +3558,12 @@ static int do_allocate_frame(quicly_conn_t *conn, quicly_send_context_t *s, size
         /* note: send_window (ssize_t) can become negative; see doc-comment */
         if (frame_type == ALLOCATE_FRAME_TYPE_ACK_ELICITING && s->send_window <= 0)
             return QUICLY_ERROR_SENDBUF_FULL;
-        if (s->payload_buf.end - s->payload_buf.datagram < conn->egress.max_udp_payload_size)
+        if (s->payload_buf.end - s->payload_buf.datagram < s->datagram_size)
             return QUICLY_ERROR_SENDBUF_FULL;
         s->target.cipher = s->current.cipher;
         s->target.full_size = 0;
         s->dst = s->payload_buf.datagram;
-        s->dst_end = s->dst + conn->egress.max_udp_payload_size;
+        s->dst_end = s->dst + s->datagram_size;
     }
     s->target.ack_eliciting = 0;
 
@@ -3311,17 +3658,27 @@ static int send_ack(quicly_conn_t *conn, struct st_quicly_pn_space_t *space, qui
     /* calc ack_delay */
     if (space->largest_pn_received_at < conn->stash.now) {
         /* We underreport ack_delay up to 1 milliseconds assuming that QUICLY_LOCAL_ACK_DELAY_EXPONENT is 10. It's considered a
-         * non-issue because our time measurement is at millisecond granurality anyways. */
-        ack_delay = ((conn->stash.now - space->largest_pn_received_at) * 1000) >> QUICLY_LOCAL_ACK_DELAY_EXPONENT;
+         * non-issue because the delay is at most a couple of milliseconds, and the peer rounds the value to its own granularity. */
+        ack_delay = ((conn->stash.now - space->largest_pn_received_at) * 1000 / conn->super.ctx->clock_resolution) >>
+                    QUICLY_LOCAL_ACK_DELAY_EXPONENT;
     } else {
         ack_delay = 0;
     }
 
+    /* send ACK_ECN once ECN-marked packets have been received */
+    uint64_t *ecn_counts = NULL;
+    for (size_t i = 0; i < QUICLY_NUM_ECN_CODEPOINTS; ++i) {
+        if (space->ecn_counts[i] != 0) {
+            ecn_counts = space->ecn_counts;
+            break;
+        }
+    }
+
 Emit: /* emit an ACK frame */
     if ((ret = do_allocate_frame(conn, s, QUICLY_ACK_FRAME_CAPACITY, ALLOCATE_FRAME_TYPE_NON_ACK_ELICITING)) != 0)
         return ret;
     uint8_t *dst = s->dst;
-    dst = quicly_encode_ack_frame(dst, s->dst_end, &space->ack_queue, ack_delay);
+    dst = quicly_encode_ack_frame(dst, s->dst_end, &space->ack_queue, ecn_counts, ack_delay);
 
     /* when there's no space, retry with a new MTU-sized packet */
     if (dst == NULL) {
@@ -3532,10 +3889,11 @@ int quicly_can_send_data(quicly_conn_t *conn, quicly_send_context_t *s)
 /**
  * If necessary, changes the frame representation from one without length field to one that has if necessary. Or, as an alternaive,
  * prepends PADDING frames. Upon return, `dst` points to the end of the frame being built. `*len`, `*wrote_all`, `*frame_type_at`
- * are also updated reflecting their values post-adjustment.
+ * are also updated reflecting their values post-adjustment. When `payload_is_written` is false, the payload is yet to be written
+ * (at `*dst - *len` upon return), and therefore only the frame header is moved.
  */
 static inline void adjust_stream_frame_layout(uint8_t **dst, uint8_t *const dst_end, size_t *len, int *wrote_all,
-                                              uint8_t **frame_at)
+                                              uint8_t **frame_at, int payload_is_written)
 {
     size_t space_left = (dst_end - *dst) - *len, len_of_len = quicly_encodev_capacity(*len);
 
@@ -3550,7 +3908,7 @@ static inline void adjust_stream_frame_layout(uint8_t **dst, uint8_t *const dst_
          * lengh field, prepending PADDING if necessary. */
         if (space_left <= len_of_len) {
             if (space_left != 0) {
-                memmove(*frame_at + space_left, *frame_at, *dst + *len - *frame_at);
+                memmove(*frame_at + space_left, *frame_at, *dst + (payload_is_written ? *len : 0) - *frame_at);
                 memset(*frame_at, QUICLY_FRAME_TYPE_PADDING, space_left);
                 *dst += space_left;
                 *frame_at += space_left;
@@ -3562,7 +3920,8 @@ static inline void adjust_stream_frame_layout(uint8_t **dst, uint8_t *const dst_
     }
 
     /* insert length before payload of `*len` bytes */
-    memmove(*dst + len_of_len, *dst, *len);
+    if (payload_is_written)
+        memmove(*dst + len_of_len, *dst, *len);
     *dst = quicly_encodev(*dst, *len);
     *dst += *len;
 }
@@ -3644,11 +4003,23 @@ int quicly_send_stream(quicly_stream_t *stream, quicly_send_context_t *s)
 
     /* Write payload, adjusting len to actual size. Note that `on_send_emit` might fail (e.g., when underlying pread(2) fails), in
      * which case the application will either close the connection immediately or reset the stream. If that happens, we return
-     * immediately without updating state. */
+     * immediately without updating state. When the application provides the payload by reference, the references are recorded so
+     * that the crypto engine can read them directly while encrypting the packet. */
     assert(len != 0);
     size_t emit_off = (size_t)(off - stream->sendstate.acked.ranges[0].end);
+    ptls_iovec_t vecs[QUICLY_MAX_PAYLOAD_GATHERS];
+    size_t num_vecs = 0;
     QUICLY_PROBE(STREAM_ON_SEND_EMIT, stream->conn, stream->conn->stash.now, stream, emit_off, len);
-    stream->callbacks->on_send_emit(stream, emit_off, dst, &len, &wrote_all);
+    if (stream->callbacks->on_send_emit_vec != NULL && stream->stream_id >= 0 &&
+        (num_vecs = QUICLY_MAX_PAYLOAD_GATHERS - s->gathers.count) != 0) {
+        size_t capacity = len;
+        stream->callbacks->on_send_emit_vec(stream, emit_off, vecs, &num_vecs, &len, &wrote_all);
+        if (num_vecs == 0)
+            len = capacity;
+    }
+    if (num_vecs == 0 && stream->conn->super.state < QUICLY_STATE_CLOSING &&
+        stream->_send_aux.reset_stream.sender_state == QUICLY_SENDER_STATE_NONE)
+        stream->callbacks->on_send_emit(stream, emit_off, dst, &len, &wrote_all);
     if (stream->conn->super.state >= QUICLY_STATE_CLOSING) {
         return QUICLY_ERROR_IS_CLOSING;
     } else if (stream->_send_aux.reset_stream.sender_state != QUICLY_SENDER_STATE_NONE) {
@@ -3656,7 +4027,17 @@ int quicly_send_stream(quicly_stream_t *stream, quicly_send_context_t *s)
     }
     assert(len != 0);
 
-    adjust_stream_frame_layout(&dst, s->dst_end, &len, &wrote_all, &s->dst);
+    adjust_stream_frame_layout(&dst, s->dst_end, &len, &wrote_all, &s->dst, num_vecs == 0);
+
+    if (num_vecs != 0) {
+        size_t dst_off = dst - len - s->payload_buf.datagram, i;
+        for (i = 0; i != num_vecs; ++i) {
+            assert(s->gathers.count < QUICLY_MAX_PAYLOAD_GATHERS);
+            s->gathers.entries[s->gathers.count++] = (quicly_payload_gather_t){dst_off, vecs[i]};
+            dst_off += vecs[i].len;
+        }
+        assert(dst_off == dst - s->payload_buf.datagram);
+    }
 
     /* determine if the frame incorporates FIN */
     if (off + len == stream->sendstate.final_size) {
@@ -3747,7 +4128,10 @@ static int mark_frames_on_pto(quicly_conn_t *conn, uint8_t ack_epoch, size_t *by
     while ((sent = quicly_sentmap_get(&iter))->packet_number != UINT64_MAX) {
         if (sent->ack_epoch == ack_epoch && sent->frames_in_flight) {
             *bytes_to_mark = *bytes_to_mark > sent->cc_bytes_in_flight ? *bytes_to_mark - sent->cc_bytes_in_flight : 0;
-            if ((ret = quicly_sentmap_update(&conn->egress.loss.sentmap, &iter, QUICLY_SENTMAP_EVENT_PTO)) != 0)
+            conn->stash.on_pto = 1;
+            ret = quicly_sentmap_update(&conn->egress.loss.sentmap, &iter, QUICLY_SENTMAP_EVENT_PTO);
+            conn->stash.on_pto = 0;
+            if (ret != 0)
                 return ret;
             assert(!sent->frames_in_flight);
             if (*bytes_to_mark == 0)
@@ -3760,7 +4144,7 @@ static int mark_frames_on_pto(quicly_conn_t *conn, uint8_t ack_epoch, size_t *by
     return 0;
 }
 
-static void on_loss_detected(quicly_loss_t *loss, const quicly_sent_packet_t *lost_packet, int is_time_threshold)
+static void on_loss_detected(quicly_loss_t *loss, quicly_sent_packet_t *lost_packet, int is_time_threshold)
 {
     quicly_conn_t *conn = (void *)((char *)loss - offsetof(quicly_conn_t, egress.loss));
 
@@ -3768,9 +4152,26 @@ static void on_loss_detected(quicly_loss_t *loss, const quicly_sent_packet_t *lo
     if (is_time_threshold)
         ++conn->super.stats.num_packets.lost_time_threshold;
     conn->super.stats.num_bytes.lost += lost_packet->cc_bytes_in_flight;
+    if (lost_packet->cc_bytes_in_flight > conn->egress.max_udp_payload_size) {
+        /* The packet is larger than the current PMTU; i.e., a PMTU probe, or a packet sent before falling back due to a black
+         * hole. Such losses are not indications of congestion (RFC 9000 Section 14.4). */
+        QUICLY_PROBE(PACKET_LOST, conn, conn->stash.now, lost_packet->packet_number, lost_packet->ack_epoch);
+        return;
+    }
+    if (conn->super.ctx->use_pmtud && lost_packet->cc_bytes_in_flight == conn->egress.max_udp_payload_size &&
+        quicly_pmtud_on_full_sized_lost(&conn->egress.pmtud, lost_packet->packet_number)) {
+        conn->egress.max_udp_payload_size = conn->egress.pmtud.search_low;
+        QUICLY_PROBE(PMTUD_UPDATE, conn, conn->stash.now, conn->egress.max_udp_payload_size, 1);
+    }
+    uint32_t num_loss_episodes = conn->egress.cc.num_loss_episodes;
     conn->egress.cc.type->cc_on_lost(&conn->egress.cc, &conn->egress.loss, lost_packet->cc_bytes_in_flight,
                                      lost_packet->packet_number, conn->egress.packet_number, conn->stash.now,
                                      conn->egress.max_udp_payload_size);
+    if (conn->egress.cc.num_loss_episodes != num_loss_episodes)
+        quicly_loss_on_loss_episode(&conn->egress.loss);
+    lost_packet->cc_lost = 1;
+    if (lost_packet->packet_number >= conn->egress.cc.undo.recovery_end)
+        ++conn->egress.cc.undo.num_lost;
     QUICLY_PROBE(PACKET_LOST, conn, conn->stash.now, lost_packet->packet_number, lost_packet->ack_epoch);
     QUICLY_PROBE(CC_CONGESTION, conn, conn->stash.now, lost_packet->packet_number + 1, conn->egress.loss.sentmap.bytes_in_flight,
                  conn->egress.cc.cwnd);
@@ -3778,6 +4179,84 @@ static void on_loss_detected(quicly_loss_t *loss, const quicly_sent_packet_t *lo
                  conn->egress.loss.sentmap.bytes_in_flight);
 }
 
+/**
+ * Called when a packet that has been deemed lost is acknowledged.
+ */
+static void on_spurious_loss(quicly_conn_t *conn, uint64_t pn, uint64_t largest_acked)
+{
+    quicly_loss_on_spurious_loss(&conn->egress.loss, largest_acked - pn);
+
+    /* undo the CWND reduction once all the packets deemed lost during the latest loss episode turn out to have been delivered */
+    if (conn->egress.cc.undo.num_lost != 0 && pn >= conn->egress.cc.undo.recovery_end && --conn->egress.cc.undo.num_lost == 0) {
+        conn->egress.cc.type->cc_on_spurious_loss(&conn->egress.cc, &conn->egress.loss, conn->stash.now);
+        QUICLY_PROBE(CC_SPURIOUS_LOSS, conn, conn->stash.now, conn->egress.cc.cwnd, conn->egress.loss.reordering_threshold.packets,
+                     conn->egress.loss.reordering_threshold.time_percentile);
+    }
+}
+
+static int on_ack_pmtu_probe(quicly_sentmap_t *map, const quicly_sent_packet_t *packet, int acked, quicly_sent_t *sent)
+{
+    quicly_conn_t *conn = (quicly_conn_t *)((char *)map - offsetof(quicly_conn_t, egress.loss.sentmap));
+    uint16_t size = sent->data.pmtu_probe.size;
+
+    if (acked) {
+        QUICLY_PROBE(PMTUD_PROBE_ACKED, conn, conn->stash.now, packet->packet_number, size);
+        if (quicly_pmtud_on_probe_acked(&conn->egress.pmtud, size, conn->stash.now) != 0) {
+            conn->egress.max_udp_payload_size = size;
+            QUICLY_PROBE(PMTUD_UPDATE, conn, conn->stash.now, size, 0);
+        }
+    } else if (conn->stash.on_pto) {
+        /* PTO is not an indication of the probe being lost; as the frame will not be notified again unless acked, re-arm the
+         * probe so that it can be retransmitted without being counted as a loss */
+        quicly_pmtud_on_probe_pto(&conn->egress.pmtud, size);
+    } else {
+        QUICLY_PROBE(PMTUD_PROBE_LOST, conn, conn->stash.now, packet->packet_number, size);
+        quicly_pmtud_on_probe_lost(&conn->egress.pmtud, size, conn->stash.now);
+    }
+
+    return 0;
+}
+
+/**
+ * Sends a PMTU probe (a packet carrying PING and PADDING frames) if necessary. The probe is sent as the first datagram; the caller
+ * is expected to stop building datagrams once the probe is sent.
+ */
+static int send_pmtu_probe(quicly_conn_t *conn, quicly_send_context_t *s)
+{
+    quicly_sent_t *sent;
+    uint16_t size;
+    int ret;
+
+    assert(s->num_datagrams == 0 && s->target.first_byte_at == NULL);
+
+    if (conn->egress.pmtud.base_size == 0) {
+        uint16_t max_size = conn->super.remote.transport_params.max_udp_payload_size;
+        if (max_size > conn->super.ctx->transport_params.max_udp_payload_size)
+            max_size = conn->super.ctx->transport_params.max_udp_payload_size;
+        quicly_pmtud_init(&conn->egress.pmtud, conn->egress.max_udp_payload_size, max_size, conn->super.ctx->clock_resolution);
+    }
+
+    if ((size = quicly_pmtud_get_probe_size(&conn->egress.pmtud, conn->stash.now)) == 0 ||
+        s->payload_buf.end - s->payload_buf.datagram < size)
+        return 0;
+
+    s->datagram_size = size;
+    if ((ret = allocate_ack_eliciting_frame(conn, s, 1, &sent, on_ack_pmtu_probe)) != 0)
+        goto Exit;
+    *s->dst++ = QUICLY_FRAME_TYPE_PING;
+    sent->data.pmtu_probe.size = size;
+    ++conn->super.stats.num_frames_sent.ping;
+    QUICLY_PROBE(PMTUD_PROBE_SEND, conn, conn->stash.now, conn->egress.packet_number, size);
+    s->target.full_size = 1;
+    if ((ret = commit_send_packet(conn, s, 0)) != 0)
+        goto Exit;
+    quicly_pmtud_on_probe_sent(&conn->egress.pmtud, size);
+
+Exit:
+    s->datagram_size = conn->egress.max_udp_payload_size;
+    return ret;
+}
+
 static int send_max_streams(quicly_conn_t *conn, int uni, quicly_send_context_t *s)
 {
     if (!should_send_max_streams(conn, uni))
@@ -4352,6 +4831,8 @@ static int do_send(quicly_conn_t *conn, quicly_send_context_t *s)
             QUICLY_PROBE(PTO, conn, conn->stash.now, conn->egress.loss.sentmap.bytes_in_flight, conn->egress.cc.cwnd,
                          conn->egress.loss.pto_count);
             ++conn->super.stats.num_ptos;
+            if (conn->egress.ecn.state == QUICLY_ECN_PROBING && conn->egress.loss.pto_count >= QUICLY_ECN_PROBING_MAX_PTOS)
+                disable_ecn(conn);
             size_t bytes_to_mark = min_packets_to_send * conn->egress.max_udp_payload_size;
             if (conn->initial != NULL && (ret = mark_frames_on_pto(conn, QUICLY_EPOCH_INITIAL, &bytes_to_mark)) != 0)
                 goto Exit;
@@ -4367,6 +4848,15 @@ static int do_send(quicly_conn_t *conn, quicly_send_context_t *s)
 
     s->send_window = calc_send_window(conn, min_packets_to_send * conn->egress.max_udp_payload_size,
                                       calc_amplification_limit_allowance(conn), restrict_sending);
+    if (conn->super.ctx->use_pacing) {
+        /* Cap the window by the amount permitted by the pacer, unless packets have to be sent due to loss recovery. The pacer is
+         * consulted even in the latter case, so that the bytes being sent are accounted. */
+        uint64_t pacer_window = quicly_pacer_get_window(&conn->egress.pacer, conn->stash.now,
+                                                        quicly_pacer_calc_send_rate(&conn->egress.cc, &conn->egress.loss),
+                                                        conn->egress.max_udp_payload_size, conn->super.ctx->clock_resolution);
+        if (min_packets_to_send == 0 && pacer_window < s->send_window)
+            s->send_window = pacer_window;
+    }
     if (s->send_window == 0)
         ack_only = 1;
 
@@ -4383,6 +4873,13 @@ static int do_send(quicly_conn_t *conn, quicly_send_context_t *s)
     /* setup 0-RTT or 1-RTT send context (as the availability of the two epochs are mutually exclusive, we can try 1-RTT first as an
      * optimization), then send application data if that succeeds */
     if (setup_send_space(conn, QUICLY_EPOCH_1RTT, s) != NULL || setup_send_space(conn, QUICLY_EPOCH_0RTT, s) != NULL) {
+        /* PMTU probe, sent once the handshake is confirmed. The probe is returned as the only datagram, as the datagrams being
+         * returned by `quicly_send` are full-sized except for the last one (so that they can be sent using GSO). */
+        if (conn->super.ctx->use_pmtud && !ack_only && min_packets_to_send == 0 && s->num_datagrams == 0 &&
+            conn->application->one_rtt_writable && conn->initial == NULL && conn->handshake == NULL) {
+            if ((ret = send_pmtu_probe(conn, s)) != 0 || s->num_datagrams != 0)
+                goto Exit;
+        }
         /* acks */
         if (conn->application->one_rtt_writable && conn->egress.send_ack_at <= conn->stash.now &&
             conn->application->super.unacked_count != 0) {
@@ -4447,7 +4944,7 @@ static int do_send(quicly_conn_t *conn, quicly_send_context_t *s)
                             ++conn->super.stats.num_frames_sent.path_challenge;
                         }
                         conn->egress.path_challenge.head = c->next;
-                        free(c);
+                        quicly_allocator_free(conn->super.allocator, c, sizeof(*c));
                     } while (conn->egress.path_challenge.head != NULL);
                     conn->egress.path_challenge.tail_ref = &conn->egress.path_challenge.head;
                     s->target.full_size = 1; /* datagrams carrying PATH_CHALLENGE / PATH_RESPONSE have to be full-sized */
@@ -4542,6 +5039,9 @@ Exit:
         } else {
             quicly_ratemeter_not_cwnd_limited(&conn->egress.ratemeter, conn->egress.packet_number);
         }
+        /* if there is nothing more to send while CWND permits, mark delivery rate samples as application-limited */
+        if (!can_send_stream_data && conn->egress.loss.sentmap.bytes_in_flight < conn->egress.cc.cwnd)
+            quicly_sentmap_mark_app_limited(&conn->egress.loss.sentmap);
         if (s->num_datagrams != 0)
             update_idle_timeout(conn, 0);
     }
@@ -4554,17 +5054,23 @@ void quicly_send_datagram_frames(quicly_conn_t *conn, ptls_iovec_t *datagrams, s
         if (conn->egress.datagram_frame_payloads.count == PTLS_ELEMENTSOF(conn->egress.datagram_frame_payloads.payloads))
             break;
         void *copied;
-        if ((copied = malloc(datagrams[i].len)) == NULL)
+        if ((copied = quicly_allocator_malloc(conn->super.allocator, datagrams[i].len)) == NULL)
             break;
         memcpy(copied, datagrams[i].base, datagrams[i].len);
         conn->egress.datagram_frame_payloads.payloads[conn->egress.datagram_frame_payloads.count++] =
             ptls_iovec_init(copied, datagrams[i].len);
     }
+    update_timer(conn);
 }
 
 int quicly_set_cc(quicly_conn_t *conn, quicly_cc_type_t *cc)
 {
-    return cc->cc_switch(&conn->egress.cc);
+    if (!cc->cc_switch(&conn->egress.cc))
+        return 0;
+    /* the state is reset when the CC restarts from slow start */
+    if (conn->super.ctx->use_hystart && conn->egress.cc.hystart.phase == QUICLY_HYSTART_DISABLED)
+        quicly_hystart_init(&conn->egress.cc.hystart);
+    return 1;
 }
 
 int quicly_send(quicly_conn_t *conn, quicly_address_t *dest, quicly_address_t *src, struct iovec *datagrams, size_t *num_datagrams,
@@ -4574,7 +5080,8 @@ int quicly_send(quicly_conn_t *conn, quicly_address_t *dest, quicly_address_t *s
                                .datagrams = datagrams,
                                .max_datagrams = *num_datagrams,
                                .payload_buf = {.datagram = buf, .end = (uint8_t *)buf + bufsize},
-                               .first_packet_number = conn->egress.packet_number};
+                               .first_packet_number = conn->egress.packet_number,
+                               .datagram_size = conn->egress.max_udp_payload_size};
     int ret;
 
     lock_now(conn, 0);
@@ -4614,7 +5121,7 @@ int quicly_send(quicly_conn_t *conn, quicly_address_t *dest, quicly_address_t *s
         }
         /* wait at least 1ms */
         if ((conn->egress.send_ack_at = quicly_sentmap_get(&iter)->sent_at + get_sentmap_expiration_time(conn)) <= conn->stash.now)
-            conn->egress.send_ack_at = conn->stash.now + 1;
+            conn->egress.send_ack_at = conn->stash.now + conn->super.ctx->clock_resolution;
         ret = 0;
         goto Exit;
     }
@@ -4626,6 +5133,8 @@ int quicly_send(quicly_conn_t *conn, quicly_address_t *dest, quicly_address_t *s
     assert_consistency(conn, 1);
 
 Exit:
+    encrypt_deferred_packets(conn, &s);
+    prepare_next_1rtt_keys(conn);
     clear_datagram_frame_payloads(conn);
     if (s.num_datagrams != 0) {
         *dest = conn->super.remote.address;
@@ -4891,15 +5400,61 @@ static int handle_reset_stream_frame(quicly_conn_t *conn, struct st_quicly_handl
     return 0;
 }
 
+/**
+ * Validates the ECN counts of an ACK frame that newly acknowledges `num_ect0_acked` packets marked ECT(0) (RFC 9000 Section
+ * 13.4.2.1), then notifies the congestion controller if the CE count has increased.
+ */
+static void update_ecn_state(quicly_conn_t *conn, size_t epoch, const quicly_ack_frame_t *frame, int is_ack_ecn,
+                             uint64_t num_ect0_acked)
+{
+    uint64_t *counts = conn->egress.ecn.counts[epoch], deltas[QUICLY_NUM_ECN_CODEPOINTS];
+    size_t i;
+
+    assert(conn->egress.ecn.state != QUICLY_ECN_OFF);
+
+    /* validation fails if the marked packets are acked without the counts, if the counts do not cover all the newly acked marked
+     * packets, or if ECT(1) is reported even though we never use that codepoint */
+    if (!is_ack_ecn || frame->ecn_counts[QUICLY_ECN_COUNT_ECT1] != 0) {
+        disable_ecn(conn);
+        return;
+    }
+    for (i = 0; i < QUICLY_NUM_ECN_CODEPOINTS; ++i)
+        deltas[i] = frame->ecn_counts[i] > counts[i] ? frame->ecn_counts[i] - counts[i] : 0;
+    if (deltas[QUICLY_ECN_COUNT_ECT0] + deltas[QUICLY_ECN_COUNT_CE] < num_ect0_acked) {
+        disable_ecn(conn);
+        return;
+    }
+
+    for (i = 0; i < QUICLY_NUM_ECN_CODEPOINTS; ++i) {
+        counts[i] += deltas[i];
+        conn->super.stats.num_ecn.acked[i] += deltas[i];
+    }
+    if (conn->egress.ecn.state == QUICLY_ECN_PROBING) {
+        conn->egress.ecn.state = QUICLY_ECN_ON;
+        QUICLY_PROBE(ECN_VALIDATION, conn, conn->stash.now, conn->egress.ecn.state);
+    }
+
+    /* CE marks are congestion signals (RFC 9002 Section 7.1) */
+    if (deltas[QUICLY_ECN_COUNT_CE] != 0) {
+        ++conn->super.stats.num_ecn.congestion_events;
+        conn->egress.cc.type->cc_on_ecn_congestion(&conn->egress.cc, &conn->egress.loss, frame->largest_acknowledged,
+                                                   conn->egress.packet_number, conn->stash.now,
+                                                   conn->egress.max_udp_payload_size);
+        /* the reduction in response to CE marks cannot be undone, even if the losses of the same episode turn out to be spurious */
+        conn->egress.cc.undo.num_lost = 0;
+        conn->egress.cc.undo.recovery_end = UINT64_MAX;
+        QUICLY_PROBE(ECN_CONGESTION, conn, conn->stash.now, counts[QUICLY_ECN_COUNT_CE], conn->egress.cc.cwnd);
+    }
+}
+
 static int handle_ack_frame(quicly_conn_t *conn, struct st_quicly_handle_payload_state_t *state)
 {
     quicly_ack_frame_t frame;
     quicly_sentmap_iter_t iter;
-    struct {
-        uint64_t pn;
-        int64_t sent_at;
-    } largest_newly_acked = {UINT64_MAX, INT64_MAX};
+    quicly_sent_packet_t largest_newly_acked = {UINT64_MAX, INT64_MAX};
+    quicly_delivery_rate_sample_t rate_sample;
     size_t bytes_acked = 0;
+    uint64_t num_ect0_acked = 0;
     int includes_ack_eliciting = 0, ret;
 
     if ((ret = quicly_decode_ack_frame(&state->src, state->end, &frame, state->frame_type == QUICLY_FRAME_TYPE_ACK_ECN)) != 0)
@@ -4928,8 +5483,7 @@ static int handle_ack_frame(quicly_conn_t *conn, struct st_quicly_handle_payload
          * Processing acks in packet number order requires processing the ack blocks in reverse order. */
         uint64_t pn_block_max = pn_acked + frame.ack_block_lengths[gap_index] - 1;
         QUICLY_PROBE(ACK_BLOCK_RECEIVED, conn, conn->stash.now, pn_acked, pn_block_max);
-        while (quicly_sentmap_get(&iter)->packet_number < pn_acked)
-            quicly_sentmap_skip(&iter);
+        quicly_sentmap_seek(&conn->egress.loss.sentmap, &iter, pn_acked);
         do {
             const quicly_sent_packet_t *sent = quicly_sentmap_get(&iter);
             uint64_t pn_sent = sent->packet_number;
@@ -4952,15 +5506,21 @@ static int handle_ack_frame(quicly_conn_t *conn, struct st_quicly_handle_payload
                 if (sent->cc_bytes_in_flight == 0) {
                     is_late_ack = 1;
                     ++conn->super.stats.num_packets.late_acked;
+                    /* losses not reported to CC (e.g., of PMTU probes) are neither reordering nor subject to undo */
+                    if (sent->cc_lost)
+                        on_spurious_loss(conn, pn_acked, frame.largest_acknowledged);
                 }
             }
             ++conn->super.stats.num_packets.ack_received;
-            largest_newly_acked.pn = pn_acked;
-            largest_newly_acked.sent_at = sent->sent_at;
+            if (pn_acked < conn->egress.ecn.marked_pn_end)
+                ++num_ect0_acked;
+            largest_newly_acked = *sent;
             QUICLY_PROBE(PACKET_ACKED, conn, conn->stash.now, pn_acked, is_late_ack);
             if (sent->cc_bytes_in_flight != 0) {
                 bytes_acked += sent->cc_bytes_in_flight;
                 conn->super.stats.num_bytes.ack_received += sent->cc_bytes_in_flight;
+                if (sent->cc_bytes_in_flight >= conn->egress.max_udp_payload_size)
+                    quicly_pmtud_on_full_sized_acked(&conn->egress.pmtud, pn_acked);
             }
             if ((ret = quicly_sentmap_update(&conn->egress.loss.sentmap, &iter, QUICLY_SENTMAP_EVENT_ACKED)) != 0)
                 return ret;
@@ -4985,19 +5545,22 @@ static int handle_ack_frame(quicly_conn_t *conn, struct st_quicly_handle_payload
 
     QUICLY_PROBE(ACK_DELAY_RECEIVED, conn, conn->stash.now, frame.ack_delay);
 
-    quicly_ratemeter_on_ack(&conn->egress.ratemeter, conn->stash.now, conn->super.stats.num_bytes.ack_received,
-                            largest_newly_acked.pn);
+    /* the ratemeter works in milliseconds regardless of the resolution of the clock */
+    quicly_ratemeter_on_ack(&conn->egress.ratemeter, conn->stash.now / conn->super.ctx->clock_resolution,
+                            conn->super.stats.num_bytes.ack_received, largest_newly_acked.packet_number);
 
     /* Update loss detection engine on ack. The function uses ack_delay only when the largest_newly_acked is also the largest acked
      * so far. So, it does not matter if the ack_delay being passed in does not apply to the largest_newly_acked. */
-    quicly_loss_on_ack_received(&conn->egress.loss, largest_newly_acked.pn, state->epoch, conn->stash.now,
+    quicly_loss_on_ack_received(&conn->egress.loss, largest_newly_acked.packet_number, state->epoch, conn->stash.now,
                                 largest_newly_acked.sent_at, frame.ack_delay, includes_ack_eliciting);
 
     /* OnPacketAcked and OnPacketAckedCC */
     if (bytes_acked > 0) {
+        quicly_sentmap_get_rate_sample(&conn->egress.loss.sentmap, &largest_newly_acked, conn->stash.now, &rate_sample);
         conn->egress.cc.type->cc_on_acked(&conn->egress.cc, &conn->egress.loss, (uint32_t)bytes_acked, frame.largest_acknowledged,
                                           (uint32_t)(conn->egress.loss.sentmap.bytes_in_flight + bytes_acked),
-                                          conn->egress.packet_number, conn->stash.now, conn->egress.max_udp_payload_size);
+                                          conn->egress.packet_number, conn->stash.now, conn->egress.max_udp_payload_size,
+                                          &rate_sample);
         QUICLY_PROBE(QUICTRACE_CC_ACK, conn, conn->stash.now, &conn->egress.loss.rtt, conn->egress.cc.cwnd,
                      conn->egress.loss.sentmap.bytes_in_flight);
     }
@@ -5005,6 +5568,12 @@ static int handle_ack_frame(quicly_conn_t *conn, struct st_quicly_handle_payload
     QUICLY_PROBE(CC_ACK_RECEIVED, conn, conn->stash.now, frame.largest_acknowledged, bytes_acked, conn->egress.cc.cwnd,
                  conn->egress.loss.sentmap.bytes_in_flight);
 
+    /* ECN; counts carried by reordered ACK frames (i.e. those not newly acknowledging the largest) are ignored, as they might be
+     * smaller than the ones already seen */
+    if (num_ect0_acked != 0 && conn->egress.ecn.state != QUICLY_ECN_OFF &&
+        largest_newly_acked.packet_number == frame.largest_acknowledged)
+        update_ecn_state(conn, state->epoch, &frame, state->frame_type == QUICLY_FRAME_TYPE_ACK_ECN, num_ect0_acked);
+
     /* loss-detection  */
     if ((ret = quicly_loss_detect_loss(&conn->egress.loss, conn->stash.now, conn->super.remote.transport_params.max_ack_delay,
                                        conn->initial == NULL && conn->handshake == NULL, on_loss_detected)) != 0)
@@ -5303,6 +5872,12 @@ static int is_stateless_reset(quicly_conn_t *conn, quicly_decoded_packet_t *deco
     return 1;
 }
 
+const quicly_cid_t *quicly_get_client_dcid(quicly_conn_t *conn)
+{
+    assert(!quicly_is_client(conn));
+    return is_retry(conn) ? &conn->retry_scid : &conn->super.original_dcid;
+}
+
 int quicly_is_destination(quicly_conn_t *conn, struct sockaddr *dest_addr, struct sockaddr *src_addr,
                           quicly_decoded_packet_t *decoded)
 {
@@ -5315,8 +5890,7 @@ int quicly_is_destination(quicly_conn_t *conn, struct sockaddr *dest_addr, struc
             return 0;
         /* server may see the CID generated by the client for Initial and 0-RTT packets */
         if (!quicly_is_client(conn) && decoded->cid.dest.might_be_client_generated) {
-            const quicly_cid_t *odcid = is_retry(conn) ? &conn->retry_scid : &conn->super.original_dcid;
-            if (quicly_cid_is_equal(odcid, decoded->cid.dest.encrypted))
+            if (quicly_cid_is_equal(quicly_get_client_dcid(conn), decoded->cid.dest.encrypted))
                 goto Found;
         }
     }
@@ -5766,10 +6340,14 @@ int quicly_accept(quicly_conn_t **conn, quicly_context_t *ctx, struct sockaddr *
 
     /* handle the input; we ignore is_ack_only, we consult if there's any output from TLS in response to CH anyways */
     (*conn)->super.stats.num_packets.received += 1;
+    if (packet->ecn != QUICLY_ECN_NOT_ECT)
+        ++(*conn)->super.stats.num_ecn.received[get_ecn_index_from_bits(packet->ecn)];
     (*conn)->super.stats.num_bytes.received += packet->datagram_size;
     if ((ret = handle_payload(*conn, QUICLY_EPOCH_INITIAL, payload.base, payload.len, &offending_frame_type, &is_ack_only)) != 0)
         goto Exit;
-    if ((ret = record_receipt(&(*conn)->initial->super, pn, 0, (*conn)->stash.now, &(*conn)->egress.send_ack_at)) != 0)
+    if ((ret = record_receipt(&(*conn)->initial->super, pn, packet->ecn, 0, (*conn)->stash.now,
+                              QUICLY_DELAYED_ACK_TIMEOUT * (*conn)->super.ctx->clock_resolution,
+                              &(*conn)->egress.send_ack_at)) != 0)
         goto Exit;
 
 Exit:
@@ -5789,7 +6367,11 @@ Exit:
     return ret;
 }
 
-int quicly_receive(quicly_conn_t *conn, struct sockaddr *dest_addr, struct sockaddr *src_addr, quicly_decoded_packet_t *packet)
+/**
+ * Processes one packet. The caller is responsible for holding the lock.
+ */
+static int receive_packet(quicly_conn_t *conn, struct sockaddr *dest_addr, struct sockaddr *src_addr,
+                          quicly_decoded_packet_t *packet)
 {
     ptls_cipher_context_t *header_protection;
     struct {
@@ -5802,10 +6384,6 @@ int quicly_receive(quicly_conn_t *conn, struct sockaddr *dest_addr, struct socka
     uint64_t pn, offending_frame_type = QUICLY_FRAME_TYPE_PADDING;
     int is_ack_only, ret;
 
-    assert(src_addr->sa_family == AF_INET || src_addr->sa_family == AF_INET6);
-
-    lock_now(conn, 0);
-
     QUICLY_PROBE(RECEIVE, conn, conn->stash.now,
                  QUICLY_PROBE_HEXDUMP(packet->cid.dest.encrypted.base, packet->cid.dest.encrypted.len), packet->octets.base,
                  packet->octets.len);
@@ -5877,8 +6455,8 @@ int quicly_receive(quicly_conn_t *conn, struct sockaddr *dest_addr, struct socka
                 goto Exit;
             }
             /* store token and ODCID */
-            free(conn->token.base);
-            if ((conn->token.base = malloc(packet->token.len)) == NULL) {
+            quicly_allocator_free(conn->super.allocator, conn->token.base, conn->token.len);
+            if ((conn->token.base = quicly_allocator_malloc(conn->super.allocator, packet->token.len)) == NULL) {
                 ret = PTLS_ERROR_NO_MEMORY;
                 goto Exit;
             }
@@ -5971,6 +6549,8 @@ int quicly_receive(quicly_conn_t *conn, struct sockaddr *dest_addr, struct socka
     if (conn->super.state == QUICLY_STATE_FIRSTFLIGHT)
         conn->super.state = QUICLY_STATE_CONNECTED;
     conn->super.stats.num_packets.received += 1;
+    if (packet->ecn != QUICLY_ECN_NOT_ECT)
+        ++conn->super.stats.num_ecn.received[get_ecn_index_from_bits(packet->ecn)];
 
     /* state updates, that are triggered by the receipt of a packet */
     switch (epoch) {
@@ -5997,7 +6577,8 @@ int quicly_receive(quicly_conn_t *conn, struct sockaddr *dest_addr, struct socka
     if ((ret = handle_payload(conn, epoch, payload.base, payload.len, &offending_frame_type, &is_ack_only)) != 0)
         goto Exit;
     if (*space != NULL && conn->super.state < QUICLY_STATE_CLOSING) {
-        if ((ret = record_receipt(*space, pn, is_ack_only, conn->stash.now, &conn->egress.send_ack_at)) != 0)
+        if ((ret = record_receipt(*space, pn, packet->ecn, is_ack_only, conn->stash.now,
+                                  QUICLY_DELAYED_ACK_TIMEOUT * conn->super.ctx->clock_resolution, &conn->egress.send_ack_at)) != 0)
             goto Exit;
     }
 
@@ -6043,14 +6624,6 @@ int quicly_receive(quicly_conn_t *conn, struct sockaddr *dest_addr, struct socka
 Exit:
     switch (ret) {
     case 0:
-        /* Avoid time in the past being emitted by quicly_get_first_timeout. We hit the condition below when retransmission is
-         * suspended by the 3x limit (in which case we have loss.alarm_at set but return INT64_MAX from quicly_get_first_timeout
-         * until we receive something from the client).
-         */
-        if (conn->egress.loss.alarm_at < conn->stash.now)
-            conn->egress.loss.alarm_at = conn->stash.now;
-        assert_consistency(conn, 0);
-        break;
     case PTLS_ERROR_NO_MEMORY:
     case QUICLY_ERROR_STATE_EXHAUSTION:
     case QUICLY_ERROR_PACKET_IGNORED:
@@ -6060,6 +6633,121 @@ Exit:
         ret = 0;
         break;
     }
+    return ret;
+}
+
+/**
+ * Updates the state after processing a batch of packets.
+ */
+static void on_receive_complete(quicly_conn_t *conn)
+{
+    /* Avoid time in the past being emitted by quicly_get_first_timeout. We hit the condition below when retransmission is
+     * suspended by the 3x limit (in which case we have loss.alarm_at set but return INT64_MAX from quicly_get_first_timeout
+     * until we receive something from the client).
+     */
+    if (conn->egress.loss.alarm_at < conn->stash.now)
+        conn->egress.loss.alarm_at = conn->stash.now;
+    assert_consistency(conn, 0);
+}
+
+int quicly_receive(quicly_conn_t *conn, struct sockaddr *dest_addr, struct sockaddr *src_addr, quicly_decoded_packet_t *packet)
+{
+    int ret;
+
+    assert(src_addr->sa_family == AF_INET || src_addr->sa_family == AF_INET6);
+
+    lock_now(conn, 0);
+    if ((ret = receive_packet(conn, dest_addr, src_addr, packet)) == 0)
+        on_receive_complete(conn);
+    unlock_now(conn);
+
+    return ret;
+}
+
+int quicly_receive_batch(quicly_conn_t *conn, struct sockaddr *dest_addr, struct sockaddr *src_addr,
+                         quicly_decoded_packet_t *packets, size_t num_packets)
+{
+    size_t i;
+    int ret = 0;
+
+    assert(src_addr->sa_family == AF_INET || src_addr->sa_family == AF_INET6);
+
+    lock_now(conn, 0);
+    for (i = 0; i != num_packets; ++i) {
+        switch (ret = receive_packet(conn, dest_addr, src_addr, packets + i)) {
+        case 0:
+        case QUICLY_ERROR_PACKET_IGNORED:
+            ret = 0;
+            break;
+        default:
+            goto Exit;
+        }
+    }
+Exit:
+    on_receive_complete(conn);
+    unlock_now(conn);
+
+    return ret;
+}
+
+int quicly_decrypt_packets(quicly_conn_t *conn, quicly_decoded_packet_t *packets, size_t num_packets)
+{
+    ptls_cipher_context_t *header_protection;
+    struct {
+        quicly_decoded_packet_t *packet;
+        uint64_t pn;
+        size_t aead_off;
+    } batch[16];
+    size_t batch_size, i = 0;
+    int ret = 0;
+
+    if (conn->application == NULL || (header_protection = conn->application->cipher.ingress.header_protection.one_rtt) == NULL)
+        return 0;
+
+    lock_now(conn, 0);
+
+    while (i < num_packets) {
+        /* Remove header protection of the packets first. Packet numbers are recovered using the largest packet number that has
+         * been authenticated before the batch, so that an unauthenticated packet cannot affect the decoding of others. */
+        uint64_t next_expected_pn = conn->application->super.next_expected_packet_number;
+        for (batch_size = 0; i < num_packets && batch_size < PTLS_ELEMENTSOF(batch); ++i) {
+            quicly_decoded_packet_t *packet = packets + i;
+            if (QUICLY_PACKET_IS_LONG_HEADER(packet->octets.base[0]) || packet->decrypted.pn != UINT64_MAX)
+                continue;
+            batch[batch_size].packet = packet;
+            if (remove_header_protection(header_protection, next_expected_pn, packet, &batch[batch_size].pn,
+                                         &batch[batch_size].aead_off) == 0)
+                ++batch_size;
+        }
+        /* then decrypt the payloads */
+        for (size_t j = 0; j != batch_size; ++j) {
+            quicly_decoded_packet_t *packet = batch[j].packet;
+            size_t ptlen;
+            if ((ret = aead_decrypt_1rtt(conn, batch[j].pn, packet, batch[j].aead_off, &ptlen)) != 0) {
+                /* The header protection has been removed and the payload might have been overwritten; mark the packet so that it
+                 * would not be decrypted again. Upon a fatal error, the rest of the batch is marked as well. */
+                if (ret == QUICLY_ERROR_PACKET_IGNORED) {
+                    packet->decrypted.pn = QUICLY_DECRYPTED_PN_FAILED;
+                    ret = 0;
+                    continue;
+                }
+                for (; j != batch_size; ++j)
+                    batch[j].packet->decrypted.pn = QUICLY_DECRYPTED_PN_FAILED;
+                goto Exit;
+            }
+            /* the packet is protected either by the key of the current phase or by that of the previous phase */
+            uint64_t key_phase = conn->application->cipher.ingress.key_phase.decrypted;
+            if ((key_phase & 1) != ((packet->octets.base[0] & QUICLY_KEY_PHASE_BIT) != 0))
+                --key_phase;
+            packet->decrypted.pn = batch[j].pn;
+            packet->decrypted.key_phase = key_phase;
+            packet->encrypted_off = batch[j].aead_off;
+            packet->octets.len = batch[j].aead_off + ptlen;
+            packet->_is_stateless_reset_cached = QUICLY__DECODED_PACKET_CACHED_NOT_STATELESS_RESET;
+        }
+    }
+
+Exit:
     unlock_now(conn);
     return ret;
 }
@@ -6125,6 +6813,7 @@ void quicly_reset_stream(quicly_stream_t *stream, int err)
     /* schedule for delivery */
     sched_stream_control(stream);
     resched_stream_data(stream);
+    update_timer(stream->conn);
 }
 
 void quicly_request_stop(quicly_stream_t *stream, int err)
@@ -6137,6 +6826,7 @@ void quicly_request_stop(quicly_stream_t *stream, int err)
         stream->_send_aux.stop_sending.sender_state = QUICLY_SENDER_STATE_SEND;
         stream->_send_aux.stop_sending.error_code = QUICLY_ERROR_GET_ERROR_CODE(err);
         sched_stream_control(stream);
+        update_timer(stream->conn);
     }
 }
 
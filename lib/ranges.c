@@ -43,13 +43,13 @@ static int insert_at(quicly_ranges_t *ranges, uint64_t start, uint64_t end, size
 {
     if (ranges->num_ranges == ranges->capacity) {
         size_t new_capacity = ranges->capacity < 4 ? 4 : ranges->capacity * 2;
-        quicly_range_t *new_ranges = malloc(new_capacity * sizeof(*new_ranges));
+        quicly_range_t *new_ranges = quicly_allocator_malloc(ranges->allocator, new_capacity * sizeof(*new_ranges));
         if (new_ranges == NULL)
             return PTLS_ERROR_NO_MEMORY;
         COPY(new_ranges, ranges->ranges, slot);
         COPY(new_ranges + slot + 1, ranges->ranges + slot, ranges->num_ranges - slot);
         if (ranges->ranges != &ranges->_initial)
-            free(ranges->ranges);
+            quicly_allocator_free(ranges->allocator, ranges->ranges, ranges->capacity * sizeof(*ranges->ranges));
         ranges->ranges = new_ranges;
         ranges->capacity = new_capacity;
     } else {
@@ -67,8 +67,9 @@ void quicly_ranges_drop_by_range_indices(quicly_ranges_t *ranges, size_t begin_r
     MOVE(ranges->ranges + begin_range_index, ranges->ranges + end_range_index, ranges->num_ranges - end_range_index);
     ranges->num_ranges -= end_range_index - begin_range_index;
     if (ranges->capacity > 4 && ranges->num_ranges * 3 <= ranges->capacity) {
-        size_t new_capacity = ranges->capacity / 2;
-        quicly_range_t *new_ranges = realloc(ranges->ranges, new_capacity * sizeof(*new_ranges));
+        size_t old_size = ranges->capacity * sizeof(*ranges->ranges), new_capacity = ranges->capacity / 2;
+        quicly_range_t *new_ranges =
+            quicly_allocator_realloc(ranges->allocator, ranges->ranges, old_size, new_capacity * sizeof(*new_ranges));
         if (new_ranges != NULL) {
             ranges->ranges = new_ranges;
             ranges->capacity = new_capacity;
@@ -88,9 +89,9 @@ static inline int merge_update(quicly_ranges_t *ranges, uint64_t start, uint64_t
     return 0;
 }
 
-int quicly_ranges_init_with_range(quicly_ranges_t *ranges, uint64_t start, uint64_t end)
+int quicly_ranges_init_with_range(quicly_ranges_t *ranges, quicly_allocator_t *allocator, uint64_t start, uint64_t end)
 {
-    quicly_ranges_init(ranges);
+    quicly_ranges_init(ranges, allocator);
     return insert_at(ranges, start, end, 0);
 }
 
@@ -22,16 +22,16 @@
 #include "quicly/constants.h"
 #include "quicly/recvstate.h"
 
-void quicly_recvstate_init(quicly_recvstate_t *state)
+void quicly_recvstate_init(quicly_recvstate_t *state, quicly_allocator_t *allocator)
 {
-    quicly_ranges_init_with_range(&state->received, 0, 0);
+    quicly_ranges_init_with_range(&state->received, allocator, 0, 0);
     state->data_off = 0;
     state->eos = UINT64_MAX;
 }
 
-void quicly_recvstate_init_closed(quicly_recvstate_t *state)
+void quicly_recvstate_init_closed(quicly_recvstate_t *state, quicly_allocator_t *allocator)
 {
-    quicly_ranges_init(&state->received);
+    quicly_ranges_init(&state->received, allocator);
     state->data_off = 0;
     state->eos = 0;
 }
@@ -26,17 +26,17 @@
 #include "quicly/constants.h"
 #include "quicly/sendstate.h"
 
-void quicly_sendstate_init(quicly_sendstate_t *state)
+void quicly_sendstate_init(quicly_sendstate_t *state, quicly_allocator_t *allocator)
 {
-    quicly_ranges_init_with_range(&state->acked, 0, 0);
-    quicly_ranges_init(&state->pending);
+    quicly_ranges_init_with_range(&state->acked, allocator, 0, 0);
+    quicly_ranges_init(&state->pending, allocator);
     state->size_inflight = 0;
     state->final_size = UINT64_MAX;
 }
 
-void quicly_sendstate_init_closed(quicly_sendstate_t *state)
+void quicly_sendstate_init_closed(quicly_sendstate_t *state, quicly_allocator_t *allocator)
 {
-    quicly_sendstate_init(state);
+    quicly_sendstate_init(state, allocator);
     state->acked.ranges[0].end = 1;
     state->final_size = 0;
 }
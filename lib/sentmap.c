@@ -21,11 +21,72 @@
  */
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include "picotls.h"
 #include "quicly/sentmap.h"
 
 const quicly_sent_t quicly_sentmap__end_iter = {quicly_sentmap__type_packet, {{UINT64_MAX, INT64_MAX}}};
 
+static struct st_quicly_sent_block_t *pool_alloc(quicly_sent_block_allocator_t *_self)
+{
+    quicly_sent_block_pool_t *self = (void *)_self;
+    struct st_quicly_sent_block_t *block;
+
+    if ((block = self->head) != NULL) {
+        self->head = block->next;
+        --self->count;
+    } else {
+        block = quicly_allocator_malloc(self->allocator, sizeof(*block));
+    }
+
+    return block;
+}
+
+static void pool_free(quicly_sent_block_allocator_t *_self, struct st_quicly_sent_block_t *block)
+{
+    quicly_sent_block_pool_t *self = (void *)_self;
+
+    if (self->count < self->capacity) {
+        block->next = self->head;
+        self->head = block;
+        ++self->count;
+    } else {
+        quicly_allocator_free(self->allocator, block, sizeof(*block));
+    }
+}
+
+void quicly_sent_block_pool_init(quicly_sent_block_pool_t *pool, size_t capacity, quicly_allocator_t *allocator)
+{
+    *pool = (quicly_sent_block_pool_t){{pool_alloc, pool_free}, NULL, 0, capacity, allocator};
+}
+
+void quicly_sent_block_pool_dispose(quicly_sent_block_pool_t *pool)
+{
+    struct st_quicly_sent_block_t *block;
+
+    while ((block = pool->head) != NULL) {
+        pool->head = block->next;
+        quicly_allocator_free(pool->allocator, block, sizeof(*block));
+    }
+    pool->count = 0;
+}
+
+static struct st_quicly_sent_block_t *alloc_block(quicly_sentmap_t *map)
+{
+    if (map->block_allocator != NULL)
+        return map->block_allocator->alloc(map->block_allocator);
+    return quicly_allocator_malloc(map->allocator, sizeof(struct st_quicly_sent_block_t));
+}
+
+static void release_block(quicly_sentmap_t *map, struct st_quicly_sent_block_t *block)
+{
+    if (map->block_allocator != NULL) {
+        map->block_allocator->free(map->block_allocator, block);
+    } else {
+        quicly_allocator_free(map->allocator, block, sizeof(*block));
+    }
+}
+
 static void next_entry(quicly_sentmap_iter_t *iter)
 {
     if (--iter->count != 0) {
@@ -43,14 +104,62 @@ static void next_entry(quicly_sentmap_iter_t *iter)
         ++iter->p;
 }
 
+static struct st_quicly_sent_block_index_entry_t *get_index_entry(quicly_sentmap_t *map, struct st_quicly_sent_block_t *block)
+{
+    assert(map->index.start_seq <= block->seq && block->seq - map->index.start_seq < map->index.end - map->index.start);
+    return map->index.entries + map->index.start + (block->seq - map->index.start_seq);
+}
+
+static int push_index_entry(quicly_sentmap_t *map, struct st_quicly_sent_block_t *block)
+{
+    if (map->index.end == map->index.capacity) {
+        size_t num_entries = map->index.end - map->index.start;
+        if (map->index.start != 0 && map->index.start >= map->index.capacity / 2) {
+            /* move the entries to the front, when sufficient space is available there */
+            memmove(map->index.entries, map->index.entries + map->index.start, sizeof(map->index.entries[0]) * num_entries);
+        } else {
+            size_t new_capacity = map->index.capacity == 0 ? 16 : map->index.capacity * 2;
+            struct st_quicly_sent_block_index_entry_t *new_entries;
+            if ((new_entries = quicly_allocator_malloc(map->allocator, sizeof(*new_entries) * new_capacity)) == NULL)
+                return PTLS_ERROR_NO_MEMORY;
+            if (num_entries != 0)
+                memcpy(new_entries, map->index.entries + map->index.start, sizeof(*new_entries) * num_entries);
+            quicly_allocator_free(map->allocator, map->index.entries, sizeof(*new_entries) * map->index.capacity);
+            map->index.entries = new_entries;
+            map->index.capacity = new_capacity;
+        }
+        map->index.start = 0;
+        map->index.end = num_entries;
+    }
+
+    block->seq = map->index.start_seq + (map->index.end - map->index.start);
+    map->index.entries[map->index.end++] = (struct st_quicly_sent_block_index_entry_t){
+        map->_pending_packet != NULL ? map->_pending_packet->data.packet.packet_number : 0, block};
+    return 0;
+}
+
+static void remove_index_entry(quicly_sentmap_t *map, struct st_quicly_sent_block_t *block)
+{
+    get_index_entry(map, block)->block = NULL;
+
+    /* drop the entries that have reached the front */
+    while (map->index.start != map->index.end && map->index.entries[map->index.start].block == NULL) {
+        ++map->index.start;
+        ++map->index.start_seq;
+    }
+}
+
 static struct st_quicly_sent_block_t **free_block(quicly_sentmap_t *map, struct st_quicly_sent_block_t **ref)
 {
     static const struct st_quicly_sent_block_t dummy = {NULL};
     static const struct st_quicly_sent_block_t *const dummy_ref = &dummy;
     struct st_quicly_sent_block_t *block = *ref;
 
+    remove_index_entry(map, block);
+
     if (block->next != NULL) {
         *ref = block->next;
+        (*ref)->prev = block->prev;
         assert((*ref)->num_entries != 0);
     } else {
         assert(block == map->tail);
@@ -64,7 +173,7 @@ static struct st_quicly_sent_block_t **free_block(quicly_sentmap_t *map, struct
         ref = (struct st_quicly_sent_block_t **)&dummy_ref;
     }
 
-    free(block);
+    release_block(map, block);
     return ref;
 }
 
@@ -88,8 +197,9 @@ void quicly_sentmap_dispose(quicly_sentmap_t *map)
 
     while ((block = map->head) != NULL) {
         map->head = block->next;
-        free(block);
+        release_block(map, block);
     }
+    quicly_allocator_free(map->allocator, map->index.entries, sizeof(*map->index.entries) * map->index.capacity);
 }
 
 int quicly_sentmap_prepare(quicly_sentmap_t *map, uint64_t packet_number, int64_t now, uint8_t ack_epoch)
@@ -98,7 +208,12 @@ int quicly_sentmap_prepare(quicly_sentmap_t *map, uint64_t packet_number, int64_
 
     if ((map->_pending_packet = quicly_sentmap_allocate(map, quicly_sentmap__type_packet)) == NULL)
         return PTLS_ERROR_NO_MEMORY;
+    /* if the header is the first entry of the block, the block is indexed by the PN of this packet */
+    if (map->_pending_packet == map->tail->entries)
+        get_index_entry(map, map->tail)->pn = packet_number;
     map->_pending_packet->data.packet = (quicly_sent_packet_t){packet_number, now, ack_epoch};
+    map->_pending_packet->data.packet.is_app_limited = map->app_limited_until != 0;
+    map->_pending_packet->data.packet.delivered = (uint32_t)map->delivered;
     return 0;
 }
 
@@ -106,10 +221,15 @@ struct st_quicly_sent_block_t *quicly_sentmap__new_block(quicly_sentmap_t *map)
 {
     struct st_quicly_sent_block_t *block;
 
-    if ((block = malloc(sizeof(*block))) == NULL)
+    if ((block = alloc_block(map)) == NULL)
         return NULL;
+    if (push_index_entry(map, block) != 0) {
+        release_block(map, block);
+        return NULL;
+    }
 
     block->next = NULL;
+    block->prev = map->tail;
     block->num_entries = 0;
     block->next_insert_at = 0;
     if (map->tail != NULL) {
@@ -129,6 +249,42 @@ void quicly_sentmap_skip(quicly_sentmap_iter_t *iter)
     } while (iter->p->acked != quicly_sentmap__type_packet);
 }
 
+void quicly_sentmap_seek(quicly_sentmap_t *map, quicly_sentmap_iter_t *iter, uint64_t pn)
+{
+    if (quicly_sentmap_get(iter)->packet_number >= pn)
+        return;
+
+    /* find the last block with an index value smaller than `pn`; headers of packets with PN equal to or greater than `pn` reside in
+     * that block or in the succeeding ones */
+    size_t lo = map->index.start, hi = map->index.end;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map->index.entries[mid].pn < pn) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo != map->index.start) {
+        size_t i = lo - 1;
+        while (i < map->index.end && map->index.entries[i].block == NULL)
+            ++i;
+        /* move the iterator to the beginning of the block, if the block is ahead of the current position */
+        struct st_quicly_sent_block_t *block;
+        if (i < map->index.end && (block = map->index.entries[i].block)->seq > (*iter->ref)->seq) {
+            iter->ref = block->prev != NULL ? &block->prev->next : &map->head;
+            iter->count = block->num_entries;
+            for (iter->p = block->entries; iter->p->acked == NULL; ++iter->p)
+                ;
+            if (iter->p->acked != quicly_sentmap__type_packet)
+                quicly_sentmap_skip(iter);
+        }
+    }
+
+    while (quicly_sentmap_get(iter)->packet_number < pn)
+        quicly_sentmap_skip(iter);
+}
+
 int quicly_sentmap_update(quicly_sentmap_t *map, quicly_sentmap_iter_t *iter, quicly_sentmap_event_t event)
 {
     quicly_sent_packet_t packet;
@@ -144,6 +300,8 @@ int quicly_sentmap_update(quicly_sentmap_t *map, quicly_sentmap_iter_t *iter, qu
     if (packet.cc_bytes_in_flight != 0 && event != QUICLY_SENTMAP_EVENT_PTO) {
         assert(map->bytes_in_flight >= packet.cc_bytes_in_flight);
         map->bytes_in_flight -= packet.cc_bytes_in_flight;
+        if (event == QUICLY_SENTMAP_EVENT_ACKED)
+            map->delivered += packet.cc_bytes_in_flight;
         iter->p->data.packet.cc_bytes_in_flight = 0;
     }
     iter->p->data.packet.frames_in_flight = 0;
@@ -169,6 +327,26 @@ Exit:
     return ret;
 }
 
+void quicly_sentmap_get_rate_sample(quicly_sentmap_t *map, const quicly_sent_packet_t *newest_acked, int64_t now,
+                                    quicly_delivery_rate_sample_t *rs)
+{
+    /* the application-limited period ends once the bytes that were inflight when it began are acked */
+    if (map->app_limited_until != 0 && map->delivered > map->app_limited_until)
+        map->app_limited_until = 0;
+
+    /* The sample is the number of bytes acked while `newest_acked` was inflight, divided by its round-trip time. The draft starts
+     * the interval at when `delivered` was last updated prior to sending the packet; as no ACK is processed in between, the number
+     * of bytes is the same. As the interval spans a full round-trip, compression of ACKs does not inflate the sample. `delivered`
+     * is recorded in 32 bits, which is sufficient as long as less than 4GB is acked within one round-trip. */
+    rs->delivered = (uint32_t)((uint32_t)map->delivered - newest_acked->delivered);
+    if (now > newest_acked->sent_at) {
+        rs->interval = now - newest_acked->sent_at;
+    } else {
+        rs->interval = 1; /* same as RTT samples, force minimum of 1 clock tick */
+    }
+    rs->is_app_limited = newest_acked->is_app_limited;
+}
+
 int quicly_sentmap__type_packet(quicly_sentmap_t *map, const quicly_sent_packet_t *packet, int acked, quicly_sent_t *sent)
 {
     assert(!"quicly_sentmap__type_packet cannot be called");
@@ -24,6 +24,34 @@
 #include <string.h>
 #include "quicly/streambuf.h"
 
+/**
+ * copy of the data being written by `quicly_sendbuf_write`
+ */
+struct st_quicly_sendbuf_raw_t {
+    quicly_allocator_t *allocator;
+    /**
+     * number of bytes that can be stored in `bytes`; small writes are appended until the capacity is exhausted
+     */
+    size_t capacity;
+    uint8_t bytes[1];
+};
+
+/**
+ * shared buffer being allocated by `quicly_sendbuf_shared_new`, followed by the storage
+ */
+struct st_quicly_sendbuf_shared_alloc_t {
+    quicly_sendbuf_shared_t super;
+    quicly_allocator_t *allocator;
+};
+
+static int flatten_raw(quicly_sendbuf_vec_t *vec, void *dst, size_t off, size_t len);
+static void discard_raw(quicly_sendbuf_vec_t *vec);
+static int flatten_shared(quicly_sendbuf_vec_t *vec, void *dst, size_t off, size_t len);
+static void discard_shared(quicly_sendbuf_vec_t *vec);
+
+static const quicly_streambuf_sendvec_callbacks_t raw_callbacks = {flatten_raw, discard_raw},
+                                                  shared_callbacks = {flatten_shared, discard_shared};
+
 static void convert_error(quicly_stream_t *stream, int err)
 {
     assert(err != 0);
@@ -47,7 +75,7 @@ void quicly_sendbuf_dispose(quicly_sendbuf_t *sb)
         if (vec->cb->discard_vec != NULL)
             vec->cb->discard_vec(vec);
     }
-    free(sb->vecs.entries);
+    quicly_allocator_free(sb->allocator, sb->vecs.entries, sb->vecs.capacity * sizeof(*sb->vecs.entries));
 }
 
 void quicly_sendbuf_shift(quicly_stream_t *stream, quicly_sendbuf_t *sb, size_t delta)
@@ -72,7 +100,7 @@ void quicly_sendbuf_shift(quicly_stream_t *stream, quicly_sendbuf_t *sb, size_t
             memmove(sb->vecs.entries, sb->vecs.entries + i, (sb->vecs.size - i) * sizeof(*sb->vecs.entries));
             sb->vecs.size -= i;
         } else {
-            free(sb->vecs.entries);
+            quicly_allocator_free(sb->allocator, sb->vecs.entries, sb->vecs.capacity * sizeof(*sb->vecs.entries));
             sb->vecs.entries = NULL;
             sb->vecs.size = 0;
             sb->vecs.capacity = 0;
@@ -118,37 +146,151 @@ void quicly_sendbuf_emit(quicly_stream_t *stream, quicly_sendbuf_t *sb, size_t o
     }
 }
 
+/**
+ * Returns the address of the data being held by the vector, or NULL if the data can only be obtained by calling `flatten_vec`.
+ */
+static uint8_t *get_vec_bytes(quicly_sendbuf_vec_t *vec)
+{
+    if (vec->cb == &raw_callbacks)
+        return ((struct st_quicly_sendbuf_raw_t *)vec->cbdata)->bytes;
+    if (vec->cb == &shared_callbacks)
+        return ((quicly_sendbuf_shared_t *)vec->cbdata)->bytes + vec->off;
+    return NULL;
+}
+
+void quicly_sendbuf_emit_vec(quicly_stream_t *stream, quicly_sendbuf_t *sb, size_t off, ptls_iovec_t *vecs, size_t *num_vecs,
+                             size_t *len, int *wrote_all)
+{
+    size_t vec_index, capacity = *len, max_vecs = *num_vecs;
+
+    *num_vecs = 0;
+    off += sb->off_in_first_vec;
+    for (vec_index = 0; capacity != 0 && vec_index < sb->vecs.size; ++vec_index) {
+        quicly_sendbuf_vec_t *vec = sb->vecs.entries + vec_index;
+        if (off < vec->len) {
+            uint8_t *bytes;
+            if (*num_vecs == max_vecs || (bytes = get_vec_bytes(vec)) == NULL)
+                break;
+            size_t bytes_emit = vec->len - off;
+            int partial = 0;
+            if (capacity < bytes_emit) {
+                bytes_emit = capacity;
+                partial = 1;
+            }
+            vecs[(*num_vecs)++] = ptls_iovec_init(bytes + off, bytes_emit);
+            capacity -= bytes_emit;
+            off = 0;
+            if (partial)
+                break;
+        } else {
+            off -= vec->len;
+        }
+    }
+
+    *len = *len - capacity;
+    *wrote_all = vec_index == sb->vecs.size;
+}
+
 static int flatten_raw(quicly_sendbuf_vec_t *vec, void *dst, size_t off, size_t len)
 {
-    memcpy(dst, (uint8_t *)vec->cbdata + off, len);
+    struct st_quicly_sendbuf_raw_t *raw = vec->cbdata;
+    memcpy(dst, raw->bytes + off, len);
     return 0;
 }
 
 static void discard_raw(quicly_sendbuf_vec_t *vec)
 {
-    free(vec->cbdata);
+    struct st_quicly_sendbuf_raw_t *raw = vec->cbdata;
+    quicly_allocator_free(raw->allocator, raw, offsetof(struct st_quicly_sendbuf_raw_t, bytes) + raw->capacity);
 }
 
 int quicly_sendbuf_write(quicly_stream_t *stream, quicly_sendbuf_t *sb, const void *src, size_t len)
 {
-    static const quicly_streambuf_sendvec_callbacks_t raw_callbacks = {flatten_raw, discard_raw};
-    quicly_sendbuf_vec_t vec = {&raw_callbacks, len, NULL};
+    struct st_quicly_sendbuf_raw_t *raw;
+    size_t alloc_size;
     int ret;
 
     assert(quicly_sendstate_is_open(&stream->sendstate));
 
-    if ((vec.cbdata = malloc(len)) == NULL) {
-        ret = PTLS_ERROR_NO_MEMORY;
-        goto Error;
+    /* coalesce small writes by appending to the copy being built by the previous write, if there is room */
+    if (sb->vecs.size != 0) {
+        quicly_sendbuf_vec_t *last = sb->vecs.entries + sb->vecs.size - 1;
+        if (last->cb == &raw_callbacks && (raw = last->cbdata)->capacity - last->len >= len) {
+            memcpy(raw->bytes + last->len, src, len);
+            last->len += len;
+            sb->bytes_written += len;
+            return quicly_stream_sync_sendbuf(stream, 1);
+        }
     }
-    memcpy(vec.cbdata, src, len);
-    if ((ret = quicly_sendbuf_write_vec(stream, sb, &vec)) != 0)
-        goto Error;
+
+    /* allocate new copy; small writes use a slab so that subsequent writes can be appended */
+    if ((alloc_size = offsetof(struct st_quicly_sendbuf_raw_t, bytes) + len) < QUICLY_SENDBUF_SLAB_SIZE)
+        alloc_size = QUICLY_SENDBUF_SLAB_SIZE;
+    if ((raw = quicly_allocator_malloc(sb->allocator, alloc_size)) == NULL)
+        return PTLS_ERROR_NO_MEMORY;
+    raw->allocator = sb->allocator;
+    raw->capacity = alloc_size - offsetof(struct st_quicly_sendbuf_raw_t, bytes);
+    memcpy(raw->bytes, src, len);
+    quicly_sendbuf_vec_t vec = {&raw_callbacks, len, raw};
+    if ((ret = quicly_sendbuf_write_vec(stream, sb, &vec)) != 0) {
+        discard_raw(&vec);
+        return ret;
+    }
+    return 0;
+}
+
+static int flatten_shared(quicly_sendbuf_vec_t *vec, void *dst, size_t off, size_t len)
+{
+    quicly_sendbuf_shared_t *shared = vec->cbdata;
+    memcpy(dst, shared->bytes + vec->off + off, len);
     return 0;
+}
 
-Error:
-    free(vec.cbdata);
-    return ret;
+static void discard_shared(quicly_sendbuf_vec_t *vec)
+{
+    quicly_sendbuf_shared_release(vec->cbdata);
+}
+
+static void dispose_shared_alloc(quicly_sendbuf_shared_t *_shared)
+{
+    struct st_quicly_sendbuf_shared_alloc_t *shared = (void *)_shared;
+    quicly_allocator_free(shared->allocator, shared, sizeof(*shared) + shared->super.len);
+}
+
+quicly_sendbuf_shared_t *quicly_sendbuf_shared_new(quicly_allocator_t *allocator, size_t len)
+{
+    struct st_quicly_sendbuf_shared_alloc_t *shared;
+
+    if ((shared = quicly_allocator_malloc(allocator, sizeof(*shared) + len)) == NULL)
+        return NULL;
+    quicly_sendbuf_shared_init(&shared->super, (uint8_t *)shared + sizeof(*shared), len, dispose_shared_alloc);
+    shared->allocator = allocator;
+
+    return &shared->super;
+}
+
+void quicly_sendbuf_shared_init_vec(quicly_sendbuf_vec_t *vec, quicly_sendbuf_shared_t *shared, size_t off, size_t len)
+{
+    assert(off + len <= shared->len);
+
+    quicly_sendbuf_shared_addref(shared);
+    *vec = (quicly_sendbuf_vec_t){&shared_callbacks, len, shared, off};
+}
+
+int quicly_sendbuf_write_shared(quicly_stream_t *stream, quicly_sendbuf_t *sb, quicly_sendbuf_shared_t *shared, size_t off,
+                                size_t len)
+{
+    quicly_sendbuf_vec_t vec;
+    int ret;
+
+    assert(quicly_sendstate_is_open(&stream->sendstate));
+
+    quicly_sendbuf_shared_init_vec(&vec, shared, off, len);
+    if ((ret = quicly_sendbuf_write_vec(stream, sb, &vec)) != 0) {
+        discard_shared(&vec);
+        return ret;
+    }
+    return 0;
 }
 
 int quicly_sendbuf_write_vec(quicly_stream_t *stream, quicly_sendbuf_t *sb, quicly_sendbuf_vec_t *vec)
@@ -158,7 +300,8 @@ int quicly_sendbuf_write_vec(quicly_stream_t *stream, quicly_sendbuf_t *sb, quic
     if (sb->vecs.size == sb->vecs.capacity) {
         quicly_sendbuf_vec_t *new_entries;
         size_t new_capacity = sb->vecs.capacity == 0 ? 4 : sb->vecs.capacity * 2;
-        if ((new_entries = realloc(sb->vecs.entries, new_capacity * sizeof(*sb->vecs.entries))) == NULL)
+        if ((new_entries = quicly_allocator_realloc(sb->allocator, sb->vecs.entries, sb->vecs.capacity * sizeof(*sb->vecs.entries),
+                                                    new_capacity * sizeof(*sb->vecs.entries))) == NULL)
             return PTLS_ERROR_NO_MEMORY;
         sb->vecs.entries = new_entries;
         sb->vecs.capacity = new_capacity;
@@ -178,19 +321,23 @@ void quicly_recvbuf_shift(quicly_stream_t *stream, ptls_buffer_t *rb, size_t del
     quicly_stream_sync_recvbuf(stream, delta);
 }
 
-ptls_iovec_t quicly_recvbuf_get(quicly_stream_t *stream, ptls_buffer_t *rb)
+/**
+ * returns the number of contiguous bytes available at the front of the receive buffer
+ */
+static size_t calc_recvbuf_avail(quicly_stream_t *stream, size_t bytes_buffered)
 {
-    size_t avail;
-
     if (quicly_recvstate_transfer_complete(&stream->recvstate)) {
-        avail = rb->off;
+        return bytes_buffered;
     } else if (stream->recvstate.data_off < stream->recvstate.received.ranges[0].end) {
-        avail = stream->recvstate.received.ranges[0].end - stream->recvstate.data_off;
+        return stream->recvstate.received.ranges[0].end - stream->recvstate.data_off;
     } else {
-        avail = 0;
+        return 0;
     }
+}
 
-    return ptls_iovec_init(rb->base, avail);
+ptls_iovec_t quicly_recvbuf_get(quicly_stream_t *stream, ptls_buffer_t *rb)
+{
+    return ptls_iovec_init(rb->base, calc_recvbuf_avail(stream, rb->off));
 }
 
 int quicly_recvbuf_receive(quicly_stream_t *stream, ptls_buffer_t *rb, size_t off, const void *src, size_t len)
@@ -208,6 +355,127 @@ int quicly_recvbuf_receive(quicly_stream_t *stream, ptls_buffer_t *rb, size_t of
     return 0;
 }
 
+void quicly_chunked_recvbuf_dispose(quicly_chunked_recvbuf_t *rb)
+{
+    size_t i;
+
+    for (i = 0; i != rb->chunks.size; ++i)
+        quicly_allocator_free(rb->allocator, rb->chunks.entries[(rb->chunks.first + i) % rb->chunks.capacity],
+                              QUICLY_RECVBUF_CHUNK_SIZE);
+    quicly_allocator_free(rb->allocator, rb->chunks.entries, rb->chunks.capacity * sizeof(*rb->chunks.entries));
+}
+
+static int reserve_chunk_slots(quicly_chunked_recvbuf_t *rb, size_t num_slots)
+{
+    if (num_slots > rb->chunks.capacity) {
+        uint8_t **new_entries;
+        size_t new_capacity = rb->chunks.capacity == 0 ? 4 : rb->chunks.capacity * 2, i;
+        while (new_capacity < num_slots)
+            new_capacity *= 2;
+        if ((new_entries = quicly_allocator_malloc(rb->allocator, new_capacity * sizeof(*new_entries))) == NULL)
+            return PTLS_ERROR_NO_MEMORY;
+        for (i = 0; i != rb->chunks.size; ++i)
+            new_entries[i] = rb->chunks.entries[(rb->chunks.first + i) % rb->chunks.capacity];
+        quicly_allocator_free(rb->allocator, rb->chunks.entries, rb->chunks.capacity * sizeof(*rb->chunks.entries));
+        rb->chunks.entries = new_entries;
+        rb->chunks.first = 0;
+        rb->chunks.capacity = new_capacity;
+    }
+    while (rb->chunks.size < num_slots) {
+        rb->chunks.entries[(rb->chunks.first + rb->chunks.size) % rb->chunks.capacity] = NULL;
+        ++rb->chunks.size;
+    }
+    return 0;
+}
+
+int quicly_chunked_recvbuf_write(quicly_chunked_recvbuf_t *rb, size_t off, const void *src, size_t len)
+{
+    size_t pos = rb->off_in_first_chunk + off, end = pos + len;
+    int ret;
+
+    if (len == 0)
+        return 0;
+
+    if ((ret = reserve_chunk_slots(rb, (end + QUICLY_RECVBUF_CHUNK_SIZE - 1) / QUICLY_RECVBUF_CHUNK_SIZE)) != 0)
+        return ret;
+    while (pos != end) {
+        uint8_t **chunk = rb->chunks.entries + (rb->chunks.first + pos / QUICLY_RECVBUF_CHUNK_SIZE) % rb->chunks.capacity;
+        size_t off_in_chunk = pos % QUICLY_RECVBUF_CHUNK_SIZE, bytes_copy = QUICLY_RECVBUF_CHUNK_SIZE - off_in_chunk;
+        if (*chunk == NULL && (*chunk = quicly_allocator_malloc(rb->allocator, QUICLY_RECVBUF_CHUNK_SIZE)) == NULL)
+            return PTLS_ERROR_NO_MEMORY;
+        if (bytes_copy > end - pos)
+            bytes_copy = end - pos;
+        memcpy(*chunk + off_in_chunk, src, bytes_copy);
+        src = (const uint8_t *)src + bytes_copy;
+        pos += bytes_copy;
+    }
+    if (rb->off < off + len)
+        rb->off = off + len;
+
+    return 0;
+}
+
+size_t quicly_chunked_recvbuf_peek(quicly_chunked_recvbuf_t *rb, size_t len, ptls_iovec_t *vecs, size_t *num_vecs)
+{
+    size_t max_vecs = *num_vecs, pos = rb->off_in_first_chunk, end;
+
+    assert(len <= rb->off);
+
+    end = pos + len;
+    *num_vecs = 0;
+    while (pos != end && *num_vecs != max_vecs) {
+        uint8_t *chunk = rb->chunks.entries[(rb->chunks.first + pos / QUICLY_RECVBUF_CHUNK_SIZE) % rb->chunks.capacity];
+        size_t off_in_chunk = pos % QUICLY_RECVBUF_CHUNK_SIZE, bytes_avail = QUICLY_RECVBUF_CHUNK_SIZE - off_in_chunk;
+        assert(chunk != NULL);
+        if (bytes_avail > end - pos)
+            bytes_avail = end - pos;
+        vecs[(*num_vecs)++] = ptls_iovec_init(chunk + off_in_chunk, bytes_avail);
+        pos += bytes_avail;
+    }
+
+    return pos - rb->off_in_first_chunk;
+}
+
+void quicly_chunked_recvbuf_consume(quicly_chunked_recvbuf_t *rb, size_t delta)
+{
+    assert(delta <= rb->off);
+
+    rb->off -= delta;
+    rb->off_in_first_chunk += delta;
+    while (rb->off_in_first_chunk >= QUICLY_RECVBUF_CHUNK_SIZE) {
+        assert(rb->chunks.size != 0);
+        quicly_allocator_free(rb->allocator, rb->chunks.entries[rb->chunks.first], QUICLY_RECVBUF_CHUNK_SIZE);
+        rb->chunks.first = (rb->chunks.first + 1) % rb->chunks.capacity;
+        --rb->chunks.size;
+        rb->off_in_first_chunk -= QUICLY_RECVBUF_CHUNK_SIZE;
+    }
+    /* when everything has been consumed, rewind so that the first chunk can be reused from its beginning */
+    if (rb->off == 0)
+        rb->off_in_first_chunk = 0;
+}
+
+void quicly_chunked_recvbuf_shift(quicly_stream_t *stream, quicly_chunked_recvbuf_t *rb, size_t delta)
+{
+    quicly_chunked_recvbuf_consume(rb, delta);
+    quicly_stream_sync_recvbuf(stream, delta);
+}
+
+size_t quicly_chunked_recvbuf_get(quicly_stream_t *stream, quicly_chunked_recvbuf_t *rb, ptls_iovec_t *vecs, size_t *num_vecs)
+{
+    return quicly_chunked_recvbuf_peek(rb, calc_recvbuf_avail(stream, rb->off), vecs, num_vecs);
+}
+
+int quicly_chunked_recvbuf_receive(quicly_stream_t *stream, quicly_chunked_recvbuf_t *rb, size_t off, const void *src, size_t len)
+{
+    int ret;
+
+    if ((ret = quicly_chunked_recvbuf_write(rb, off, src, len)) != 0) {
+        convert_error(stream, ret);
+        return -1;
+    }
+    return 0;
+}
+
 int quicly_streambuf_create(quicly_stream_t *stream, size_t sz)
 {
     quicly_streambuf_t *sbuf;
@@ -215,10 +483,11 @@ int quicly_streambuf_create(quicly_stream_t *stream, size_t sz)
     assert(sz >= sizeof(*sbuf));
     assert(stream->data == NULL);
 
-    if ((sbuf = malloc(sz)) == NULL)
+    if ((sbuf = quicly_allocator_malloc(quicly_get_allocator(stream->conn), sz)) == NULL)
         return PTLS_ERROR_NO_MEMORY;
-    quicly_sendbuf_init(&sbuf->egress);
+    quicly_sendbuf_init(&sbuf->egress, quicly_get_allocator(stream->conn));
     ptls_buffer_init(&sbuf->ingress, "", 0);
+    sbuf->_size = sz;
     if (sz != sizeof(*sbuf))
         memset((char *)sbuf + sizeof(*sbuf), 0, sz - sizeof(*sbuf));
 
@@ -232,7 +501,7 @@ void quicly_streambuf_destroy(quicly_stream_t *stream, int err)
 
     quicly_sendbuf_dispose(&sbuf->egress);
     ptls_buffer_dispose(&sbuf->ingress);
-    free(sbuf);
+    quicly_allocator_free(quicly_get_allocator(stream->conn), sbuf, sbuf->_size);
     stream->data = NULL;
 }
 
@@ -242,6 +511,13 @@ void quicly_streambuf_egress_emit(quicly_stream_t *stream, size_t off, void *dst
     quicly_sendbuf_emit(stream, &sbuf->egress, off, dst, len, wrote_all);
 }
 
+void quicly_streambuf_egress_emit_vec(quicly_stream_t *stream, size_t off, ptls_iovec_t *vecs, size_t *num_vecs, size_t *len,
+                                      int *wrote_all)
+{
+    quicly_streambuf_t *sbuf = stream->data;
+    quicly_sendbuf_emit_vec(stream, &sbuf->egress, off, vecs, num_vecs, len, wrote_all);
+}
+
 int quicly_streambuf_egress_shutdown(quicly_stream_t *stream)
 {
     quicly_streambuf_t *sbuf = stream->data;
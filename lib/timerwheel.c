@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <assert.h>
+#include <stddef.h>
+#include "quicly/timerwheel.h"
+
+#define SLOT_MASK (QUICLY_TIMERWHEEL_SLOTS_PER_LEVEL - 1)
+#define TOP_LEVEL (QUICLY_TIMERWHEEL_NUM_LEVELS - 1)
+/**
+ * the farthest point in time (relative to `last_run`) that can be represented by the wheel
+ */
+#define MAX_TICKS ((uint64_t)SLOT_MASK << (QUICLY_TIMERWHEEL_BITS_PER_LEVEL * TOP_LEVEL))
+
+/**
+ * Returns the level to which a timer should be linked. Timers are linked to the level at which the slot index of `at` first differs
+ * from that of `last_run` (when comparing from the top).
+ */
+static size_t get_level(uint64_t at, uint64_t last_run)
+{
+    uint64_t diff = at ^ last_run;
+    size_t level = 0;
+
+    while ((diff >>= QUICLY_TIMERWHEEL_BITS_PER_LEVEL) != 0)
+        ++level;
+
+    return level < TOP_LEVEL ? level : TOP_LEVEL;
+}
+
+/**
+ * Returns the range of (unmasked) slot indexes of given level that might contain timers.
+ */
+static uint64_t get_slot_range(quicly_timerwheel_t *wheel, size_t level, uint64_t *end)
+{
+    uint64_t cur = (uint64_t)wheel->last_run >> (level * QUICLY_TIMERWHEEL_BITS_PER_LEVEL);
+
+    /* except for the top level that wraps around, each level holds the remainder of the current round */
+    *end = level < TOP_LEVEL ? cur | SLOT_MASK : cur + SLOT_MASK;
+    return cur + 1;
+}
+
+void quicly_timerwheel_init(quicly_timerwheel_t *wheel, int64_t now)
+{
+    size_t level, slot;
+
+    assert(now >= 0);
+
+    wheel->last_run = now;
+    quicly_linklist_init(&wheel->expired);
+    for (level = 0; level != QUICLY_TIMERWHEEL_NUM_LEVELS; ++level)
+        for (slot = 0; slot != QUICLY_TIMERWHEEL_SLOTS_PER_LEVEL; ++slot)
+            quicly_linklist_init(&wheel->slots[level][slot]);
+}
+
+void quicly_timerwheel_dispose(quicly_timerwheel_t *wheel)
+{
+    assert(quicly_timerwheel_get_wake_at(wheel) == INT64_MAX);
+}
+
+void quicly_timerwheel_link(quicly_timerwheel_t *wheel, quicly_timer_t *timer, int64_t at)
+{
+    quicly_timerwheel_unlink(timer);
+    timer->at = at;
+
+    if (at <= wheel->last_run) {
+        quicly_linklist_insert(wheel->expired.prev, &timer->_link);
+        return;
+    }
+
+    /* timers beyond the span of the wheel are linked to the farthest slot, and are relinked when that slot is reached */
+    uint64_t ticks = (uint64_t)at;
+    if (ticks - wheel->last_run > MAX_TICKS)
+        ticks = wheel->last_run + MAX_TICKS;
+
+    size_t level = get_level(ticks, wheel->last_run);
+    quicly_linklist_insert(
+        wheel->slots[level][(ticks >> (level * QUICLY_TIMERWHEEL_BITS_PER_LEVEL)) & SLOT_MASK].prev, &timer->_link);
+}
+
+int64_t quicly_timerwheel_get_wake_at(quicly_timerwheel_t *wheel)
+{
+    size_t level;
+
+    if (quicly_linklist_is_linked(&wheel->expired))
+        return wheel->last_run;
+
+    /* the slots of lower levels always precede those of higher levels; return the start of the first slot being occupied */
+    for (level = 0; level != QUICLY_TIMERWHEEL_NUM_LEVELS; ++level) {
+        uint64_t index, end;
+        for (index = get_slot_range(wheel, level, &end); index <= end; ++index) {
+            if (quicly_linklist_is_linked(&wheel->slots[level][index & SLOT_MASK]))
+                return (int64_t)(index << (level * QUICLY_TIMERWHEEL_BITS_PER_LEVEL));
+        }
+    }
+
+    return INT64_MAX;
+}
+
+/**
+ * Advances the wheel to `now`, moving the timers that have expired to the expired list. Timers in the slots being passed that have
+ * not yet expired are relinked, moving to lower levels.
+ */
+static void advance(quicly_timerwheel_t *wheel, int64_t now)
+{
+    quicly_linklist_t pending;
+    size_t level;
+
+    if (now <= wheel->last_run)
+        return;
+
+    quicly_linklist_init(&pending);
+
+    /* collect timers in the slots that cover the period between `last_run` and `now` */
+    for (level = 0; level != QUICLY_TIMERWHEEL_NUM_LEVELS; ++level) {
+        uint64_t index, end, upto = (uint64_t)now >> (level * QUICLY_TIMERWHEEL_BITS_PER_LEVEL);
+        index = get_slot_range(wheel, level, &end);
+        if (upto < end)
+            end = upto;
+        for (; index <= end; ++index)
+            quicly_linklist_insert_list(pending.prev, &wheel->slots[level][index & SLOT_MASK]);
+    }
+
+    /* update the time and relink the collected timers */
+    wheel->last_run = now;
+    while (quicly_linklist_is_linked(&pending)) {
+        quicly_timer_t *timer = (quicly_timer_t *)((char *)pending.next - offsetof(quicly_timer_t, _link));
+        quicly_linklist_unlink(&timer->_link);
+        quicly_timerwheel_link(wheel, timer, timer->at);
+    }
+}
+
+quicly_timer_t *quicly_timerwheel_pop(quicly_timerwheel_t *wheel, int64_t now)
+{
+    if (!quicly_linklist_is_linked(&wheel->expired))
+        advance(wheel, now);
+    if (!quicly_linklist_is_linked(&wheel->expired))
+        return NULL;
+
+    quicly_timer_t *timer = (quicly_timer_t *)((char *)wheel->expired.next - offsetof(quicly_timer_t, _link));
+    quicly_linklist_unlink(&timer->_link);
+    return timer;
+}
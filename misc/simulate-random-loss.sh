@@ -0,0 +1,18 @@
+#!/bin/sh
+#
+# Compares the throughput of congestion controllers on a long-fat path with random loss, using the simulator.
+#
+# usage: misc/simulate-random-loss.sh [path-to-simulator]
+#
+# Each line of the output is the throughput summary being emitted by the simulator, prefixed by the random loss rate.
+
+SIMULATOR=${1:-./simulator}
+
+# 10MB/s bottleneck, 100ms one-way delay, 60 seconds
+ARGS="-b 10000000 -d 0.1 -q 0.2 -l 60"
+
+for LOSS in 0 0.001 0.01 ; do
+    for CC in cubic bbr ; do
+        $SIMULATOR $ARGS -p -r $LOSS -n $CC | grep '^{"sender"' | sed "s/^/$LOSS /"
+    done
+done
@@ -0,0 +1,18 @@
+#!/bin/sh
+#
+# Compares the losses induced by slow start with and without HyStart++, using the simulator.
+#
+# usage: misc/simulate-slow-start.sh [path-to-simulator]
+#
+# Each line of the output is the summary being emitted by the simulator. With HyStart++, "packets-lost" is expected to drop, as slow
+# start is exited upon observing the increase of RTT instead of upon overflowing the bottleneck queue.
+
+SIMULATOR=${1:-./simulator}
+
+# 10MB/s bottleneck, 100ms one-way delay, 50ms queue, 10 seconds
+ARGS="-b 10000000 -d 0.1 -q 0.05 -l 10"
+
+for CC in reno cubic pico ; do
+    $SIMULATOR $ARGS -n $CC | grep '^{"sender"'
+    $SIMULATOR $ARGS -H -n $CC | grep '^{"sender"'
+done
@@ -28,13 +28,20 @@
 #include <netinet/udp.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <linux/net_tstamp.h>
+#endif
 #include <picotls.h>
 #if QUICLY_HAVE_FUSION
 #include "picotls/fusion.h"
 #endif
 #include "quicly.h"
+#include "quicly/conn_map.h"
 #include "quicly/defaults.h"
 #include "quicly/streambuf.h"
 #include "../deps/picotls/t/util.h"
@@ -45,6 +52,16 @@
 FILE *quicly_trace_fp = NULL;
 static unsigned verbosity = 0;
 static int suppress_output = 0, send_datagram_frame = 0;
+/**
+ * When SO_TXTIME is used, departure time of each datagram is calculated using the pacing rate (`bytes_per_msec`) of the connection
+ * that sent the datagram most recently. `next_at` retains the earliest time (in nanoseconds, CLOCK_MONOTONIC) at which the next
+ * datagram can depart.
+ */
+static __thread struct {
+    int enabled;
+    uint32_t bytes_per_msec;
+    uint64_t next_at;
+} txtime;
 static int64_t enqueue_requests_at = 0, request_interval = 0;
 
 static void hexdump(const char *title, const uint8_t *p, size_t l)
@@ -70,11 +87,18 @@ static const char *session_file = NULL;
 static ptls_handshake_properties_t hs_properties;
 static quicly_transport_parameters_t resumed_transport_params;
 static ptls_iovec_t resumption_token;
-static quicly_context_t ctx;
-static quicly_cid_plaintext_t next_cid;
-static struct {
+/**
+ * The context, CID and the AEAD contexts are thread-local, as they are modified or are stateful. When running multiple server
+ * threads, each thread initializes its own copy.
+ */
+static __thread quicly_context_t ctx;
+static __thread quicly_cid_plaintext_t next_cid;
+static __thread struct {
     ptls_aead_context_t *enc, *dec;
 } address_token_aead;
+static const char *cid_key = NULL;
+static uint8_t address_token_secret[PTLS_MAX_DIGEST_SIZE];
+static unsigned udpbufsize = 0;
 static ptls_save_ticket_t save_session_ticket = {save_session_ticket_cb};
 static ptls_on_client_hello_t on_client_hello = {on_client_hello_cb};
 static int enforce_retry;
@@ -123,13 +147,15 @@ static const quicly_stream_callbacks_t server_stream_callbacks = {quicly_streamb
                                                                   quicly_streambuf_egress_emit,
                                                                   on_stop_sending,
                                                                   server_on_receive,
-                                                                  on_receive_reset},
+                                                                  on_receive_reset,
+                                                                  quicly_streambuf_egress_emit_vec},
                                        client_stream_callbacks = {quicly_streambuf_destroy,
                                                                   quicly_streambuf_egress_shift,
                                                                   quicly_streambuf_egress_emit,
                                                                   on_stop_sending,
                                                                   client_on_receive,
-                                                                  on_receive_reset};
+                                                                  on_receive_reset,
+                                                                  quicly_streambuf_egress_emit_vec};
 
 static void dump_stats(FILE *fp, quicly_conn_t *conn)
 {
@@ -363,7 +389,7 @@ static void client_on_receive(quicly_stream_t *stream, size_t off, const void *s
         ++num_resp_received;
         if (reqs[num_resp_received].path == NULL) {
             if (request_interval != 0) {
-                enqueue_requests_at = ctx.now->cb(ctx.now) + request_interval;
+                enqueue_requests_at = ctx.now->cb(ctx.now) + request_interval * ctx.clock_resolution;
             } else {
                 dump_stats(stderr, stream->conn);
                 quicly_close(stream->conn, 0, "");
@@ -412,7 +438,72 @@ static int on_generate_resumption_token(quicly_generate_resumption_token_t *self
 
 static quicly_generate_resumption_token_t generate_resumption_token = {&on_generate_resumption_token};
 
-static void send_packets_default(int fd, struct sockaddr *dest, struct iovec *packets, size_t num_packets)
+static void setup_address_token_aead(void)
+{
+    address_token_aead.enc = ptls_aead_new(&ptls_openssl_aes128gcm, &ptls_openssl_sha256, 1, address_token_secret, "");
+    address_token_aead.dec = ptls_aead_new(&ptls_openssl_aes128gcm, &ptls_openssl_sha256, 0, address_token_secret, "");
+}
+
+static quicly_cid_encryptor_t *new_cid_encryptor(void)
+{
+    return quicly_new_default_cid_encryptor(&ptls_openssl_bfecb, &ptls_openssl_aes128ecb, &ptls_openssl_sha256,
+                                            ptls_iovec_init(cid_key, strlen(cid_key)));
+}
+
+#ifdef SO_TXTIME
+
+/**
+ * Returns the departure time of a datagram carrying `bytes`, and advances the clock by the duration required for sending it at the
+ * pacing rate.
+ */
+static uint64_t calc_txtime(size_t bytes)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+    if (txtime.next_at < now)
+        txtime.next_at = now;
+    uint64_t at = txtime.next_at;
+    if (txtime.bytes_per_msec != 0)
+        txtime.next_at += bytes * 1000000 / txtime.bytes_per_msec;
+    return at;
+}
+
+/**
+ * Writes SCM_TXTIME cmsg to `buf`, returning the number of bytes being written.
+ */
+static size_t build_txtime_cmsg(void *buf, size_t bytes)
+{
+    struct cmsghdr *cmsg = buf;
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_TXTIME;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+    *(uint64_t *)CMSG_DATA(cmsg) = calc_txtime(bytes);
+    return CMSG_SPACE(sizeof(uint64_t));
+}
+
+#endif
+
+/**
+ * Writes a cmsg that sets the ECN bits of the outgoing datagrams to `buf`, returning the number of bytes being written.
+ */
+static size_t build_ecn_cmsg(void *buf, struct sockaddr *dest, uint8_t ecn)
+{
+    struct cmsghdr *cmsg = buf;
+    if (dest->sa_family == AF_INET6) {
+        cmsg->cmsg_level = IPPROTO_IPV6;
+        cmsg->cmsg_type = IPV6_TCLASS;
+    } else {
+        cmsg->cmsg_level = IPPROTO_IP;
+        cmsg->cmsg_type = IP_TOS;
+    }
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    *(int *)CMSG_DATA(cmsg) = ecn;
+    return CMSG_SPACE(sizeof(int));
+}
+
+static void send_packets_default(int fd, struct sockaddr *dest, struct iovec *packets, size_t num_packets, uint8_t ecn)
 {
     for (size_t i = 0; i != num_packets; ++i) {
         struct msghdr mess;
@@ -421,6 +512,21 @@ static void send_packets_default(int fd, struct sockaddr *dest, struct iovec *pa
         mess.msg_namelen = quicly_get_socklen(dest);
         mess.msg_iov = &packets[i];
         mess.msg_iovlen = 1;
+        union {
+            struct cmsghdr hdr;
+            char buf[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(uint64_t))];
+        } cmsg;
+        size_t cmsg_len = 0;
+        if (ecn != QUICLY_ECN_NOT_ECT)
+            cmsg_len += build_ecn_cmsg(cmsg.buf, dest, ecn);
+#ifdef SO_TXTIME
+        if (txtime.enabled)
+            cmsg_len += build_txtime_cmsg(cmsg.buf + cmsg_len, packets[i].iov_len);
+#endif
+        if (cmsg_len != 0) {
+            mess.msg_control = &cmsg;
+            mess.msg_controllen = (socklen_t)cmsg_len;
+        }
         if (verbosity >= 2)
             hexdump("sendmsg", packets[i].iov_base, packets[i].iov_len);
         int ret;
@@ -437,7 +543,7 @@ static void send_packets_default(int fd, struct sockaddr *dest, struct iovec *pa
 #define UDP_SEGMENT 103
 #endif
 
-static void send_packets_gso(int fd, struct sockaddr *dest, struct iovec *packets, size_t num_packets)
+static void send_packets_gso(int fd, struct sockaddr *dest, struct iovec *packets, size_t num_packets, uint8_t ecn)
 {
     struct iovec vec = {.iov_base = (void *)packets[0].iov_base,
                         .iov_len = packets[num_packets - 1].iov_base + packets[num_packets - 1].iov_len - packets[0].iov_base};
@@ -450,15 +556,26 @@ static void send_packets_gso(int fd, struct sockaddr *dest, struct iovec *packet
 
     union {
         struct cmsghdr hdr;
-        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        char buf[CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(uint64_t))];
     } cmsg;
+    size_t cmsg_len = 0;
     if (num_packets != 1) {
         cmsg.hdr.cmsg_level = SOL_UDP;
         cmsg.hdr.cmsg_type = UDP_SEGMENT;
         cmsg.hdr.cmsg_len = CMSG_LEN(sizeof(uint16_t));
         *(uint16_t *)CMSG_DATA(&cmsg.hdr) = packets[0].iov_len;
+        cmsg_len = CMSG_SPACE(sizeof(uint16_t));
+    }
+    if (ecn != QUICLY_ECN_NOT_ECT)
+        cmsg_len += build_ecn_cmsg(cmsg.buf + cmsg_len, dest, ecn);
+#ifdef SO_TXTIME
+    /* the entire GSO batch departs at once, at the time calculated for the first datagram */
+    if (txtime.enabled)
+        cmsg_len += build_txtime_cmsg(cmsg.buf + cmsg_len, vec.iov_len);
+#endif
+    if (cmsg_len != 0) {
         mess.msg_control = &cmsg;
-        mess.msg_controllen = (socklen_t)CMSG_SPACE(sizeof(uint16_t));
+        mess.msg_controllen = (socklen_t)cmsg_len;
     }
 
     int ret;
@@ -470,12 +587,12 @@ static void send_packets_gso(int fd, struct sockaddr *dest, struct iovec *packet
 
 #endif
 
-static void (*send_packets)(int, struct sockaddr *, struct iovec *, size_t) = send_packets_default;
+static void (*send_packets)(int, struct sockaddr *, struct iovec *, size_t, uint8_t) = send_packets_default;
 
 static void send_one_packet(int fd, struct sockaddr *dest, const void *payload, size_t payload_len)
 {
     struct iovec vec = {.iov_base = (void *)payload, .iov_len = payload_len};
-    send_packets(fd, dest, &vec, 1);
+    send_packets(fd, dest, &vec, 1, QUICLY_ECN_NOT_ECT);
 }
 
 static int send_pending(int fd, quicly_conn_t *conn)
@@ -486,10 +603,173 @@ static int send_pending(int fd, quicly_conn_t *conn)
     size_t num_packets = MAX_BURST_PACKETS;
     int ret;
 
-    if ((ret = quicly_send(conn, &dest, &src, packets, &num_packets, buf, sizeof(buf))) == 0 && num_packets != 0)
-        send_packets(fd, &dest.sa, packets, num_packets);
+    if ((ret = quicly_send(conn, &dest, &src, packets, &num_packets, buf, sizeof(buf))) == 0 && num_packets != 0) {
+        if (txtime.enabled)
+            txtime.bytes_per_msec = quicly_get_pacing_rate(conn);
+        send_packets(fd, &dest.sa, packets, num_packets, quicly_send_get_ecn_bits(conn));
+    }
+
+    return ret;
+}
+
+#ifndef RECV_BATCH_SIZE
+#define RECV_BATCH_SIZE 16
+#endif
+#define RECV_BUFFER_SIZE 65536
+
+#ifdef __linux__
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+static int use_gro = 0;
+
+struct st_received_datagram_t {
+    quicly_address_t src;
+    uint8_t *bytes;
+    size_t len;
+    /**
+     * size of each datagram when multiple datagrams have been coalesced by UDP GRO, otherwise same as `len`
+     */
+    size_t segment_size;
+    /**
+     * ECN bits of the IP header (QUICLY_ECN_*)
+     */
+    uint8_t ecn;
+};
+
+/**
+ * buffers used for receiving and decoding datagrams
+ */
+struct st_recv_buffers_t {
+    uint8_t bytes[RECV_BATCH_SIZE][RECV_BUFFER_SIZE];
+    struct st_received_datagram_t datagrams[RECV_BATCH_SIZE];
+    quicly_decoded_packet_t packets[RECV_BUFFER_SIZE / 64];
+};
+
+/**
+ * Receives up to RECV_BATCH_SIZE datagrams at once into `bufs->datagrams`, returning the number of datagrams being received.
+ */
+static size_t receive_datagrams(int fd, struct st_recv_buffers_t *bufs)
+{
+    struct st_received_datagram_t *datagrams = bufs->datagrams;
+
+#ifdef __linux__
+    struct mmsghdr mmsgs[RECV_BATCH_SIZE];
+    struct iovec vecs[RECV_BATCH_SIZE];
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(int))];
+    } cmsgs[RECV_BATCH_SIZE];
+    int use_cmsg = use_gro || ctx.use_ecn, i, ret;
+
+    for (i = 0; i != RECV_BATCH_SIZE; ++i) {
+        vecs[i] = (struct iovec){.iov_base = bufs->bytes[i], .iov_len = sizeof(bufs->bytes[i])};
+        mmsgs[i] = (struct mmsghdr){.msg_hdr = {
+                                        .msg_name = &datagrams[i].src,
+                                        .msg_namelen = sizeof(datagrams[i].src),
+                                        .msg_iov = &vecs[i],
+                                        .msg_iovlen = 1,
+                                        .msg_control = use_cmsg ? cmsgs[i].buf : NULL,
+                                        .msg_controllen = use_cmsg ? sizeof(cmsgs[i].buf) : 0,
+                                    }};
+    }
+    while ((ret = recvmmsg(fd, mmsgs, RECV_BATCH_SIZE, 0, NULL)) == -1 && errno == EINTR)
+        ;
+    if (ret <= 0)
+        return 0;
+
+    for (i = 0; i != ret; ++i) {
+        datagrams[i].bytes = bufs->bytes[i];
+        datagrams[i].len = mmsgs[i].msg_len;
+        datagrams[i].segment_size = datagrams[i].len;
+        datagrams[i].ecn = QUICLY_ECN_NOT_ECT;
+        if (use_cmsg) {
+            struct cmsghdr *cmsg;
+            for (cmsg = CMSG_FIRSTHDR(&mmsgs[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&mmsgs[i].msg_hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    int segment_size;
+                    memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+                    if (segment_size > 0)
+                        datagrams[i].segment_size = segment_size;
+                } else if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS) {
+                    /* linux delivers the TOS byte as a single octet, whereas the traffic class is delivered as an int */
+                    datagrams[i].ecn = *(uint8_t *)CMSG_DATA(cmsg) & 3;
+                } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_TCLASS) {
+                    int tclass;
+                    memcpy(&tclass, CMSG_DATA(cmsg), sizeof(tclass));
+                    datagrams[i].ecn = tclass & 3;
+                }
+            }
+        }
+    }
 
     return ret;
+#else
+    struct iovec vec = {.iov_base = bufs->bytes[0], .iov_len = sizeof(bufs->bytes[0])};
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } cmsg_buf;
+    struct msghdr mess = {.msg_name = &datagrams[0].src,
+                          .msg_namelen = sizeof(datagrams[0].src),
+                          .msg_iov = &vec,
+                          .msg_iovlen = 1,
+                          .msg_control = ctx.use_ecn ? cmsg_buf.buf : NULL,
+                          .msg_controllen = ctx.use_ecn ? sizeof(cmsg_buf.buf) : 0};
+    ssize_t rret;
+
+    while ((rret = recvmsg(fd, &mess, 0)) == -1 && errno == EINTR)
+        ;
+    if (rret <= 0)
+        return 0;
+
+    datagrams[0].bytes = bufs->bytes[0];
+    datagrams[0].len = rret;
+    datagrams[0].segment_size = rret;
+    datagrams[0].ecn = QUICLY_ECN_NOT_ECT;
+    if (ctx.use_ecn) {
+        struct cmsghdr *cmsg;
+        for (cmsg = CMSG_FIRSTHDR(&mess); cmsg != NULL; cmsg = CMSG_NXTHDR(&mess, cmsg)) {
+            if (cmsg->cmsg_level == IPPROTO_IP && (cmsg->cmsg_type == IP_TOS || cmsg->cmsg_type == IP_RECVTOS)) {
+                /* BSDs deliver the TOS byte as IP_RECVTOS, as a single octet */
+                datagrams[0].ecn = *(uint8_t *)CMSG_DATA(cmsg) & 3;
+            } else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_TCLASS) {
+                int tclass;
+                memcpy(&tclass, CMSG_DATA(cmsg), sizeof(tclass));
+                datagrams[0].ecn = tclass & 3;
+            }
+        }
+    }
+    return 1;
+#endif
+}
+
+/**
+ * Decodes the QUIC packets found in the datagram (or in each of the datagrams being coalesced), returning the number of packets
+ * being decoded.
+ */
+static size_t decode_datagram(struct st_received_datagram_t *datagram, quicly_decoded_packet_t *packets, size_t max_packets)
+{
+    size_t num_packets = 0, seg_off;
+
+    for (seg_off = 0; seg_off < datagram->len; seg_off += datagram->segment_size) {
+        uint8_t *seg = datagram->bytes + seg_off;
+        size_t seg_len = datagram->len - seg_off, off = 0;
+        if (seg_len > datagram->segment_size)
+            seg_len = datagram->segment_size;
+        if (verbosity >= 2)
+            hexdump("recvmsg", seg, seg_len);
+        while (off != seg_len && num_packets < max_packets) {
+            if (quicly_decode_packet(&ctx, packets + num_packets, seg, seg_len, &off) == SIZE_MAX)
+                break;
+            packets[num_packets].ecn = datagram->ecn;
+            ++num_packets;
+        }
+    }
+
+    return num_packets;
 }
 
 static void on_receive_datagram_frame(quicly_receive_datagram_frame_t *self, quicly_conn_t *conn, ptls_iovec_t payload)
@@ -556,8 +836,8 @@ static int run_client(int fd, struct sockaddr *sa, const char *host)
                 quicly_context_t *ctx = quicly_get_context(conn);
                 int64_t delta = timeout_at - ctx->now->cb(ctx->now);
                 if (delta > 0) {
-                    tvbuf.tv_sec = delta / 1000;
-                    tvbuf.tv_usec = (delta % 1000) * 1000;
+                    tvbuf.tv_sec = delta / (1000 * ctx->clock_resolution);
+                    tvbuf.tv_usec = (delta % (1000 * ctx->clock_resolution)) * 1000 / ctx->clock_resolution;
                 } else {
                     tvbuf.tv_sec = 0;
                     tvbuf.tv_usec = 0;
@@ -572,37 +852,19 @@ static int run_client(int fd, struct sockaddr *sa, const char *host)
         if (enqueue_requests_at <= ctx.now->cb(ctx.now))
             enqueue_requests(conn);
         if (FD_ISSET(fd, &readfds)) {
-            while (1) {
-                uint8_t buf[ctx.transport_params.max_udp_payload_size];
-                struct msghdr mess;
-                struct sockaddr sa;
-                struct iovec vec;
-                memset(&mess, 0, sizeof(mess));
-                mess.msg_name = &sa;
-                mess.msg_namelen = sizeof(sa);
-                vec.iov_base = buf;
-                vec.iov_len = sizeof(buf);
-                mess.msg_iov = &vec;
-                mess.msg_iovlen = 1;
-                ssize_t rret;
-                while ((rret = recvmsg(fd, &mess, 0)) == -1 && errno == EINTR)
-                    ;
-                if (rret <= 0)
-                    break;
-                if (verbosity >= 2)
-                    hexdump("recvmsg", buf, rret);
-                size_t off = 0;
-                while (off != rret) {
-                    quicly_decoded_packet_t packet;
-                    if (quicly_decode_packet(&ctx, &packet, buf, rret, &off) == SIZE_MAX)
-                        break;
-                    quicly_receive(conn, NULL, &sa, &packet);
-                    if (send_datagram_frame && quicly_connection_is_ready(conn)) {
-                        const char *message = "hello datagram!";
-                        ptls_iovec_t datagram = ptls_iovec_init(message, strlen(message));
-                        quicly_send_datagram_frames(conn, &datagram, 1);
-                        send_datagram_frame = 0;
-                    }
+            static struct st_recv_buffers_t bufs;
+            size_t num_datagrams, i;
+            while ((num_datagrams = receive_datagrams(fd, &bufs)) != 0) {
+                for (i = 0; i != num_datagrams; ++i) {
+                    size_t num_packets = decode_datagram(bufs.datagrams + i, bufs.packets, PTLS_ELEMENTSOF(bufs.packets));
+                    if (num_packets != 0)
+                        quicly_receive_batch(conn, NULL, &bufs.datagrams[i].src.sa, bufs.packets, num_packets);
+                }
+                if (send_datagram_frame && quicly_connection_is_ready(conn)) {
+                    const char *message = "hello datagram!";
+                    ptls_iovec_t datagram = ptls_iovec_init(message, strlen(message));
+                    quicly_send_datagram_frames(conn, &datagram, 1);
+                    send_datagram_frame = 0;
                 }
             }
         }
@@ -622,29 +884,159 @@ static int run_client(int fd, struct sockaddr *sa, const char *host)
     }
 }
 
-static quicly_conn_t **conns;
-static size_t num_conns = 0;
+/**
+ * State of each server thread. When running multiple threads, each thread owns a UDP socket bound to the same address using
+ * SO_REUSEPORT, and the kernel distributes the datagrams among the sockets by the hash of the 4-tuple. Therefore, a packet might
+ * arrive at a thread different from the one owning the connection (e.g., after the client migrates to a new address). Such packets
+ * are handed off to the thread identified by the `thread_id` field of the CID, through a unix domain socket.
+ */
+struct st_server_thread_t {
+    pthread_t tid;
+    uint32_t thread_id;
+    /**
+     * the UDP socket
+     */
+    int fd;
+    /**
+     * socket pair used for receiving the packets being handed off by other threads; [0] is read by this thread, [1] is written to
+     * by the other threads. Both are set to -1 when running only one thread.
+     */
+    int handoff_fds[2];
+    quicly_conn_map_t *conn_map;
+    quicly_timerwheel_t timerwheel;
+    quicly_conn_t **conns;
+    size_t num_conns;
+    /**
+     * values inherited from the main thread upon startup
+     */
+    struct {
+        const quicly_context_t *ctx;
+        int txtime_enabled;
+    } parent;
+    struct st_recv_buffers_t bufs;
+};
+
+/**
+ * Upper bound of `-T`. Each thread owns a socket, an epoll instance, and a socket pair; the number also has to fit in the 24-bit
+ * `thread_id` field of the CID.
+ */
+#define MAX_SERVER_THREADS 256
+
+static struct st_server_thread_t *server_threads;
+static size_t num_server_threads = 1;
 
 static void on_signal(int signo)
 {
-    size_t i;
-    for (i = 0; i != num_conns; ++i) {
-        const quicly_cid_plaintext_t *master_id = quicly_get_master_id(conns[i]);
-        fprintf(stderr, "conn:%08" PRIu32 ": ", master_id->master_id);
-        dump_stats(stderr, conns[i]);
+    size_t i, j;
+    for (i = 0; i != num_server_threads; ++i) {
+        struct st_server_thread_t *thread = server_threads + i;
+        for (j = 0; j != thread->num_conns; ++j) {
+            const quicly_cid_plaintext_t *master_id = quicly_get_master_id(thread->conns[j]);
+            fprintf(stderr, "conn:%08" PRIu32 ": ", master_id->master_id);
+            dump_stats(stderr, thread->conns[j]);
+        }
     }
     if (signo == SIGINT)
         _exit(0);
 }
 
+/**
+ * Creates a non-blocking UDP socket with the socket options being applied. Returns -1 on failure.
+ */
+static int create_socket(int family)
+{
+    int fd;
+
+    if ((fd = socket(family, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
+        perror("socket(2) failed");
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    {
+        int on = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0) {
+            perror("setsockopt(SO_REUSEADDR) failed");
+            goto Error;
+        }
+    }
+#ifdef SO_REUSEPORT
+    if (num_server_threads > 1) {
+        /* let the kernel distribute the incoming datagrams among the sockets of the server threads */
+        int on = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+            perror("setsockopt(SO_REUSEPORT) failed");
+            goto Error;
+        }
+    }
+#endif
+    if (udpbufsize != 0) {
+        unsigned arg = udpbufsize;
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &arg, sizeof(arg)) != 0) {
+            perror("setsockopt(SO_RCVBUF) failed");
+            goto Error;
+        }
+        arg = udpbufsize;
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &arg, sizeof(arg)) != 0) {
+            perror("setsockopt(SO_RCVBUF) failed");
+            goto Error;
+        }
+    }
+#ifdef SO_TXTIME
+    if (txtime.enabled) {
+        struct sock_txtime arg = {.clockid = CLOCK_MONOTONIC};
+        if (setsockopt(fd, SOL_SOCKET, SO_TXTIME, &arg, sizeof(arg)) != 0) {
+            perror("setsockopt(SO_TXTIME) failed");
+            goto Error;
+        }
+    }
+#endif
+#if defined(IP_DONTFRAG)
+    {
+        int on = 1;
+        if (setsockopt(fd, IPPROTO_IP, IP_DONTFRAG, &on, sizeof(on)) != 0)
+            perror("Warning: setsockopt(IP_DONTFRAG) failed");
+    }
+#elif defined(IP_PMTUDISC_DO)
+    {
+        int opt = IP_PMTUDISC_DO;
+        if (setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &opt, sizeof(opt)) != 0)
+            perror("Warning: setsockopt(IP_MTU_DISCOVER) failed");
+    }
+#endif
+#ifdef __linux__
+    {
+        /* receive coalesced datagrams if the kernel supports UDP GRO */
+        int on = 1;
+        use_gro = setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+    }
+#endif
+    if (ctx.use_ecn) {
+        /* receive the ECN bits of the incoming datagrams */
+        int on = 1;
+        if (family == AF_INET6) {
+            if (setsockopt(fd, IPPROTO_IPV6, IPV6_RECVTCLASS, &on, sizeof(on)) != 0)
+                perror("Warning: setsockopt(IPV6_RECVTCLASS) failed");
+        } else {
+            if (setsockopt(fd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on)) != 0)
+                perror("Warning: setsockopt(IP_RECVTOS) failed");
+        }
+    }
+
+
+    return fd;
+Error:
+    close(fd);
+    return -1;
+}
+
 static int validate_token(struct sockaddr *remote, ptls_iovec_t client_cid, ptls_iovec_t server_cid,
                           quicly_address_token_plaintext_t *token, const char **err_desc)
 {
     int64_t age;
     int port_is_equal;
 
-    /* calculate and normalize age */
-    if ((age = ctx.now->cb(ctx.now) - token->issued_at) < 0)
+    /* calculate and normalize age (in milliseconds) */
+    if ((age = (ctx.now->cb(ctx.now) - token->issued_at) / ctx.clock_resolution) < 0)
         age = 0;
 
     /* check address, deferring the use of port number match to type-specific checks */
@@ -707,32 +1099,214 @@ CIDMismatch:
     return 0;
 }
 
-static int run_server(int fd, struct sockaddr *sa, socklen_t salen)
+/**
+ * Hands off a packet to the thread owning the connection. The packet is dropped if the thread is not keeping up.
+ */
+static void handoff_packet(struct st_server_thread_t *to, quicly_address_t *src, uint8_t ecn, ptls_iovec_t octets)
 {
-    signal(SIGINT, on_signal);
-    signal(SIGHUP, on_signal);
+    struct iovec vecs[3] = {{.iov_base = src, .iov_len = sizeof(*src)},
+                            {.iov_base = &ecn, .iov_len = sizeof(ecn)},
+                            {.iov_base = octets.base, .iov_len = octets.len}};
+    struct msghdr mess = {.msg_iov = vecs, .msg_iovlen = PTLS_ELEMENTSOF(vecs)};
 
-    if (bind(fd, sa, salen) != 0) {
-        perror("bind(2) failed");
+    while (sendmsg(to->handoff_fds[1], &mess, MSG_DONTWAIT) == -1 && errno == EINTR)
+        ;
+}
+
+/**
+ * Receives up to RECV_BATCH_SIZE packets being handed off by other threads, returning them as datagrams.
+ */
+static size_t receive_handoffs(int fd, struct st_recv_buffers_t *bufs)
+{
+    size_t num_datagrams;
+
+    for (num_datagrams = 0; num_datagrams != RECV_BATCH_SIZE; ++num_datagrams) {
+        struct st_received_datagram_t *datagram = bufs->datagrams + num_datagrams;
+        struct iovec vecs[3] = {{.iov_base = &datagram->src, .iov_len = sizeof(datagram->src)},
+                                {.iov_base = &datagram->ecn, .iov_len = sizeof(datagram->ecn)},
+                                {.iov_base = bufs->bytes[num_datagrams], .iov_len = sizeof(bufs->bytes[num_datagrams])}};
+        struct msghdr mess = {.msg_iov = vecs, .msg_iovlen = PTLS_ELEMENTSOF(vecs)};
+        ssize_t rret;
+        while ((rret = recvmsg(fd, &mess, 0)) == -1 && errno == EINTR)
+            ;
+        if (rret < (ssize_t)(sizeof(datagram->src) + sizeof(datagram->ecn)))
+            break;
+        datagram->bytes = bufs->bytes[num_datagrams];
+        datagram->len = rret - sizeof(datagram->src) - sizeof(datagram->ecn);
+        datagram->segment_size = datagram->len;
+    }
+
+    return num_datagrams;
+}
+
+/**
+ * Handles the packets within a datagram being received by the server. Consecutive packets that belong to the same connection are
+ * delivered to the connection in a batch.
+ */
+static void server_handle_datagram(struct st_server_thread_t *thread, struct st_received_datagram_t *datagram)
+{
+    quicly_decoded_packet_t *packets = thread->bufs.packets;
+    struct sockaddr *remote = &datagram->src.sa;
+    int fd = thread->fd;
+    quicly_conn_t *batch_conn = NULL;
+    size_t num_packets = decode_datagram(datagram, packets, PTLS_ELEMENTSOF(thread->bufs.packets)), batch_start = 0, j;
+
+    for (j = 0; j != num_packets; ++j) {
+        quicly_decoded_packet_t *packet = packets + j;
+        if (QUICLY_PACKET_IS_LONG_HEADER(packet->octets.base[0])) {
+            if (packet->version != 0 && !quicly_is_supported_version(packet->version)) {
+                uint8_t payload[ctx.transport_params.max_udp_payload_size];
+                size_t payload_len = quicly_send_version_negotiation(&ctx, packet->cid.src, packet->cid.dest.encrypted,
+                                                                     quicly_supported_versions, payload);
+                assert(payload_len != SIZE_MAX);
+                send_one_packet(fd, remote, payload, payload_len);
+                break;
+            }
+            /* there is no way to send response to these v1 packets */
+            if (packet->cid.dest.encrypted.len > QUICLY_MAX_CID_LEN_V1 || packet->cid.src.len > QUICLY_MAX_CID_LEN_V1)
+                break;
+        }
+
+        /* hand off the packet if the CID indicates that the connection is owned by another thread */
+        if (!packet->cid.dest.might_be_client_generated && packet->cid.dest.plaintext.node_id == 0 &&
+            packet->cid.dest.plaintext.thread_id != thread->thread_id &&
+            packet->cid.dest.plaintext.thread_id < num_server_threads) {
+            if (batch_conn != NULL) {
+                quicly_receive_batch(batch_conn, NULL, remote, packets + batch_start, j - batch_start);
+                batch_conn = NULL;
+            }
+            handoff_packet(server_threads + packet->cid.dest.plaintext.thread_id, &datagram->src, packet->ecn, packet->octets);
+            continue;
+        }
+
+        quicly_conn_t *conn = quicly_conn_map_lookup(thread->conn_map, NULL, remote, packet);
+        if (conn != NULL && conn == batch_conn)
+            continue;
+        /* deliver the packets being batched, as this packet belongs to a different connection (or to none) */
+        if (batch_conn != NULL)
+            quicly_receive_batch(batch_conn, NULL, remote, packets + batch_start, j - batch_start);
+        batch_conn = conn;
+        batch_start = j;
+        if (conn != NULL) {
+            /* existing connection; packets are delivered in batches */
+        } else if (QUICLY_PACKET_IS_INITIAL(packet->octets.base[0])) {
+            /* long header packet; potentially a new connection */
+            quicly_address_token_plaintext_t *token = NULL, token_buf;
+            if (packet->token.len != 0) {
+                const char *err_desc = NULL;
+                int ret = quicly_decrypt_address_token(address_token_aead.dec, &token_buf, packet->token.base, packet->token.len, 0,
+                                                       &err_desc);
+                if (ret == 0 && validate_token(remote, packet->cid.src, packet->cid.dest.encrypted, &token_buf, &err_desc)) {
+                    token = &token_buf;
+                } else if (enforce_retry && (ret == QUICLY_TRANSPORT_ERROR_INVALID_TOKEN ||
+                                             (ret == 0 && token_buf.type == QUICLY_ADDRESS_TOKEN_TYPE_RETRY))) {
+                    /* Token that looks like retry was unusable, and we require retry. There's no chance of the handshake
+                     * succeeding. Therefore, send close without aquiring state. */
+                    uint8_t payload[ctx.transport_params.max_udp_payload_size];
+                    size_t payload_len = quicly_send_close_invalid_token(&ctx, packet->version, packet->cid.src,
+                                                                         packet->cid.dest.encrypted, err_desc, payload);
+                    assert(payload_len != SIZE_MAX);
+                    send_one_packet(fd, remote, payload, payload_len);
+                }
+            }
+            if (enforce_retry && token == NULL && packet->cid.dest.encrypted.len >= 8) {
+                /* unbound connection; send a retry token unless the client has supplied the correct one, but not too many */
+                uint8_t new_server_cid[8], payload[ctx.transport_params.max_udp_payload_size];
+                memcpy(new_server_cid, packet->cid.dest.encrypted.base, sizeof(new_server_cid));
+                new_server_cid[0] ^= 0xff;
+                size_t payload_len = quicly_send_retry(&ctx, address_token_aead.enc, packet->version, remote, packet->cid.src, NULL,
+                                                       ptls_iovec_init(new_server_cid, sizeof(new_server_cid)),
+                                                       packet->cid.dest.encrypted, ptls_iovec_init(NULL, 0),
+                                                       ptls_iovec_init(NULL, 0), NULL, payload);
+                assert(payload_len != SIZE_MAX);
+                send_one_packet(fd, remote, payload, payload_len);
+                break;
+            } else {
+                /* new connection */
+                int ret = quicly_accept(&conn, &ctx, NULL, remote, packet, token, &next_cid, NULL);
+                if (ret == 0) {
+                    assert(conn != NULL);
+                    ++next_cid.master_id;
+                    if (quicly_conn_map_add(thread->conn_map, conn) != 0) {
+                        fprintf(stderr, "failed to register connection\n");
+                        quicly_free(conn);
+                        break;
+                    }
+                    thread->conns = realloc(thread->conns, sizeof(*thread->conns) * (thread->num_conns + 1));
+                    assert(thread->conns != NULL);
+                    thread->conns[thread->num_conns++] = conn;
+                    quicly_set_timerwheel(conn, &thread->timerwheel);
+                } else {
+                    assert(conn == NULL);
+                }
+            }
+        } else if (!QUICLY_PACKET_IS_LONG_HEADER(packet->octets.base[0])) {
+            /* short header packet; potentially a dead connection. No need to check the length of the incoming packet, because loop
+             * is prevented by authenticating the CID (by checking node_id and thread_id). If the peer is also sending a reset, then
+             * the next CID is highly likely to contain a non-authenticating CID, ... */
+            if (packet->cid.dest.plaintext.node_id == 0 && packet->cid.dest.plaintext.thread_id == thread->thread_id) {
+                uint8_t payload[ctx.transport_params.max_udp_payload_size];
+                size_t payload_len = quicly_send_stateless_reset(&ctx, packet->cid.dest.encrypted.base, payload);
+                assert(payload_len != SIZE_MAX);
+                send_one_packet(fd, remote, payload, payload_len);
+            }
+        }
+    }
+    if (batch_conn != NULL)
+        quicly_receive_batch(batch_conn, NULL, remote, packets + batch_start, j - batch_start);
+}
+
+static int server_loop(struct st_server_thread_t *thread)
+{
+#ifdef __linux__
+    int epfd, fds[2] = {thread->fd, thread->handoff_fds[0]}, i;
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        perror("epoll_create1(2) failed");
         return 1;
     }
+    for (i = 0; i != PTLS_ELEMENTSOF(fds); ++i) {
+        if (fds[i] == -1)
+            continue;
+        struct epoll_event ev = {.events = EPOLLIN, .data.fd = fds[i]};
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev) != 0) {
+            perror("epoll_ctl(2) failed");
+            close(epfd);
+            return 1;
+        }
+    }
+#endif
 
     while (1) {
+        int64_t timeout_at = quicly_timerwheel_get_wake_at(&thread->timerwheel);
+        int sock_readable = 0, handoff_readable = 0;
+#ifdef __linux__
+        struct epoll_event events[2];
+        int timeout = -1, nevents;
+        if (timeout_at != INT64_MAX) {
+            /* round up to milliseconds, as otherwise we would busy-loop until the timer fires */
+            int64_t delta = timeout_at - ctx.now->cb(ctx.now);
+            timeout = delta > 0 ? (int)((delta + 1000 * ctx.clock_resolution - 1) / (1000 * ctx.clock_resolution)) : 0;
+        }
+        while ((nevents = epoll_wait(epfd, events, PTLS_ELEMENTSOF(events), timeout)) == -1 && errno == EINTR)
+            ;
+        for (i = 0; i < nevents; ++i) {
+            if (events[i].data.fd == thread->fd) {
+                sock_readable = 1;
+            } else {
+                handoff_readable = 1;
+            }
+        }
+#else
+        /* only one thread is used on this platform, therefore there is nothing being handed off */
         fd_set readfds;
         struct timeval *tv, tvbuf;
         do {
-            int64_t timeout_at = INT64_MAX;
-            size_t i;
-            for (i = 0; i != num_conns; ++i) {
-                int64_t conn_to = quicly_get_first_timeout(conns[i]);
-                if (conn_to < timeout_at)
-                    timeout_at = conn_to;
-            }
             if (timeout_at != INT64_MAX) {
                 int64_t delta = timeout_at - ctx.now->cb(ctx.now);
                 if (delta > 0) {
-                    tvbuf.tv_sec = delta / 1000;
-                    tvbuf.tv_usec = (delta % 1000) * 1000;
+                    tvbuf.tv_sec = delta / (1000 * ctx.clock_resolution);
+                    tvbuf.tv_usec = (delta % (1000 * ctx.clock_resolution)) * 1000 / ctx.clock_resolution;
                 } else {
                     tvbuf.tv_sec = 0;
                     tvbuf.tv_usec = 0;
@@ -742,137 +1316,138 @@ static int run_server(int fd, struct sockaddr *sa, socklen_t salen)
                 tv = NULL;
             }
             FD_ZERO(&readfds);
-            FD_SET(fd, &readfds);
-        } while (select(fd + 1, &readfds, NULL, NULL, tv) == -1 && errno == EINTR);
-        if (FD_ISSET(fd, &readfds)) {
-            while (1) {
-                uint8_t buf[ctx.transport_params.max_udp_payload_size];
-                struct msghdr mess;
-                quicly_address_t remote;
-                struct iovec vec;
-                memset(&mess, 0, sizeof(mess));
-                mess.msg_name = &remote.sa;
-                mess.msg_namelen = sizeof(remote);
-                vec.iov_base = buf;
-                vec.iov_len = sizeof(buf);
-                mess.msg_iov = &vec;
-                mess.msg_iovlen = 1;
-                ssize_t rret;
-                while ((rret = recvmsg(fd, &mess, 0)) == -1 && errno == EINTR)
-                    ;
-                if (rret == -1)
-                    break;
-                if (verbosity >= 2)
-                    hexdump("recvmsg", buf, rret);
-                size_t off = 0;
-                while (off != rret) {
-                    quicly_decoded_packet_t packet;
-                    if (quicly_decode_packet(&ctx, &packet, buf, rret, &off) == SIZE_MAX)
-                        break;
-                    if (QUICLY_PACKET_IS_LONG_HEADER(packet.octets.base[0])) {
-                        if (packet.version != 0 && !quicly_is_supported_version(packet.version)) {
-                            uint8_t payload[ctx.transport_params.max_udp_payload_size];
-                            size_t payload_len = quicly_send_version_negotiation(&ctx, packet.cid.src, packet.cid.dest.encrypted,
-                                                                                 quicly_supported_versions, payload);
-                            assert(payload_len != SIZE_MAX);
-                            send_one_packet(fd, &remote.sa, payload, payload_len);
-                            break;
-                        }
-                        /* there is no way to send response to these v1 packets */
-                        if (packet.cid.dest.encrypted.len > QUICLY_MAX_CID_LEN_V1 || packet.cid.src.len > QUICLY_MAX_CID_LEN_V1)
-                            break;
-                    }
-
-                    quicly_conn_t *conn = NULL;
-                    size_t i;
-                    for (i = 0; i != num_conns; ++i) {
-                        if (quicly_is_destination(conns[i], NULL, &remote.sa, &packet)) {
-                            conn = conns[i];
-                            break;
-                        }
-                    }
-                    if (conn != NULL) {
-                        /* existing connection */
-                        quicly_receive(conn, NULL, &remote.sa, &packet);
-                    } else if (QUICLY_PACKET_IS_INITIAL(packet.octets.base[0])) {
-                        /* long header packet; potentially a new connection */
-                        quicly_address_token_plaintext_t *token = NULL, token_buf;
-                        if (packet.token.len != 0) {
-                            const char *err_desc = NULL;
-                            int ret = quicly_decrypt_address_token(address_token_aead.dec, &token_buf, packet.token.base,
-                                                                   packet.token.len, 0, &err_desc);
-                            if (ret == 0 &&
-                                validate_token(&remote.sa, packet.cid.src, packet.cid.dest.encrypted, &token_buf, &err_desc)) {
-                                token = &token_buf;
-                            } else if (enforce_retry && (ret == QUICLY_TRANSPORT_ERROR_INVALID_TOKEN ||
-                                                         (ret == 0 && token_buf.type == QUICLY_ADDRESS_TOKEN_TYPE_RETRY))) {
-                                /* Token that looks like retry was unusable, and we require retry. There's no chance of the
-                                 * handshake succeeding. Therefore, send close without aquiring state. */
-                                uint8_t payload[ctx.transport_params.max_udp_payload_size];
-                                size_t payload_len = quicly_send_close_invalid_token(&ctx, packet.version, packet.cid.src,
-                                                                                     packet.cid.dest.encrypted, err_desc, payload);
-                                assert(payload_len != SIZE_MAX);
-                                send_one_packet(fd, &remote.sa, payload, payload_len);
-                            }
-                        }
-                        if (enforce_retry && token == NULL && packet.cid.dest.encrypted.len >= 8) {
-                            /* unbound connection; send a retry token unless the client has supplied the correct one, but not too
-                             * many
-                             */
-                            uint8_t new_server_cid[8], payload[ctx.transport_params.max_udp_payload_size];
-                            memcpy(new_server_cid, packet.cid.dest.encrypted.base, sizeof(new_server_cid));
-                            new_server_cid[0] ^= 0xff;
-                            size_t payload_len = quicly_send_retry(
-                                &ctx, address_token_aead.enc, packet.version, &remote.sa, packet.cid.src, NULL,
-                                ptls_iovec_init(new_server_cid, sizeof(new_server_cid)), packet.cid.dest.encrypted,
-                                ptls_iovec_init(NULL, 0), ptls_iovec_init(NULL, 0), NULL, payload);
-                            assert(payload_len != SIZE_MAX);
-                            send_one_packet(fd, &remote.sa, payload, payload_len);
-                            break;
-                        } else {
-                            /* new connection */
-                            int ret = quicly_accept(&conn, &ctx, NULL, &remote.sa, &packet, token, &next_cid, NULL);
-                            if (ret == 0) {
-                                assert(conn != NULL);
-                                ++next_cid.master_id;
-                                conns = realloc(conns, sizeof(*conns) * (num_conns + 1));
-                                assert(conns != NULL);
-                                conns[num_conns++] = conn;
-                            } else {
-                                assert(conn == NULL);
-                            }
-                        }
-                    } else if (!QUICLY_PACKET_IS_LONG_HEADER(packet.octets.base[0])) {
-                        /* short header packet; potentially a dead connection. No need to check the length of the incoming packet,
-                         * because loop is prevented by authenticating the CID (by checking node_id and thread_id). If the peer is
-                         * also sending a reset, then the next CID is highly likely to contain a non-authenticating CID, ... */
-                        if (packet.cid.dest.plaintext.node_id == 0 && packet.cid.dest.plaintext.thread_id == 0) {
-                            uint8_t payload[ctx.transport_params.max_udp_payload_size];
-                            size_t payload_len = quicly_send_stateless_reset(&ctx, packet.cid.dest.encrypted.base, payload);
-                            assert(payload_len != SIZE_MAX);
-                            send_one_packet(fd, &remote.sa, payload, payload_len);
-                        }
-                    }
-                }
+            FD_SET(thread->fd, &readfds);
+        } while (select(thread->fd + 1, &readfds, NULL, NULL, tv) == -1 && errno == EINTR);
+        sock_readable = FD_ISSET(thread->fd, &readfds);
+#endif
+        if (sock_readable) {
+            size_t num_datagrams, j;
+            while ((num_datagrams = receive_datagrams(thread->fd, &thread->bufs)) != 0) {
+                for (j = 0; j != num_datagrams; ++j)
+                    server_handle_datagram(thread, thread->bufs.datagrams + j);
+            }
+        }
+        if (handoff_readable) {
+            size_t num_datagrams, j;
+            while ((num_datagrams = receive_handoffs(thread->handoff_fds[0], &thread->bufs)) != 0) {
+                for (j = 0; j != num_datagrams; ++j)
+                    server_handle_datagram(thread, thread->bufs.datagrams + j);
             }
         }
         {
-            size_t i;
-            for (i = 0; i != num_conns; ++i) {
-                if (quicly_get_first_timeout(conns[i]) <= ctx.now->cb(ctx.now)) {
-                    if (send_pending(fd, conns[i]) != 0) {
-                        dump_stats(stderr, conns[i]);
-                        quicly_free(conns[i]);
-                        memmove(conns + i, conns + i + 1, (num_conns - i - 1) * sizeof(*conns));
-                        --i;
-                        --num_conns;
-                    }
+            int64_t now = ctx.now->cb(ctx.now);
+            quicly_conn_t *conn;
+            while ((conn = quicly_pop_expired_conn(&thread->timerwheel, now)) != NULL) {
+                if (send_pending(thread->fd, conn) != 0) {
+                    size_t j;
+                    for (j = 0; thread->conns[j] != conn; ++j)
+                        ;
+                    dump_stats(stderr, conn);
+                    quicly_conn_map_remove(thread->conn_map, conn);
+                    quicly_free(conn);
+                    memmove(thread->conns + j, thread->conns + j + 1, (thread->num_conns - j - 1) * sizeof(*thread->conns));
+                    --thread->num_conns;
                 }
             }
         }
     }
 }
 
+static void *server_thread_main(void *_thread)
+{
+    struct st_server_thread_t *thread = _thread;
+
+    /* setup the thread-local state; CID encryptor and the AEAD contexts are stateful, hence are instantiated for each thread */
+    ctx = *thread->parent.ctx;
+    ctx.cid_encryptor = new_cid_encryptor();
+    txtime.enabled = thread->parent.txtime_enabled;
+    setup_address_token_aead();
+    next_cid.thread_id = thread->thread_id;
+
+    if (server_loop(thread) != 0)
+        exit(1);
+    return NULL;
+}
+
+/**
+ * The session cache being set up by `setup_session_cache` is not thread-safe. When running multiple threads, invocations are
+ * serialized using a mutex.
+ */
+static struct {
+    ptls_encrypt_ticket_t super;
+    ptls_encrypt_ticket_t *orig;
+    pthread_mutex_t mutex;
+} locked_encrypt_ticket = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static int locked_encrypt_ticket_cb(ptls_encrypt_ticket_t *self, ptls_t *tls, int is_encrypt, ptls_buffer_t *dst, ptls_iovec_t src)
+{
+    int ret;
+
+    pthread_mutex_lock(&locked_encrypt_ticket.mutex);
+    ret = locked_encrypt_ticket.orig->cb(locked_encrypt_ticket.orig, tls, is_encrypt, dst, src);
+    pthread_mutex_unlock(&locked_encrypt_ticket.mutex);
+
+    return ret;
+}
+
+static int run_server(int fd, struct sockaddr *sa, socklen_t salen)
+{
+    size_t i;
+
+    signal(SIGINT, on_signal);
+    signal(SIGHUP, on_signal);
+
+    if ((server_threads = calloc(num_server_threads, sizeof(*server_threads))) == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        return 1;
+    }
+    for (i = 0; i != num_server_threads; ++i) {
+        struct st_server_thread_t *thread = server_threads + i;
+        thread->thread_id = (uint32_t)i;
+        if (i == 0) {
+            thread->fd = fd;
+        } else if ((thread->fd = create_socket(sa->sa_family)) == -1) {
+            return 1;
+        }
+        if (bind(thread->fd, sa, salen) != 0) {
+            perror("bind(2) failed");
+            return 1;
+        }
+        thread->handoff_fds[0] = -1;
+        thread->handoff_fds[1] = -1;
+        if (num_server_threads > 1) {
+            if (socketpair(AF_UNIX, SOCK_DGRAM, 0, thread->handoff_fds) != 0) {
+                perror("socketpair(2) failed");
+                return 1;
+            }
+            fcntl(thread->handoff_fds[0], F_SETFL, O_NONBLOCK);
+        }
+        if ((thread->conn_map = quicly_conn_map_new()) == NULL) {
+            fprintf(stderr, "failed to allocate connection map\n");
+            return 1;
+        }
+        quicly_timerwheel_init(&thread->timerwheel, ctx.now->cb(ctx.now));
+        thread->parent.ctx = &ctx;
+        thread->parent.txtime_enabled = txtime.enabled;
+    }
+
+    if (num_server_threads > 1 && ctx.tls->encrypt_ticket != NULL) {
+        locked_encrypt_ticket.super.cb = locked_encrypt_ticket_cb;
+        locked_encrypt_ticket.orig = ctx.tls->encrypt_ticket;
+        ctx.tls->encrypt_ticket = &locked_encrypt_ticket.super;
+    }
+
+    /* spawn the threads, the first one being run by the main thread */
+    for (i = 1; i < num_server_threads; ++i) {
+        int ret;
+        if ((ret = pthread_create(&server_threads[i].tid, NULL, server_thread_main, server_threads + i)) != 0) {
+            fprintf(stderr, "pthread_create failed:%s\n", strerror(ret));
+            return 1;
+        }
+    }
+    return server_loop(server_threads);
+}
+
 static void load_session(void)
 {
     static uint8_t buf[65536];
@@ -1040,6 +1615,8 @@ static void usage(const char *cmd)
            "  -r [initial-pto]          initial PTO (in milliseconds)\n"
            "  -S [num-speculative-ptos] number of speculative PTOs\n"
            "  -s session-file           file to load / store the session ticket\n"
+           "  -t                        use a clock with microsecond resolution\n"
+           "  -T num-threads            number of server threads (linux only; up to 256; default: 1)\n"
            "  -u size                   initial size of UDP datagram payload\n"
            "  -U size                   maximum size of UDP datagarm payload\n"
            "  -V                        verify peer using the default certificates\n"
@@ -1052,6 +1629,17 @@ static void usage(const char *cmd)
            "  -x named-group            named group to be used (default: secp256r1)\n"
            "  -X                        max bidirectional stream count (default: 100)\n"
            "  -y cipher-suite           cipher-suite to be used (default: all)\n"
+           "  --pacing                  pace the packets being sent\n"
+           "  --txtime                  pace the packets, and also let the kernel release the\n"
+           "                            datagrams at the pacing rate using SO_TXTIME (linux\n"
+           "                            only; requires the fq qdisc)\n"
+           "  --pmtud                   raise the size of the datagrams using path MTU\n"
+           "                            discovery, up to the value specified by -U\n"
+           "  --ecn                     mark the packets being sent with ECT(0), and report\n"
+           "                            the ECN bits of the packets being received\n"
+           "  --hystart                 exit slow start using HyStart++ (RFC 9406)\n"
+           "  --batch-encrypt           encrypt the 1-RTT packets being built by each call to\n"
+           "                            quicly_send in a batch\n"
            "  -h                        print this help\n"
            "\n",
            cmd);
@@ -1070,16 +1658,16 @@ static void push_req(const char *path, int to_file)
 
 int main(int argc, char **argv)
 {
-    const char *cert_file = NULL, *raw_pubkey_file = NULL, *host, *port, *cid_key = NULL;
+    const char *cert_file = NULL, *raw_pubkey_file = NULL, *host, *port;
     struct sockaddr_storage sa;
     socklen_t salen;
-    unsigned udpbufsize = 0;
-    int ch, fd;
+    int ch, opt_index, fd;
 
     reqs = malloc(sizeof(*reqs));
     memset(reqs, 0, sizeof(*reqs));
     ctx = quicly_spec_context;
     ctx.tls = &tlsctx;
+    ctx.sent_block_allocator = &quicly_default_sent_block_allocator;
     ctx.stream_open = &stream_open;
     ctx.closed_by_remote = &closed_by_remote;
     ctx.save_resumption_token = &save_resumption_token;
@@ -1088,15 +1676,42 @@ int main(int argc, char **argv)
     setup_session_cache(ctx.tls);
     quicly_amend_ptls_context(ctx.tls);
 
-    {
-        uint8_t secret[PTLS_MAX_DIGEST_SIZE];
-        ctx.tls->random_bytes(secret, ptls_openssl_sha256.digest_size);
-        address_token_aead.enc = ptls_aead_new(&ptls_openssl_aes128gcm, &ptls_openssl_sha256, 1, secret, "");
-        address_token_aead.dec = ptls_aead_new(&ptls_openssl_aes128gcm, &ptls_openssl_sha256, 0, secret, "");
-    }
-
-    while ((ch = getopt(argc, argv, "a:b:B:c:C:Dd:k:Ee:f:Gi:I:K:l:M:m:NnOp:P:Rr:S:s:u:U:Vvw:W:x:X:y:h")) != -1) {
+    ctx.tls->random_bytes(address_token_secret, ptls_openssl_sha256.digest_size);
+    setup_address_token_aead();
+
+    static const struct option longopts[] = {{"pacing", no_argument, NULL, 0},
+                                                {"txtime", no_argument, NULL, 0},
+                                                {"pmtud", no_argument, NULL, 0},
+                                                {"ecn", no_argument, NULL, 0},
+                                                {"hystart", no_argument, NULL, 0},
+                                                {"batch-encrypt", no_argument, NULL, 0},
+                                                {NULL}};
+    while ((ch = getopt_long(argc, argv, "a:b:B:c:C:Dd:k:Ee:f:Gi:I:K:l:M:m:NnOp:P:Rr:S:s:tT:u:U:Vvw:W:x:X:y:h", longopts,
+                             &opt_index)) != -1) {
         switch (ch) {
+        case 0: /* longopts */
+            if (strcmp(longopts[opt_index].name, "pacing") == 0) {
+                ctx.use_pacing = 1;
+            } else if (strcmp(longopts[opt_index].name, "txtime") == 0) {
+#ifdef SO_TXTIME
+                ctx.use_pacing = 1;
+                txtime.enabled = 1;
+#else
+                fprintf(stderr, "SO_TXTIME is not supported on this platform\n");
+                exit(1);
+#endif
+            } else if (strcmp(longopts[opt_index].name, "pmtud") == 0) {
+                ctx.use_pmtud = 1;
+            } else if (strcmp(longopts[opt_index].name, "ecn") == 0) {
+                ctx.use_ecn = 1;
+            } else if (strcmp(longopts[opt_index].name, "hystart") == 0) {
+                ctx.use_hystart = 1;
+            } else if (strcmp(longopts[opt_index].name, "batch-encrypt") == 0) {
+                ctx.crypto_engine = &quicly_default_batch_crypto_engine;
+            } else {
+                assert(!"unexpected longopt");
+            }
+            break;
         case 'a':
             assert(negotiated_protocols.count < PTLS_ELEMENTSOF(negotiated_protocols.list));
             negotiated_protocols.list[negotiated_protocols.count++] = ptls_iovec_init(optarg, strlen(optarg));
@@ -1236,6 +1851,22 @@ int main(int argc, char **argv)
         case 's':
             session_file = optarg;
             break;
+        case 't':
+            ctx.now = &quicly_default_now_usec;
+            ctx.clock_resolution = QUICLY_CLOCK_RESOLUTION_USEC;
+            break;
+        case 'T':
+#ifdef __linux__
+            if (sscanf(optarg, "%zu", &num_server_threads) != 1 || num_server_threads == 0 ||
+                num_server_threads > MAX_SERVER_THREADS) {
+                fprintf(stderr, "invalid argument passed to `-T`\n");
+                exit(1);
+            }
+#else
+            fprintf(stderr, "multi-threaded server is only supported on linux\n");
+            exit(1);
+#endif
+            break;
         case 'u':
             if (sscanf(optarg, "%" SCNu16, &ctx.initial_egress_max_udp_payload_size) != 1) {
                 fprintf(stderr, "invalid argument passed to `-u`\n");
@@ -1379,8 +2010,7 @@ int main(int argc, char **argv)
             tlsctx.random_bytes(random_key, sizeof(random_key) - 1);
             cid_key = random_key;
         }
-        ctx.cid_encryptor = quicly_new_default_cid_encryptor(&ptls_openssl_bfecb, &ptls_openssl_aes128ecb, &ptls_openssl_sha256,
-                                                             ptls_iovec_init(cid_key, strlen(cid_key)));
+        ctx.cid_encryptor = new_cid_encryptor();
     } else {
         /* client */
         if (raw_pubkey_file != NULL) {
@@ -1411,43 +2041,8 @@ int main(int argc, char **argv)
     if (resolve_address((void *)&sa, &salen, host, port, AF_INET, SOCK_DGRAM, IPPROTO_UDP) != 0)
         exit(1);
 
-    if ((fd = socket(sa.ss_family, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
-        perror("socket(2) failed");
+    if ((fd = create_socket(sa.ss_family)) == -1)
         return 1;
-    }
-    fcntl(fd, F_SETFL, O_NONBLOCK);
-    {
-        int on = 1;
-        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0) {
-            perror("setsockopt(SO_REUSEADDR) failed");
-            return 1;
-        }
-    }
-    if (udpbufsize != 0) {
-        unsigned arg = udpbufsize;
-        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &arg, sizeof(arg)) != 0) {
-            perror("setsockopt(SO_RCVBUF) failed");
-            return 1;
-        }
-        arg = udpbufsize;
-        if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &arg, sizeof(arg)) != 0) {
-            perror("setsockopt(SO_RCVBUF) failed");
-            return 1;
-        }
-    }
-#if defined(IP_DONTFRAG)
-    {
-        int on = 1;
-        if (setsockopt(fd, IPPROTO_IP, IP_DONTFRAG, &on, sizeof(on)) != 0)
-            perror("Warning: setsockopt(IP_DONTFRAG) failed");
-    }
-#elif defined(IP_PMTUDISC_DO)
-    {
-        int opt = IP_PMTUDISC_DO;
-        if (setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, &opt, sizeof(opt)) != 0)
-            perror("Warning: setsockopt(IP_MTU_DISCOVER) failed");
-    }
-#endif
 
     return ctx.tls->certificates.count != 0 ? run_server(fd, (void *)&sa, salen) : run_client(fd, (void *)&sa, host);
 }
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <string.h>
+#include "quicly/allocator.h"
+#include "test.h"
+
+struct counting_allocator_t {
+    quicly_allocator_t super;
+    size_t num_allocs, num_frees, bytes_allocated;
+};
+
+static void *counting_alloc(quicly_allocator_t *_self, size_t size)
+{
+    struct counting_allocator_t *self = (void *)_self;
+    ++self->num_allocs;
+    self->bytes_allocated += size;
+    return malloc(size);
+}
+
+static void *counting_realloc(quicly_allocator_t *_self, void *p, size_t old_size, size_t new_size)
+{
+    struct counting_allocator_t *self = (void *)_self;
+    void *newp;
+    if ((newp = realloc(p, new_size)) != NULL)
+        self->bytes_allocated = self->bytes_allocated - old_size + new_size;
+    return newp;
+}
+
+static void counting_free(quicly_allocator_t *_self, void *p, size_t size)
+{
+    struct counting_allocator_t *self = (void *)_self;
+    ++self->num_frees;
+    self->bytes_allocated -= size;
+    free(p);
+}
+
+static void test_arena(void)
+{
+    struct counting_allocator_t parent = {{counting_alloc, counting_realloc, counting_free}};
+    quicly_arena_t arena;
+    uint8_t *p1, *p2, *p3, *large;
+
+    quicly_arena_init(&arena, &parent.super);
+
+    /* objects are carved out of one chunk */
+    p1 = quicly_allocator_malloc(&arena.super, 1);
+    p2 = quicly_allocator_malloc(&arena.super, 100);
+    ok(p1 != NULL);
+    ok(p2 != NULL);
+    ok((uintptr_t)p1 % QUICLY_ARENA_ALIGNMENT == 0);
+    ok((uintptr_t)p2 % QUICLY_ARENA_ALIGNMENT == 0);
+    ok(p2 - p1 == QUICLY_ARENA_ALIGNMENT);
+    ok(parent.num_allocs == 1);
+    memset(p2, 'A', 100);
+
+    /* objects being freed are reused */
+    quicly_allocator_free(&arena.super, p1, 1);
+    p3 = quicly_allocator_malloc(&arena.super, QUICLY_ARENA_ALIGNMENT);
+    ok(p3 == p1);
+
+    /* realloc within the same size class retains the address, otherwise moves */
+    p3 = quicly_allocator_realloc(&arena.super, p2, 100, 112);
+    ok(p3 == p2);
+    p3 = quicly_allocator_realloc(&arena.super, p2, 112, 200);
+    ok(p3 != p2);
+    ok(p3[0] == 'A' && p3[99] == 'A');
+    ok(quicly_allocator_malloc(&arena.super, 100) == p2);
+
+    /* large objects are obtained from the parent */
+    large = quicly_allocator_malloc(&arena.super, QUICLY_ARENA_MAX_OBJECT_SIZE + 1);
+    ok(large != NULL);
+    ok(parent.num_allocs == 2);
+    large = quicly_allocator_realloc(&arena.super, large, QUICLY_ARENA_MAX_OBJECT_SIZE + 1, QUICLY_ARENA_MAX_OBJECT_SIZE * 2);
+    ok(large != NULL);
+    quicly_allocator_free(&arena.super, large, QUICLY_ARENA_MAX_OBJECT_SIZE * 2);
+    ok(parent.num_frees == 1);
+
+    /* new chunks are allocated as necessary */
+    for (size_t i = 0; i < QUICLY_ARENA_CHUNK_SIZE / QUICLY_ARENA_MAX_OBJECT_SIZE * 2; ++i)
+        ok(quicly_allocator_malloc(&arena.super, QUICLY_ARENA_MAX_OBJECT_SIZE) != NULL);
+    ok(parent.num_allocs > 3);
+
+    quicly_arena_dispose(&arena);
+    ok(parent.num_allocs == parent.num_frees);
+    ok(parent.bytes_allocated == 0);
+}
+
+static void test_conn(void)
+{
+    struct counting_allocator_t counter = {{counting_alloc, counting_realloc, counting_free}};
+    quicly_allocator_t *orig_allocator = quic_ctx.allocator;
+    quicly_conn_t *conn;
+    int use_arena, ret;
+
+    for (use_arena = 0; use_arena <= 1; ++use_arena) {
+        quic_ctx.allocator = &counter.super;
+        quic_ctx.use_connection_arena = use_arena;
+
+        ret = quicly_connect(&conn, &quic_ctx, "example.com", &fake_address.sa, NULL, new_master_id(), ptls_iovec_init(NULL, 0),
+                             NULL, NULL);
+        ok(ret == 0);
+        ok(counter.num_allocs != 0);
+        if (use_arena) {
+            ok(quicly_get_allocator(conn) != &counter.super);
+        } else {
+            ok(quicly_get_allocator(conn) == &counter.super);
+        }
+        quicly_free(conn);
+        ok(counter.num_allocs == counter.num_frees);
+        ok(counter.bytes_allocated == 0);
+
+        quic_ctx.allocator = orig_allocator;
+        quic_ctx.use_connection_arena = 0;
+    }
+}
+
+void test_allocator(void)
+{
+    subtest("arena", test_arena);
+    subtest("conn", test_conn);
+}
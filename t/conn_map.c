@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "quicly/conn_map.h"
+#include "test.h"
+
+void test_conn_map(void)
+{
+    quicly_conn_map_t *client_map = quicly_conn_map_new(), *server_map = quicly_conn_map_new();
+    quicly_conn_t *client, *server;
+    quicly_address_t dest, src;
+    struct iovec packets[8];
+    uint8_t packetsbuf[PTLS_ELEMENTSOF(packets) * quic_ctx.transport_params.max_udp_payload_size];
+    size_t num_packets, num_decoded, i;
+    quicly_decoded_packet_t decoded[PTLS_ELEMENTSOF(packets) * 4];
+    int ret;
+
+    ok(client_map != NULL);
+    ok(server_map != NULL);
+
+    /* client sends CH */
+    ret = quicly_connect(&client, &quic_ctx, "example.com", &fake_address.sa, NULL, new_master_id(), ptls_iovec_init(NULL, 0), NULL,
+                         NULL);
+    ok(ret == 0);
+    ok(quicly_conn_map_add(client_map, client) == 0);
+    ok(quicly_conn_map_get_size(client_map) == 1);
+    num_packets = PTLS_ELEMENTSOF(packets);
+    ret = quicly_send(client, &dest, &src, packets, &num_packets, packetsbuf, sizeof(packetsbuf));
+    ok(ret == 0);
+    num_decoded = decode_packets(decoded, packets, num_packets);
+    ok(num_decoded == 1);
+
+    /* server finds no connection, accepts, then finds the connection using the CID chosen by the client */
+    ok(quicly_conn_map_lookup(server_map, NULL, &fake_address.sa, decoded) == NULL);
+    ret = quicly_accept(&server, &quic_ctx, NULL, &fake_address.sa, decoded, NULL, new_master_id(), NULL);
+    ok(ret == 0);
+    ok(quicly_conn_map_add(server_map, server) == 0);
+    ok(quicly_conn_map_get_size(server_map) == 1);
+    ok(quicly_conn_map_lookup(server_map, NULL, &fake_address.sa, decoded) == server);
+
+    /* server flight is routed to the client */
+    num_packets = PTLS_ELEMENTSOF(packets);
+    ret = quicly_send(server, &dest, &src, packets, &num_packets, packetsbuf, sizeof(packetsbuf));
+    ok(ret == 0);
+    num_decoded = decode_packets(decoded, packets, num_packets);
+    ok(num_decoded != 0);
+    for (i = 0; i != num_decoded; ++i) {
+        ok(quicly_conn_map_lookup(client_map, NULL, &fake_address.sa, decoded + i) == client);
+        ret = quicly_receive(client, NULL, &fake_address.sa, decoded + i);
+        ok(ret == 0);
+    }
+
+    /* client flight is routed to the server */
+    num_packets = PTLS_ELEMENTSOF(packets);
+    ret = quicly_send(client, &dest, &src, packets, &num_packets, packetsbuf, sizeof(packetsbuf));
+    ok(ret == 0);
+    num_decoded = decode_packets(decoded, packets, num_packets);
+    ok(num_decoded != 0);
+    for (i = 0; i != num_decoded; ++i)
+        ok(quicly_conn_map_lookup(server_map, NULL, &fake_address.sa, decoded + i) == server);
+
+    /* nothing is found once unregistered */
+    quicly_conn_map_remove(server_map, server);
+    ok(quicly_conn_map_get_size(server_map) == 0);
+    for (i = 0; i != num_decoded; ++i)
+        ok(quicly_conn_map_lookup(server_map, NULL, &fake_address.sa, decoded + i) == NULL);
+    quicly_conn_map_remove(client_map, client);
+    ok(quicly_conn_map_get_size(client_map) == 0);
+
+    quicly_free(client);
+    quicly_free(server);
+    quicly_conn_map_free(client_map);
+    quicly_conn_map_free(server_map);
+}
@@ -128,11 +128,11 @@ static void test_ack_encode(void)
     const uint8_t *src;
     quicly_ack_frame_t decoded;
 
-    quicly_ranges_init(&ranges);
+    quicly_ranges_init(&ranges, NULL);
     quicly_ranges_add(&ranges, 0x12, 0x14);
 
     /* encode */
-    end = quicly_encode_ack_frame(buf, buf + sizeof(buf), &ranges, 63);
+    end = quicly_encode_ack_frame(buf, buf + sizeof(buf), &ranges, NULL, 63);
     ok(end - buf == 5);
     /* decode */
     src = buf + 1;
@@ -146,7 +146,7 @@ static void test_ack_encode(void)
     quicly_ranges_add(&ranges, 0x10, 0x11);
 
     /* encode */
-    end = quicly_encode_ack_frame(buf, buf + sizeof(buf), &ranges, 63);
+    end = quicly_encode_ack_frame(buf, buf + sizeof(buf), &ranges, NULL, 63);
     ok(end - buf == 7);
     /* decode */
     src = buf + 1;
@@ -158,6 +158,42 @@ static void test_ack_encode(void)
     ok(decoded.ack_block_lengths[0] == 2);
     ok(decoded.gaps[0] == 1);
     ok(decoded.ack_block_lengths[1] == 1);
+    ok(decoded.ecn_counts[QUICLY_ECN_COUNT_CE] == 0);
+
+    quicly_ranges_clear(&ranges);
+}
+
+static void test_ack_ecn_encode(void)
+{
+    quicly_ranges_t ranges;
+    uint64_t ecn_counts[QUICLY_NUM_ECN_CODEPOINTS] = {1000, 0, 64};
+    uint8_t buf[256], *end;
+    const uint8_t *src;
+    quicly_ack_frame_t decoded;
+
+    quicly_ranges_init(&ranges, NULL);
+    quicly_ranges_add(&ranges, 0x12, 0x14);
+
+    /* encode */
+    end = quicly_encode_ack_frame(buf, buf + sizeof(buf), &ranges, ecn_counts, 63);
+    ok(buf[0] == QUICLY_FRAME_TYPE_ACK_ECN);
+    ok(end - buf == 5 + 2 + 1 + 2);
+    /* decode */
+    src = buf + 1;
+    ok(quicly_decode_ack_frame(&src, end, &decoded, 1) == 0);
+    ok(src == end);
+    ok(decoded.largest_acknowledged == 0x13);
+    ok(decoded.ack_block_lengths[0] == 2);
+    ok(decoded.ecn_counts[QUICLY_ECN_COUNT_ECT0] == 1000);
+    ok(decoded.ecn_counts[QUICLY_ECN_COUNT_ECT1] == 0);
+    ok(decoded.ecn_counts[QUICLY_ECN_COUNT_CE] == 64);
+
+    /* truncated counts */
+    src = buf + 1;
+    ok(quicly_decode_ack_frame(&src, end - 1, &decoded, 1) != 0);
+
+    /* no space for the counts */
+    ok(quicly_encode_ack_frame(buf, buf + 5 + QUICLY_NUM_ECN_CODEPOINTS * 8 - 1, &ranges, ecn_counts, 63) == NULL);
 
     quicly_ranges_clear(&ranges);
 }
@@ -174,5 +210,6 @@ void test_frame(void)
 {
     subtest("ack-decode", test_ack_decode);
     subtest("ack-encode", test_ack_encode);
+    subtest("ack-ecn-encode", test_ack_ecn_encode);
     subtest("mozquic", test_mozquic);
 }
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "quicly/cc.h"
+#include "quicly/hystart.h"
+#include "test.h"
+
+#define MTU 1000
+#define PACKETS_PER_ROUND 10
+
+/**
+ * Acknowledges the packets of the `round`-th round one by one, each carrying given RTT sample. One new packet is sent for each ACK,
+ * so that the next round starts when the first packet sent during this round gets acknowledged.
+ */
+static uint32_t ack_round(quicly_hystart_t *hystart, uint64_t round, uint32_t rtt)
+{
+    uint32_t increase = 0;
+    for (uint64_t i = 0; i < PACKETS_PER_ROUND; ++i) {
+        uint64_t pn = round * PACKETS_PER_ROUND + i;
+        increase += quicly_hystart_on_acked(hystart, MTU, pn, pn + PACKETS_PER_ROUND, rtt, QUICLY_CLOCK_RESOLUTION_MSEC, MTU);
+        if (hystart->phase == QUICLY_HYSTART_DONE)
+            break;
+    }
+    return increase;
+}
+
+static void test_exit(void)
+{
+    quicly_hystart_t hystart;
+    uint64_t round = 0;
+
+    quicly_hystart_init(&hystart);
+
+    /* stable RTT, or an increase below the threshold (i.e., 100 / 8 = 12ms) does not change the phase */
+    ok(ack_round(&hystart, round++, 100) == PACKETS_PER_ROUND * MTU);
+    ok(ack_round(&hystart, round++, 100) == PACKETS_PER_ROUND * MTU);
+    ok(ack_round(&hystart, round++, 111) == PACKETS_PER_ROUND * MTU);
+    ok(hystart.phase == QUICLY_HYSTART_SLOW_START);
+
+    /* RTT increases by 14ms (threshold being 111 / 8 = 13ms); CSS is entered upon the 8th sample, which is the first to see the
+     * reduced increase */
+    ok(ack_round(&hystart, round++, 125) == (PACKETS_PER_ROUND - 3) * MTU + 3 * MTU / QUICLY_HYSTART_CSS_GROWTH_DIVISOR);
+    ok(hystart.phase == QUICLY_HYSTART_CSS);
+    ok(hystart.css_baseline_min_rtt == 125);
+
+    /* CSS lasts for CSS_ROUNDS, then slow start is exited */
+    for (size_t i = 0; i < QUICLY_HYSTART_CSS_ROUNDS - 1; ++i) {
+        ok(ack_round(&hystart, round++, 130) == PACKETS_PER_ROUND * MTU / QUICLY_HYSTART_CSS_GROWTH_DIVISOR);
+        ok(hystart.phase == QUICLY_HYSTART_CSS);
+    }
+    ok(ack_round(&hystart, round++, 130) == 0);
+    ok(hystart.phase == QUICLY_HYSTART_DONE);
+}
+
+static void test_spurious(void)
+{
+    quicly_hystart_t hystart;
+    uint64_t round = 0;
+
+    quicly_hystart_init(&hystart);
+
+    ack_round(&hystart, round++, 100);
+    ack_round(&hystart, round++, 120);
+    ok(hystart.phase == QUICLY_HYSTART_CSS);
+
+    /* RTT going back below the baseline indicates that the increase was spurious */
+    ack_round(&hystart, round++, 110);
+    ok(hystart.phase == QUICLY_HYSTART_SLOW_START);
+    ok(ack_round(&hystart, round++, 110) == PACKETS_PER_ROUND * MTU);
+    ok(hystart.phase == QUICLY_HYSTART_SLOW_START);
+}
+
+static void test_limit(void)
+{
+    quicly_hystart_t hystart;
+
+    quicly_hystart_init(&hystart);
+
+    /* increase upon receiving one ACK is capped to L packets */
+    ok(quicly_hystart_on_acked(&hystart, 100 * MTU, 99, 200, 100, QUICLY_CLOCK_RESOLUTION_MSEC, MTU) == QUICLY_HYSTART_L * MTU);
+    ok(quicly_hystart_on_acked(&hystart, 3 * MTU, 102, 203, 100, QUICLY_CLOCK_RESOLUTION_MSEC, MTU) == 3 * MTU);
+}
+
+static void test_cc(quicly_cc_type_t *cctype)
+{
+    quicly_cc_t cc;
+    quicly_loss_t loss = {.clock_resolution = QUICLY_CLOCK_RESOLUTION_MSEC};
+    uint64_t pn = 0, next_pn = PACKETS_PER_ROUND;
+    int64_t now = 0;
+
+    cctype->cc_init->cb(cctype->cc_init, &cc, PACKETS_PER_ROUND * MTU, now);
+    quicly_hystart_init(&cc.hystart);
+    loss.rtt.smoothed = loss.rtt.latest = 100;
+
+    /* ACK-clocked transfer with RTT growing by 20ms every round; CWND grows slower than standard slow start, then CA is entered */
+    for (uint64_t round = 0; cc.cwnd < cc.ssthresh; ++round) {
+        uint64_t round_end = next_pn;
+        uint32_t cwnd_at_start = cc.cwnd;
+        ok(round < 20);
+        loss.rtt.latest = 100 + round * 20;
+        for (; pn < round_end && cc.cwnd < cc.ssthresh; ++pn) {
+            now += 1;
+            cctype->cc_on_acked(&cc, &loss, MTU, pn, cc.cwnd, next_pn++, now, MTU, NULL);
+        }
+        if (cc.cwnd < cc.ssthresh && round >= 2)
+            ok(cc.cwnd < cwnd_at_start * 2);
+        next_pn = round_end + cc.cwnd / MTU;
+    }
+
+    ok(cc.hystart.phase == QUICLY_HYSTART_DONE);
+    ok(cc.ssthresh == cc.cwnd);
+    ok(cc.cwnd_exiting_slow_start == cc.cwnd);
+    ok(cc.num_loss_episodes == 0);
+}
+
+static void test_reno(void)
+{
+    test_cc(&quicly_cc_type_reno);
+}
+
+static void test_cubic(void)
+{
+    test_cc(&quicly_cc_type_cubic);
+}
+
+static void test_pico(void)
+{
+    test_cc(&quicly_cc_type_pico);
+}
+
+static void test_disabled(void)
+{
+    quicly_cc_t cc;
+    quicly_loss_t loss = {.clock_resolution = QUICLY_CLOCK_RESOLUTION_MSEC};
+
+    /* without initializing HyStart++, slow start continues regardless of RTT increase */
+    quicly_cc_type_reno.cc_init->cb(quicly_cc_type_reno.cc_init, &cc, PACKETS_PER_ROUND * MTU, 0);
+    ok(cc.hystart.phase == QUICLY_HYSTART_DISABLED);
+    for (uint64_t pn = 0; pn < 1000; ++pn) {
+        loss.rtt.latest = 100 + pn;
+        quicly_cc_type_reno.cc_on_acked(&cc, &loss, MTU, pn, UINT32_MAX, pn + 1000, 0, MTU, NULL);
+    }
+    ok(cc.cwnd == (PACKETS_PER_ROUND + 1000) * MTU);
+    ok(cc.ssthresh == UINT32_MAX);
+}
+
+void test_hystart(void)
+{
+    subtest("exit", test_exit);
+    subtest("spurious", test_spurious);
+    subtest("limit", test_limit);
+    subtest("reno", test_reno);
+    subtest("cubic", test_cubic);
+    subtest("pico", test_pico);
+    subtest("disabled", test_disabled);
+}
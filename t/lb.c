@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "picotls/openssl.h"
+#include "quicly/lb.h"
+#include "test.h"
+
+static const uint8_t lb_key[16] = {0x8f, 0x95, 0xf0, 0x92, 0x45, 0x76, 0x5f, 0x80, 0x25, 0x69, 0x34, 0xe5, 0x0c, 0x66, 0x20, 0x7f};
+
+static void test_codec(const quicly_lb_config_t *config, ptls_cipher_algorithm_t *cipher)
+{
+    quicly_lb_codec_t codec;
+    uint8_t server_id[QUICLY_LB_MAX_SERVER_ID_LEN], nonce[QUICLY_MAX_CID_LEN_V1], cid[QUICLY_MAX_CID_LEN_V1],
+        decoded_server_id[QUICLY_LB_MAX_SERVER_ID_LEN], decoded_nonce[QUICLY_MAX_CID_LEN_V1];
+    size_t cid_len = 1 + config->server_id_len + config->nonce_len;
+
+    ok(quicly_lb_codec_init(&codec, config, cipher, lb_key) == 0);
+    ok(quicly_lb_get_cid_len(&codec) == cid_len);
+
+    for (size_t i = 0; i < config->server_id_len; ++i)
+        server_id[i] = (uint8_t)(0xa0 + i);
+    for (size_t i = 0; i < config->nonce_len; ++i)
+        nonce[i] = (uint8_t)(0x30 + i);
+
+    quicly_lb_encrypt(&codec, cid, server_id, nonce);
+    ok(quicly_lb_get_config_id(cid) == config->config_id);
+    if (config->self_encode_length)
+        ok((cid[0] & 0x1f) == cid_len - 1);
+    if (cipher == NULL) {
+        ok(memcmp(cid + 1, server_id, config->server_id_len) == 0);
+    } else {
+        ok(memcmp(cid + 1, server_id, config->server_id_len) != 0);
+    }
+
+    /* full decode */
+    ok(quicly_lb_decrypt(&codec, decoded_server_id, decoded_nonce, cid, 0) == cid_len);
+    ok(memcmp(decoded_server_id, server_id, config->server_id_len) == 0);
+    ok(memcmp(decoded_nonce, nonce, config->nonce_len) == 0);
+
+    /* server ID only, as a load balancer would do */
+    memset(decoded_server_id, 0, sizeof(decoded_server_id));
+    ok(quicly_lb_decrypt(&codec, decoded_server_id, NULL, cid, cid_len) == cid_len);
+    ok(memcmp(decoded_server_id, server_id, config->server_id_len) == 0);
+
+    /* length and config ID mismatch */
+    ok(quicly_lb_decrypt(&codec, decoded_server_id, NULL, cid, cid_len - 1) == SIZE_MAX);
+    cid[0] ^= 0x20;
+    ok(quicly_lb_decrypt(&codec, decoded_server_id, NULL, cid, 0) == SIZE_MAX);
+
+    quicly_lb_codec_dispose(&codec);
+}
+
+static void test_modes(void)
+{
+    /* plaintext */
+    test_codec(&(quicly_lb_config_t){.config_id = 0, .server_id_len = 3, .nonce_len = 4, .self_encode_length = 1}, NULL);
+    /* single-pass */
+    test_codec(&(quicly_lb_config_t){.config_id = 1, .server_id_len = 4, .nonce_len = 12}, &ptls_openssl_aes128ecb);
+    /* four-pass, odd and even lengths */
+    test_codec(&(quicly_lb_config_t){.config_id = 2, .server_id_len = 3, .nonce_len = 8, .self_encode_length = 1},
+               &ptls_openssl_aes128ecb);
+    test_codec(&(quicly_lb_config_t){.config_id = 3, .server_id_len = 6, .nonce_len = 8}, &ptls_openssl_aes128ecb);
+    test_codec(&(quicly_lb_config_t){.config_id = 4, .server_id_len = 5, .nonce_len = 10}, &ptls_openssl_aes128ecb);
+}
+
+static void test_vector(ptls_cipher_algorithm_t *cipher, uint8_t config_id, const char *server_id_hex, const char *nonce_hex,
+                        const char *cid_hex)
+{
+    quicly_lb_config_t config = {.config_id = config_id, .self_encode_length = 1};
+    quicly_lb_codec_t codec;
+    uint8_t server_id[QUICLY_LB_MAX_SERVER_ID_LEN], nonce[QUICLY_MAX_CID_LEN_V1], expected[QUICLY_MAX_CID_LEN_V1],
+        cid[QUICLY_MAX_CID_LEN_V1], decoded_server_id[QUICLY_LB_MAX_SERVER_ID_LEN], decoded_nonce[QUICLY_MAX_CID_LEN_V1];
+    size_t i;
+
+    config.server_id_len = strlen(server_id_hex) / 2;
+    config.nonce_len = strlen(nonce_hex) / 2;
+    for (i = 0; i < config.server_id_len; ++i)
+        sscanf(server_id_hex + i * 2, "%2hhx", server_id + i);
+    for (i = 0; i < config.nonce_len; ++i)
+        sscanf(nonce_hex + i * 2, "%2hhx", nonce + i);
+    for (i = 0; i < strlen(cid_hex) / 2; ++i)
+        sscanf(cid_hex + i * 2, "%2hhx", expected + i);
+
+    ok(quicly_lb_codec_init(&codec, &config, cipher, lb_key) == 0);
+    ok(quicly_lb_get_cid_len(&codec) == strlen(cid_hex) / 2);
+    quicly_lb_encrypt(&codec, cid, server_id, nonce);
+    ok(memcmp(cid, expected, quicly_lb_get_cid_len(&codec)) == 0);
+    ok(quicly_lb_decrypt(&codec, decoded_server_id, decoded_nonce, expected, 0) == quicly_lb_get_cid_len(&codec));
+    ok(memcmp(decoded_server_id, server_id, config.server_id_len) == 0);
+    ok(memcmp(decoded_nonce, nonce, config.nonce_len) == 0);
+    quicly_lb_codec_dispose(&codec);
+}
+
+/**
+ * Test vectors of draft-ietf-quic-load-balancers, Appendix B.
+ */
+static void test_vectors(void)
+{
+    /* unencrypted */
+    test_vector(NULL, 0, "c4605e", "4504cd9e", "07c4605e4504cd9e");
+    /* four-pass, odd lengths */
+    test_vector(&ptls_openssl_aes128ecb, 0, "ed793a", "ee080dbf", "0720b1d07b359d3c");
+    test_vector(&ptls_openssl_aes128ecb, 1, "ed793a51d49b8f5fab65", "ee080dbf48", "2fcc381bc74cb4fbad2823a3d1f8fed2");
+    /* single-pass */
+    test_vector(&ptls_openssl_aes128ecb, 2, "ed793a51d49b8f5f", "ee080dbf48c0d1e5", "504dd2d05a7b0de9b2b9907afb5ecf8cc3");
+}
+
+static void test_encryptor(ptls_cipher_algorithm_t *cipher, uint8_t server_id_len, uint8_t nonce_len)
+{
+    quicly_lb_config_t config = {.config_id = 5, .server_id_len = server_id_len, .nonce_len = nonce_len};
+    quicly_cid_encryptor_t *encryptor = quicly_new_lb_cid_encryptor(&config, cipher, lb_key, &ptls_openssl_aes128ecb,
+                                                                     &ptls_openssl_sha256, ptls_iovec_init("abc", 3));
+    quicly_cid_plaintext_t plaintext = {.master_id = 0x12345678, .path_id = 2, .thread_id = 0xabcdef, .node_id = 0x1234},
+                           decrypted;
+    quicly_cid_t cid;
+    uint8_t token[QUICLY_STATELESS_RESET_TOKEN_LEN], token2[QUICLY_STATELESS_RESET_TOKEN_LEN],
+        server_id[QUICLY_LB_MAX_SERVER_ID_LEN];
+    quicly_lb_codec_t lb;
+
+    encryptor->encrypt_cid(encryptor, &cid, token, &plaintext);
+    ok(cid.len == 1 + server_id_len + nonce_len);
+
+    /* quicly can decode */
+    ok(encryptor->decrypt_cid(encryptor, &decrypted, cid.cid, 0) == cid.len);
+    ok(decrypted.master_id == plaintext.master_id);
+    ok(decrypted.path_id == plaintext.path_id);
+    ok(decrypted.thread_id == plaintext.thread_id);
+    ok(decrypted.node_id == plaintext.node_id);
+    ok(encryptor->decrypt_cid(encryptor, &decrypted, cid.cid, cid.len) == cid.len);
+    ok(encryptor->decrypt_cid(encryptor, &decrypted, cid.cid, cid.len + 1) == SIZE_MAX);
+
+    /* reset token is reproducible from CID */
+    ok(encryptor->generate_stateless_reset_token(encryptor, token2, cid.cid));
+    ok(memcmp(token, token2, sizeof(token)) == 0);
+
+    /* load balancer can extract the node_id */
+    ok(quicly_lb_codec_init(&lb, &config, cipher, lb_key) == 0);
+    ok(quicly_lb_decrypt(&lb, server_id, NULL, cid.cid, 0) == cid.len);
+    ok(server_id[server_id_len - 2] == 0x12);
+    ok(server_id[server_id_len - 1] == 0x34);
+    quicly_lb_codec_dispose(&lb);
+
+    quicly_free_lb_cid_encryptor(encryptor);
+}
+
+static void test_encryptors(void)
+{
+    test_encryptor(&ptls_openssl_aes128ecb, 8, 8);
+    test_encryptor(&ptls_openssl_aes128ecb, 3, 8);
+}
+
+void test_lb(void)
+{
+    subtest("modes", test_modes);
+    subtest("vectors", test_vectors);
+    subtest("encryptor", test_encryptors);
+}
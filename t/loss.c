@@ -26,7 +26,7 @@
 static int64_t now;
 static uint64_t num_packets_lost = 0;
 
-static void on_loss_detected(quicly_loss_t *loss, const quicly_sent_packet_t *lost_packet, int is_time_threshold)
+static void on_loss_detected(quicly_loss_t *loss, quicly_sent_packet_t *lost_packet, int is_time_threshold)
 {
     ++num_packets_lost;
 }
@@ -55,7 +55,8 @@ static void test_time_detection(void)
     num_packets_lost = 0;
 
     quicly_loss_init(&loss, &quicly_spec_context.loss, 20, &quicly_spec_context.transport_params.max_ack_delay,
-                     &quicly_spec_context.transport_params.ack_delay_exponent);
+                     &quicly_spec_context.transport_params.ack_delay_exponent, quicly_spec_context.clock_resolution, NULL,
+                     NULL);
     ok(loss.loss_time == INT64_MAX);
 
     /* commit 3 packets (pn=0..2); check that loss timer is not active */
@@ -99,7 +100,8 @@ static void test_pn_detection(void)
     num_packets_lost = 0;
 
     quicly_loss_init(&loss, &quicly_spec_context.loss, 20, &quicly_spec_context.transport_params.max_ack_delay,
-                     &quicly_spec_context.transport_params.ack_delay_exponent);
+                     &quicly_spec_context.transport_params.ack_delay_exponent, quicly_spec_context.clock_resolution, NULL,
+                     NULL);
     ok(loss.loss_time == INT64_MAX);
 
     /* commit 4 packets (pn=0..3); check that loss timer is not active */
@@ -140,7 +142,8 @@ static void test_slow_cert_verify(void)
     num_packets_lost = 0;
 
     quicly_loss_init(&loss, &quicly_spec_context.loss, 20, &quicly_spec_context.transport_params.max_ack_delay,
-                     &quicly_spec_context.transport_params.ack_delay_exponent);
+                     &quicly_spec_context.transport_params.ack_delay_exponent, quicly_spec_context.clock_resolution, NULL,
+                     NULL);
     ok(loss.loss_time == INT64_MAX);
 
     /* sent Handshake+1RTT packet */
@@ -184,9 +187,217 @@ static void test_slow_cert_verify(void)
     quicly_loss_dispose(&loss);
 }
 
+static void test_usec_clock(void)
+{
+    quicly_loss_t loss;
+
+    now = 0;
+    num_packets_lost = 0;
+
+    quicly_loss_init(&loss, &quicly_spec_context.loss, 20, &quicly_spec_context.transport_params.max_ack_delay,
+                     &quicly_spec_context.transport_params.ack_delay_exponent, QUICLY_CLOCK_RESOLUTION_USEC, NULL, NULL);
+    ok(loss.rtt.smoothed == 20000);
+
+    /* send a packet and receive an ack 1500us later, with an ack_delay of 512us (encoded using the default exponent of 3) */
+    ok(quicly_sentmap_prepare(&loss.sentmap, 1, now, QUICLY_EPOCH_1RTT) == 0);
+    quicly_sentmap_commit(&loss.sentmap, 10);
+    quicly_loss_update_alarm(&loss, now, now, 1, 0, 0, 0, 1);
+    now += 1500;
+    {
+        quicly_sentmap_iter_t iter;
+        quicly_loss_init_sentmap_iter(&loss, &iter, now, quicly_spec_context.transport_params.max_ack_delay, 0);
+        ok(quicly_sentmap_get(&iter)->packet_number == 1);
+        ok(quicly_sentmap_update(&loss.sentmap, &iter, QUICLY_SENTMAP_EVENT_ACKED) == 0);
+    }
+    quicly_loss_on_ack_received(&loss, 1, QUICLY_EPOCH_1RTT, now, 0, 512 >> 3, 1);
+    ok(loss.rtt.latest == 1500);
+    ok(loss.rtt.minimum == 1500);
+    ok(loss.rtt.smoothed == 1500);
+
+    /* sub-millisecond RTT is retained in the PTO, with min_pto being converted to microseconds */
+    ok(quicly_loss_get_pto(&loss, 0) == 1500 + 750 * 4);
+
+    quicly_loss_dispose(&loss);
+}
+
+/**
+ * Returns the duration of the first speculative PTO (i.e., PTO / 4) armed after observing an RTT of 200us.
+ */
+static int64_t speculative_pto(uint32_t min_pto_usec)
+{
+    quicly_loss_conf_t conf = quicly_spec_context.loss;
+    quicly_loss_t loss;
+    int64_t duration;
+
+    conf.min_pto_usec = min_pto_usec;
+    conf.num_speculative_ptos = 2;
+    now = 0;
+
+    quicly_loss_init(&loss, &conf, 20, &quicly_spec_context.transport_params.max_ack_delay,
+                     &quicly_spec_context.transport_params.ack_delay_exponent, QUICLY_CLOCK_RESOLUTION_USEC, NULL, NULL);
+    ok(quicly_sentmap_prepare(&loss.sentmap, 1, now, QUICLY_EPOCH_1RTT) == 0);
+    quicly_sentmap_commit(&loss.sentmap, 10);
+    now += 200;
+    acked(&loss, 1, QUICLY_EPOCH_1RTT);
+    ok(loss.rtt.smoothed == 200);
+
+    ok(quicly_sentmap_prepare(&loss.sentmap, 2, now, QUICLY_EPOCH_1RTT) == 0);
+    quicly_sentmap_commit(&loss.sentmap, 10);
+    quicly_loss_update_alarm(&loss, now, now, 1, 0, 0, 10, 1);
+    ok(loss.pto_count == -2);
+    duration = loss.alarm_at - now;
+
+    quicly_loss_dispose(&loss);
+    return duration;
+}
+
+static void test_sub_msec_min_pto(void)
+{
+    quicly_loss_t loss = {.conf = &quicly_spec_context.loss, .clock_resolution = QUICLY_CLOCK_RESOLUTION_USEC};
+
+    /* min_pto is converted to clock ticks, being rounded up to at least one tick */
+    ok(quicly_loss_get_min_pto(&loss) == 1000);
+    loss.clock_resolution = QUICLY_CLOCK_RESOLUTION_MSEC;
+    ok(quicly_loss_get_min_pto(&loss) == 1);
+    loss.conf = &(quicly_loss_conf_t){.min_pto_usec = 100};
+    ok(quicly_loss_get_min_pto(&loss) == 1);
+    loss.clock_resolution = QUICLY_CLOCK_RESOLUTION_USEC;
+    ok(quicly_loss_get_min_pto(&loss) == 100);
+
+    /* the default floor of 1ms applies to speculative PTOs, while a sub-millisecond floor lets them fire as early as PTO / 4 */
+    ok(speculative_pto(QUICLY_DEFAULT_MIN_PTO) == 1000);
+    ok(speculative_pto(100) == (200 + 100 * 4) / 4);
+}
+
+static void test_adaptive_reordering(void)
+{
+    quicly_loss_t loss;
+
+    now = 0;
+    num_packets_lost = 0;
+
+    quicly_loss_init(&loss, &quicly_spec_context.loss, 20, &quicly_spec_context.transport_params.max_ack_delay,
+                     &quicly_spec_context.transport_params.ack_delay_exponent, quicly_spec_context.clock_resolution, NULL,
+                     NULL);
+    ok(loss.reordering_threshold.packets == QUICLY_LOSS_DEFAULT_PACKET_THRESHOLD);
+    ok(loss.reordering_threshold.time_percentile == QUICLY_LOSS_DEFAULT_TIME_REORDERING_PERCENTILE);
+
+    /* commit 16 packets (pn=0..15) */
+    for (uint64_t pn = 0; pn < 16; ++pn) {
+        ok(quicly_sentmap_prepare(&loss.sentmap, pn, now, QUICLY_EPOCH_INITIAL) == 0);
+        quicly_sentmap_commit(&loss.sentmap, 10);
+    }
+
+    /* receive ack for pn=5; pn=0..2 are declared lost by the default packet threshold */
+    acked(&loss, 5, QUICLY_EPOCH_INITIAL);
+    ok(quicly_loss_detect_loss(&loss, now, quicly_spec_context.transport_params.max_ack_delay, 0, on_loss_detected) == 0);
+    ok(num_packets_lost == 3);
+
+    /* pn=0 turns out to have been reordered by 5 packets; thresholds are raised */
+    quicly_loss_on_spurious_loss(&loss, 5);
+    ok(loss.reordering_threshold.packets == 6);
+    ok(loss.reordering_threshold.time_percentile == QUICLY_LOSS_DEFAULT_TIME_REORDERING_PERCENTILE * 2);
+
+    /* the time threshold is raised only once per loss episode, and the packet threshold is never lowered */
+    quicly_loss_on_spurious_loss(&loss, 4);
+    ok(loss.reordering_threshold.packets == 6);
+    ok(loss.reordering_threshold.time_percentile == QUICLY_LOSS_DEFAULT_TIME_REORDERING_PERCENTILE * 2);
+
+    /* receive ack for pn=11; only pn=3,4 are declared lost, while the default threshold would have declared pn=6..8 as well */
+    acked(&loss, 11, QUICLY_EPOCH_INITIAL);
+    ok(quicly_loss_detect_loss(&loss, now, quicly_spec_context.transport_params.max_ack_delay, 0, on_loss_detected) == 0);
+    ok(num_packets_lost == 5);
+
+    /* the thresholds are capped */
+    for (size_t i = 0; i < 20; ++i) {
+        quicly_loss_on_loss_episode(&loss);
+        quicly_loss_on_spurious_loss(&loss, 10000);
+    }
+    ok(loss.reordering_threshold.packets == QUICLY_LOSS_MAX_PACKET_THRESHOLD);
+    ok(loss.reordering_threshold.time_percentile == QUICLY_LOSS_MAX_TIME_REORDERING_PERCENTILE);
+
+    /* and are restored after a number of loss episodes without spurious losses */
+    for (size_t i = 0; i < QUICLY_LOSS_REORDERING_DECAY_EPISODES - 1; ++i)
+        quicly_loss_on_loss_episode(&loss);
+    ok(loss.reordering_threshold.packets == QUICLY_LOSS_MAX_PACKET_THRESHOLD);
+    quicly_loss_on_loss_episode(&loss);
+    ok(loss.reordering_threshold.packets == QUICLY_LOSS_DEFAULT_PACKET_THRESHOLD);
+    ok(loss.reordering_threshold.time_percentile == QUICLY_LOSS_DEFAULT_TIME_REORDERING_PERCENTILE);
+
+    quicly_loss_dispose(&loss);
+}
+
+static void test_cc_undo(void)
+{
+    quicly_loss_t loss;
+    const uint32_t mtu = 1200, initcwnd = 10 * mtu;
+
+    quicly_loss_init(&loss, &quicly_spec_context.loss, 20, &quicly_spec_context.transport_params.max_ack_delay,
+                     &quicly_spec_context.transport_params.ack_delay_exponent, quicly_spec_context.clock_resolution, NULL,
+                     NULL);
+
+    for (quicly_cc_type_t **cctype = quicly_cc_all_types; *cctype != NULL; ++cctype) {
+        quicly_cc_t cc;
+        (*cctype)->cc_init->cb((*cctype)->cc_init, &cc, initcwnd, 0);
+
+        /* loss of pn=5 starts a loss episode, reducing CWND */
+        (*cctype)->cc_on_lost(&cc, &loss, mtu, 5, 20, 0, mtu);
+        ok(cc.cwnd < initcwnd);
+        ok(cc.recovery_end == 20);
+        ok(cc.undo.cwnd == initcwnd);
+        ok(cc.undo.recovery_end == 0);
+
+        /* losses within the same episode do not overwrite the saved state */
+        (*cctype)->cc_on_lost(&cc, &loss, mtu, 6, 21, 0, mtu);
+        ok(cc.undo.cwnd == initcwnd);
+
+        /* undo restores the state prior to the episode */
+        (*cctype)->cc_on_spurious_loss(&cc, &loss, 0);
+        ok(cc.cwnd == initcwnd);
+        ok(cc.recovery_end == 0);
+        ok(cc.num_loss_episodes == 1);
+        ok(cc.num_loss_episodes_undone == 1);
+        if (*cctype != &quicly_cc_type_bbr) {
+            ok(cc.ssthresh == UINT32_MAX);
+            ok(cc.cwnd_exiting_slow_start == 0);
+        }
+    }
+
+    quicly_loss_dispose(&loss);
+}
+
+static void test_bbr_persistent_congestion(void)
+{
+    quicly_loss_t loss;
+    quicly_cc_t cc;
+    const uint32_t mtu = 1400, initcwnd = 10 * mtu;
+
+    quicly_loss_init(&loss, &quicly_spec_context.loss, 20, &quicly_spec_context.transport_params.max_ack_delay,
+                     &quicly_spec_context.transport_params.ack_delay_exponent, quicly_spec_context.clock_resolution, NULL,
+                     NULL);
+    quicly_cc_bbr_init.cb(&quicly_cc_bbr_init, &cc, initcwnd, 0);
+
+    /* enter recovery, then observe persistent congestion */
+    quicly_cc_type_bbr.cc_on_lost(&cc, &loss, mtu, 5, 20, 0, mtu);
+    ok(cc.state.bbr.in_recovery);
+    cc.undo.num_lost = 1; /* incremented by the caller of `cc_on_lost` */
+    quicly_cc_type_bbr.cc_on_persistent_congestion(&cc, &loss, 0);
+    ok(cc.cwnd == 4 * mtu);
+    ok(cc.cwnd_minimum == 4 * mtu);
+    ok(!cc.state.bbr.in_recovery);
+    ok(cc.undo.num_lost == 0);
+
+    quicly_loss_dispose(&loss);
+}
+
 void test_loss(void)
 {
     subtest("time-detection", test_time_detection);
     subtest("pn-detection", test_pn_detection);
     subtest("slow-cert-verify", test_slow_cert_verify);
+    subtest("usec-clock", test_usec_clock);
+    subtest("sub-msec-min-pto", test_sub_msec_min_pto);
+    subtest("adaptive-reordering", test_adaptive_reordering);
+    subtest("cc-undo", test_cc_undo);
+    subtest("bbr-persistent-congestion", test_bbr_persistent_congestion);
 }
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "quicly/pacer.h"
+#include "test.h"
+
+static void test_burst_and_drain(uint32_t clock_resolution)
+{
+    quicly_pacer_t pacer;
+    const uint16_t mtu = 1000;
+    const uint32_t bytes_per_msec = 2000; /* 2 packets per millisecond */
+    int64_t now = 1000 * clock_resolution;
+
+    quicly_pacer_reset(&pacer);
+    ok(quicly_pacer_can_send_at(&pacer, bytes_per_msec, mtu, clock_resolution) <= now);
+
+    /* initially, full burst can be sent */
+    ok(quicly_pacer_get_window(&pacer, now, bytes_per_msec, mtu, clock_resolution) == QUICLY_PACER_BURST_PACKETS * mtu);
+    for (size_t i = 0; i < QUICLY_PACER_BURST_PACKETS; ++i)
+        quicly_pacer_consume_window(&pacer, mtu);
+    ok(quicly_pacer_get_window(&pacer, now, bytes_per_msec, mtu, clock_resolution) == 0);
+
+    /* one packet can be sent 0.5ms later */
+    int64_t send_at = quicly_pacer_can_send_at(&pacer, bytes_per_msec, mtu, clock_resolution);
+    ok(send_at == now + (clock_resolution + 1) / 2);
+    now = send_at;
+    uint64_t window = quicly_pacer_get_window(&pacer, now, bytes_per_msec, mtu, clock_resolution);
+    ok(window >= mtu);
+    for (; window >= mtu; window -= mtu)
+        quicly_pacer_consume_window(&pacer, mtu);
+    ok(quicly_pacer_can_send_at(&pacer, bytes_per_msec, mtu, clock_resolution) > now);
+
+    /* after being idle, the window is restored to the burst size */
+    now += 10 * clock_resolution;
+    ok(quicly_pacer_get_window(&pacer, now, bytes_per_msec, mtu, clock_resolution) == QUICLY_PACER_BURST_PACKETS * mtu);
+}
+
+static void test_msec(void)
+{
+    test_burst_and_drain(QUICLY_CLOCK_RESOLUTION_MSEC);
+}
+
+static void test_usec(void)
+{
+    test_burst_and_drain(QUICLY_CLOCK_RESOLUTION_USEC);
+}
+
+static void test_steady_rate(void)
+{
+    quicly_pacer_t pacer;
+    const uint16_t mtu = 1200;
+    const uint32_t bytes_per_msec = 1500, clock_resolution = QUICLY_CLOCK_RESOLUTION_USEC;
+    int64_t now = 0, start_at;
+    uint64_t bytes_sent = 0;
+
+    quicly_pacer_reset(&pacer);
+
+    /* send as much as permitted for 100ms; the amount sent should be the burst plus the amount permitted by the rate */
+    for (start_at = now; now < start_at + 100 * clock_resolution; now = quicly_pacer_can_send_at(&pacer, bytes_per_msec, mtu,
+                                                                                                    clock_resolution)) {
+        uint64_t window = quicly_pacer_get_window(&pacer, now, bytes_per_msec, mtu, clock_resolution);
+        while (window >= mtu) {
+            quicly_pacer_consume_window(&pacer, mtu);
+            bytes_sent += mtu;
+            window -= mtu;
+        }
+    }
+    ok(bytes_sent >= 100 * bytes_per_msec);
+    ok(bytes_sent <= 100 * bytes_per_msec + QUICLY_PACER_BURST_PACKETS * mtu + mtu);
+}
+
+static void test_calc_send_rate(void)
+{
+    quicly_cc_t cc = {.cwnd = 100000, .ssthresh = UINT32_MAX};
+    quicly_loss_t loss = {.clock_resolution = QUICLY_CLOCK_RESOLUTION_USEC};
+
+    loss.rtt.smoothed = 10000; /* 10ms */
+    ok(quicly_pacer_calc_send_rate(&cc, &loss) == 100000 * 2 / 10);
+    cc.ssthresh = cc.cwnd;
+    ok(quicly_pacer_calc_send_rate(&cc, &loss) == 100000 * 5 / 4 / 10);
+    cc.pacing_rate = 1234;
+    ok(quicly_pacer_calc_send_rate(&cc, &loss) == 1234);
+}
+
+void test_pacer(void)
+{
+    subtest("msec", test_msec);
+    subtest("usec", test_usec);
+    subtest("steady-rate", test_steady_rate);
+    subtest("calc-send-rate", test_calc_send_rate);
+}
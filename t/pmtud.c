@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "quicly/pmtud.h"
+#include "quicly/constants.h"
+#include "test.h"
+
+/**
+ * Runs the search on a path that supports up to `path_mtu` bytes, returning the number of probes being sent.
+ */
+static size_t run_search(quicly_pmtud_t *pmtud, uint16_t path_mtu, int64_t now)
+{
+    size_t num_probes = 0;
+    uint16_t size;
+
+    while ((size = quicly_pmtud_get_probe_size(pmtud, now)) != 0) {
+        quicly_pmtud_on_probe_sent(pmtud, size);
+        ok(quicly_pmtud_get_probe_size(pmtud, now) == 0); /* only one probe is inflight */
+        if (size <= path_mtu) {
+            ok(quicly_pmtud_on_probe_acked(pmtud, size, now) == size);
+        } else {
+            quicly_pmtud_on_probe_lost(pmtud, size, now);
+        }
+        ++num_probes;
+    }
+
+    return num_probes;
+}
+
+static void test_search(void)
+{
+    quicly_pmtud_t pmtud;
+    size_t num_probes;
+
+    /* path supports the maximum size; one probe is sufficient */
+    quicly_pmtud_init(&pmtud, 1280, 9000, QUICLY_CLOCK_RESOLUTION_MSEC);
+    num_probes = run_search(&pmtud, 9000, 0);
+    ok(num_probes == 1);
+    ok(pmtud.search_low == 9000);
+
+    /* path supports a smaller size */
+    quicly_pmtud_init(&pmtud, 1280, 9000, QUICLY_CLOCK_RESOLUTION_MSEC);
+    num_probes = run_search(&pmtud, 1500, 0);
+    ok(pmtud.search_low <= 1500);
+    ok(pmtud.search_low > 1500 - QUICLY_PMTUD_SEARCH_GRANULARITY);
+    ok(num_probes < 40);
+
+    /* path does not support anything above the base */
+    quicly_pmtud_init(&pmtud, 1280, 1472, QUICLY_CLOCK_RESOLUTION_MSEC);
+    run_search(&pmtud, 1280, 0);
+    ok(pmtud.search_low == 1280);
+
+    /* disabled */
+    quicly_pmtud_init(&pmtud, 1280, 1200, QUICLY_CLOCK_RESOLUTION_MSEC);
+    ok(quicly_pmtud_get_probe_size(&pmtud, 0) == 0);
+}
+
+static void test_probe_lost(void)
+{
+    quicly_pmtud_t pmtud;
+    size_t i;
+
+    quicly_pmtud_init(&pmtud, 1280, 1472, QUICLY_CLOCK_RESOLUTION_MSEC);
+
+    /* the same size is probed until MAX_PROBES are lost */
+    for (i = 0; i != QUICLY_PMTUD_MAX_PROBES; ++i) {
+        ok(quicly_pmtud_get_probe_size(&pmtud, 0) == 1472);
+        quicly_pmtud_on_probe_sent(&pmtud, 1472);
+        quicly_pmtud_on_probe_lost(&pmtud, 1472, 0);
+    }
+    ok(pmtud.search_high == 1471);
+    ok(quicly_pmtud_get_probe_size(&pmtud, 0) == 1376);
+
+    /* late ack of a probe that has been deemed lost raises the PMTU */
+    quicly_pmtud_on_probe_sent(&pmtud, 1376);
+    ok(quicly_pmtud_on_probe_acked(&pmtud, 1472, 0) == 1472);
+    ok(pmtud.search_low == 1472);
+    ok(quicly_pmtud_get_probe_size(&pmtud, 0) == 0);
+}
+
+static void test_probe_pto(void)
+{
+    quicly_pmtud_t pmtud;
+    size_t i;
+
+    quicly_pmtud_init(&pmtud, 1280, 1472, QUICLY_CLOCK_RESOLUTION_MSEC);
+
+    /* PTO re-arms the probe without counting it as lost */
+    for (i = 0; i != QUICLY_PMTUD_MAX_PROBES * 2; ++i) {
+        ok(quicly_pmtud_get_probe_size(&pmtud, 0) == 1472);
+        quicly_pmtud_on_probe_sent(&pmtud, 1472);
+        ok(quicly_pmtud_get_probe_size(&pmtud, 0) == 0);
+        quicly_pmtud_on_probe_pto(&pmtud, 1472);
+    }
+    ok(pmtud.num_probes_lost == 0);
+    ok(pmtud.search_high == 1472);
+
+    /* late ack of a probe that has been subject to PTO */
+    ok(quicly_pmtud_on_probe_acked(&pmtud, 1472, 0) == 1472);
+    ok(pmtud.search_low == 1472);
+}
+
+static void test_raise_timer(void)
+{
+    quicly_pmtud_t pmtud;
+    int64_t now = 1000;
+
+    quicly_pmtud_init(&pmtud, 1280, 9000, QUICLY_CLOCK_RESOLUTION_MSEC);
+    run_search(&pmtud, 1500, now);
+    ok(pmtud.search_low <= 1500);
+
+    /* nothing is probed until the raise timer fires */
+    ok(quicly_pmtud_get_probe_size(&pmtud, now + QUICLY_PMTUD_RAISE_INTERVAL - 1) == 0);
+    now += QUICLY_PMTUD_RAISE_INTERVAL;
+    ok(quicly_pmtud_get_probe_size(&pmtud, now) == 9000);
+
+    /* the path now supports jumbo frames */
+    run_search(&pmtud, 9000, now);
+    ok(pmtud.search_low == 9000);
+}
+
+static void test_black_hole(void)
+{
+    quicly_pmtud_t pmtud;
+    uint64_t pn = 0;
+    size_t i;
+
+    quicly_pmtud_init(&pmtud, 1280, 9000, QUICLY_CLOCK_RESOLUTION_MSEC);
+    run_search(&pmtud, 9000, 0);
+    ok(pmtud.search_low == 9000);
+
+    /* losses followed by an ack of a full-sized packet being sent later are not considered as a black hole */
+    for (i = 0; i != QUICLY_PMTUD_BLACK_HOLE_THRESHOLD - 1; ++i)
+        ok(!quicly_pmtud_on_full_sized_lost(&pmtud, pn++));
+    quicly_pmtud_on_full_sized_acked(&pmtud, pn++);
+    ok(!quicly_pmtud_on_full_sized_lost(&pmtud, 0));
+    for (i = 0; i != QUICLY_PMTUD_BLACK_HOLE_THRESHOLD - 1; ++i)
+        ok(!quicly_pmtud_on_full_sized_lost(&pmtud, pn++));
+
+    /* consecutive losses */
+    ok(quicly_pmtud_on_full_sized_lost(&pmtud, pn++));
+    ok(pmtud.search_low == 1280);
+    ok(pmtud.search_high == 8999);
+    ok(!quicly_pmtud_on_full_sized_lost(&pmtud, pn++));
+
+    /* the search resumes below the size that stopped working */
+    run_search(&pmtud, 4000, 0);
+    ok(pmtud.search_low <= 4000);
+    ok(pmtud.search_low > 4000 - QUICLY_PMTUD_SEARCH_GRANULARITY);
+}
+
+void test_pmtud(void)
+{
+    subtest("search", test_search);
+    subtest("probe-lost", test_probe_lost);
+    subtest("probe-pto", test_probe_pto);
+    subtest("raise-timer", test_raise_timer);
+    subtest("black-hole", test_black_hole);
+}
@@ -38,7 +38,7 @@ static void test_add(void)
     quicly_ranges_t ranges;
     int ret;
 
-    quicly_ranges_init(&ranges);
+    quicly_ranges_init(&ranges, NULL);
     ok(ranges.num_ranges == 0);
 
     ret = quicly_ranges_add(&ranges, 40, 100);
@@ -99,7 +99,7 @@ static void test_subtract(void)
     quicly_ranges_t ranges;
     int ret;
 
-    quicly_ranges_init(&ranges);
+    quicly_ranges_init(&ranges, NULL);
 
     ret = quicly_ranges_add(&ranges, 100, 200);
     ok(ret == 0);
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "quicly/streambuf.h"
+#include "test.h"
+
+static void fill_pattern(uint8_t *buf, size_t off, size_t len)
+{
+    size_t i;
+    for (i = 0; i != len; ++i)
+        buf[i] = (uint8_t)((off + i) * 7);
+}
+
+static int vecs_match(ptls_iovec_t *vecs, size_t num_vecs, size_t off)
+{
+    size_t i, j;
+    for (i = 0; i != num_vecs; ++i) {
+        for (j = 0; j != vecs[i].len; ++j)
+            if (vecs[i].base[j] != (uint8_t)((off + j) * 7))
+                return 0;
+        off += vecs[i].len;
+    }
+    return 1;
+}
+
+static void test_in_order(void)
+{
+    quicly_chunked_recvbuf_t rb;
+    uint8_t buf[QUICLY_RECVBUF_CHUNK_SIZE * 2];
+    ptls_iovec_t vecs[4];
+    size_t num_vecs;
+
+    quicly_chunked_recvbuf_init(&rb, NULL);
+
+    /* small write, then consume everything; the chunk is retained and rewound */
+    fill_pattern(buf, 0, 100);
+    ok(quicly_chunked_recvbuf_write(&rb, 0, buf, 100) == 0);
+    ok(rb.off == 100);
+    num_vecs = PTLS_ELEMENTSOF(vecs);
+    ok(quicly_chunked_recvbuf_peek(&rb, 100, vecs, &num_vecs) == 100);
+    ok(num_vecs == 1);
+    ok(vecs_match(vecs, num_vecs, 0));
+    quicly_chunked_recvbuf_consume(&rb, 100);
+    ok(rb.off == 0);
+    ok(rb.off_in_first_chunk == 0);
+    ok(rb.chunks.size == 1);
+
+    /* write across chunk boundaries */
+    fill_pattern(buf, 100, sizeof(buf));
+    ok(quicly_chunked_recvbuf_write(&rb, 0, buf, sizeof(buf)) == 0);
+    ok(rb.chunks.size == 2);
+    num_vecs = PTLS_ELEMENTSOF(vecs);
+    ok(quicly_chunked_recvbuf_peek(&rb, sizeof(buf), vecs, &num_vecs) == sizeof(buf));
+    ok(num_vecs == 2);
+    ok(vecs_match(vecs, num_vecs, 100));
+
+    /* partial consumption keeps the data in place */
+    quicly_chunked_recvbuf_consume(&rb, 10);
+    num_vecs = PTLS_ELEMENTSOF(vecs);
+    ok(quicly_chunked_recvbuf_peek(&rb, sizeof(buf) - 10, vecs, &num_vecs) == sizeof(buf) - 10);
+    ok(num_vecs == 2);
+    ok(vecs_match(vecs, num_vecs, 110));
+
+    /* vecs being too small */
+    num_vecs = 1;
+    ok(quicly_chunked_recvbuf_peek(&rb, sizeof(buf) - 10, vecs, &num_vecs) == QUICLY_RECVBUF_CHUNK_SIZE - 10);
+    ok(num_vecs == 1);
+
+    /* consuming beyond the first chunk releases it */
+    quicly_chunked_recvbuf_consume(&rb, QUICLY_RECVBUF_CHUNK_SIZE);
+    ok(rb.chunks.size == 1);
+    ok(rb.off_in_first_chunk == 10);
+    num_vecs = PTLS_ELEMENTSOF(vecs);
+    ok(quicly_chunked_recvbuf_peek(&rb, rb.off, vecs, &num_vecs) == QUICLY_RECVBUF_CHUNK_SIZE - 10);
+    ok(num_vecs == 1);
+    ok(vecs_match(vecs, num_vecs, 100 + QUICLY_RECVBUF_CHUNK_SIZE + 10));
+
+    quicly_chunked_recvbuf_dispose(&rb);
+}
+
+static void test_out_of_order(void)
+{
+    quicly_chunked_recvbuf_t rb;
+    uint8_t buf[QUICLY_RECVBUF_CHUNK_SIZE * 5];
+    ptls_iovec_t vecs[8];
+    size_t num_vecs, off;
+
+    fill_pattern(buf, 0, sizeof(buf));
+    quicly_chunked_recvbuf_init(&rb, NULL);
+
+    /* write the last part first; the chunks in between are not allocated */
+    ok(quicly_chunked_recvbuf_write(&rb, QUICLY_RECVBUF_CHUNK_SIZE * 4 + 1, buf + QUICLY_RECVBUF_CHUNK_SIZE * 4 + 1,
+                                    QUICLY_RECVBUF_CHUNK_SIZE - 1) == 0);
+    ok(rb.off == sizeof(buf));
+    ok(rb.chunks.size == 5);
+    ok(rb.chunks.entries[0] == NULL);
+    ok(rb.chunks.entries[3] == NULL);
+    ok(rb.chunks.entries[4] != NULL);
+
+    /* fill the gap */
+    ok(quicly_chunked_recvbuf_write(&rb, 0, buf, QUICLY_RECVBUF_CHUNK_SIZE * 4 + 1) == 0);
+    ok(rb.off == sizeof(buf));
+    num_vecs = PTLS_ELEMENTSOF(vecs);
+    ok(quicly_chunked_recvbuf_peek(&rb, sizeof(buf), vecs, &num_vecs) == sizeof(buf));
+    ok(num_vecs == 5);
+    ok(vecs_match(vecs, num_vecs, 0));
+
+    /* consume and append repeatedly so that the ring wraps around */
+    for (off = sizeof(buf); off < sizeof(buf) * 4; off += QUICLY_RECVBUF_CHUNK_SIZE) {
+        uint8_t chunk[QUICLY_RECVBUF_CHUNK_SIZE];
+        quicly_chunked_recvbuf_consume(&rb, QUICLY_RECVBUF_CHUNK_SIZE);
+        fill_pattern(chunk, off, sizeof(chunk));
+        ok(quicly_chunked_recvbuf_write(&rb, rb.off, chunk, sizeof(chunk)) == 0);
+    }
+    ok(rb.chunks.capacity == 8);
+    num_vecs = PTLS_ELEMENTSOF(vecs);
+    ok(quicly_chunked_recvbuf_peek(&rb, rb.off, vecs, &num_vecs) == sizeof(buf));
+    ok(num_vecs == 5);
+    ok(vecs_match(vecs, num_vecs, off - sizeof(buf)));
+
+    quicly_chunked_recvbuf_dispose(&rb);
+}
+
+void test_recvbuf(void)
+{
+    subtest("in-order", test_in_order);
+    subtest("out-of-order", test_out_of_order);
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Measures the per-frame cost of the stream schedulers in isolation. The functions of lib/quicly.c that the schedulers call are
+ * replaced by the stubs below (as the program is linked against the static library, lib/quicly.c is not linked in), so that the
+ * numbers reflect the cost of the scheduling logic alone; each call to `quicly_send_stream` emits one frame without doing any I/O.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "quicly.h"
+#include "quicly/defaults.h"
+
+struct st_quicly_send_context_t {
+    size_t num_frames;
+    size_t max_frames;
+};
+
+static struct _st_quicly_conn_public_t conn;
+
+int quicly_stream_can_send(quicly_stream_t *stream, int at_stream_level)
+{
+    return 1;
+}
+
+int quicly_is_blocked(quicly_conn_t *conn)
+{
+    return 0;
+}
+
+int quicly_can_send_data(quicly_conn_t *conn, quicly_send_context_t *s)
+{
+    return s->num_frames < s->max_frames;
+}
+
+int quicly_send_stream(quicly_stream_t *stream, quicly_send_context_t *s)
+{
+    ++s->num_frames;
+    conn.stats.num_bytes.stream_data_sent += 1200;
+    return 0;
+}
+
+static void init_conn(void)
+{
+    size_t i;
+
+    memset(&conn, 0, sizeof(conn));
+    quicly_linklist_init(&conn._default_scheduler.active);
+    quicly_linklist_init(&conn._default_scheduler.blocked);
+    for (i = 0; i < QUICLY_PRIORITY_NUM_URGENCIES; ++i) {
+        quicly_linklist_init(&conn._priority_scheduler.active[i].non_incremental);
+        quicly_linklist_init(&conn._priority_scheduler.active[i].incremental);
+    }
+    quicly_linklist_init(&conn._priority_scheduler.blocked);
+    quicly_linklist_init(&conn._drr_scheduler.active);
+    quicly_linklist_init(&conn._drr_scheduler.blocked);
+}
+
+static double elapsed_nsec(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Activates `num_streams` streams in random order (so that the schedulers that sort the streams have to insert them in the middle),
+ * then emits frames. The average time (in nanoseconds) spent for activating one stream and for scheduling one frame are returned.
+ */
+static void run(quicly_stream_scheduler_t *scheduler, size_t num_streams, int incremental, double *activate_cost, double *send_cost)
+{
+    static const size_t num_iterations = 10000, frames_per_iteration = 100;
+    quicly_stream_t *streams = calloc(num_streams, sizeof(*streams));
+    struct timespec start, end;
+    size_t i;
+
+    init_conn();
+    for (i = 0; i < num_streams; ++i)
+        streams[i].stream_id = i * 4;
+    for (i = num_streams - 1; i > 0; --i) {
+        size_t j = rand() % (i + 1);
+        quicly_stream_id_t tmp = streams[i].stream_id;
+        streams[i].stream_id = streams[j].stream_id;
+        streams[j].stream_id = tmp;
+    }
+    for (i = 0; i < num_streams; ++i) {
+        quicly_stream_t *stream = streams + i;
+        stream->conn = (quicly_conn_t *)&conn;
+        stream->priority.urgency = i % QUICLY_PRIORITY_NUM_URGENCIES;
+        stream->priority.incremental = incremental;
+        stream->drr_quantum = QUICLY_DRR_DEFAULT_QUANTUM;
+        quicly_linklist_init(&stream->_send_aux.pending_link.default_scheduler);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < num_streams; ++i)
+        scheduler->update_state(scheduler, streams + i);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *activate_cost = elapsed_nsec(&start, &end) / num_streams;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < num_iterations; ++i) {
+        quicly_send_context_t s = {0, frames_per_iteration};
+        scheduler->do_send(scheduler, (quicly_conn_t *)&conn, &s);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *send_cost = elapsed_nsec(&start, &end) / (num_iterations * frames_per_iteration);
+
+    free(streams);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        quicly_stream_scheduler_t *scheduler;
+        int incremental;
+    } schedulers[] = {{"default", &quicly_default_stream_scheduler, 0},
+                      {"priority (non-incremental)", &quicly_priority_stream_scheduler, 0},
+                      {"priority (incremental)", &quicly_priority_stream_scheduler, 1},
+                      {"drr", &quicly_drr_stream_scheduler, 0}};
+    static const size_t num_streams[] = {10, 100, 1000, 10000};
+#define NUM_SCHEDULERS (sizeof(schedulers) / sizeof(schedulers[0]))
+#define NUM_STREAMS_VARIANTS (sizeof(num_streams) / sizeof(num_streams[0]))
+    double activate_cost[NUM_SCHEDULERS][NUM_STREAMS_VARIANTS], send_cost[NUM_SCHEDULERS][NUM_STREAMS_VARIANTS];
+    size_t i, j;
+
+    for (i = 0; i < NUM_SCHEDULERS; ++i)
+        for (j = 0; j < NUM_STREAMS_VARIANTS; ++j)
+            run(schedulers[i].scheduler, num_streams[j], schedulers[i].incremental, &activate_cost[i][j], &send_cost[i][j]);
+
+    for (int table = 0; table < 2; ++table) {
+        printf("%-28s", table == 0 ? "activation, ns/stream" : "send, ns/frame");
+        for (j = 0; j < NUM_STREAMS_VARIANTS; ++j)
+            printf("%10zu", num_streams[j]);
+        printf("\n");
+        for (i = 0; i < NUM_SCHEDULERS; ++i) {
+            printf("%-28s", schedulers[i].name);
+            for (j = 0; j < NUM_STREAMS_VARIANTS; ++j)
+                printf("%10.1f", table == 0 ? activate_cost[i][j] : send_cost[i][j]);
+            printf("\n");
+        }
+    }
+
+#undef NUM_SCHEDULERS
+#undef NUM_STREAMS_VARIANTS
+    return 0;
+}
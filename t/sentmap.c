@@ -51,7 +51,7 @@ static void test_basic(void)
     quicly_sentmap_iter_t iter;
     const quicly_sent_packet_t *sent;
 
-    quicly_sentmap_init(&map);
+    quicly_sentmap_init(&map, NULL, NULL);
 
     /* save 50 packets, with 2 frames each */
     for (at = 0; at < 10; ++at) {
@@ -110,7 +110,7 @@ static void test_late_ack(void)
     on_acked_callcnt = 0;
     on_acked_ackcnt = 0;
 
-    quicly_sentmap_init(&map);
+    quicly_sentmap_init(&map, NULL, NULL);
 
     /* commit pn 1, 2 */
     quicly_sentmap_prepare(&map, 1, 0, QUICLY_EPOCH_INITIAL);
@@ -154,7 +154,7 @@ static void test_pto(void)
     on_acked_callcnt = 0;
     on_acked_ackcnt = 0;
 
-    quicly_sentmap_init(&map);
+    quicly_sentmap_init(&map, NULL, NULL);
 
     /* commit pn 1, 2 */
     quicly_sentmap_prepare(&map, 1, 0, QUICLY_EPOCH_INITIAL);
@@ -189,9 +189,179 @@ static void test_pto(void)
     quicly_sentmap_dispose(&map);
 }
 
+static void test_rate_sample(void)
+{
+    quicly_sentmap_t map;
+    quicly_sentmap_iter_t iter;
+    quicly_sent_packet_t newest;
+    quicly_delivery_rate_sample_t rs;
+
+    quicly_sentmap_init(&map, NULL, NULL);
+
+    /* pn 1, 2 sent at 0, pn 1 acked at 100 */
+    quicly_sentmap_prepare(&map, 1, 0, QUICLY_EPOCH_1RTT);
+    quicly_sentmap_commit(&map, 10);
+    quicly_sentmap_prepare(&map, 2, 0, QUICLY_EPOCH_1RTT);
+    quicly_sentmap_commit(&map, 20);
+    quicly_sentmap_init_iter(&map, &iter);
+    newest = *quicly_sentmap_get(&iter);
+    ok(quicly_sentmap_update(&map, &iter, QUICLY_SENTMAP_EVENT_ACKED) == 0);
+    quicly_sentmap_get_rate_sample(&map, &newest, 100, &rs);
+    ok(map.delivered == 10);
+    ok(rs.delivered == 10);
+    ok(rs.interval == 100);
+    ok(!rs.is_app_limited);
+
+    /* pn 3 sent at 100, pn 2, 3 acked at 150 */
+    quicly_sentmap_prepare(&map, 3, 100, QUICLY_EPOCH_1RTT);
+    quicly_sentmap_commit(&map, 40);
+    quicly_sentmap_init_iter(&map, &iter);
+    ok(quicly_sentmap_update(&map, &iter, QUICLY_SENTMAP_EVENT_ACKED) == 0);
+    newest = *quicly_sentmap_get(&iter);
+    ok(newest.packet_number == 3);
+    ok(quicly_sentmap_update(&map, &iter, QUICLY_SENTMAP_EVENT_ACKED) == 0);
+    quicly_sentmap_get_rate_sample(&map, &newest, 150, &rs);
+    ok(map.delivered == 70);
+    ok(rs.delivered == 60);
+    ok(rs.interval == 50);
+
+    /* sender becomes app-limited; pn 4 is marked as such, and the mark is cleared once pn 4 is acked */
+    quicly_sentmap_mark_app_limited(&map);
+    quicly_sentmap_prepare(&map, 4, 150, QUICLY_EPOCH_1RTT);
+    quicly_sentmap_commit(&map, 10);
+    quicly_sentmap_init_iter(&map, &iter);
+    newest = *quicly_sentmap_get(&iter);
+    ok(newest.is_app_limited);
+    ok(quicly_sentmap_update(&map, &iter, QUICLY_SENTMAP_EVENT_ACKED) == 0);
+    quicly_sentmap_get_rate_sample(&map, &newest, 250, &rs);
+    ok(rs.delivered == 10);
+    ok(rs.is_app_limited);
+    ok(map.app_limited_until == 0);
+
+    quicly_sentmap_dispose(&map);
+}
+
+static void test_seek(void)
+{
+    quicly_sentmap_t map;
+    quicly_sentmap_iter_t iter;
+    uint64_t pn;
+
+    quicly_sentmap_init(&map, NULL, NULL);
+
+    /* save packets with PN 0, 2, 4, ..., 1998, with varying number of frames, some spanning more than one block */
+    for (pn = 0; pn < 2000; pn += 2) {
+        quicly_sentmap_prepare(&map, pn, 0, QUICLY_EPOCH_1RTT);
+        for (size_t i = 0; i < pn % 37; ++i)
+            quicly_sentmap_allocate(&map, on_acked);
+        quicly_sentmap_commit(&map, 1);
+    }
+
+    /* remove packets in the range of 400 <= pn < 1200, except for the multiples of 100 */
+    quicly_sentmap_init_iter(&map, &iter);
+    quicly_sentmap_seek(&map, &iter, 400);
+    ok(quicly_sentmap_get(&iter)->packet_number == 400);
+    while (quicly_sentmap_get(&iter)->packet_number < 1200) {
+        if (quicly_sentmap_get(&iter)->packet_number % 100 == 0) {
+            quicly_sentmap_skip(&iter);
+        } else {
+            ok(quicly_sentmap_update(&map, &iter, QUICLY_SENTMAP_EVENT_EXPIRED) == 0);
+        }
+    }
+
+    /* seek from the beginning */
+    for (pn = 0; pn < 2001; ++pn) {
+        uint64_t expected = pn + pn % 2;
+        if (400 < expected && expected < 1200)
+            expected = (expected + 99) / 100 * 100;
+        if (expected >= 2000)
+            expected = UINT64_MAX;
+        quicly_sentmap_init_iter(&map, &iter);
+        quicly_sentmap_seek(&map, &iter, pn);
+        if (quicly_sentmap_get(&iter)->packet_number != expected) {
+            ok(!"unexpected packet number");
+            break;
+        }
+    }
+
+    /* seek forward using the same iterator, then make sure that seeking backwards is no-op */
+    quicly_sentmap_init_iter(&map, &iter);
+    for (pn = 0; pn < 2000; pn += 50)
+        quicly_sentmap_seek(&map, &iter, pn);
+    ok(quicly_sentmap_get(&iter)->packet_number == 1950);
+    quicly_sentmap_seek(&map, &iter, 10);
+    ok(quicly_sentmap_get(&iter)->packet_number == 1950);
+
+    quicly_sentmap_dispose(&map);
+}
+
+static size_t pool_num_blocks_allocated;
+
+static void *pool_test_alloc(quicly_allocator_t *self, size_t size)
+{
+    ++pool_num_blocks_allocated;
+    return malloc(size);
+}
+
+static void pool_test_free(quicly_allocator_t *self, void *p, size_t size)
+{
+    --pool_num_blocks_allocated;
+    free(p);
+}
+
+static void test_pool(void)
+{
+    quicly_allocator_t allocator = {pool_test_alloc, NULL, pool_test_free};
+    quicly_sent_block_pool_t pool;
+    quicly_sentmap_t map;
+    quicly_sentmap_iter_t iter;
+    uint64_t pn;
+    size_t i;
+
+    quicly_sent_block_pool_init(&pool, 4, &allocator);
+    quicly_sentmap_init(&map, NULL, &pool.super);
+
+    /* save 10 packets, each occupying one block */
+    for (pn = 0; pn < 10; ++pn) {
+        quicly_sentmap_prepare(&map, pn, 0, QUICLY_EPOCH_1RTT);
+        for (i = 0; i < 15; ++i)
+            quicly_sentmap_allocate(&map, on_acked);
+        quicly_sentmap_commit(&map, 1);
+    }
+    ok(num_blocks(&map) == 10);
+    ok(pool.count == 0);
+    ok(pool_num_blocks_allocated == 10);
+
+    /* discard the first 8 packets; only up to 4 blocks are retained */
+    quicly_sentmap_init_iter(&map, &iter);
+    while (quicly_sentmap_get(&iter)->packet_number < 8)
+        quicly_sentmap_update(&map, &iter, QUICLY_SENTMAP_EVENT_EXPIRED);
+    ok(num_blocks(&map) == 2);
+    ok(pool.count == 4);
+    ok(pool_num_blocks_allocated == 6);
+
+    /* blocks being cached are reused */
+    quicly_sentmap_prepare(&map, 10, 0, QUICLY_EPOCH_1RTT);
+    for (i = 0; i < 15; ++i)
+        quicly_sentmap_allocate(&map, on_acked);
+    quicly_sentmap_commit(&map, 1);
+    ok(num_blocks(&map) == 3);
+    ok(pool.count == 3);
+
+    quicly_sentmap_dispose(&map);
+    ok(pool.count == 4);
+    quicly_sent_block_pool_dispose(&pool);
+    ok(pool.count == 0);
+    ok(pool.head == NULL);
+    ok(pool_num_blocks_allocated == 0);
+}
+
 void test_sentmap(void)
 {
     subtest("basic", test_basic);
     subtest("late-ack", test_late_ack);
     subtest("pto", test_pto);
+    subtest("rate-sample", test_rate_sample);
+    subtest("seek", test_seek);
+    subtest("pool", test_pool);
 }
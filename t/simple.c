@@ -20,6 +20,7 @@
  * IN THE SOFTWARE.
  */
 #include <string.h>
+#include "quicly/defaults.h"
 #include "quicly/streambuf.h"
 #include "test.h"
 
@@ -154,6 +155,384 @@ static void simple_http(void)
     ok(quicly_num_streams(server) == 0);
 }
 
+static void test_receive_batch(void)
+{
+    quicly_stream_t *client_stream, *server_stream;
+    test_streambuf_t *client_streambuf, *server_streambuf;
+    quicly_address_t dest, src;
+    struct iovec packets[8];
+    uint8_t packetsbuf[PTLS_ELEMENTSOF(packets) * quic_ctx.transport_params.max_udp_payload_size];
+    quicly_decoded_packet_t decoded[PTLS_ELEMENTSOF(packets) * 4];
+    size_t num_packets, num_decoded, i;
+    char data[4000];
+    int ret;
+
+    memset(data, 'a', sizeof(data));
+    ret = quicly_open_stream(client, &client_stream, 0);
+    ok(ret == 0);
+    client_streambuf = client_stream->data;
+    quicly_streambuf_egress_write(client_stream, data, sizeof(data));
+    quicly_streambuf_egress_shutdown(client_stream);
+
+    /* client sends the request using multiple packets */
+    num_packets = PTLS_ELEMENTSOF(packets);
+    ret = quicly_send(client, &dest, &src, packets, &num_packets, packetsbuf, sizeof(packetsbuf));
+    ok(ret == 0);
+    ok(num_packets >= 3);
+
+    /* server processes them in one batch, and acknowledges all of them using one packet */
+    num_decoded = decode_packets(decoded, packets, num_packets);
+    ok(num_decoded == num_packets);
+    ret = quicly_receive_batch(server, NULL, &fake_address.sa, decoded, num_decoded);
+    ok(ret == 0);
+    server_stream = quicly_get_stream(server, client_stream->stream_id);
+    ok(server_stream != NULL);
+    server_streambuf = server_stream->data;
+    ok(quicly_recvstate_transfer_complete(&server_stream->recvstate));
+    ok(server_streambuf->super.ingress.off == sizeof(data));
+    ok(quicly_get_first_timeout(server) <= quic_now);
+    num_packets = PTLS_ELEMENTSOF(packets);
+    ret = quicly_send(server, &dest, &src, packets, &num_packets, packetsbuf, sizeof(packetsbuf));
+    ok(ret == 0);
+    ok(num_packets == 1);
+    num_decoded = decode_packets(decoded, packets, num_packets);
+    for (i = 0; i != num_decoded; ++i) {
+        ret = quicly_receive(client, NULL, &fake_address.sa, decoded + i);
+        ok(ret == 0);
+    }
+    ok(client_streambuf->super.egress.vecs.size == 0);
+
+    /* close the stream */
+    quicly_streambuf_egress_shutdown(server_stream);
+    transmit(server, client);
+    ok(client_streambuf->is_detached);
+    quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+    transmit(client, server);
+    ok(server_streambuf->is_detached);
+}
+
+static void deliver(quicly_conn_t *dst, struct iovec *datagrams, size_t num_datagrams)
+{
+    quicly_decoded_packet_t decoded[num_datagrams * 2];
+    size_t num_decoded, i;
+
+    num_decoded = decode_packets(decoded, datagrams, num_datagrams);
+    for (i = 0; i != num_decoded; ++i)
+        ok(quicly_receive(dst, NULL, &fake_address.sa, decoded + i) == 0);
+}
+
+static size_t num_encrypt_packets_calls, num_packets_encrypted_in_batch;
+
+static void encrypt_packets_counting(quicly_crypto_engine_t *engine, quicly_conn_t *conn, ptls_cipher_context_t *header_protect_ctx,
+                                     ptls_aead_context_t *packet_protect_ctx, const quicly_deferred_packet_t *packets,
+                                     size_t num_packets)
+{
+    ++num_encrypt_packets_calls;
+    num_packets_encrypted_in_batch += num_packets;
+    quicly_default_batch_crypto_engine.encrypt_packets(engine, conn, header_protect_ctx, packet_protect_ctx, packets, num_packets);
+}
+
+static void test_batch_encrypt(void)
+{
+    quicly_crypto_engine_t *engine_orig = quic_ctx.crypto_engine, engine = quicly_default_batch_crypto_engine;
+    quicly_stream_t *client_stream, *server_stream;
+    test_streambuf_t *client_streambuf, *server_streambuf;
+    quicly_address_t dest, src;
+    struct iovec packets[8];
+    uint8_t packetsbuf[PTLS_ELEMENTSOF(packets) * quic_ctx.transport_params.max_udp_payload_size];
+    size_t num_packets;
+    char data[4000];
+    int ret;
+
+    engine.encrypt_packets = encrypt_packets_counting;
+    quic_ctx.crypto_engine = &engine;
+
+    memset(data, 'a', sizeof(data));
+    ret = quicly_open_stream(client, &client_stream, 0);
+    ok(ret == 0);
+    client_streambuf = client_stream->data;
+    quicly_streambuf_egress_write(client_stream, data, sizeof(data));
+    quicly_streambuf_egress_shutdown(client_stream);
+
+    /* all the packets are encrypted at once, when quicly_send returns */
+    num_encrypt_packets_calls = 0;
+    num_packets_encrypted_in_batch = 0;
+    num_packets = PTLS_ELEMENTSOF(packets);
+    ret = quicly_send(client, &dest, &src, packets, &num_packets, packetsbuf, sizeof(packetsbuf));
+    ok(ret == 0);
+    ok(num_packets >= 3);
+    ok(num_encrypt_packets_calls == 1);
+    ok(num_packets_encrypted_in_batch == num_packets);
+
+    /* server can decrypt them */
+    deliver(server, packets, num_packets);
+    server_stream = quicly_get_stream(server, client_stream->stream_id);
+    ok(server_stream != NULL);
+    server_streambuf = server_stream->data;
+    ok(quicly_recvstate_transfer_complete(&server_stream->recvstate));
+    ok(server_streambuf->super.ingress.off == sizeof(data));
+
+    /* close the stream */
+    quicly_streambuf_egress_shutdown(server_stream);
+    transmit(server, client);
+    ok(client_streambuf->is_detached);
+    quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+    transmit(client, server);
+    ok(server_streambuf->is_detached);
+
+    quic_ctx.crypto_engine = engine_orig;
+}
+
+static void test_decrypt_batch(void)
+{
+    quicly_stream_t *client_stream, *server_stream;
+    test_streambuf_t *client_streambuf, *server_streambuf;
+    quicly_address_t dest, src;
+    struct iovec packets[8];
+    uint8_t packetsbuf[PTLS_ELEMENTSOF(packets) * quic_ctx.transport_params.max_udp_payload_size];
+    quicly_decoded_packet_t decoded[PTLS_ELEMENTSOF(packets) * 4];
+    size_t num_packets, num_decoded, i;
+    char data[4000];
+    int ret;
+
+    memset(data, 'a', sizeof(data));
+    ret = quicly_open_stream(client, &client_stream, 0);
+    ok(ret == 0);
+    client_streambuf = client_stream->data;
+    quicly_streambuf_egress_write(client_stream, data, sizeof(data));
+    quicly_streambuf_egress_shutdown(client_stream);
+
+    num_packets = PTLS_ELEMENTSOF(packets);
+    ret = quicly_send(client, &dest, &src, packets, &num_packets, packetsbuf, sizeof(packetsbuf));
+    ok(ret == 0);
+    ok(num_packets >= 3);
+
+    /* server decrypts all the packets at once, then processes them */
+    num_decoded = decode_packets(decoded, packets, num_packets);
+    ok(num_decoded == num_packets);
+    ret = quicly_decrypt_packets(server, decoded, num_decoded);
+    ok(ret == 0);
+    for (i = 0; i != num_decoded; ++i)
+        ok(decoded[i].decrypted.pn != UINT64_MAX);
+    ok(decoded[0].decrypted.pn < decoded[1].decrypted.pn);
+    ret = quicly_receive_batch(server, NULL, &fake_address.sa, decoded, num_decoded);
+    ok(ret == 0);
+    server_stream = quicly_get_stream(server, client_stream->stream_id);
+    ok(server_stream != NULL);
+    server_streambuf = server_stream->data;
+    ok(quicly_recvstate_transfer_complete(&server_stream->recvstate));
+    ok(server_streambuf->super.ingress.off == sizeof(data));
+
+    /* close the stream */
+    quicly_streambuf_egress_shutdown(server_stream);
+    transmit(server, client);
+    ok(client_streambuf->is_detached);
+    quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+    transmit(client, server);
+    ok(server_streambuf->is_detached);
+}
+
+static void test_decrypt_batch_corrupted(void)
+{
+    quicly_stream_t *client_stream, *server_stream;
+    test_streambuf_t *server_streambuf;
+    quicly_address_t dest, src;
+    struct iovec packets[8];
+    uint8_t packetsbuf[PTLS_ELEMENTSOF(packets) * quic_ctx.transport_params.max_udp_payload_size];
+    quicly_decoded_packet_t decoded[PTLS_ELEMENTSOF(packets) * 4];
+    quicly_stats_t stats;
+    uint64_t num_decryption_failed;
+    size_t num_packets, num_decoded, i;
+    char data[4000];
+    int ret;
+
+    memset(data, 'a', sizeof(data));
+    ret = quicly_open_stream(client, &client_stream, 0);
+    ok(ret == 0);
+    quicly_streambuf_egress_write(client_stream, data, sizeof(data));
+    quicly_streambuf_egress_shutdown(client_stream);
+
+    num_packets = PTLS_ELEMENTSOF(packets);
+    ret = quicly_send(client, &dest, &src, packets, &num_packets, packetsbuf, sizeof(packetsbuf));
+    ok(ret == 0);
+    ok(num_packets >= 3);
+
+    /* corrupt the AEAD tag of the second packet */
+    num_decoded = decode_packets(decoded, packets, num_packets);
+    ok(num_decoded == num_packets);
+    decoded[1].octets.base[decoded[1].octets.len - 1] ^= 1;
+
+    /* the corrupted packet is marked as such, while others are decrypted */
+    ret = quicly_decrypt_packets(server, decoded, num_decoded);
+    ok(ret == 0);
+    for (i = 0; i != num_decoded; ++i) {
+        if (i == 1) {
+            ok(decoded[i].decrypted.pn == QUICLY_DECRYPTED_PN_FAILED);
+        } else {
+            ok(decoded[i].decrypted.pn != UINT64_MAX && decoded[i].decrypted.pn != QUICLY_DECRYPTED_PN_FAILED);
+        }
+    }
+
+    /* the corrupted packet is discarded and counted, without being decrypted again */
+    quicly_get_stats(server, &stats);
+    num_decryption_failed = stats.num_packets.decryption_failed;
+    ret = quicly_receive_batch(server, NULL, &fake_address.sa, decoded, num_decoded);
+    ok(ret == 0);
+    quicly_get_stats(server, &stats);
+    ok(stats.num_packets.decryption_failed == num_decryption_failed + 1);
+    server_stream = quicly_get_stream(server, client_stream->stream_id);
+    ok(server_stream != NULL);
+    ok(!quicly_recvstate_transfer_complete(&server_stream->recvstate));
+
+    /* the data carried by the corrupted packet is delivered by loss recovery */
+    for (i = 0; i < 100 && !quicly_recvstate_transfer_complete(&server_stream->recvstate); ++i) {
+        quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+        transmit(server, client);
+        quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+        transmit(client, server);
+    }
+    ok(quicly_recvstate_transfer_complete(&server_stream->recvstate));
+    server_streambuf = server_stream->data;
+    ok(server_streambuf->super.ingress.off == sizeof(data));
+
+    /* close the stream */
+    quicly_streambuf_egress_shutdown(server_stream);
+    transmit(server, client);
+    quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+    transmit(client, server);
+    ok(server_streambuf->is_detached);
+}
+
+static int num_shared_disposed;
+
+static void on_shared_dispose(quicly_sendbuf_shared_t *shared)
+{
+    ++num_shared_disposed;
+}
+
+static void test_shared_sendbuf(void)
+{
+    static uint8_t data[3000];
+    quicly_sendbuf_shared_t shared;
+    quicly_stream_t *client_stream, *server_stream;
+    test_streambuf_t *client_streambuf, *server_streambuf;
+    size_t i;
+    int ret;
+
+    for (i = 0; i != sizeof(data); ++i)
+        data[i] = 'a' + i % 26;
+    quicly_sendbuf_shared_init(&shared, data, sizeof(data), on_shared_dispose);
+    num_shared_disposed = 0;
+
+    ret = quicly_open_stream(client, &client_stream, 0);
+    ok(ret == 0);
+    client_streambuf = client_stream->data;
+
+    /* small writes are coalesced */
+    quicly_streambuf_egress_write(client_stream, "hello", 5);
+    quicly_streambuf_egress_write(client_stream, " ", 1);
+    ok(client_streambuf->super.egress.vecs.size == 1);
+
+    /* shared buffer is written twice without being copied */
+    ret = quicly_streambuf_egress_write_shared(client_stream, &shared, 1000, 2000);
+    ok(ret == 0);
+    ret = quicly_streambuf_egress_write_shared(client_stream, &shared, 1000, 2000);
+    ok(ret == 0);
+    ok(shared._refcnt == 3);
+    quicly_streambuf_egress_write(client_stream, "world", 5);
+    ok(client_streambuf->super.egress.vecs.size == 4);
+    quicly_streambuf_egress_shutdown(client_stream);
+
+    transmit(client, server);
+    server_stream = quicly_get_stream(server, client_stream->stream_id);
+    ok(server_stream != NULL);
+    server_streambuf = server_stream->data;
+    ok(quicly_recvstate_transfer_complete(&server_stream->recvstate));
+    ok(server_streambuf->super.ingress.off == 6 + 2000 * 2 + 5);
+    ok(memcmp(server_streambuf->super.ingress.base, "hello ", 6) == 0);
+    ok(memcmp(server_streambuf->super.ingress.base + 6, data + 1000, 2000) == 0);
+    ok(memcmp(server_streambuf->super.ingress.base + 2006, data + 1000, 2000) == 0);
+    ok(memcmp(server_streambuf->super.ingress.base + 4006, "world", 5) == 0);
+
+    /* references are released when the data is acknowledged */
+    quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+    transmit(server, client);
+    ok(client_streambuf->super.egress.vecs.size == 0);
+    ok(shared._refcnt == 1);
+    ok(num_shared_disposed == 0);
+    quicly_sendbuf_shared_release(&shared);
+    ok(num_shared_disposed == 1);
+
+    /* close the stream */
+    quicly_streambuf_egress_shutdown(server_stream);
+    transmit(server, client);
+    ok(client_streambuf->is_detached);
+    quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+    transmit(client, server);
+    ok(server_streambuf->is_detached);
+}
+
+static size_t num_emit_vec_calls;
+
+static void emit_vec_counting(quicly_stream_t *stream, size_t off, ptls_iovec_t *vecs, size_t *num_vecs, size_t *len,
+                              int *wrote_all)
+{
+    ++num_emit_vec_calls;
+    quicly_streambuf_egress_emit_vec(stream, off, vecs, num_vecs, len, wrote_all);
+}
+
+static void test_send_emit_vec(void)
+{
+    static quicly_stream_callbacks_t vec_callbacks;
+    static uint8_t data[5000];
+    quicly_sendbuf_shared_t shared;
+    quicly_stream_t *client_stream, *server_stream;
+    test_streambuf_t *client_streambuf, *server_streambuf;
+    size_t i;
+    int ret;
+
+    vec_callbacks = stream_callbacks;
+    vec_callbacks.on_send_emit_vec = emit_vec_counting;
+    num_emit_vec_calls = 0;
+    for (i = 0; i != sizeof(data); ++i)
+        data[i] = 'a' + i % 26;
+    quicly_sendbuf_shared_init(&shared, data, sizeof(data), on_shared_dispose);
+
+    ret = quicly_open_stream(client, &client_stream, 0);
+    ok(ret == 0);
+    client_stream->callbacks = &vec_callbacks;
+    client_streambuf = client_stream->data;
+    quicly_streambuf_egress_write(client_stream, "hello", 5);
+    quicly_streambuf_egress_write_shared(client_stream, &shared, 0, sizeof(data));
+    quicly_streambuf_egress_write(client_stream, "world", 5);
+    quicly_streambuf_egress_shutdown(client_stream);
+
+    /* payload is encrypted directly from the buffers being referred to */
+    transmit(client, server);
+    ok(num_emit_vec_calls >= 3);
+    server_stream = quicly_get_stream(server, client_stream->stream_id);
+    ok(server_stream != NULL);
+    server_streambuf = server_stream->data;
+    ok(quicly_recvstate_transfer_complete(&server_stream->recvstate));
+    ok(server_streambuf->super.ingress.off == 5 + sizeof(data) + 5);
+    ok(memcmp(server_streambuf->super.ingress.base, "hello", 5) == 0);
+    ok(memcmp(server_streambuf->super.ingress.base + 5, data, sizeof(data)) == 0);
+    ok(memcmp(server_streambuf->super.ingress.base + 5 + sizeof(data), "world", 5) == 0);
+
+    quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+    transmit(server, client);
+    ok(client_streambuf->super.egress.vecs.size == 0);
+    quicly_sendbuf_shared_release(&shared);
+
+    /* close the stream */
+    quicly_streambuf_egress_shutdown(server_stream);
+    transmit(server, client);
+    ok(client_streambuf->is_detached);
+    quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+    transmit(client, server);
+    ok(server_streambuf->is_detached);
+}
+
 static void test_reset_then_close(void)
 {
     quicly_stream_t *client_stream, *server_stream;
@@ -594,10 +973,421 @@ static void tiny_connection_window(void)
     quic_ctx.transport_params.max_data = max_data_orig;
 }
 
+static void test_drr_scheduler(void)
+{
+    quicly_stream_scheduler_t *scheduler_orig = quic_ctx.stream_scheduler;
+    quicly_stream_t *client_streams[2];
+    static const char zeros[65536];
+    size_t i;
+    int ret;
+
+    quic_ctx.stream_scheduler = &quicly_drr_stream_scheduler;
+
+    { /* create connection */
+        quicly_address_t dest, src;
+        struct iovec raw;
+        uint8_t rawbuf[quic_ctx.transport_params.max_udp_payload_size];
+        size_t num_packets = 1;
+        quicly_decoded_packet_t decoded;
+
+        ret = quicly_connect(&client, &quic_ctx, "example.com", &fake_address.sa, NULL, new_master_id(), ptls_iovec_init(NULL, 0),
+                             NULL, NULL);
+        ok(ret == 0);
+        ret = quicly_send(client, &dest, &src, &raw, &num_packets, rawbuf, sizeof(rawbuf));
+        ok(ret == 0);
+        decode_packets(&decoded, &raw, 1);
+        ret = quicly_accept(&server, &quic_ctx, NULL, &fake_address.sa, &decoded, NULL, new_master_id(), NULL);
+        ok(ret == 0);
+        transmit(server, client);
+        ok(quicly_get_state(client) == QUICLY_STATE_CONNECTED);
+    }
+
+    /* open two streams, the second one having three times as much quantum as the first one */
+    for (i = 0; i < PTLS_ELEMENTSOF(client_streams); ++i) {
+        ret = quicly_open_stream(client, &client_streams[i], 0);
+        ok(ret == 0);
+        client_streams[i]->drr_quantum = 2048 * (i * 2 + 1);
+        quicly_streambuf_egress_write(client_streams[i], zeros, sizeof(zeros));
+    }
+
+    { /* send a handful of packets, and check that the bytes being sent are proportional to the quanta */
+        quicly_address_t dest, src;
+        struct iovec raw[8];
+        uint8_t rawbuf[PTLS_ELEMENTSOF(raw) * quic_ctx.transport_params.max_udp_payload_size];
+        size_t num_packets = PTLS_ELEMENTSOF(raw);
+        ret = quicly_send(client, &dest, &src, raw, &num_packets, rawbuf, sizeof(rawbuf));
+        ok(ret == 0);
+        ok(num_packets == PTLS_ELEMENTSOF(raw));
+        uint64_t sent0 = client_streams[0]->sendstate.size_inflight, sent1 = client_streams[1]->sendstate.size_inflight;
+        ok(sent0 != 0);
+        ok(sent0 * 2 < sent1 && sent1 < sent0 * 4);
+    }
+
+    /* send the rest, and check that everything has been received */
+    for (i = 0; i < 100 && (quicly_stream_can_send(client_streams[0], 1) || quicly_stream_can_send(client_streams[1], 1)); ++i) {
+        transmit(client, server);
+        quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+        transmit(server, client);
+    }
+    for (i = 0; i < PTLS_ELEMENTSOF(client_streams); ++i) {
+        test_streambuf_t *server_streambuf = quicly_get_stream(server, client_streams[i]->stream_id)->data;
+        ok(server_streambuf->super.ingress.off == sizeof(zeros));
+    }
+
+    quic_ctx.stream_scheduler = scheduler_orig;
+}
+
+static void priority_connect(void)
+{
+    quicly_address_t dest, src;
+    struct iovec raw;
+    uint8_t rawbuf[quic_ctx.transport_params.max_udp_payload_size];
+    size_t num_packets = 1;
+    quicly_decoded_packet_t decoded;
+    int ret;
+
+    ret = quicly_connect(&client, &quic_ctx, "example.com", &fake_address.sa, NULL, new_master_id(), ptls_iovec_init(NULL, 0), NULL,
+                         NULL);
+    ok(ret == 0);
+    ret = quicly_send(client, &dest, &src, &raw, &num_packets, rawbuf, sizeof(rawbuf));
+    ok(ret == 0);
+    decode_packets(&decoded, &raw, 1);
+    ret = quicly_accept(&server, &quic_ctx, NULL, &fake_address.sa, &decoded, NULL, new_master_id(), NULL);
+    ok(ret == 0);
+    transmit(server, client);
+    ok(quicly_get_state(client) == QUICLY_STATE_CONNECTED);
+}
+
+static quicly_stream_t *priority_open_stream(uint8_t urgency, int incremental, size_t len)
+{
+    static const char zeros[65536];
+    quicly_stream_t *stream;
+    int ret;
+
+    assert(len <= sizeof(zeros));
+
+    ret = quicly_open_stream(client, &stream, 0);
+    ok(ret == 0);
+    quicly_stream_set_priority(stream, urgency, incremental);
+    quicly_streambuf_egress_write(stream, zeros, len);
+    return stream;
+}
+
+/**
+ * Sends up to `max_packets` packets from the client, dropping them.
+ */
+static void priority_send(size_t max_packets)
+{
+    quicly_address_t dest, src;
+    struct iovec raw[8];
+    uint8_t rawbuf[PTLS_ELEMENTSOF(raw) * quic_ctx.transport_params.max_udp_payload_size];
+    size_t num_packets = max_packets;
+    int ret;
+
+    assert(max_packets <= PTLS_ELEMENTSOF(raw));
+    ret = quicly_send(client, &dest, &src, raw, &num_packets, rawbuf, sizeof(rawbuf));
+    ok(ret == 0);
+    ok(num_packets == max_packets);
+}
+
+static void test_priority_urgency(void)
+{
+    quicly_stream_t *streams[3];
+    size_t i;
+
+    priority_connect();
+
+    streams[0] = priority_open_stream(5, 0, 65536);
+    streams[1] = priority_open_stream(1, 0, 65536);
+    streams[2] = priority_open_stream(1, 0, 65536);
+
+    /* the most urgent stream is served first, and among the streams sharing the urgency, the one with the smaller ID */
+    priority_send(4);
+    ok(streams[1]->sendstate.size_inflight != 0);
+    ok(streams[0]->sendstate.size_inflight == 0);
+    ok(streams[2]->sendstate.size_inflight == 0);
+
+    /* each stream is sent in full, before the next one is served */
+    for (i = 0; i < 100 && quicly_stream_can_send(streams[0], 1); ++i) {
+        transmit(client, server);
+        quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+        transmit(server, client);
+        ok(streams[2]->sendstate.size_inflight == 0 || !quicly_stream_can_send(streams[1], 1));
+        ok(streams[0]->sendstate.size_inflight == 0 || !quicly_stream_can_send(streams[2], 1));
+    }
+    ok(!quicly_stream_can_send(streams[0], 1));
+}
+
+static void test_priority_incremental(void)
+{
+    quicly_stream_t *streams[3];
+
+    priority_connect();
+
+    streams[0] = priority_open_stream(3, 1, 65536);
+    streams[1] = priority_open_stream(3, 1, 65536);
+    streams[2] = priority_open_stream(4, 0, 65536);
+
+    /* incremental streams sharing the urgency are served in round-robin */
+    priority_send(8);
+    uint64_t sent0 = streams[0]->sendstate.size_inflight, sent1 = streams[1]->sendstate.size_inflight;
+    ok(sent0 != 0);
+    ok(sent1 != 0);
+    ok(sent0 < sent1 * 2 && sent1 < sent0 * 2);
+    ok(streams[2]->sendstate.size_inflight == 0);
+}
+
+static void test_priority_set_priority(void)
+{
+    quicly_stream_t *streams[2];
+
+    priority_connect();
+
+    streams[0] = priority_open_stream(3, 0, 65536);
+    streams[1] = priority_open_stream(3, 0, 65536);
+
+    priority_send(2);
+    uint64_t sent0 = streams[0]->sendstate.size_inflight;
+    ok(sent0 != 0);
+    ok(streams[1]->sendstate.size_inflight == 0);
+
+    /* raising the urgency of an active stream relinks it, preempting the one being served */
+    quicly_stream_set_priority(streams[1], 0, 0);
+    ok(streams[1]->priority.urgency == 0);
+    priority_send(2);
+    ok(streams[0]->sendstate.size_inflight == sent0);
+    ok(streams[1]->sendstate.size_inflight != 0);
+}
+
+static void test_priority_blocked(void)
+{
+    uint64_t max_data_orig = quic_ctx.transport_params.max_data;
+    struct st_quicly_priority_scheduler_state_t *sched;
+    quicly_stream_t *streams[2];
+    size_t i;
+
+    quic_ctx.transport_params.max_data = 4096;
+    priority_connect();
+    sched = &((struct _st_quicly_conn_public_t *)client)->_priority_scheduler;
+
+    streams[0] = priority_open_stream(1, 0, 16384);
+    streams[1] = priority_open_stream(2, 0, 16384);
+
+    /* once the connection-level flow control is exhausted, the streams are parked in the blocked list */
+    transmit(client, server);
+    ok(quicly_is_blocked(client));
+    ok(quicly_linklist_is_linked(&sched->blocked));
+    ok(!quic_ctx.stream_scheduler->can_send(quic_ctx.stream_scheduler, client, 1));
+    ok(streams[1]->sendstate.size_inflight == 0);
+
+    /* as the server consumes the data, the streams are unblocked and served in the order of urgency */
+    for (i = 0; i < 100 && (quicly_stream_can_send(streams[0], 1) || quicly_stream_can_send(streams[1], 1)); ++i) {
+        size_t j;
+        for (j = 0; j < PTLS_ELEMENTSOF(streams); ++j) {
+            quicly_stream_t *server_stream = quicly_get_stream(server, streams[j]->stream_id);
+            if (server_stream != NULL) {
+                test_streambuf_t *server_streambuf = server_stream->data;
+                quicly_streambuf_ingress_shift(server_stream, server_streambuf->super.ingress.off);
+            }
+        }
+        quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+        transmit(server, client);
+        transmit(client, server);
+        ok(streams[1]->sendstate.size_inflight == 0 || !quicly_stream_can_send(streams[0], 1));
+    }
+    ok(!quicly_stream_can_send(streams[0], 1));
+    ok(!quicly_stream_can_send(streams[1], 1));
+    ok(!quicly_linklist_is_linked(&sched->blocked));
+
+    quic_ctx.transport_params.max_data = max_data_orig;
+}
+
+static void test_priority_scheduler(void)
+{
+    quicly_stream_scheduler_t *scheduler_orig = quic_ctx.stream_scheduler;
+
+    quic_ctx.stream_scheduler = &quicly_priority_stream_scheduler;
+    subtest("urgency", test_priority_urgency);
+    subtest("incremental", test_priority_incremental);
+    subtest("set-priority", test_priority_set_priority);
+    subtest("blocked", test_priority_blocked);
+    quic_ctx.stream_scheduler = scheduler_orig;
+}
+
+static void test_path_mtu_discovery(void)
+{
+    quicly_stream_t *client_stream;
+    quicly_address_t dest, src;
+    struct iovec datagrams[8];
+    uint8_t buf[PTLS_ELEMENTSOF(datagrams) * quic_ctx.transport_params.max_udp_payload_size];
+    size_t num_datagrams;
+    char data[4000];
+    int ret;
+
+    quic_ctx.use_pmtud = 1;
+    memset(data, 'a', sizeof(data));
+    ret = quicly_open_stream(client, &client_stream, 0);
+    ok(ret == 0);
+    quicly_streambuf_egress_write(client_stream, data, sizeof(data));
+
+    /* the probe is sent alone, probing the maximum size first */
+    num_datagrams = PTLS_ELEMENTSOF(datagrams);
+    ret = quicly_send(client, &dest, &src, datagrams, &num_datagrams, buf, sizeof(buf));
+    ok(ret == 0);
+    ok(num_datagrams == 1);
+    ok(datagrams[0].iov_len == quic_ctx.transport_params.max_udp_payload_size);
+    deliver(server, datagrams, num_datagrams);
+
+    /* stream data is sent using the initial size */
+    num_datagrams = PTLS_ELEMENTSOF(datagrams);
+    ret = quicly_send(client, &dest, &src, datagrams, &num_datagrams, buf, sizeof(buf));
+    ok(ret == 0);
+    ok(num_datagrams >= 2);
+    ok(datagrams[0].iov_len == quic_ctx.initial_egress_max_udp_payload_size);
+    deliver(server, datagrams, num_datagrams);
+
+    /* once the probe is acked, the size being probed is used; the server sends its own probe before the ACK */
+    quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+    ok(transmit(server, client) == 1);
+    transmit(server, client);
+    quicly_streambuf_egress_write(client_stream, data, sizeof(data));
+    num_datagrams = PTLS_ELEMENTSOF(datagrams);
+    ret = quicly_send(client, &dest, &src, datagrams, &num_datagrams, buf, sizeof(buf));
+    ok(ret == 0);
+    ok(num_datagrams >= 2);
+    ok(datagrams[0].iov_len == quic_ctx.transport_params.max_udp_payload_size);
+    deliver(server, datagrams, num_datagrams);
+
+    quic_ctx.use_pmtud = 0;
+}
+
+/**
+ * Sends packets from `src` to `dst`, marking them as the kernel would do using the value of `quicly_send_get_ecn_bits`. If
+ * `override` is not QUICLY_ECN_NOT_ECT, ECT-marked packets are delivered with the given codepoint (e.g., CE being set by an AQM).
+ */
+static size_t transmit_ecn(quicly_conn_t *src, quicly_conn_t *dst, uint8_t override)
+{
+    quicly_address_t destaddr, srcaddr;
+    struct iovec datagrams[32];
+    uint8_t buf[PTLS_ELEMENTSOF(datagrams) * quic_ctx.transport_params.max_udp_payload_size];
+    quicly_decoded_packet_t decoded[PTLS_ELEMENTSOF(datagrams) * 2];
+    size_t num_datagrams = PTLS_ELEMENTSOF(datagrams), num_decoded, i;
+    int ret;
+
+    ret = quicly_send(src, &destaddr, &srcaddr, datagrams, &num_datagrams, buf, sizeof(buf));
+    ok(ret == 0);
+    uint8_t ecn = quicly_send_get_ecn_bits(src);
+    if (ecn != QUICLY_ECN_NOT_ECT && override != QUICLY_ECN_NOT_ECT)
+        ecn = override;
+    num_decoded = decode_packets(decoded, datagrams, num_datagrams);
+    for (i = 0; i != num_decoded; ++i) {
+        decoded[i].ecn = ecn;
+        ret = quicly_receive(dst, NULL, &fake_address.sa, decoded + i);
+        ok(ret == 0 || ret == QUICLY_ERROR_PACKET_IGNORED);
+    }
+
+    return num_datagrams;
+}
+
+static void connect_ecn(int server_reads_ecn)
+{
+    quicly_address_t dest, src;
+    struct iovec raw;
+    uint8_t rawbuf[quic_ctx.transport_params.max_udp_payload_size];
+    size_t num_packets = 1;
+    quicly_decoded_packet_t decoded;
+    int ret, i;
+
+    ret = quicly_connect(&client, &quic_ctx, "example.com", &fake_address.sa, NULL, new_master_id(), ptls_iovec_init(NULL, 0), NULL,
+                         NULL);
+    ok(ret == 0);
+    ret = quicly_send(client, &dest, &src, &raw, &num_packets, rawbuf, sizeof(rawbuf));
+    ok(ret == 0);
+    ok(num_packets == 1);
+    ok(quicly_send_get_ecn_bits(client) == QUICLY_ECN_ECT0);
+    decode_packets(&decoded, &raw, 1);
+    decoded.ecn = server_reads_ecn ? QUICLY_ECN_ECT0 : QUICLY_ECN_NOT_ECT;
+    ret = quicly_accept(&server, &quic_ctx, NULL, &fake_address.sa, &decoded, NULL, new_master_id(), NULL);
+    ok(ret == 0);
+
+    /* a path that clears the ECN bits is emulated by the server not reading them */
+    for (i = 0; i != 4; ++i) {
+        transmit_ecn(server, client, QUICLY_ECN_NOT_ECT);
+        if (server_reads_ecn) {
+            transmit_ecn(client, server, QUICLY_ECN_NOT_ECT);
+        } else {
+            transmit(client, server);
+        }
+        quic_now += QUICLY_DELAYED_ACK_TIMEOUT;
+    }
+    ok(quicly_get_state(client) == QUICLY_STATE_CONNECTED);
+    ok(quicly_connection_is_ready(client));
+}
+
+static void test_ecn_congestion(void)
+{
+    quicly_stream_t *client_stream;
+    quicly_stats_t stats;
+    char data[4000];
+    int ret;
+
+    connect_ecn(1);
+
+    /* the path is validated */
+    quicly_get_stats(client, &stats);
+    ok(stats.num_ecn.acked[QUICLY_ECN_COUNT_ECT0] != 0);
+    ok(stats.num_ecn.validation_failed == 0);
+    ok(stats.num_ecn.received[QUICLY_ECN_COUNT_ECT0] != 0);
+    ok(quicly_send_get_ecn_bits(client) == QUICLY_ECN_ECT0);
+    ok(stats.cc.ssthresh == UINT32_MAX);
+
+    /* CE-marked packets are acked immediately, and the sender reduces CWND */
+    memset(data, 'a', sizeof(data));
+    ret = quicly_open_stream(client, &client_stream, 0);
+    ok(ret == 0);
+    quicly_streambuf_egress_write(client_stream, data, sizeof(data));
+    ok(transmit_ecn(client, server, QUICLY_ECN_CE) != 0);
+    ok(transmit_ecn(server, client, QUICLY_ECN_NOT_ECT) != 0);
+    quicly_get_stats(client, &stats);
+    ok(stats.num_ecn.acked[QUICLY_ECN_COUNT_CE] != 0);
+    ok(stats.num_ecn.congestion_events == 1);
+    ok(stats.num_packets.lost == 0);
+    ok(stats.cc.num_loss_episodes == 1);
+    ok(stats.cc.ssthresh == stats.cc.cwnd);
+    quicly_get_stats(server, &stats);
+    ok(stats.num_ecn.received[QUICLY_ECN_COUNT_CE] != 0);
+}
+
+static void test_ecn_bleached(void)
+{
+    quicly_stats_t stats;
+
+    connect_ecn(0);
+
+    /* ECT(0)-marked packets being acked without the counts fail the validation */
+    quicly_get_stats(client, &stats);
+    ok(stats.num_ecn.validation_failed == 1);
+    ok(quicly_send_get_ecn_bits(client) == QUICLY_ECN_NOT_ECT);
+}
+
+static void test_ecn(void)
+{
+    quic_ctx.use_ecn = 1;
+    subtest("congestion", test_ecn_congestion);
+    subtest("bleached", test_ecn_bleached);
+    quic_ctx.use_ecn = 0;
+}
+
 void test_simple(void)
 {
     subtest("handshake", test_handshake);
     subtest("simple-http", simple_http);
+    subtest("receive-batch", test_receive_batch);
+    subtest("decrypt-batch", test_decrypt_batch);
+    subtest("decrypt-batch-corrupted", test_decrypt_batch_corrupted);
+    subtest("batch-encrypt", test_batch_encrypt);
+    subtest("shared-sendbuf", test_shared_sendbuf);
+    subtest("send-emit-vec", test_send_emit_vec);
     subtest("reset-then-close", test_reset_then_close);
     subtest("send-then-close", test_send_then_close);
     subtest("reset-after-close", test_reset_after_close);
@@ -605,4 +1395,8 @@ void test_simple(void)
     subtest("reset-during-loss", test_reset_during_loss);
     subtest("close", test_close);
     subtest("tiny-connection-window", tiny_connection_window);
+    subtest("priority-scheduler", test_priority_scheduler);
+    subtest("drr-scheduler", test_drr_scheduler);
+    subtest("path-mtu-discovery", test_path_mtu_discovery);
+    subtest("ecn", test_ecn);
 }
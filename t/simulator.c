@@ -455,6 +455,8 @@ static void usage(const char *cmd)
            "  -n <cc>             adds a sender using specified controller\n"
            "  -b <bytes_per_sec>  bottleneck bandwidth (default: 1000000, i.e., 1MB/s)\n"
            "  -l <seconds>        number of seconds to simulate (default: 100)\n"
+           "  -p                  enables pacing on the senders\n"
+           "  -H                  enables HyStart++ on the senders\n"
            "  -d <delay>          delay to be introduced between the sender and the botteneck, in seconds (default: 0.1)\n"
            "  -q <seconds>        maximum depth of the bottleneck queue, in seconds (default: 0.1)\n"
            "  -r <rate>           introduce random loss at specified probability (default: 0)\n"
@@ -574,13 +576,19 @@ int main(int argc, char **argv)
     *node_insert_at++ = &server_node.node.super;
 
     /* parse args */
+    struct net_endpoint *senders[16];
+    size_t num_senders = 0;
     double delay = 0.1, bw = 1e6, depth = 0.1, start = 0, random_loss = 0;
     unsigned length = 100;
     int ch;
-    while ((ch = getopt(argc, argv, "n:b:d:s:l:q:r:th")) != -1) {
+    while ((ch = getopt(argc, argv, "n:b:d:s:l:pHq:r:th")) != -1) {
         switch (ch) {
         case 'n': {
             quicly_cc_type_t **cc;
+            if (num_senders == PTLS_ELEMENTSOF(senders)) {
+                fprintf(stderr, "too many senders\n");
+                exit(1);
+            }
             for (cc = quicly_cc_all_types; *cc != NULL; ++cc)
                 if (strcmp((*cc)->name, optarg) == 0)
                     break;
@@ -608,6 +616,7 @@ int main(int argc, char **argv)
             assert(ret == 0);
             client_node->conns[0].egress = &delay_node->super;
             *node_insert_at++ = &client_node->super;
+            senders[num_senders++] = client_node;
         } break;
         case 'b':
             if (sscanf(optarg, "%lf", &bw) != 1) {
@@ -633,6 +642,12 @@ int main(int argc, char **argv)
                 exit(1);
             }
             break;
+        case 'p':
+            quicctx.use_pacing = 1;
+            break;
+        case 'H':
+            quicctx.use_hystart = 1;
+            break;
         case 'q':
             if (sscanf(optarg, "%lf", &depth) != 1) {
                 fprintf(stderr, "invalid queue depth: %s\n", optarg);
@@ -672,5 +687,18 @@ int main(int argc, char **argv)
     while (now < 1000 + length)
         run_nodes(nodes);
 
+    /* print throughput of each sender */
+    for (size_t i = 0; i < num_senders; ++i) {
+        quicly_stats_t stats;
+        quicly_get_stats(senders[i]->conns[0].quic, &stats);
+        double elapsed = now - senders[i]->start_at;
+        const quicly_context_t *ctx = quicly_get_context(senders[i]->conns[0].quic);
+        printf("{\"sender\": %zu, \"cc\": \"%s\", \"pacing\": %s, \"hystart\": %s, \"bytes-acked\": %" PRIu64
+               ", \"packets-lost\": %" PRIu64 ", \"cwnd-exiting-slow-start\": %" PRIu32 ", \"throughput\": %f}\n",
+               i, stats.cc.type->name, ctx->use_pacing ? "true" : "false", ctx->use_hystart ? "true" : "false",
+               stats.num_bytes.ack_received, stats.num_packets.lost, stats.cc.cwnd_exiting_slow_start,
+               elapsed > 0 ? stats.num_bytes.ack_received / elapsed : 0);
+    }
+
     return 0;
 }
@@ -100,35 +100,35 @@ size_t on_destroy_callcnt;
 
 static void test_adjust_stream_frame_layout(void)
 {
-#define TEST(_is_crypto, _capacity, check)                                                                                         \
+#define TEST(_is_crypto, _capacity, _payload_is_written, check)                                                                    \
     do {                                                                                                                           \
         uint8_t buf[] = {0xff, 0x04, 'h', 'e', 'l', 'l', 'o', 0, 0, 0};                                                            \
         uint8_t *dst = buf + 2, *const dst_end = buf + _capacity, *frame_at = buf;                                                 \
         size_t len = 5;                                                                                                            \
         int wrote_all = 1;                                                                                                         \
         buf[0] = _is_crypto ? 0x06 : 0x08;                                                                                         \
-        adjust_stream_frame_layout(&dst, dst_end, &len, &wrote_all, &frame_at);                                                    \
+        adjust_stream_frame_layout(&dst, dst_end, &len, &wrote_all, &frame_at, _payload_is_written);                               \
         do {                                                                                                                       \
             check                                                                                                                  \
         } while (0);                                                                                                               \
     } while (0);
 
     /* test CRYPTO frames that fit and don't when length is inserted */
-    TEST(1, 10, {
+    TEST(1, 10, 1, {
         ok(dst == buf + 8);
         ok(len == 5);
         ok(wrote_all);
         ok(frame_at == buf);
         ok(memcmp(buf, "\x06\x04\x05hello", 8) == 0);
     });
-    TEST(1, 8, {
+    TEST(1, 8, 1, {
         ok(dst == buf + 8);
         ok(len == 5);
         ok(wrote_all);
         ok(frame_at == buf);
         ok(memcmp(buf, "\x06\x04\x05hello", 8) == 0);
     });
-    TEST(1, 7, {
+    TEST(1, 7, 1, {
         ok(dst == buf + 7);
         ok(len == 4);
         ok(!wrote_all);
@@ -137,21 +137,21 @@ static void test_adjust_stream_frame_layout(void)
     });
 
     /* test STREAM frames */
-    TEST(0, 9, {
+    TEST(0, 9, 1, {
         ok(dst == buf + 8);
         ok(len == 5);
         ok(wrote_all);
         ok(frame_at == buf);
         ok(memcmp(buf, "\x0a\x04\x05hello", 8) == 0);
     });
-    TEST(0, 8, {
+    TEST(0, 8, 1, {
         ok(dst == buf + 8);
         ok(len == 5);
         ok(wrote_all);
         ok(frame_at == buf + 1);
         ok(memcmp(buf, "\x00\x08\x04hello", 8) == 0);
     });
-    TEST(0, 7, {
+    TEST(0, 7, 1, {
         ok(dst == buf + 7);
         ok(len == 5);
         ok(wrote_all);
@@ -159,6 +159,19 @@ static void test_adjust_stream_frame_layout(void)
         ok(memcmp(buf, "\x08\x04hello", 7) == 0);
     });
 
+    /* test STREAM frames the payload of which is written afterwards; only the frame header is adjusted */
+    TEST(0, 9, 0, {
+        ok(dst == buf + 8);
+        ok(len == 5);
+        ok(memcmp(buf, "\x0a\x04\x05", 3) == 0);
+    });
+    TEST(0, 8, 0, {
+        ok(dst == buf + 8);
+        ok(len == 5);
+        ok(frame_at == buf + 1);
+        ok(memcmp(buf, "\x00\x08\x04", 3) == 0);
+    });
+
 #undef TEST
 }
 
@@ -497,21 +510,21 @@ static void test_address_token_codec(void)
 static void do_test_record_receipt(size_t epoch)
 {
     struct st_quicly_pn_space_t *space =
-        alloc_pn_space(sizeof(*space), epoch == QUICLY_EPOCH_1RTT ? QUICLY_DEFAULT_PACKET_TOLERANCE : 1);
+        alloc_pn_space(NULL, sizeof(*space), epoch == QUICLY_EPOCH_1RTT ? QUICLY_DEFAULT_PACKET_TOLERANCE : 1);
     uint64_t pn = 0;
     int64_t now = 12345, send_ack_at = INT64_MAX;
 
     if (epoch == QUICLY_EPOCH_1RTT) {
         /* 2nd packet triggers an ack */
-        ok(record_receipt(space, pn++, 0, now, &send_ack_at) == 0);
+        ok(record_receipt(space, pn++, QUICLY_ECN_NOT_ECT, 0, now, QUICLY_DELAYED_ACK_TIMEOUT, &send_ack_at) == 0);
         ok(send_ack_at == now + QUICLY_DELAYED_ACK_TIMEOUT);
         now += 1;
-        ok(record_receipt(space, pn++, 0, now, &send_ack_at) == 0);
+        ok(record_receipt(space, pn++, QUICLY_ECN_NOT_ECT, 0, now, QUICLY_DELAYED_ACK_TIMEOUT, &send_ack_at) == 0);
         ok(send_ack_at == now);
         now += 1;
     } else {
         /* every packet triggers an ack */
-        ok(record_receipt(space, pn++, 0, now, &send_ack_at) == 0);
+        ok(record_receipt(space, pn++, QUICLY_ECN_NOT_ECT, 0, now, QUICLY_DELAYED_ACK_TIMEOUT, &send_ack_at) == 0);
         ok(send_ack_at == now);
         now += 1;
     }
@@ -521,23 +534,23 @@ static void do_test_record_receipt(size_t epoch)
     send_ack_at = INT64_MAX;
 
     /* ack-only packets do not elicit an ack */
-    ok(record_receipt(space, pn++, 1, now, &send_ack_at) == 0);
+    ok(record_receipt(space, pn++, QUICLY_ECN_NOT_ECT, 1, now, QUICLY_DELAYED_ACK_TIMEOUT, &send_ack_at) == 0);
     ok(send_ack_at == INT64_MAX);
     now += 1;
-    ok(record_receipt(space, pn++, 1, now, &send_ack_at) == 0);
+    ok(record_receipt(space, pn++, QUICLY_ECN_NOT_ECT, 1, now, QUICLY_DELAYED_ACK_TIMEOUT, &send_ack_at) == 0);
     ok(send_ack_at == INT64_MAX);
     now += 1;
     pn++; /* gap */
-    ok(record_receipt(space, pn++, 1, now, &send_ack_at) == 0);
+    ok(record_receipt(space, pn++, QUICLY_ECN_NOT_ECT, 1, now, QUICLY_DELAYED_ACK_TIMEOUT, &send_ack_at) == 0);
     ok(send_ack_at == INT64_MAX);
     now += 1;
-    ok(record_receipt(space, pn++, 1, now, &send_ack_at) == 0);
+    ok(record_receipt(space, pn++, QUICLY_ECN_NOT_ECT, 1, now, QUICLY_DELAYED_ACK_TIMEOUT, &send_ack_at) == 0);
     ok(send_ack_at == INT64_MAX);
     now += 1;
 
     /* gap triggers an ack */
     pn += 1; /* gap */
-    ok(record_receipt(space, pn++, 0, now, &send_ack_at) == 0);
+    ok(record_receipt(space, pn++, QUICLY_ECN_NOT_ECT, 0, now, QUICLY_DELAYED_ACK_TIMEOUT, &send_ack_at) == 0);
     ok(send_ack_at == now);
     now += 1;
 
@@ -549,15 +562,15 @@ static void do_test_record_receipt(size_t epoch)
     if (epoch == QUICLY_EPOCH_1RTT) {
         space->ignore_order = 1;
         pn++; /* gap */
-        ok(record_receipt(space, pn++, 0, now, &send_ack_at) == 0);
+        ok(record_receipt(space, pn++, QUICLY_ECN_NOT_ECT, 0, now, QUICLY_DELAYED_ACK_TIMEOUT, &send_ack_at) == 0);
         ok(send_ack_at == now + QUICLY_DELAYED_ACK_TIMEOUT);
         now += 1;
-        ok(record_receipt(space, pn++, 0, now, &send_ack_at) == 0);
+        ok(record_receipt(space, pn++, QUICLY_ECN_NOT_ECT, 0, now, QUICLY_DELAYED_ACK_TIMEOUT, &send_ack_at) == 0);
         ok(send_ack_at == now);
         now += 1;
     }
 
-    do_free_pn_space(space);
+    do_free_pn_space(NULL, space, sizeof(*space));
 }
 
 static void test_record_receipt(void)
@@ -566,11 +579,59 @@ static void test_record_receipt(void)
     do_test_record_receipt(QUICLY_EPOCH_1RTT);
 }
 
+static int cid_plaintext_is_equal(const quicly_cid_plaintext_t *x, const quicly_cid_plaintext_t *y)
+{
+    return x->master_id == y->master_id && x->path_id == y->path_id && x->thread_id == y->thread_id && x->node_id == y->node_id;
+}
+
+static void test_cid_encryptor(void)
+{
+    quicly_cid_encryptor_t *encryptor = quicly_new_default_cid_encryptor(&ptls_openssl_aes128ecb, &ptls_openssl_aes128ecb,
+                                                                         &ptls_openssl_sha256, ptls_iovec_init("abc", 3));
+    uint8_t datagrams[20][1 + QUICLY_MAX_CID_LEN_V1];
+    const void *encrypted[PTLS_ELEMENTSOF(datagrams)];
+    quicly_cid_plaintext_t plaintexts[PTLS_ELEMENTSOF(datagrams)], decrypted[PTLS_ELEMENTSOF(datagrams)];
+    size_t i;
+
+    /* build short header packets carrying CIDs for different threads and nodes */
+    for (i = 0; i < PTLS_ELEMENTSOF(datagrams); ++i) {
+        quicly_cid_t cid;
+        plaintexts[i] = (quicly_cid_plaintext_t){.master_id = i, .path_id = 1, .thread_id = i * 3, .node_id = 1000 + i};
+        encryptor->encrypt_cid(encryptor, &cid, NULL, plaintexts + i);
+        ok(cid.len == 16);
+        memset(datagrams[i], 0, sizeof(datagrams[i]));
+        datagrams[i][0] = QUICLY_QUIC_BIT;
+        memcpy(datagrams[i] + 1, cid.cid, cid.len);
+        encrypted[i] = datagrams[i] + 1;
+    }
+
+    /* decrypt in batch, the number of CIDs being more than what is processed at once */
+    ok(encryptor->decrypt_cid_batch(encryptor, decrypted, encrypted, PTLS_ELEMENTSOF(encrypted)) == 16);
+    for (i = 0; i < PTLS_ELEMENTSOF(datagrams); ++i)
+        ok(cid_plaintext_is_equal(decrypted + i, plaintexts + i));
+
+    /* peek short header packets */
+    ok(quicly_peek_cid(encryptor, decrypted, datagrams[5], sizeof(datagrams[5])) == 16);
+    ok(cid_plaintext_is_equal(decrypted, plaintexts + 5));
+    ok(quicly_peek_cid(encryptor, decrypted, datagrams[5], 10) == SIZE_MAX);
+
+    { /* peek long header packets */
+        uint8_t handshake[1 + 4 + 1 + 16 + 1] = {QUICLY_PACKET_TYPE_HANDSHAKE, 0, 0, 0, 1, 16};
+        memcpy(handshake + 6, datagrams[7] + 1, 16);
+        ok(quicly_peek_cid(encryptor, decrypted, handshake, sizeof(handshake)) == 16);
+        ok(cid_plaintext_is_equal(decrypted, plaintexts + 7));
+        ok(quicly_peek_cid(encryptor, decrypted, handshake, 10) == SIZE_MAX);
+    }
+
+    quicly_free_default_cid_encryptor(encryptor);
+}
+
 static void test_cid(void)
 {
     subtest("received cid", test_received_cid);
     subtest("local cid", test_local_cid);
     subtest("retire cid", test_retire_cid);
+    subtest("cid encryptor", test_cid_encryptor);
 }
 
 /**
@@ -697,6 +758,34 @@ static void test_set_cc(void)
     ret = quicly_get_stats(conn, &stats);
     ok(ret == 0);
     ok(strcmp(stats.cc.type->name, "reno") == 0);
+
+    // reno to bbr
+    quicly_set_cc(conn, &quicly_cc_type_reno);
+    quicly_set_cc(conn, &quicly_cc_type_bbr);
+    ret = quicly_get_stats(conn, &stats);
+    ok(ret == 0);
+    ok(strcmp(stats.cc.type->name, "bbr") == 0);
+
+    // bbr to cubic
+    quicly_set_cc(conn, &quicly_cc_type_bbr);
+    quicly_set_cc(conn, &quicly_cc_type_cubic);
+    ret = quicly_get_stats(conn, &stats);
+    ok(ret == 0);
+    ok(strcmp(stats.cc.type->name, "cubic") == 0);
+
+    // pico to bbr
+    quicly_set_cc(conn, &quicly_cc_type_pico);
+    quicly_set_cc(conn, &quicly_cc_type_bbr);
+    ret = quicly_get_stats(conn, &stats);
+    ok(ret == 0);
+    ok(strcmp(stats.cc.type->name, "bbr") == 0);
+
+    // bbr to reno
+    quicly_set_cc(conn, &quicly_cc_type_bbr);
+    quicly_set_cc(conn, &quicly_cc_type_reno);
+    ret = quicly_get_stats(conn, &stats);
+    ok(ret == 0);
+    ok(strcmp(stats.cc.type->name, "reno") == 0);
 }
 
 int main(int argc, char **argv)
@@ -757,8 +846,14 @@ int main(int argc, char **argv)
 
     subtest("next-packet-number", test_next_packet_number);
     subtest("address-token-codec", test_address_token_codec);
+    subtest("allocator", test_allocator);
     subtest("ranges", test_ranges);
     subtest("rate", test_rate);
+    subtest("pacer", test_pacer);
+    subtest("hystart", test_hystart);
+    subtest("pmtud", test_pmtud);
+    subtest("timerwheel", test_timerwheel);
+    subtest("recvbuf", test_recvbuf);
     subtest("record-receipt", test_record_receipt);
     subtest("frame", test_frame);
     subtest("maxsender", test_maxsender);
@@ -769,7 +864,9 @@ int main(int argc, char **argv)
     subtest("test-retry-aead", test_retry_aead);
     subtest("transport-parameters", test_transport_parameters);
     subtest("cid", test_cid);
+    subtest("lb", test_lb);
     subtest("simple", test_simple);
+    subtest("conn-map", test_conn_map);
     subtest("stream-concurrency", test_stream_concurrency);
     subtest("lossy", test_lossy);
     subtest("test-nondecryptable-initial", test_nondecryptable_initial);
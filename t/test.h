@@ -48,17 +48,25 @@ int buffer_is(ptls_buffer_t *buf, const char *s);
 size_t transmit(quicly_conn_t *src, quicly_conn_t *dst);
 int max_data_is_equal(quicly_conn_t *client, quicly_conn_t *server);
 
+void test_allocator(void);
 void test_ranges(void);
 void test_rate(void);
+void test_pacer(void);
+void test_hystart(void);
+void test_pmtud(void);
+void test_timerwheel(void);
+void test_recvbuf(void);
 void test_frame(void);
 void test_maxsender(void);
 void test_sentmap(void);
 void test_loss(void);
 void test_simple(void);
+void test_conn_map(void);
 void test_lossy(void);
 void test_stream_concurrency(void);
 void test_received_cid(void);
 void test_local_cid(void);
+void test_lb(void);
 void test_retire_cid(void);
 
 #endif
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2021 Fastly, Kazuho Oku
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include "quicly/timerwheel.h"
+#include "test.h"
+
+static void test_basic(void)
+{
+    quicly_timerwheel_t wheel;
+    quicly_timer_t timers[4];
+    size_t i;
+
+    quicly_timerwheel_init(&wheel, 1000);
+    for (i = 0; i != PTLS_ELEMENTSOF(timers); ++i)
+        quicly_timer_init(&timers[i]);
+    ok(quicly_timerwheel_get_wake_at(&wheel) == INT64_MAX);
+    ok(quicly_timerwheel_pop(&wheel, 1000) == NULL);
+
+    quicly_timerwheel_link(&wheel, &timers[0], 1010);
+    quicly_timerwheel_link(&wheel, &timers[1], 5000);
+    quicly_timerwheel_link(&wheel, &timers[2], 1000); /* already expired */
+    quicly_timerwheel_link(&wheel, &timers[3], INT64_MAX / 2);
+    ok(quicly_timer_is_linked(&timers[0]));
+    ok(quicly_timerwheel_get_wake_at(&wheel) == 1000);
+    ok(quicly_timerwheel_pop(&wheel, 1000) == &timers[2]);
+    ok(!quicly_timer_is_linked(&timers[2]));
+    ok(quicly_timerwheel_pop(&wheel, 1000) == NULL);
+    ok(quicly_timerwheel_get_wake_at(&wheel) == 1010);
+
+    ok(quicly_timerwheel_pop(&wheel, 1009) == NULL);
+    ok(quicly_timerwheel_pop(&wheel, 1010) == &timers[0]);
+    ok(quicly_timerwheel_pop(&wheel, 4999) == NULL);
+    ok(quicly_timerwheel_get_wake_at(&wheel) <= 5000);
+
+    /* relinking moves the timer */
+    quicly_timerwheel_link(&wheel, &timers[1], 6000);
+    ok(quicly_timerwheel_pop(&wheel, 5999) == NULL);
+    ok(quicly_timerwheel_pop(&wheel, 7000) == &timers[1]);
+
+    quicly_timerwheel_unlink(&timers[3]);
+    ok(quicly_timerwheel_get_wake_at(&wheel) == INT64_MAX);
+    quicly_timerwheel_dispose(&wheel);
+}
+
+static uint64_t rand_state = 1;
+
+static uint64_t next_rand(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+}
+
+static int64_t rand_delta(void)
+{
+    /* choose the magnitude first so that every level of the wheel (and beyond) gets exercised */
+    return next_rand() % ((uint64_t)1 << (next_rand() % 48));
+}
+
+static void test_fuzz(void)
+{
+    quicly_timerwheel_t wheel;
+    quicly_timer_t timers[1000], *timer;
+    int64_t now = 12345;
+    size_t i, iter, num_popped = 0;
+    int popped_ok = 1, remaining_ok = 1, wake_at_ok = 1;
+
+    quicly_timerwheel_init(&wheel, now);
+    for (i = 0; i != PTLS_ELEMENTSOF(timers); ++i) {
+        quicly_timer_init(&timers[i]);
+        quicly_timerwheel_link(&wheel, &timers[i], now + rand_delta());
+    }
+
+    for (iter = 0; iter != 10000; ++iter) {
+        /* relink or unlink some of the timers */
+        for (i = 0; i != 10; ++i) {
+            timer = &timers[next_rand() % PTLS_ELEMENTSOF(timers)];
+            if (next_rand() % 4 == 0) {
+                quicly_timerwheel_unlink(timer);
+            } else {
+                quicly_timerwheel_link(&wheel, timer, now + rand_delta() - 10);
+            }
+        }
+        /* check that the wake-up time does not come after any timer (timers linked in the past are due now) */
+        int64_t wake_at = quicly_timerwheel_get_wake_at(&wheel);
+        for (i = 0; i != PTLS_ELEMENTSOF(timers); ++i)
+            if (quicly_timer_is_linked(&timers[i]) && timers[i].at < wake_at && now < wake_at)
+                wake_at_ok = 0;
+        /* advance, and check that exactly the timers that have expired are popped */
+        now += next_rand() % 2 == 0 ? rand_delta() : (int64_t)(next_rand() % 100);
+        while ((timer = quicly_timerwheel_pop(&wheel, now)) != NULL) {
+            if (quicly_timer_is_linked(timer) || timer->at > now)
+                popped_ok = 0;
+            ++num_popped;
+        }
+        for (i = 0; i != PTLS_ELEMENTSOF(timers); ++i)
+            if (quicly_timer_is_linked(&timers[i]) && timers[i].at <= now)
+                remaining_ok = 0;
+    }
+
+    ok(popped_ok);
+    ok(remaining_ok);
+    ok(wake_at_ok);
+    ok(num_popped != 0);
+
+    for (i = 0; i != PTLS_ELEMENTSOF(timers); ++i)
+        quicly_timerwheel_unlink(&timers[i]);
+    quicly_timerwheel_dispose(&wheel);
+}
+
+static void test_conn(void)
+{
+    quicly_timerwheel_t wheel;
+    quicly_conn_t *conn;
+    quicly_address_t dest, src;
+    struct iovec packets[8];
+    uint8_t packetsbuf[PTLS_ELEMENTSOF(packets) * quic_ctx.transport_params.max_udp_payload_size];
+    size_t num_packets = PTLS_ELEMENTSOF(packets);
+    int ret;
+
+    quicly_timerwheel_init(&wheel, quic_now);
+
+    /* new connection has CH to be sent */
+    ret = quicly_connect(&conn, &quic_ctx, "example.com", &fake_address.sa, NULL, new_master_id(), ptls_iovec_init(NULL, 0), NULL,
+                         NULL);
+    ok(ret == 0);
+    quicly_set_timerwheel(conn, &wheel);
+    ok(quicly_pop_expired_conn(&wheel, quic_now) == conn);
+    ok(quicly_pop_expired_conn(&wheel, quic_now) == NULL);
+
+    /* once sent, the connection is rescheduled to the retransmission timeout */
+    ret = quicly_send(conn, &dest, &src, packets, &num_packets, packetsbuf, sizeof(packetsbuf));
+    ok(ret == 0);
+    ok(num_packets == 1);
+    ok(quicly_pop_expired_conn(&wheel, quic_now) == NULL);
+    ok(quicly_timerwheel_get_wake_at(&wheel) <= quicly_get_first_timeout(conn));
+    ok(quicly_pop_expired_conn(&wheel, quicly_get_first_timeout(conn)) == conn);
+
+    quicly_free(conn);
+    quicly_timerwheel_dispose(&wheel);
+}
+
+void test_timerwheel(void)
+{
+    subtest("basic", test_basic);
+    subtest("fuzz", test_fuzz);
+    subtest("conn", test_conn);
+}